@@ -492,8 +492,17 @@ uint64_t dynld_mapobj(Dl_Library *lib, int fd, uint64_t base, const char *name,
 				prot |= PROT_EXEC;
 			};
 			
+			// fault the text and read-only data in at once; those pages are shared with
+			// the file cache. The writable segment is left to fault as relocation touches
+			// it, since populating it would copy every page, even those never written.
+			int mapFlags = MAP_PRIVATE | MAP_FIXED;
+			if ((prot & PROT_WRITE) == 0)
+			{
+				mapFlags |= MAP_POPULATE;
+			};
+			
 			if (mmap(lib->segs[index].base, lib->segs[index].size,
-					prot, MAP_PRIVATE | MAP_FIXED,
+					prot, mapFlags,
 					fd, phdr.p_offset & ~0xFFF) == MAP_FAILED)
 			{
 				strcpy(dynld_errmsg, "failed to map segment into memory");
@@ -47,6 +47,9 @@
 #include <sys/mount.h>
 #include <sys/statvfs.h>
 #include <sys/module.h>
+#include <spawn.h>
+
+extern char **environ;
 
 int shouldHalt = 0;
 int shouldRunPoweroff = 0;
@@ -588,15 +591,13 @@ int main(int argc, char *argv[])
 			else if ((shouldRunPoweroff) && (!ranPoweroff))
 			{
 				ranPoweroff = 1;
-				if (fork() == 0)
+				char *poweroffArgs[] = {"poweroff", NULL};
+				int error = posix_spawn(NULL, "/usr/bin/halt", NULL, NULL, poweroffArgs, environ);
+				if (error != 0)
 				{
-					if (execl("/usr/bin/halt", "poweroff", NULL) == -1)
-					{
-						perror("exec poweroff");
-						fprintf(stderr, "forcing shutdown\n");
-						kill(1, SIGTERM);
-						exit(1);
-					};
+					fprintf(stderr, "exec poweroff: %s\n", strerror(error));
+					fprintf(stderr, "forcing shutdown\n");
+					kill(1, SIGTERM);
 				};
 			};
 		};
@@ -46,7 +46,7 @@ catch:
 	
 	mov	rax,			currentThread
 	mov	rax,			[rax]
-	add	rax,			0x250
+	add	rax,			0x58
 	mov	[rax+0],		rbx
 	mov	[rax+8],		r10			; RSP before call
 	mov	[rax+16],		rbp
@@ -63,7 +63,7 @@ throw:
 	; see if we're even catching exceptions
 	mov	rax,			currentThread
 	mov	rax,			[rax]
-	add	rax,			0x250
+	add	rax,			0x58
 	mov	rcx,			[rax+56]
 	test	rcx,			rcx
 	jz	throw_unhandled
@@ -91,7 +91,7 @@ throw_unhandled:
 uncatch:
 	mov	rax,			currentThread
 	mov	rax,			[rax]
-	add	rax,			0x250
+	add	rax,			0x58
 	xor	rcx,			rcx
 	mov	[rax+56],		rcx
 	ret
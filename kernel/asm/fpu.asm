@@ -26,13 +26,21 @@
 
 bits 64
 
-global fpuInit
+global fpuInitCPU
 global fpuSave
 global fpuLoad
+global fpuSaveLegacy
+global fpuLoadLegacy
 global fpuGetMXCSR
 global fpuSetMXCSR
 
-fpuInit:
+extern fpuMode
+
+; values of fpuMode (must match FPU_MODE_* in <glidix/hw/fpu.h>)
+FPU_MODE_XSAVE		equ	1
+FPU_MODE_XSAVEOPT	equ	2
+
+fpuInitCPU:
 	finit
 	mov	rax,	cr0
 	and	ax,	0xFFFB
@@ -51,10 +59,41 @@ fpuInit:
 	ret
 
 fpuSave:
+	mov	rcx,	fpuMode
+	mov	ecx,	[rcx]
+	mov	eax,	0xFFFFFFFF		; save all components enabled in XCR0
+	mov	edx,	eax
+	cmp	ecx,	FPU_MODE_XSAVEOPT
+	je	.xsaveopt
+	cmp	ecx,	FPU_MODE_XSAVE
+	je	.xsave
 	fxsave	[rdi]
 	ret
+.xsaveopt:
+	xsaveopt	[rdi]
+	ret
+.xsave:
+	xsave	[rdi]
+	ret
 
 fpuLoad:
+	mov	rcx,	fpuMode
+	mov	ecx,	[rcx]
+	mov	eax,	0xFFFFFFFF
+	mov	edx,	eax
+	test	ecx,	ecx
+	jnz	.xrstor
+	fxrstor	[rdi]
+	ret
+.xrstor:
+	xrstor	[rdi]
+	ret
+
+fpuSaveLegacy:
+	fxsave	[rdi]
+	ret
+
+fpuLoadLegacy:
 	fxrstor	[rdi]
 	ret
 
@@ -29,6 +29,17 @@ bits 64
 
 [global refreshAddrSpace]
 refreshAddrSpace:
+	; if global pages are enabled, a CR3 reload would leave the kernel's global pages (and
+	; entries tagged with other PCIDs) in the TLB, so toggle CR4.PGE to flush everything
+	mov	rax,	cr4
+	test	rax,	(1 << 7)
+	jz	.reload
+	mov	rdx,	rax
+	and	rdx,	~(1 << 7)
+	mov	cr4,	rdx
+	mov	cr4,	rax
+	ret
+.reload:
 	mov	rax,	cr3
 	mov	cr3,	rax
 	ret
@@ -48,7 +59,7 @@ frameWrite:
 	
 	; turn the frame address that was passed in into a valid PTE
 	shl	rdi, 12
-	or	rdi, 3	; present, write
+	or	rdi, 0x103	; present, write, global (so that invlpg drops it under every PCID)
 	
 	; allocate a page-aligned page-sized region on the stack to temporarily remap
 	sub	rsp, 0x1000
@@ -88,7 +99,7 @@ frameRead:
 	
 	; turn the frame address that was passed in into a valid PTE
 	shl	rdi, 12
-	or	rdi, 3	; present, write
+	or	rdi, 0x103	; present, write, global (so that invlpg drops it under every PCID)
 	
 	; allocate a page-aligned page-sized region on the stack to temporarily remap
 	sub	rsp, 0x1000
@@ -129,7 +140,7 @@ __zeroFrame:
 	
 	; turn the frame address that was passed in into a valid PTE
 	shl	rdi, 12
-	or	rdi, 3	; present, write
+	or	rdi, 0x103	; present, write, global (so that invlpg drops it under every PCID)
 	
 	; allocate a page-aligned page-sized region on the stack to temporarily remap
 	sub	rsp, 0x1000
@@ -161,6 +172,110 @@ __zeroFrame:
 	pop	rbp
 	ret
 	
+[global __zeroFrameNT]
+__zeroFrameNT:
+	push	rbp
+	mov	rbp, rsp
+	
+	; same temporary mapping as __zeroFrame
+	shl	rdi, 12
+	or	rdi, 0x103
+	
+	sub	rsp, 0x1000
+	and	rsp, ~0xFFF
+	
+	mov	rdx, rsp
+	mov	rax, 0xffffff8000000000
+	shr	rdx, 9
+	or	rdx, rax
+	
+	mov	r8, [rdx]
+	mov	[rdx], rdi
+	invlpg	[rsp]
+	
+	; zero with non-temporal stores, one cache line per iteration, so that the page does
+	; not displace anything from the cache
+	mov	rdi, rsp
+	xor	rax, rax
+	mov	rcx, 64
+.line:
+	movnti	[rdi], rax
+	movnti	[rdi+8], rax
+	movnti	[rdi+16], rax
+	movnti	[rdi+24], rax
+	movnti	[rdi+32], rax
+	movnti	[rdi+40], rax
+	movnti	[rdi+48], rax
+	movnti	[rdi+56], rax
+	add	rdi, 64
+	dec	rcx
+	jnz	.line
+	
+	; make the stores globally visible before the frame is handed out
+	sfence
+	
+	mov	[rdx], r8
+	invlpg	[rsp]
+	
+	mov	rsp, rbp
+	pop	rbp
+	ret
+
+[global frameWriteNT]
+frameWriteNT:
+	push	rbp
+	mov	rbp, rsp
+	
+	; same temporary mapping as frameWrite
+	shl	rdi, 12
+	or	rdi, 0x103
+	
+	sub	rsp, 0x1000
+	and	rsp, ~0xFFF
+	
+	mov	rdx, rsp
+	mov	rax, 0xffffff8000000000
+	shr	rdx, 9
+	or	rdx, rax
+	
+	mov	r8, [rdx]
+	mov	[rdx], rdi
+	invlpg	[rsp]
+	
+	; copy with non-temporal stores, one cache line per iteration (buffer already in RSI)
+	mov	rdi, rsp
+	mov	rcx, 64
+.line:
+	mov	rax, [rsi]
+	mov	r9, [rsi+8]
+	mov	r10, [rsi+16]
+	mov	r11, [rsi+24]
+	movnti	[rdi], rax
+	movnti	[rdi+8], r9
+	movnti	[rdi+16], r10
+	movnti	[rdi+24], r11
+	mov	rax, [rsi+32]
+	mov	r9, [rsi+40]
+	mov	r10, [rsi+48]
+	mov	r11, [rsi+56]
+	movnti	[rdi+32], rax
+	movnti	[rdi+40], r9
+	movnti	[rdi+48], r10
+	movnti	[rdi+56], r11
+	add	rsi, 64
+	add	rdi, 64
+	dec	rcx
+	jnz	.line
+	
+	sfence
+	
+	mov	[rdx], r8
+	invlpg	[rsp]
+	
+	mov	rsp, rbp
+	pop	rbp
+	ret
+
 [global invlpg]
 invlpg:
 	invlpg	[rdi]
@@ -24,6 +24,14 @@
 ;	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 ;	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+; values of stringMode (must match STRING_MODE_* in <glidix/util/string.h>)
+STRING_MODE_QWORDS	equ	0
+STRING_MODE_BYTES	equ	1
+
+section .data
+global stringMode
+stringMode dd STRING_MODE_QWORDS
+
 section .text
 bits 64
 
@@ -35,10 +43,22 @@ global memcmp
 global strcmp
 global strcat
 
+; With ERMS (enhanced REP MOVSB/STOSB), the microcode moves whole cache lines for byte-sized
+; string instructions, so a single 'rep movsb' is best. Otherwise, byte-sized string instructions
+; move one byte at a time; so we move qwords, then the remaining bytes. stringInit() picks the mode.
 memcpy:
 	push	rbp
 	mov	rbp,	rsp
+	mov	rax,	rdi
 	mov	rcx,	rdx
+	mov	r8,	stringMode
+	cmp	dword [r8],	STRING_MODE_BYTES
+	je	.bytes
+	shr	rcx,	3
+	rep	movsq
+	mov	rcx,	rdx
+	and	rcx,	7
+.bytes:
 	rep	movsb
 	pop	rbp
 	ret
@@ -46,9 +66,22 @@ memcpy:
 memset:
 	push	rbp
 	mov	rbp,	rsp
-	mov	rax,	rsi
+	mov	r9,	rdi
+	mov	rcx,	rdx
+	movzx	eax,	sil
+	mov	r8,	stringMode
+	cmp	dword [r8],	STRING_MODE_BYTES
+	je	.bytes
+	; replicate the byte into all 8 bytes of RAX
+	mov	r8,	0x0101010101010101
+	imul	rax,	r8
+	shr	rcx,	3
+	rep	stosq
 	mov	rcx,	rdx
+	and	rcx,	7
+.bytes:
 	rep	stosb
+	mov	rax,	r9
 	pop	rbp
 	ret
 
@@ -37,17 +37,17 @@ _syscall_entry:
 	; the fourth argument, that is normally in RCX, is passed in R10 in this context
 	; as RCX contains the return address
 	swapgs					; GS.base = currentThread
-	mov [gs:0x208], rbx
-	mov [gs:0x210], rsp
-	mov [gs:0x218], rbp
-	mov [gs:0x220], r12
-	mov [gs:0x228], r13
-	mov [gs:0x230], r14
-	mov [gs:0x238], r15
-	mov [gs:0x240], rcx			; return RIP
-	mov [gs:0x248], dword 0			; errno
-	mov rsp, [gs:512]			; get syscall stack pointer
-	push qword [gs:0x210]			; push user stack pointer
+	mov [gs:0x10], rbx
+	mov [gs:0x18], rsp
+	mov [gs:0x20], rbp
+	mov [gs:0x28], r12
+	mov [gs:0x30], r13
+	mov [gs:0x38], r14
+	mov [gs:0x40], r15
+	mov [gs:0x48], rcx			; return RIP
+	mov [gs:0x50], dword 0			; errno
+	mov rsp, [gs:0x08]			; get syscall stack pointer
+	push qword [gs:0x18]			; push user stack pointer
 	swapgs
 	
 	; preserve other stuff
@@ -0,0 +1,93 @@
+;	Glidix kernel
+;
+;	Copyright (c) 2014-2017, Madd Games.
+;	All rights reserved.
+;	
+;	Redistribution and use in source and binary forms, with or without
+;	modification, are permitted provided that the following conditions are met:
+;	
+;	* Redistributions of source code must retain the above copyright notice, this
+;	  list of conditions and the following disclaimer.
+;	
+;	* Redistributions in binary form must reproduce the above copyright notice,
+;	  this list of conditions and the following disclaimer in the documentation
+;	  and/or other materials provided with the distribution.
+;	
+;	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+;	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+;	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+;	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+;	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+;	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+;	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+;	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+;	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+;	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+; Copying to and from userspace. An instruction which may fault on a user address has an
+; entry in the exception table (the .extable section), giving the address to resume at if it
+; does; see <glidix/util/extable.h>. Each entry is the address of the instruction followed by
+; the address of its fixup code.
+
+; values of stringMode (must match STRING_MODE_* in <glidix/util/string.h>)
+STRING_MODE_BYTES	equ	1
+
+extern stringMode
+global __copyUser
+global __strcpyUser
+
+section .extable progbits alloc noexec nowrite align=8
+section .text
+bits 64
+
+; int __copyUser(void *dst, const void *src, size_t size);
+; Returns 0 on success, or -1 if a page fault occured.
+__copyUser:
+	mov	rcx,	rdx
+	mov	r8,	stringMode
+	cmp	dword [r8],	STRING_MODE_BYTES
+	je	.bytes
+	shr	rcx,	3
+.qwords:
+	rep	movsq
+	mov	rcx,	rdx
+	and	rcx,	7
+.bytes:
+	rep	movsb
+	xor	eax,	eax
+	ret
+.fault:
+	mov	eax,	-1
+	ret
+
+section .extable
+	dq	__copyUser.qwords,	__copyUser.fault
+	dq	__copyUser.bytes,	__copyUser.fault
+section .text
+
+; int __strcpyUser(char *dst, const char *src, size_t max);
+; Copies a string including its terminator, reading no more than 'max' bytes. Returns 0 on
+; success, or -1 if a page fault occured or the terminator was not within 'max' bytes.
+__strcpyUser:
+	test	rdx,	rdx
+	jz	.fail
+.load:
+	mov	al,	[rsi]
+	mov	[rdi],	al
+	inc	rsi
+	inc	rdi
+	test	al,	al
+	jz	.ok
+	dec	rdx
+	jnz	.load
+.fail:
+	mov	eax,	-1
+	ret
+.ok:
+	xor	eax,	eax
+	ret
+
+section .extable
+	dq	__strcpyUser.load,	__strcpyUser.fail
+section .text
@@ -95,6 +95,7 @@ _stack_done:
 ;;	RBX = pointer to FPU registers
 ;;	R12 = pointer to GPRs
 ;;	R13 = old signal mask to restore
+;;	R14 = FPU mode (FPU_MODE_FXSAVE, or XRSTOR is used)
 usup_sigret:
 	; sigmask
 	push	r13		; push the signal mask
@@ -105,7 +106,15 @@ usup_sigret:
 	syscall
 	
 	; restore FPU registers
+	test	r14,	r14
+	jz	.legacy
+	mov	eax,	0xFFFFFFFF	; all components
+	mov	edx,	eax
+	xrstor	[rbx]
+	jmp	.fpu_done
+.legacy:
 	fxrstor	[rbx]
+.fpu_done:
 	
 	; move the stack pointer to where the "rflags" value is
 	mov	rsp,	r12
@@ -156,6 +156,13 @@ void ftDown(FileTree *ft);
  */
 uint64_t ftGetPage(FileTree *ft, off_t pos);
 
+/**
+ * Like ftGetPage(), but only returns the page if it is already in the cache; never performs I/O, and
+ * returns 0 instead of waiting if the tree is locked. Trees with a 'getpage' callback are never cached,
+ * so this always returns 0 for them.
+ */
+uint64_t ftFindPage(FileTree *ft, off_t pos);
+
 /**
  * Commit the contents of the file tree to disk.
  */
@@ -54,4 +54,10 @@ void procfsDelete(int pid);
  */
 void procfsUpdateCreds();
 
+/**
+ * Create a read-only text file at /proc/<name>. Every time the file is opened, 'gen' is called to produce a
+ * snapshot of its contents as a kmalloc()'d NUL-terminated string, which is freed when the file is closed.
+ */
+void procfsAddText(const char *name, char* (*gen)());
+
 #endif
@@ -696,6 +696,11 @@ struct File_
 	 * Reference count.
 	 */
 	int					refcount;
+	
+	/**
+	 * Event queue items watching this description (see <glidix/int/equeue.h>).
+	 */
+	struct EQItem_*				eqitems;
 };
 
 /**
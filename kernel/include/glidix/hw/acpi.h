@@ -66,6 +66,22 @@ typedef struct
 	uint8_t					len;
 } PACKED MADTRecordHeader;
 
+/**
+ * Payload of the HPET table.
+ */
+typedef struct
+{
+	uint32_t				id;
+	uint8_t					spaceID;	/* 0 = memory */
+	uint8_t					bitWidth;
+	uint8_t					bitOffset;
+	uint8_t					accessWidth;
+	uint64_t				base;
+	uint8_t					seq;
+	uint16_t				minTick;
+	uint8_t					flags;
+} PACKED ACPI_HPET;
+
 typedef struct
 {
 	uint8_t					apicID;
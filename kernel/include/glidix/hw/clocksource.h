@@ -0,0 +1,118 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __glidix_clocksource_h
+#define __glidix_clocksource_h
+
+#include <glidix/util/common.h>
+
+/**
+ * Clock sources, from worst to best. Until clockInit() is called, we count PIT ticks.
+ */
+#define	CLOCK_SOURCE_TICKS			0
+#define	CLOCK_SOURCE_HPET			1
+#define	CLOCK_SOURCE_TSC			2
+
+/**
+ * Where the clock page is mapped, read-only, in every address space (slot 2 of the ISP page table). Userspace
+ * mirrors this as _GLIDIX_CLOCK_PAGE.
+ */
+#define	CLOCK_PAGE_ADDR				0xFFFF808000002000UL
+
+/**
+ * Where the HPET registers are mapped (slot 20 of the ISP page table, right after the I/O APICs).
+ */
+#define	HPET_ADDR				0xFFFF808000014000UL
+
+/**
+ * HPET registers.
+ */
+#define	HPET_REG_CAPS				0x00
+#define	HPET_REG_CONFIG				0x10
+#define	HPET_REG_COUNTER			0xF0
+
+#define	HPET_CAPS_COUNT_64			(1UL << 13)
+#define	HPET_CONFIG_ENABLE			(1UL << 0)
+
+/**
+ * The clock page. Userspace (the C library) reads it to get the time without a system call, when the clock
+ * source is the TSC. The fields are only consistent if 'seq' was even and did not change while they were being
+ * read; the kernel makes it odd while updating them. This layout is mirrored as _glidix_clockpage.
+ */
+typedef struct
+{
+	volatile uint32_t			seq;
+	uint32_t				source;		/* CLOCK_SOURCE_* */
+	
+	/**
+	 * For CLOCK_SOURCE_TSC: nanotime = nanoBase + (((rdtsc() - tscBase) * mult) >> 32)
+	 */
+	uint64_t				tscBase;
+	uint64_t				nanoBase;
+	uint64_t				mult;
+	
+	/**
+	 * Add this to the nanotime to get nanoseconds since the UNIX epoch.
+	 */
+	int64_t					realOffset;
+	
+	/**
+	 * Frequency of the clock source in Hz (informational).
+	 */
+	uint64_t				freq;
+} ClockPage;
+
+/**
+ * Called by the ACPI code if an HPET was found at the given physical address.
+ */
+void hpetDetected(uint64_t base);
+
+/**
+ * Calibrate and switch to the best available clock source, and map the clock page. Call with interrupts enabled,
+ * once the PIT is running.
+ */
+void clockInit();
+
+/**
+ * Tell the clock that the current UNIX time is 'now' (in seconds), as read from the RTC.
+ */
+void clockSetRealtime(time_t now);
+
+/**
+ * Return the name of the current clock source.
+ */
+const char* clockSourceName();
+
+/**
+ * Returns nonzero if the clock source is a free-running counter (TSC or HPET), so that the time can be read
+ * without the PIT ticking.
+ */
+int clockHasCounter();
+
+#endif
@@ -47,6 +47,12 @@ typedef struct
 	 * The CPU's APIC ID.
 	 */
 	uint32_t apicID;
+	
+	/**
+	 * The thread currently running on this CPU (possibly its idle thread). Updated by the
+	 * scheduler on each switch.
+	 */
+	struct _Thread* volatile running;
 } CPU;
 
 /**
@@ -127,6 +133,11 @@ CPU* getCurrentCPU();
  */
 void sendHintToCPU(int id);
 
+/**
+ * Send a TLB shootdown IPI to a CPU.
+ */
+void sendShootdownToCPU(int id);
+
 /**
  * Send the scheduler hint to all CPUs.
  */
@@ -152,4 +163,9 @@ void cpuDispatch();
  */
 int cpuSleeping();
 
+/**
+ * Return nonzero if the given thread is currently running on the CPU with the given ID.
+ */
+int cpuIsRunning(int id, struct _Thread *thread);
+
 #endif
@@ -93,7 +93,8 @@ void dmaInit();
 
 /**
  * Create a new DMA buffer, and fill the 'handle' with all required information to manipulate it.
- * Call this before doing anything else with the DMA buffer.
+ * Call this before doing anything else with the DMA buffer. Buffers of exactly 2MB are mapped with a
+ * single 2MB page when possible.
  * Flags:
  *	DMA_32BIT		Fail if not all physical addresses fit in 32 bits.
  *
@@ -125,7 +126,7 @@ void* dmaGetPtr(DMABuffer *handle);
  * regions until, at the end, 'physAddr' is set to 0. Results are returned into the DMARegion structure.
  *
  * If 'maxRegion' is zero, then there is no limit on the size of the returned regions. Otherwise, a region
- * will have at most 'maxRegion' bytes.
+ * will have at most 'maxRegion' bytes. Within a 2MB page, a region may span up to the whole page.
  *
  * These functions will trigger a undefined behaviour if one or more pages of the buffer are not correctly mapped.
  * In other words, pass only trusted buffers, allocated by the kernel!
@@ -30,6 +30,7 @@
 #define __glidix_fpu_h
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define	MX_IE				(1 << 0)
 #define	MX_DE				(1 << 1)
@@ -50,6 +51,42 @@
 #define	MX_RC_RZ			0x6000
 #define	MX_RC_FZ			(1 << 15)
 
+/**
+ * How FPU state is saved and restored (the value of 'fpuMode'); fpu.asm depends on these values.
+ */
+#define	FPU_MODE_FXSAVE			0
+#define	FPU_MODE_XSAVE			1
+#define	FPU_MODE_XSAVEOPT		2
+
+/**
+ * XCR0 state components which we enable if supported.
+ */
+#define	XCR0_X87			(1 << 0)
+#define	XCR0_SSE			(1 << 1)
+#define	XCR0_AVX			(1 << 2)
+#define	XCR0_OPMASK			(1 << 5)
+#define	XCR0_ZMM_HI256			(1 << 6)
+#define	XCR0_HI16_ZMM			(1 << 7)
+#define	XCR0_AVX512			(XCR0_OPMASK | XCR0_ZMM_HI256 | XCR0_HI16_ZMM)
+
+#define	CR4_OSXSAVE			(1UL << 18)
+#define	CPUID_1_ECX_XSAVE		(1 << 26)
+
+/**
+ * Required alignment of an FPU state area (XSAVE needs 64 bytes).
+ */
+#define	FPU_ALIGN			64
+
+/**
+ * Initial value of the x87 control word.
+ */
+#define	FPU_DEFAULT_FCW			0x37F
+
+/**
+ * The legacy (FXSAVE) FPU state area; this is also the format in which FPU state is exposed to userspace.
+ * When XSAVE is in use, a thread's FPU state is a larger area (fpuStateSize bytes) which begins with
+ * this, followed by the XSAVE header and the extended state components.
+ */
 typedef struct
 {
 	//uint8_t block[512];
@@ -69,10 +106,41 @@ typedef struct
 	uint8_t				block[512-32];
 } ALIGN(16) FPURegs;
 
-/* all functions implemented in fpu.asm */
+/**
+ * The save/restore mode, and the size of an FPU state area, chosen by fpuInit().
+ */
+extern int fpuMode;
+extern size_t fpuStateSize;
+
+/**
+ * Initialize the FPU on the calling CPU, enabling XSAVE and all supported SIMD state components (up
+ * to AVX-512). Called on every CPU.
+ */
 void fpuInit();
-void fpuSave(FPURegs *regs);
+
+/**
+ * Allocate a zeroed FPU state area of fpuStateSize bytes, suitably aligned; and free it.
+ */
+FPURegs* fpuAlloc();
+void fpuFree(FPURegs *regs);
+
+/**
+ * Copy the legacy (FXSAVE-format) part of a saved state area into 'out' (512 bytes), filling in the
+ * initial values of components that XSAVE left out because they were in their initial state.
+ */
+void fpuGetLegacy(void *out, const FPURegs *area);
+
+/**
+ * Replace the legacy part of a saved state area with 'in' (512 bytes, FXSAVE format).
+ */
+void fpuSetLegacy(FPURegs *area, const void *in);
+
+/* implemented in fpu.asm */
+void fpuInitCPU();
+void fpuSave(FPURegs *regs);			/* whole state area */
 void fpuLoad(FPURegs *regs);
+void fpuSaveLegacy(FPURegs *regs);		/* 512-byte legacy area only */
+void fpuLoadLegacy(FPURegs *regs);
 uint32_t fpuGetMXCSR();
 void fpuSetMXCSR(uint32_t val);
 
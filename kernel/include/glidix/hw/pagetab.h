@@ -135,6 +135,36 @@ typedef struct
 	PTe				entries[512];
 } PACKED PT;
 
+/**
+ * A page directory entry mapping a 2MB page (with 'ps' set). The layout is that of a PTe with PS in
+ * place of PAT (which would be bit 12, always 0 here), so 'framePhysAddr' is the number of the first
+ * 4KB frame of the page, and the software (gx_*) bits mean the same.
+ */
+typedef struct
+{
+	uint64_t			present:1;
+	uint64_t			rw:1;
+	uint64_t			user:1;
+	uint64_t			pwt:1;
+	uint64_t			pcd:1;
+	uint64_t			accessed:1;
+	uint64_t			dirty:1;
+	uint64_t			ps:1;
+	uint64_t			global:1;
+	uint64_t			ignored:3;
+	uint64_t			framePhysAddr:36;
+	uint64_t			zero:4;
+	uint64_t			gx_r:1;
+	uint64_t			gx_w:1;
+	uint64_t			gx_x:1;
+	uint64_t			gx_loaded:1;
+	uint64_t			gx_cow:1;
+	uint64_t			gx_shared:1;
+	uint64_t			gx_perm_ovr:1;
+	uint64_t			moreIgnored:4;
+	uint64_t			xd:1;
+} PACKED HugePDe;
+
 PML4 *getPML4();
 void refreshAddrSpace();
 
@@ -143,6 +173,12 @@ void refreshAddrSpace();
  */
 void frameWrite(uint64_t frame, const void *buffer);
 
+/**
+ * Like frameWrite(), but with non-temporal stores, so that the frame does not displace anything
+ * from the cache. Use this when filling many frames which will not be read again soon.
+ */
+void frameWriteNT(uint64_t frame, const void *buffer);
+
 /**
  * Read data into the 'buffer' from the specified memory frame.
  */
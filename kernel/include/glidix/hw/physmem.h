@@ -40,10 +40,23 @@
  * phmTotalFrames			Total number of frames of physical memory.
  * phmUsedFrames			Number of frames currently allocated, either to applications or to the cache.
  * phmCachedFrames			Number of frames, out of phmUsedFrames, which are in the cache (and can be reallocated).
+ * phmZeroPooled			Number of frames, out of phmUsedFrames, which are sitting zeroed in the per-CPU pools.
+ * phmZeroHits				Number of phmTakeZeroFrame() calls served from a pool.
+ * phmZeroMisses			Number of phmTakeZeroFrame() calls which had to zero a frame themselves.
  */
 extern uint64_t phmTotalFrames;
 extern uint64_t phmUsedFrames;
 extern uint64_t phmCachedFrames;
+extern uint64_t phmZeroPooled;
+extern uint64_t phmZeroHits;
+extern uint64_t phmZeroMisses;
+
+/**
+ * Size of each per-CPU pool of pre-zeroed frames, and the number of frames which must be free for the
+ * idle thread to keep filling it.
+ */
+#define	ZERO_POOL_SIZE			64
+#define	ZERO_POOL_MIN_FREE		4096
 
 /**
  * Initialize the physical memory manager.
@@ -55,6 +68,10 @@ void initPhysMem2();
  * Allocate a list of consecutive frames, and return the index of the first one.
  * Flags should be 0.
  * Return 0 on failure.
+ *
+ * Runs of up to 64 frames are always found (by evicting cached pages if necessary). Longer runs,
+ * of up to 512 frames (2MB), are aligned on a 2MB boundary, and 0 is returned if no such run is
+ * free, since evicting the cache does not make free memory contiguous.
  */
 uint64_t phmAllocFrameEx(uint64_t count, int flags);
 
@@ -64,11 +81,30 @@ uint64_t phmAllocFrameEx(uint64_t count, int flags);
  */
 uint64_t phmAllocFrame();
 
+/**
+ * Return one past the highest frame number of useable RAM, as reported by the memory map. No frame
+ * returned by the allocator is ever at or above this. Only valid after initPhysMem2().
+ */
+uint64_t phmGetRAMEnd();
+
 /**
  * Calls phmAllocFrame() to allcoate a frame, then zeroes it out.
  */
 uint64_t phmAllocZeroFrame();
 
+/**
+ * Like phmAllocZeroFrame(), but takes a frame from the calling CPU's pool of pre-zeroed frames if
+ * possible, so that the page fault path does not have to clear it. Only for use once the CPU's
+ * per-CPU area is set up.
+ */
+uint64_t phmTakeZeroFrame();
+
+/**
+ * Called by the idle thread: zero one free frame with non-temporal stores and add it to this CPU's
+ * pool. Returns 1 if a frame was added, or 0 if the pool is full or memory is short.
+ */
+int phmFillZeroPool();
+
 /**
  * NOTE: Do not free frames until the heap is set up and initPhysMem2() was called.
  */
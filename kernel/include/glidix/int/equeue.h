@@ -0,0 +1,84 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __glidix_equeue_h
+#define __glidix_equeue_h
+
+/**
+ * Event queues. An event queue is a file description holding a set of file descriptions the caller is
+ * interested in; each is registered once (with sys_eqctl()), and sys_eqwait() then returns only those which are
+ * ready, in time proportional to their number. Readiness is tracked by watching the semaphores returned by the
+ * pollinfo() callback of each file, so no polling is ever done.
+ *
+ * Like poll(), an item is keyed by file descriptor, but belongs to the file description: it is removed
+ * automatically when the description is finally closed.
+ */
+
+#include <glidix/util/common.h>
+#include <glidix/fs/vfs.h>
+
+/**
+ * Operations for sys_eqctl().
+ */
+#define	EQ_ADD				0
+#define	EQ_MOD				1
+#define	EQ_DEL				2
+
+/**
+ * Flags which may be ORed into the POLL_* mask passed to sys_eqctl(). By default, an item is level-triggered:
+ * it is returned by every sys_eqwait() for as long as it's ready.
+ */
+#define	EQ_EDGE				(1 << 16)		/* only report when the file becomes ready */
+#define	EQ_ONESHOT			(1 << 17)		/* disable after one report, until EQ_MOD */
+
+/**
+ * Maximum number of events returned by one call to sys_eqwait().
+ */
+#define	EQ_MAX_EVENTS			1024
+
+/**
+ * An event returned by sys_eqwait(); mirrored as struct _glidix_eqevent in the C library.
+ */
+typedef struct
+{
+	uint64_t			udata;			/* as passed to sys_eqctl() */
+	int				fd;			/* the descriptor it was registered with */
+	int				events;			/* POLL_* bits which are ready */
+} EQEvent;
+
+/**
+ * Called by vfsClose() when a file description which was added to event queues is released.
+ */
+void equeueFileClosed(File *fp);
+
+int sys_eqcreate(int flags);
+int sys_eqctl(int eqfd, int op, int fd, int events, uint64_t udata);
+int sys_eqwait(int eqfd, EQEvent *uevents, int max, int flags, uint64_t nanotimeout);
+
+#endif
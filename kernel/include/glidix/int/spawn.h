@@ -0,0 +1,119 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __glidix_spawn_h
+#define __glidix_spawn_h
+
+#include <glidix/util/common.h>
+#include <glidix/int/syscall.h>
+
+/**
+ * Types of file actions.
+ */
+#define	SPAWN_OPEN			1
+#define	SPAWN_CLOSE			2
+#define	SPAWN_DUP2			3
+
+/**
+ * Spawn attribute flags; these are the POSIX_SPAWN_* values from libc.
+ */
+#define	SPAWN_RESETIDS			0x01
+#define	SPAWN_SETPGROUP			0x02
+#define	SPAWN_SETSIGDEF			0x04
+#define	SPAWN_SETSID			0x80
+#define	SPAWN_TCSETPGROUP		0x100
+#define	SPAWN_ALL			(SPAWN_RESETIDS | SPAWN_SETPGROUP | SPAWN_SETSIGDEF | SPAWN_SETSID \
+					| SPAWN_TCSETPGROUP)
+
+/**
+ * Maximum number of file actions accepted by a single spawn.
+ */
+#define	SPAWN_MAX_ACTIONS		256
+
+/**
+ * A file action, performed by the child before the exec. Must match 'struct __spawn_action' from libc.
+ */
+typedef struct
+{
+	int				type;
+	int				fd;
+	int				newfd;
+	int				oflag;
+	mode_t				mode;
+	const char*			path;
+} SpawnAction;
+
+/**
+ * Spawn attributes; must match 'posix_spawnattr_t' from libc.
+ */
+typedef struct
+{
+	int				flags;
+	int				pgroup;
+	uint64_t			sigdefault;
+	uint64_t			sigmask;
+	int				tcfd;
+} SpawnAttr;
+
+/**
+ * A spawn request. The parent copies it into kernel memory, and the child carries it out while the
+ * parent is blocked on its vforkWait semaphore.
+ */
+typedef struct
+{
+	char				path[USER_STRING_MAX];
+	char				pars[4096];
+	size_t				parsz;
+	SpawnAttr			attr;
+	
+	/**
+	 * The file actions; the 'path' of each SPAWN_OPEN action points into 'paths'.
+	 */
+	SpawnAction*			actions;
+	int				numActions;
+	char*				paths;
+	
+	/**
+	 * Set by the child to the errno value if it fails before the exec.
+	 */
+	int				error;
+} SpawnInfo;
+
+/**
+ * Create a new process running the executable at 'upath', with the exec parameters 'upars' (formatted
+ * as for sys_exec()), after applying the 'nacts' file actions in 'uacts' and the attributes in 'uattr'
+ * (which may be NULL). Unlike fork() followed by exec(), the address space of the caller is never
+ * duplicated or shared: the child runs in kernel mode until the new image is loaded. Returns the pid of
+ * the child, or -1 and sets ERRNO if the child could not be started; in that case the child has been
+ * reaped.
+ */
+int sys_spawn(const char *upath, const char *upars, size_t parsz, const SpawnAction *uacts, int nacts,
+		const SpawnAttr *uattr);
+
+#endif
@@ -41,10 +41,17 @@
  * Copy data from userspace to kernel space or vice versa. Returns 0 on success, -1 on error.
  * strcpy_u2k() is necessary because the kernel, in some cases, does not know how many bytes
  * must be copied from userspace; but in the case of copying from kernel to userspace, the
- * kernel knows how many bytes to copy and so it can just call memcpy_k2u().
+ * kernel knows how many bytes to copy and so it can just call memcpy_k2u(). strcpy_u2k() fails
+ * if the string, including its terminator, does not fit in USER_STRING_MAX bytes.
  */
 int memcpy_u2k(void *dst, const void *src, size_t size);
 int memcpy_k2u(void *dst, const void *src, size_t size);
 int strcpy_u2k(char *dst, const char *src);
 
+/**
+ * Session and process group calls, also used by spawned children to apply their attributes.
+ */
+int sys_setsid();
+int sys_setpgid(int pid, int pgid);
+
 #endif
@@ -34,7 +34,8 @@
  */
  
 #include <glidix/util/common.h>
-#include <glidix/thread/condvar.h>
+#include <glidix/util/time.h>
+#include <glidix/thread/semaphore.h>
 
 /**
  * EtherType values for supported protocols.
@@ -47,6 +48,7 @@
  * Flags for onEtherFrame().
  */
 #define	ETHER_IGNORE_CRC		(1 << 0)
+#define	ETHER_CSUM_VERIFIED		(1 << 1)
 
 /**
  * Flags for NDP Router Advertisments.
@@ -56,6 +58,7 @@
 #define	NDP_NADV_OVERRIDE		(1 << 5)
 
 struct NetIf_;
+struct NetOffload_;
 struct sockaddr;
 
 typedef struct
@@ -115,32 +118,43 @@ typedef struct
 } NDPNeighborAdvert;
 
 /**
- * Describes a resolution of an IP address to a MAC address.
+ * Neighbor (ARP/NDP) cache entry states.
  */
-typedef struct MacResolution_
+#define	NEIGH_INCOMPLETE		0		/* resolution in progress; packets are queued */
+#define	NEIGH_REACHABLE			1		/* recently confirmed */
+#define	NEIGH_STALE			2		/* not confirmed for a while, but still used */
+#define	NEIGH_PROBE			3		/* being re-confirmed; still used meanwhile */
+#define	NEIGH_FAILED			4		/* nobody answered; sending fails with EHOSTUNREACH */
+
+/**
+ * Neighbor cache tuning (times in nanoseconds).
+ */
+#define	NEIGH_HASH_SIZE			64		/* buckets per interface; power of 2 */
+#define	NEIGH_MAX_ENTRIES		1024		/* per interface, before entries are evicted early */
+#define	NEIGH_QUEUE_MAX			16		/* packets queued per unresolved neighbor */
+#define	NEIGH_MAX_PROBES		3		/* solicitations before giving up */
+#define	NEIGH_REACHABLE_TIME		NT_SECS(30)
+#define	NEIGH_RETRANS_TIME		NT_SECS(1)
+#define	NEIGH_GC_TIME			NT_SECS(120)	/* stale entries unused for this long are removed */
+#define	NEIGH_FAILED_TIME		NT_SECS(20)	/* failed entries are kept this long */
+#define	NEIGH_TICK_MS			500		/* how often etherNeighborTick() is called */
+
+struct NeighTable_;
+
+/**
+ * Information about a neighbor cache entry, as returned by sysNeighborTable(); the userspace version is
+ * _glidix_neigh.
+ */
+typedef struct
 {
-	/**
-	 * Which version of IP this address is for - AF_INET for IPv4 or AF_INET6 for IPv6.
-	 */
+	char				ifname[16];
 	int				family;
-	
-	/**
-	 * The IP address; for IPv4, only the first 4 bytes are used.
-	 */
+	int				state;			/* NEIGH_* */
 	uint8_t				ip[16];
-	
-	/**
-	 * The physical (MAC) address. All zeroes means the address is unresolved.
-	 */
 	MacAddress			mac;
-	
-	/**
-	 * This condition variable is signalled once this resolution actually becomes valid.
-	 */
-	CondVar				cond;
-
-	struct MacResolution_*		next;
-} MacResolution;
+	uint16_t			queued;			/* number of packets waiting for resolution */
+	uint64_t			age;			/* nanoseconds since last confirmed */
+} NeighInfo;
 
 /**
  * Calculate the Ethernet CRC32.
@@ -148,22 +162,48 @@ typedef struct MacResolution_
 uint32_t ether_checksum(const void *data, size_t size);
 
 /**
- * Send an IP packet through an Ethernet device. This may use ARP or NDP to resolve to a MAC address, and
- * the time allowed for that is limited by 'nanotimeout'.
+ * Send an IP packet through an Ethernet device. The next hop is looked up in the neighbor cache; if it is not yet
+ * resolved, the packet is queued and sent once ARP or NDP gives us the MAC address (or dropped if that fails), so
+ * this never blocks. 'off' is either NULL or describes the offloads requested for the packet (see
+ * netifFinishOffload()).
  */
-int sendPacketToEthernet(struct NetIf_ *netif, const struct sockaddr *gateway, const void *packet, size_t packetlen, uint64_t nanotimeout);
+int sendPacketToEthernet(struct NetIf_ *netif, const struct sockaddr *gateway, const void *packet, size_t packetlen,
+				const struct NetOffload_ *off);
 
 /**
  * Called by drivers upon receiving an Ethernet frame.
  * Flags:
  *	ETHER_IGNORE_CRC - This frame had its CRC checked by the hardware and might not be valid
  *	                   in the received buffer.
+ *	ETHER_CSUM_VERIFIED - The hardware verified the TCP/UDP checksum of the packet inside.
  */
 void onEtherFrame(struct NetIf_ *netif, const void *frame, size_t framelen, int flags);
 
 /**
- * Add an address resolution to an Ethernet device.
+ * Add an address resolution to an Ethernet device. Any packets waiting for it are sent. etherUpdateResolution()
+ * only updates an existing entry, and ignores addresses which are not in the cache.
  */
 void etherAddResolution(struct NetIf_ *netif, int family, const void *ip, const MacAddress *mac);
+void etherUpdateResolution(struct NetIf_ *netif, int family, const void *ip, const MacAddress *mac);
+
+/**
+ * Create and destroy the neighbor cache of an Ethernet interface.
+ */
+struct NeighTable_* etherCreateNeighbors();
+void etherDestroyNeighbors(struct NeighTable_ *table);
+
+/**
+ * Periodic neighbor cache maintenance, called every NEIGH_TICK_MS with iflistLock held: retransmits solicitations
+ * for unresolved and probed neighbors, gives up on those which do not answer (failing packets queued for them
+ * with EHOSTUNREACH), ages reachable entries to stale, and removes stale entries which have not been used for
+ * NEIGH_GC_TIME and failed entries after NEIGH_FAILED_TIME.
+ */
+void etherNeighborTick(struct NetIf_ *netif);
+
+/**
+ * If 'info' is NULL, return the number of entries in the neighbor cache of an Ethernet interface. Otherwise, store
+ * information about at most 'max' of them in 'info', and return the number stored.
+ */
+int etherListNeighbors(struct NetIf_ *netif, NeighInfo *info, int max);
 
 #endif
@@ -76,13 +76,38 @@
 #define	PKT_HDRINC			(1 << 8)
 #define	PKT_DONTROUTE			(1 << 9)
 #define	PKT_DONTFRAG			(1 << 10)
-#define	PKT_MASK			(PKT_HDRINC|PKT_DONTROUTE|PKT_DONTFRAG)
+#define	PKT_CSUM_OFFLOAD		(1 << 11)		/* TCP/UDP checksum field is zero; fill it in at the interface */
+#define	PKT_TSO				(1 << 12)		/* TCP segment may exceed the MTU; segment it at the interface */
+#define	PKT_MASK			(PKT_HDRINC|PKT_DONTROUTE|PKT_DONTFRAG|PKT_CSUM_OFFLOAD|PKT_TSO)
+#define	PKT_KERNEL_ONLY			(PKT_CSUM_OFFLOAD|PKT_TSO)	/* only set by the kernel, never taken from GSO_SNDFLAGS */
 
 /* types of interfaces */
 #define	IF_LOOPBACK			0		/* loopback interface (localhost) */
 #define	IF_ETHERNET			1		/* ethernet controller */
 #define	IF_TUNNEL			2		/* software tunnel */
 
+/* interface offload capabilities */
+#define	NETIF_CAP_TXCSUM		(1 << 0)	/* inserts TCP/UDP checksums into outgoing packets */
+#define	NETIF_CAP_RXCSUM		(1 << 1)	/* verifies TCP/UDP checksums of incoming packets */
+#define	NETIF_CAP_TSO4			(1 << 2)	/* TCP segmentation offload over IPv4 */
+#define	NETIF_CAP_TSO6			(1 << 3)	/* TCP segmentation offload over IPv6 */
+
+/* offload requests (NetOffload.flags) */
+#define	NETIF_OFF_CSUM			(1 << 0)	/* fill in the TCP/UDP checksum */
+#define	NETIF_OFF_TSO			(1 << 1)	/* split the TCP packet into 'mss'-sized segments */
+#define	NETIF_OFF_IPV4			(1 << 2)	/* the packet is IPv4 (otherwise IPv6) */
+#define	NETIF_OFF_TCP			(1 << 3)	/* the transport is TCP (otherwise UDP) */
+
+/* onPacketEx() flags */
+#define	NETIF_RX_CSUM_VERIFIED		(1 << 0)	/* the device verified the TCP/UDP checksum */
+
+/**
+ * Maximum size of a packet (including the IP and TCP headers) which may be passed down with PKT_TSO.
+ * Drivers advertising NETIF_CAP_TSO4 or NETIF_CAP_TSO6 must accept frames of this size plus the
+ * link-layer overhead.
+ */
+#define	NETIF_TSO_MAX			0x4000
+
 /* system-defined address/route domains; numbers 0-15 are reserved for the system; 16+ may be used by user */
 #define	DOM_GLOBAL			0		/* global (internet) */
 #define	DOM_LINK			1		/* link-local (LAN only) */
@@ -111,6 +136,23 @@
  * Type-specific network interface options.
  */
 struct NetIf_;
+
+/**
+ * Describes the offloads requested for an outgoing packet. All offsets are in bytes from the start of the
+ * buffer passed to the driver. When NETIF_OFF_CSUM is set, the checksum field already contains the sum of
+ * the pseudo-header (with the length left out if NETIF_OFF_TSO is also set), so the device only has to add
+ * the TCP/UDP header and payload, as is standard for checksum offload engines.
+ */
+typedef struct NetOffload_
+{
+	int				flags;			/* NETIF_OFF_* */
+	uint16_t			l3off;			/* offset to the IP header */
+	uint16_t			l4off;			/* offset to the TCP/UDP header */
+	uint16_t			csumoff;		/* offset to the TCP/UDP checksum field */
+	uint16_t			hdrlen;			/* size of all headers, up to and including TCP (TSO) */
+	uint16_t			mss;			/* maximum payload size of each segment (TSO) */
+} NetOffload;
+
 typedef union
 {
 	/**
@@ -139,6 +181,12 @@ typedef union
 		 */
 		MacAddress		mac;
 		
+		/**
+		 * Offload capabilities of the device (NETIF_CAP_*). Only honoured if 'sendOffload'
+		 * is implemented; zero means everything is done in software.
+		 */
+		int			caps;
+		
 		/**
 		 * Send an ethernet frame through the interface. 'frame' points to the ethernet frame,
 		 * which already has an EtherHeader at the front. 'framelen' is the length, in bytes,
@@ -147,10 +195,16 @@ typedef union
 		void (*send)(struct NetIf_ *netif, const void *frame, size_t framelen);
 		
 		/**
-		 * The head of the currently-resolved address list, and the list lock.
+		 * (Optional) Send an ethernet frame, asking the device to perform the offloads described
+		 * by 'off' (which are always a subset of 'caps'). The frame is laid out as for send(), except
+		 * that the CRC has not been computed, so the device must insert it.
 		 */
-		MacResolution*		res;
-		Semaphore		resLock;
+		void (*sendOffload)(struct NetIf_ *netif, const void *frame, size_t framelen, const NetOffload *off);
+		
+		/**
+		 * The neighbor (ARP/NDP) cache; created by CreateNetworkInterface().
+		 */
+		struct NeighTable_*	neigh;
 	} ethernet;
 	
 	/**
@@ -369,6 +423,7 @@ typedef struct
 	int				numAddrs;
 	IPRoute4*			routes;
 	int				numRoutes;
+	int				capRoutes;	/* allocated size of 'routes' */
 } IPConfig4;
 
 /**
@@ -395,6 +450,7 @@ typedef struct
 	int				numAddrs;
 	IPRoute6*			routes;
 	int				numRoutes;
+	int				capRoutes;	/* allocated size of 'routes' */
 } IPConfig6;
 
 /**
@@ -482,6 +538,11 @@ void initNetIf();
  */
 void onPacket(NetIf *netif, const void *packet, size_t packetlen);
 
+/**
+ * Like onPacket(), but 'flags' (NETIF_RX_*) report what the device has already checked about the packet.
+ */
+void onPacketEx(NetIf *netif, const void *packet, size_t packetlen, int flags);
+
 typedef struct
 {
 	char				ifname[16];
@@ -518,6 +579,12 @@ typedef struct
  */
 int sysRouteTable(uint64_t family);
 
+/**
+ * Implements the neightab() system call. Returns a file descriptor which reads NeighInfo structures describing
+ * the neighbor caches of all Ethernet interfaces.
+ */
+int sysNeighborTable();
+
 int sendPacket(struct sockaddr *src, const struct sockaddr *dest, const void *packet, size_t packetlen, int flags,
 		uint64_t nanotimeout, const char *ifname);
 
@@ -539,6 +606,34 @@ void getDefaultAddr6(struct in6_addr *src, const struct in6_addr *dest, const ch
  */
 uint16_t ipv4_checksum(const void *data, size_t size);
 
+/**
+ * Add the data to a running one's complement sum 'sum' (not complemented), and return the new sum folded
+ * to 16 bits. All but the last chunk of data summed this way must have an even size. The checksum of the
+ * whole thing is the complement of the final result.
+ */
+uint32_t ipv4_checksum_partial(uint32_t sum, const void *data, size_t size);
+
+/**
+ * Calculate the checksum of a TCP or UDP packet including its pseudo-header, given the source and destination
+ * addresses (AF_INET or AF_INET6) and the protocol. A packet with a valid checksum field gives a result of zero.
+ */
+uint16_t transportChecksum(const struct sockaddr *src, const struct sockaddr *dest, int proto, const void *packet, size_t size);
+
+/**
+ * Returns the offload capabilities (NETIF_CAP_*) of the interface through which packets to 'dest' would currently
+ * be routed, or 0 if there is no route. The TSO capability is only reported for the address family that would
+ * actually be used on the wire. If 'ifname' is not NULL, it limits the selection to the named interface.
+ */
+int getRouteCaps(const struct sockaddr *dest, const char *ifname);
+
+/**
+ * Called by link layers once they have a writable copy of an outgoing IP packet which came with offload
+ * requests. 'caps' are the capabilities of the device. If the device is to compute the checksum, the field
+ * is seeded with the pseudo-header sum; otherwise it is computed here, and NETIF_OFF_CSUM is removed from
+ * 'off'. Offsets in 'off' are relative to 'packet', and 'packetlen' is the size of the IP packet.
+ */
+void netifFinishOffload(void *packet, size_t packetlen, NetOffload *off, int caps);
+
 /**
  * System call to add a new route. Only 'root' is allowed to do this (effective UID must be 0).
  * The family is either AF_INET or AF_INET6. 'route' is a pointer to an address structure, which
@@ -0,0 +1,118 @@
+/*
+	Glidix kernel
+	
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __glidix_route_h
+#define __glidix_route_h
+
+/**
+ * Longest-prefix-match routing.
+ *
+ * The per-interface route arrays (netif->ipv4.routes and netif->ipv6.routes) remain the configuration,
+ * but lookups are done in a path-compressed binary trie built from them. The trie is immutable once
+ * published: every change to the routes, addresses or interfaces builds a new one under iflistLock and
+ * swaps it in, and readers only hold a reference to the table while they walk it, so they never take
+ * iflistLock and never wait for a writer. Each table has a generation number, which lets callers cache
+ * lookup results and later check whether they are still valid.
+ *
+ * Among routes with the same prefix, the ones on earlier interfaces, and earlier in an interface's
+ * route array, take priority.
+ */
+
+#include <glidix/util/common.h>
+#include <glidix/thread/spinlock.h>
+#include <glidix/net/netif.h>
+
+/**
+ * The result of a route lookup.
+ */
+typedef struct
+{
+	/**
+	 * Generation of the routing table which produced this result. The interface pointer may only be
+	 * dereferenced with iflistLock held, and only if this is still the current generation.
+	 */
+	uint64_t				gen;
+	
+	/**
+	 * The interface to send through.
+	 */
+	NetIf*					netif;
+	
+	/**
+	 * The next hop (a sockaddr_in or sockaddr_in6).
+	 */
+	struct sockaddr_in6			gateway;
+	
+	/**
+	 * The default source address for this route (the first address on the interface whose domain
+	 * matches the route); zeroes if there is no such address.
+	 */
+	uint8_t					src[16];
+} RouteResult;
+
+/**
+ * Per-socket cache of the last route lookup. Connected sockets keep one and pass it to sendPacketCached(),
+ * so that as long as the routing table does not change, sending skips the lookup entirely. It must be
+ * zeroed before first use.
+ */
+typedef struct
+{
+	Spinlock				lock;
+	int					flags;
+	char					ifname[16];
+	struct sockaddr_in6			dest;
+	RouteResult				res;
+} RouteCache;
+
+/**
+ * Build a new routing table from the interface list and publish it. Must be called with iflistLock held, after
+ * any change to the routes, addresses or interfaces.
+ */
+void routeRebuild(NetIf *iflist);
+
+/**
+ * Returns the generation of the current routing table.
+ */
+uint64_t routeGeneration();
+
+/**
+ * Look up the route to 'dest' (AF_INET or AF_INET6), optionally restricted to the interface named 'ifname'
+ * (NULL for any). If 'flags' contains PKT_DONTROUTE, the first interface which fits is returned, with the
+ * destination itself as the next hop; the source address is still that of the matching route. 'cache', if not
+ * NULL, is consulted first and updated afterwards. Returns 0 on success, or -ENETUNREACH if there is no route;
+ * in the latter case 'out->src' is still zeroed.
+ */
+int routeLookup(const struct sockaddr *dest, const char *ifname, int flags, RouteCache *cache, RouteResult *out);
+
+/**
+ * Like sendPacketEx(), but uses (and updates) the given route cache. Defined in netif.c.
+ */
+int sendPacketCached(struct sockaddr *src, const struct sockaddr *dest, const void *packet, size_t packetlen,
+			int proto, uint64_t *sockopts, const char *ifname, RouteCache *cache);
+
+#endif
@@ -52,6 +52,13 @@
 #define	MSG_OOB				(1 << 1)
 #define	MSG_PEEK			(1 << 2)
 #define	MSG_WAITALL			(1 << 3)
+#define	MSG_TRUNC			(1 << 4)
+#define	MSG_CTRUNC			(1 << 5)
+
+/**
+ * Maximum number of file descriptors which may be passed along with a single message (SCM_RIGHTS).
+ */
+#define	SOCK_MAX_FDS			16
 
 #define	GSO_RCVTIMEO			0
 #define	GSO_SNDTIMEO			1
@@ -168,6 +175,23 @@ typedef struct Socket_
 	 * Get the current socket error and clear it.
 	 */
 	int (*geterr)(struct Socket_ *sock);
+	
+	/**
+	 * (Optional) Like sendto() on a connected socket, but also passes 'numfps' file descriptions
+	 * (at most SOCK_MAX_FDS) to the peer. On success, the socket takes over the caller's references
+	 * to the descriptions; on error, they are left to the caller. Fails with EBUSY if passing a
+	 * description could create a reference cycle that is never freed.
+	 */
+	ssize_t (*sendmsg)(struct Socket_ *sock, const void *message, size_t size, int flags, File **fps, int numfps);
+	
+	/**
+	 * (Optional) Like recvfrom(), but also receives file descriptions passed with the data. '*numfps' is
+	 * initially the number of entries in 'fps'; it is set to the number of descriptions that came with
+	 * the data. If that is more than would fit, the rest are closed. The caller gets a reference to each
+	 * description stored in 'fps'. If MSG_TRUNC is passed in 'flags' to a message-based socket, the full
+	 * size of the message is returned even if it was truncated to 'len' bytes.
+	 */
+	ssize_t (*recvmsg)(struct Socket_ *sock, void *buffer, size_t len, int flags, File **fps, int *numfps);
 } Socket;
 
 typedef struct
@@ -191,15 +215,16 @@ typedef struct
 	
 /**
  * This is called from onPacket() once an address is obtained. This will try to deliver the packet to all interested
- * sockets.
+ * sockets. 'flags' is a bitwise-OR of NETIF_RX_* flags passed to onPacketEx().
  */
 void passPacketToSocket(const struct sockaddr *src, const struct sockaddr *dest, size_t addrlen,
-			const void *packet, size_t size, int proto, uint64_t dataOffset, const char *ifname);
+			const void *packet, size_t size, int proto, uint64_t dataOffset, const char *ifname, int flags);
 
 /**
- * Called by passPacketToSocket() or the IP reassembler once we have a full transport-layer packet.
+ * Called by passPacketToSocket() or the IP reassembler once we have a full transport-layer packet. TCP checksums
+ * are verified here (once, rather than by every socket), unless 'flags' includes NETIF_RX_CSUM_VERIFIED.
  */
-void onTransportPacket(const struct sockaddr *src, const struct sockaddr *dest, size_t addrlen, const void *packet, size_t size, int proto, const char *ifname);
+void onTransportPacket(const struct sockaddr *src, const struct sockaddr *dest, size_t addrlen, const void *packet, size_t size, int proto, const char *ifname, int flags);
 
 /**
  * Create a socket file description. The returned description will be marked with the O_SOCKET flag, and the 'fsdata'
@@ -223,6 +248,16 @@ ssize_t SendtoSocket(File *fp, const void *message, size_t len, int flags, const
  */
 ssize_t RecvfromSocket(File *fp, void *message, size_t len, int flags, struct sockaddr *addr, size_t *addrlen);
 
+/**
+ * Send a message along with file descriptions (SCM_RIGHTS); see the 'sendmsg' operation above.
+ */
+ssize_t SendmsgSocket(File *fp, const void *message, size_t len, int flags, File **fps, int numfps);
+
+/**
+ * Receive a message along with file descriptions (SCM_RIGHTS); see the 'recvmsg' operation above.
+ */
+ssize_t RecvmsgSocket(File *fp, void *message, size_t len, int flags, File **fps, int *numfps);
+
 /**
  * Implements getsockname().
  */
@@ -38,19 +38,90 @@
 #include <glidix/thread/semaphore.h>
 
 /**
- * Maximum number of files that can be opened per file table. A file table is per-process,
- * and all threads in one process share the table.
+ * Default soft limit on the number of open files (RLIMIT_NOFILE) for new file tables. A file table is
+ * per-process, and all threads in one process share the table. The descriptor array grows on demand, so
+ * this does not decide how much memory a table takes.
  */
-#define	MAX_OPEN_FILES					256
+#define	MAX_OPEN_FILES					1024
+
+/**
+ * Absolute maximum number of descriptors in a table; this is also the default hard limit.
+ */
+#define	FTAB_MAX_FILES					65536
+
+/**
+ * Initial number of slots in a descriptor array; must be a multiple of 64 (the array grows by doubling,
+ * and the free bitmap is made of 64-bit words).
+ */
+#define	FTAB_MIN_SLOTS					64
+
+/**
+ * Resource numbers for sys_getrlimit() and sys_setrlimit(). Only RLIMIT_NOFILE is enforced; the others
+ * read as RLIM_INFINITY and cannot be set.
+ */
+#define	RLIMIT_CORE					0
+#define	RLIMIT_CPU					1
+#define	RLIMIT_DATA					2
+#define	RLIMIT_FSIZE					3
+#define	RLIMIT_NOFILE					4
+#define	RLIMIT_STACK					5
+#define	RLIMIT_AS					6
+#define	RLIM_INFINITY					((uint64_t)-1)
+
+struct rlimit
+{
+	uint64_t					rlim_cur;
+	uint64_t					rlim_max;
+};
+
+typedef struct
+{
+	File*						fp;
+	int						flags;
+} FileSlot;
+
+/**
+ * A descriptor array. Readers (ftabGet()) access it without taking the table lock, inside a read-side
+ * critical section; when the array is replaced by a larger one, the old one is only freed once all
+ * readers which could have seen it have left. See ftabGet() in ftab.c.
+ */
+typedef struct
+{
+	int						size;
+	FileSlot					ents[];
+} FileSlots;
 
 typedef struct
 {
 	int						refcount;			// number of threads using this table.
-	struct
-	{
-		File*					fp;
-		int					flags;
-	}						list[MAX_OPEN_FILES];
+	
+	/**
+	 * The current descriptor array; replaced (never modified in size) when the table grows.
+	 */
+	FileSlots* volatile				slots;
+	
+	/**
+	 * Bitmap of used descriptors (including reserved ones), one bit per slot; and the index of the
+	 * lowest word which may have a clear bit. Only accessed with the lock held.
+	 */
+	uint64_t*					usedMap;
+	int						lowWord;
+	
+	/**
+	 * RLIMIT_NOFILE; descriptors at or above 'limit' cannot be allocated.
+	 */
+	int						limit;
+	int						hardLimit;
+	
+	/**
+	 * Reader counts for the two read-side epochs; see ftabGet().
+	 */
+	volatile int					epoch;
+	volatile int					readers[2];
+	
+	/**
+	 * Serializes all changes to the table.
+	 */
 	Semaphore					lock;
 } FileTable;
 
@@ -65,7 +136,7 @@ FileTable *ftabDup(FileTable *ftab);
 File* ftabGet(FileTable *ftab, int fd);
 
 /**
- * Allocate a new file descriptor. Returns -1 if no more descriptors are available. The descriptor becomes
+ * Allocate the lowest free file descriptor. Returns -1 if no more descriptors are available. The descriptor becomes
  * reserved and you MUST set it with ftabSet() (perhaps to NULL).
  */
 int ftabAlloc(FileTable *ftab);
@@ -107,4 +178,15 @@ int ftabGetFlags(FileTable *ftab, int fd);
  */
 int ftabSetFlags(FileTable *ftab, int fd, int flags);
 
+/**
+ * Get the current RLIMIT_NOFILE of a table.
+ */
+void ftabGetLimit(FileTable *ftab, struct rlimit *rl);
+
+/**
+ * Set RLIMIT_NOFILE. Only root may raise the hard limit. Existing descriptors above the new limit stay open.
+ * Returns 0 on success, or an error number on error.
+ */
+int ftabSetLimit(FileTable *ftab, const struct rlimit *rl);
+
 #endif
@@ -0,0 +1,92 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __glidix_futex_h
+#define __glidix_futex_h
+
+/**
+ * Futexes ("fast userspace mutexes"): userspace keeps its lock state in an aligned 64-bit word, and only enters
+ * the kernel to sleep while the word has a given value, or to wake up threads sleeping on it. Sleeping threads
+ * are kept in a hash table of wait queues keyed by the address of the word.
+ */
+
+#include <glidix/util/common.h>
+
+/**
+ * Futex operations (the low bits of 'op' passed to sys_futex()).
+ */
+#define	FUTEX_WAIT				0
+#define	FUTEX_WAKE				1
+#define	FUTEX_REQUEUE				2
+
+#define	FUTEX_OP_MASK				0x7F
+
+/**
+ * If this flag is set in 'op', the futex is private to the calling process; it is keyed by the virtual address,
+ * which saves a page table walk but means it must not be used with shared memory.
+ */
+#define	FUTEX_PRIVATE				0x80
+
+/**
+ * Pass as 'count' to wake up all sleepers.
+ */
+#define	FUTEX_ALL				0x7FFFFFFF
+
+/**
+ * Number of wait queues in the hash table. Must be a power of 2.
+ */
+#define	FUTEX_HASH_SIZE				256
+
+/**
+ * Sleep as long as the 64-bit word at the user address 'addr' has the value 'expected'. Returns 0 when woken up,
+ * -EAGAIN if the value was different from the start, -ETIMEDOUT if 'nanotimeout' (if not 0) passed, -EINTR if a
+ * signal arrived, -EINVAL if 'addr' is misaligned or -EFAULT if it is not readable.
+ */
+int futexWait(uint64_t addr, uint64_t expected, uint64_t nanotimeout, int flags);
+
+/**
+ * Wake up at most 'count' threads sleeping on the futex at 'addr'. Returns the number of threads woken up, or a
+ * negated error number.
+ */
+int futexWake(uint64_t addr, int count, int flags);
+
+/**
+ * Wake up at most 'count' threads sleeping on the futex at 'addr', and move at most 'requeue' of the remaining
+ * ones so that they sleep on 'addr2' instead. Returns the number of threads woken up, or a negated error number.
+ */
+int futexRequeue(uint64_t addr, int count, uint64_t addr2, int requeue, int flags);
+
+/**
+ * Wake up all threads sleeping on shared futexes within the specified physical frame. This is called when a
+ * process stops mapping the frame at the address where it used to be (for example when breaking copy-on-write),
+ * so that the sleepers look up the futex again.
+ */
+void futexInvalidateFrame(uint64_t frame);
+
+#endif
@@ -55,6 +55,12 @@ typedef struct
 	 */
 	struct _Thread*			owner;
 	
+	/**
+	 * The CPU on which the owner took the mutex, or -1 if unknown (ownership was handed over to a
+	 * waiter which did not run yet). Used to decide whether spinning on the owner is worthwhile.
+	 */
+	volatile int			ownerCPU;
+	
 	/**
 	 * Number of times the current owner has recursively locked the mutex. This field
 	 * is owned by the mutex owner!
@@ -68,9 +74,47 @@ typedef struct
 	MutexWaiter*			last;
 } Mutex;
 
+/**
+ * Maximum number of iterations to spin, waiting for an owner running on another CPU to release a
+ * mutex, before going to sleep.
+ */
+#define	MUTEX_SPIN_MAX			4096
+
+/**
+ * Maximum number of call sites for which lock statistics are kept.
+ */
+#define	MUTEX_STAT_MAX			1024
+
+/**
+ * Lock statistics for a call site of mutexLock().
+ */
+typedef struct
+{
+	volatile int			used;
+	const char*			aid;
+	int				lineno;
+	uint64_t			acquired;		// total number of acquisitions
+	uint64_t			contended;		// number of acquisitions which found the mutex owned
+	uint64_t			spun;			// number of contended acquisitions which did not sleep
+	uint64_t			waitNanos;		// total time spent waiting
+	uint64_t			maxWaitNanos;		// longest wait
+} MutexStat;
+
 void mutexInit(Mutex *mutex);
-void mutexLock(Mutex *mutex);
+void _mutexLock(Mutex *mutex, const char *aid, int lineno);
+#define	mutexLock(mutex)		_mutexLock((mutex), __FILE__, __LINE__)
 int mutexTryLock(Mutex *mutex);		// 0 = locked, -1 = failed
 void mutexUnlock(Mutex *mutex);
 
+/**
+ * Enable or disable collection of lock statistics (it is disabled by default). Enabling it resets all
+ * counters.
+ */
+void mutexSetStats(int enable);
+
+/**
+ * Return a kmalloc()'d string describing the lock statistics; this is the contents of /proc/lockstat.
+ */
+char* mutexStatText();
+
 #endif
@@ -30,15 +30,15 @@
 #define __glidix_pageinfo_h
 
 /**
- * We use a 4-level global page tree (similar to the PML4) to hold information about each
- * frame of PHYSICAL memory. This is used by the virtual memory manager to keep track of
- * how many address spaces a certain frame was mapped into (so as to not release it by
- * accident), and also by file paging to use some frames for caching while allowing them
- * to be returned when an application needs memory and no more is free.
+ * We use a flat table, indexed by frame number, to hold information about each frame of
+ * PHYSICAL memory. This is used by the virtual memory manager to keep track of how many
+ * address spaces a certain frame was mapped into (so as to not release it by accident),
+ * and also by file paging to use some frames for caching while allowing them to be returned
+ * when an application needs memory and no more is free.
  *
- * All levels of the tree contain pointers to the next level, except the bottommost level.
- * The bottommost level contains the number of references in the low 32 bits, and the high
- * 32 bits contain the flags, described below.
+ * The table is allocated by piInit(), with one entry for each frame up to the end of RAM,
+ * so finding an entry never takes a lock. Each entry contains the number of references in
+ * the low 32 bits, and the high 32 bits contain the flags, described below.
  */
 
 #include <glidix/util/common.h>
@@ -62,16 +62,19 @@
 #define	PI_ACCESSED				(1UL << 34)
 
 /**
- * Page information node.
+ * Set on the first frame of a 2MB page (see piNewHuge()); the reference count of the first frame
+ * then counts references to the whole page, and the entries of the other 511 frames are unused.
  */
-typedef union PageInfoNode_
-{
-	uint64_t				entries[512];
-	union PageInfoNode_*			branches[512];
-} PageInfoNode;
+#define	PI_HUGE					(1UL << 35)
 
 /**
- * Initialize the page info system.
+ * Set on the first frame of a 2MB page while piHugeSplit() is copying its entry to the other 511
+ * frames; the reference count of the page must not change until it is cleared.
+ */
+#define	PI_SPLITTING				(1UL << 36)
+
+/**
+ * Initialize the page info system. Must be called after initPhysMem2().
  */
 void piInit();
 
@@ -131,4 +134,30 @@ void piStaticFrame(uint64_t frame);
  */
 uint64_t piGetInfo(uint64_t frame);
 
+/**
+ * Create a new zeroed 2MB page with the specified flags, and return the number of its first frame,
+ * which is 2MB-aligned. Returns 0 if no such physical memory is free; the caller should then fall
+ * back to 4KB pages.
+ */
+uint64_t piNewHuge(uint64_t flags);
+
+/**
+ * Increase or decrease the reference count of a page created by piNewHuge(). If the page was split
+ * in the meantime, the reference count of each of its frames is changed instead.
+ */
+void piHugeIncref(uint64_t frame);
+void piHugeDecref(uint64_t frame);
+
+/**
+ * Split a page created by piNewHuge() into 512 independent frames, each with the reference count
+ * of the whole page; so each holder of a reference to the page now holds a reference to each frame.
+ * Does nothing if the page was already split.
+ */
+void piHugeSplit(uint64_t frame);
+
+/**
+ * Like piNeedsCopyOnWrite(), for a page created by piNewHuge().
+ */
+int piHugeNeedsCopyOnWrite(uint64_t frame);
+
 #endif
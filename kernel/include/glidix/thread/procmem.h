@@ -32,6 +32,8 @@
 #include <glidix/util/common.h>
 #include <glidix/fs/ftree.h>
 #include <glidix/thread/semaphore.h>
+#include <glidix/thread/rwsem.h>
+#include <glidix/thread/mutex.h>
 
 /**
  * Protection settings.
@@ -53,16 +55,57 @@
 #	define	MAP_FIXED			(1 << 3)
 #	define	MAP_THREAD			(1 << 4)
 #	define	MAP_UN				(1 << 5)
-#	define	MAP_ALLFLAGS			((1 << 6)-1)
+#	define	MAP_POPULATE			(1 << 6)
+#	define	MAP_ALLFLAGS			((1 << 7)-1)
 #	define	MAP_FAILED			((uint64_t)-1)
 #endif
 
+/**
+ * Advice for vmAdvise(). Only define those if they weren't yet defined, as above.
+ */
+#ifndef MADV_NORMAL
+#	define	MADV_NORMAL			0
+#	define	MADV_HUGEPAGE			14
+#	define	MADV_NOHUGEPAGE			15
+#endif
+
 /**
  * Minimum and maximum allowed addresses for mapping.
  */
 #define	ADDR_MIN				0x200000
 #define	ADDR_MAX				0x8000000000
 
+/**
+ * TLB shootdowns of more than this many pages flush the whole TLB instead of invalidating each page.
+ */
+#define	VM_FLUSH_MAX_PAGES			32
+
+/**
+ * Size of a huge page, and the number of 4KB pages in one. Anonymous private mappings are backed by
+ * huge pages where a whole aligned 2MB block lies within the mapping, unless MADV_NOHUGEPAGE was given.
+ */
+#define	VM_HUGE_SIZE				0x200000UL
+#define	VM_HUGE_PAGES				512
+
+/**
+ * Size (in pages) of the aligned window around a read fault on a file mapping within which pages already
+ * in the file cache are mapped as well. A power of 2, no larger than VM_HUGE_PAGES.
+ */
+#define	VM_FAULT_AROUND				16
+
+/**
+ * Number of PCIDs each CPU hands out to the address spaces it runs (PCIDs 1 to VM_NUM_PCIDS; 0 is
+ * used until the first switch).
+ */
+#define	VM_NUM_PCIDS				8
+
+/**
+ * CR4 bits and CPUID feature flags used by the TLB code.
+ */
+#define	CR4_PGE					(1UL << 7)
+#define	CR4_PCIDE				(1UL << 17)
+#define	CPUID_1_ECX_PCID			(1 << 17)
+
 /**
  * Describes a segment in a virtual address space.
  */
@@ -74,6 +117,20 @@ typedef struct Segment_
 	struct Segment_*			prev;
 	struct Segment_*			next;
 	
+	/**
+	 * Links in the segment tree (an AVL tree keyed by 'start'), and the height of the subtree
+	 * rooted here.
+	 */
+	struct Segment_*			left;
+	struct Segment_*			right;
+	int					height;
+	
+	/**
+	 * Address of the start of this segment. The segments always cover the whole address space,
+	 * so this is the sum of the sizes of all previous segments.
+	 */
+	uint64_t				start;
+	
 	/**
 	 * Size of this segment, in pages.
 	 */
@@ -108,6 +165,11 @@ typedef struct Segment_
 	 * Access flags of the mapped file (O_RDONLY, O_WRONLY, or O_RDWR).
 	 */
 	int					access;
+	
+	/**
+	 * Advice given by vmAdvise() (MADV_*).
+	 */
+	int					advice;
 } Segment;
 
 /**
@@ -116,14 +178,30 @@ typedef struct Segment_
 typedef struct
 {
 	/**
-	 * Lock for the object.
+	 * Lock for the segment list. Page faults (and vmGetPhys()) take it for reading, so that
+	 * the threads of a process may fault in parallel; anything which changes the segment list,
+	 * or changes page table entries in bulk (vmProtect(), vmClone(), etc), takes it for writing.
 	 */
-	Semaphore				lock;
+	RWSem					lock;
 	
 	/**
-	 * Head of the segment list.
+	 * Serializes changes to page table entries by faults, which only hold 'lock' for reading.
+	 * Always taken after 'lock'.
+	 */
+	Mutex					ptLock;
+	
+	/**
+	 * Head of the segment list, and root of the segment tree. The list is in address order, and
+	 * the tree is used to find the segment containing an address.
 	 */
 	Segment*				segs;
+	Segment*				tree;
+	
+	/**
+	 * Generation number; changed (to a globally unique value) every time the segments are changed,
+	 * to invalidate the per-thread segment caches.
+	 */
+	uint64_t				gen;
 	
 	/**
 	 * Reference count.
@@ -134,6 +212,25 @@ typedef struct
 	 * Physical frame number of the PDPT.
 	 */
 	uint64_t				phys;
+	
+	/**
+	 * Bitmap of CPUs (by ID) which have this address space loaded, and may therefore hold TLB entries
+	 * for it. A CPU sets its bit when switching to the address space, and clears it when switching to
+	 * another one.
+	 */
+	volatile uint32_t			cpuMask;
+	
+	/**
+	 * Context ID; unique among all address spaces ever created, and used to match the address space
+	 * with the PCID it was given on each CPU.
+	 */
+	uint64_t				ctx;
+	
+	/**
+	 * TLB generation; incremented by every shootdown. A CPU which switches back to this address space
+	 * under a PCID it still holds only keeps the TLB entries if this has not changed since.
+	 */
+	volatile uint64_t			tlbGen;
 } ProcMem;
 
 /**
@@ -146,6 +243,9 @@ int vmNew();
  * only used if MAP_ANON is not passed in 'flags'. If 'addr' is 0, then the highest possible
  * address is chosen such that the new segment does not collide with others.
  *
+ * With MAP_POPULATE, the whole range is faulted in before returning; the flag is not kept in
+ * the segment.
+ *
  * On success, returns an address larger than or equal to ADDR_MIN, otherwise an error number,
  * e.g. ENODEV.
  */
@@ -165,6 +265,12 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags);
  */
 int vmProtect(uint64_t addr, size_t len, int prot);
 
+/**
+ * Apply advice (MADV_*) to a region of virtual memory. Returns 0 on success, or a nonzero error number
+ * on error.
+ */
+int vmAdvise(uint64_t addr, size_t len, int advice);
+
 /**
  * Unmap all MAP_THREAD mappings established by the calling thread.
  */
@@ -209,4 +315,22 @@ void vmDump(ProcMem *pm, uint64_t addr);
  */
 uint64_t vmGetPhys(uint64_t addr, int requiredPerms);
 
+/**
+ * Set up paging features on the calling CPU: global pages for the kernel, and PCIDs if supported.
+ * Called by initPerCPU2() on every CPU.
+ */
+void vmInitCPU();
+
+/**
+ * Called when a TLB shootdown IPI is received, with interrupts disabled.
+ */
+void vmShootdownIPI();
+
+/**
+ * Return the total number of TLB shootdowns which required IPIs since boot, and the number of those
+ * in the last second.
+ */
+uint64_t vmShootdownCount();
+uint64_t vmShootdownRate();
+
 #endif
@@ -0,0 +1,90 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __glidix_rwsem_h
+#define __glidix_rwsem_h
+
+/**
+ * Reader-writer semaphores. Any number of readers may hold the semaphore at once, or a single writer.
+ * Waiters are served in FIFO order: once a thread is queued, later readers queue up behind it too, so
+ * that a writer cannot be starved by a stream of readers. When a waiter is woken, the semaphore has
+ * already been handed over to it. Not recursive.
+ */
+
+#include <glidix/util/common.h>
+#include <glidix/thread/spinlock.h>
+
+typedef struct RWWaiter_
+{
+	struct _Thread*			thread;
+	struct RWWaiter_*		next;
+	int				write;
+	volatile int			awaken;
+} RWWaiter;
+
+typedef struct
+{
+	/**
+	 * Spinlock protecting the fields below.
+	 */
+	Spinlock			lock;
+	
+	/**
+	 * Number of readers holding the semaphore; or -1 if held by a writer; or 0 if free.
+	 */
+	int				count;
+	
+	/**
+	 * Waiting queue.
+	 */
+	RWWaiter*			first;
+	RWWaiter*			last;
+} RWSem;
+
+/**
+ * Initialize a reader-writer semaphore. It starts free.
+ */
+void rwsemInit(RWSem *sem);
+
+/**
+ * Acquire the semaphore for reading (shared).
+ */
+void rwsemRead(RWSem *sem);
+
+/**
+ * Acquire the semaphore for writing (exclusive).
+ */
+void rwsemWrite(RWSem *sem);
+
+/**
+ * Release the semaphore, whether it was acquired for reading or writing.
+ */
+void rwsemRelease(RWSem *sem);
+
+#endif
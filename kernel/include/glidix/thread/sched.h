@@ -44,8 +44,11 @@
 #include <stddef.h>
 
 #define	DEFAULT_STACK_SIZE		0x200000
+#define	QUANTUM_MILLI			35		/* length of a time slice */
 #define	CLONE_THREAD			(1 << 0)
 #define	CLONE_DETACHED			(1 << 1)
+#define	CLONE_VFORK			(1 << 2)
+#define	CLONE_SPAWN			(1 << 3)
 
 /**
  * Standard priorities.
@@ -311,47 +314,47 @@ typedef struct _RunqueueEntry
 typedef struct _Thread
 {
 	/**
-	 * The thread's FPU registers. This must be the first member of this structure
-	 * so that they are 16-byte-aligned without any waste.
+	 * The thread's saved FPU state; an area of fpuStateSize bytes allocated by fpuAlloc(),
+	 * as its size depends on which XSAVE components the CPU supports.
 	 */
-	FPURegs				fpuRegs;				// 0
+	FPURegs*			fpuRegs;				// 0
 
 	/**
 	 * The value to load into RSP upon a syscall.
 	 */
-	uint64_t			syscallStackPointer;			// 0x200
+	uint64_t			syscallStackPointer;			// 0x08
 	
 	/**
 	 * Registers that must be preserved across system calls. Those are stored
 	 * by the system call dispatcher and may be read by functions like fork()
 	 * which need to know the return state.
 	 */
-	uint64_t			urbx;					// 0x208
-	uint64_t			ursp;					// 0x210
-	uint64_t			urbp;					// 0x218
-	uint64_t			ur12;					// 0x220
-	uint64_t			ur13;					// 0x228
-	uint64_t			ur14;					// 0x230
-	uint64_t			ur15;					// 0x238
-	uint64_t			urip;					// 0x240
+	uint64_t			urbx;					// 0x10
+	uint64_t			ursp;					// 0x18
+	uint64_t			urbp;					// 0x20
+	uint64_t			ur12;					// 0x28
+	uint64_t			ur13;					// 0x30
+	uint64_t			ur14;					// 0x38
+	uint64_t			ur15;					// 0x40
+	uint64_t			urip;					// 0x48
 
 	/**
 	 * Current error. Set to 0 by _syscall_entry(), and only stored at userspace
 	 * errno address if set to nonzero.
 	 */
-	int				therrno;				// 0x248
+	int				therrno;				// 0x50
 
 	/**
 	 * The 8 registers: RBX, RSP, RBP, R12, R13, R14, R15, RIP, preserved for
 	 * exception catching.
 	 * If RIP != 0, then we are catching exceptions.
 	 */
-	uint64_t			catchRegs[8];				// 0x250
+	uint64_t			catchRegs[8];				// 0x58
 
 	/**
 	 * Debug flags.
 	 */
-	int				debugFlags;				// 0x258
+	int				debugFlags;				// 0x98
 	
 	// --- END OF ASSEMBLY REGION --- //
 	
@@ -365,6 +368,11 @@ typedef struct _Thread
 	 * The thread's registers.
 	 */
 	Regs				regs;
+	
+	/**
+	 * ID of the CPU whose FPU registers were last loaded with this thread's state, or -1.
+	 */
+	int				fpuCPU;
 
 	/**
 	 * Thread name (for debugging of kernel threads), or the path to the executable in
@@ -472,12 +480,6 @@ typedef struct _Thread
 	 */
 	ProcStat			ps;
 	
-	/**
-	 * The physical address on which this thread is blocking. When sys_unblock() is called on
-	 * an address which maps to this, the thread will be woken up.
-	 */
-	uint64_t			blockPhys;
-	
 	/**
 	 * Spinlock for controlling coredumps. Only one thread will ever acquire this lock, and
 	 * it guarantees that there aren't multiple threads coredumping all at once.
@@ -503,11 +505,26 @@ typedef struct _Thread
 	 */
 	int				allocFromCacheNow;
 	
+	/**
+	 * The segment in which this thread last faulted, and the generation of the ProcMem it was
+	 * found in; only valid while the generation is unchanged. See procmem.c.
+	 */
+	struct Segment_*		segCache;
+	uint64_t			segCacheGen;
+	
 	/**
 	 * Whether or not this thread is performing an SD cache miss. In this case it is not allowed
 	 * to allocate from the file cache.
 	 */
 	int				sdMissNow;
+	
+	/**
+	 * For a child created with CLONE_VFORK or CLONE_SPAWN, the semaphore its parent waits on until the child
+	 * stops using its address space (by calling exec or exiting); NULL otherwise. The parent
+	 * uses its own 'vforkWait'.
+	 */
+	struct Semaphore_*		vforkDone;
+	struct Semaphore_		vforkWait;
 } Thread;
 
 typedef struct
@@ -549,6 +566,33 @@ void switchTaskUnlocked(Regs *regs);
 int haveReadySigs(Thread *thread);
 int wasSignalled();				// returns 1 if the current thread has signals ready
 
+/**
+ * Called by init.c once the PIT has been stopped. From then on, the BSP arms its APIC timer for the next timed event
+ * (as well as for the end of each slice) and processes the timer wheel.
+ */
+void schedSetTickless();
+
+/**
+ * Returns the number of periodic timer interrupts that idle CPUs did not have to take.
+ */
+uint64_t schedTicksAvoided();
+
+/**
+ * Called when the APIC timer fires, with interrupts disabled.
+ */
+void schedTimer(Regs *regs);
+
+/**
+ * Called when a scheduler hint IPI is received, with interrupts disabled.
+ */
+void schedHint();
+
+/**
+ * Called by timedPost() when an event was posted which must be processed at the given nanotime. If the BSP is not
+ * going to wake up by then, its timer is re-armed (via a hint IPI if necessary).
+ */
+void schedTimerHint(uint64_t nanotime);
+
 void lockSched();				// only call with IF=0!
 int isSchedLocked();
 void unlockSched();
@@ -608,11 +652,23 @@ int signalThread(Thread *thread);
  *	CLONE_THREAD -		create a thread within the same process; otherwise a new process with
  *				an initial thread.
  *	CLONE_DETACHED -	create a detached thread.
+ *	CLONE_VFORK -		create a new process which shares the address space of the caller until
+ *				it calls exec or exits (see vforkRelease()); the caller must then wait
+ *				for its 'vforkWait' semaphore before returning to userspace.
+ *	CLONE_SPAWN -		create a new process with no address space, which starts running in
+ *				kernel mode at regs->rip on its own kernel stack, and must call exec or
+ *				exit; the caller waits on 'vforkWait' as with CLONE_VFORK.
  * state = use this when you need to set FPU registers basically. throwback to when this was a system
  *         call.
  */
 int threadClone(Regs *regs, int flags, MachineState *state);
 
+/**
+ * Called by a child created with CLONE_VFORK or CLONE_SPAWN once it no longer uses its parent's address space,
+ * to let the parent continue. Does nothing in other threads.
+ */
+void vforkRelease();
+
 /**
  * Exit the thread.
  */
@@ -728,4 +784,9 @@ void detachMe();
  */
 int getClosingPid();
 
+/**
+ * Reset the calling thread's FPU state to the initial one, with the given MXCSR value. Used by exec.
+ */
+void fpuResetThread(uint32_t mxcsr);
+
 #endif
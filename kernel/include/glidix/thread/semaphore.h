@@ -86,6 +86,30 @@ typedef struct SemWaitThread_
 	struct SemWaitThread_*			next;
 } SemWaitThread;
 
+/**
+ * A watch on a semaphore; see semWatch().
+ */
+typedef struct SemWatch_
+{
+	/**
+	 * Called whenever resources are returned to the semaphore, or it is terminated. It is called with the
+	 * semaphore's spinlock held and interrupts disabled, so it must not block or yield.
+	 */
+	void (*callback)(struct SemWatch_ *watch);
+	
+	/**
+	 * Free for use by the owner of the watch.
+	 */
+	void*					context;
+	
+	/**
+	 * The semaphore being watched, and links in its list of watches.
+	 */
+	struct Semaphore_*			sem;
+	struct SemWatch_*			prev;
+	struct SemWatch_*			next;
+} SemWatch;
+
 /**
  * The structure representing a semaphore. This may be allocated statically or using kmalloc().
  */
@@ -112,6 +136,11 @@ typedef struct Semaphore_
 	 */
 	SemWaitThread*				first;
 	SemWaitThread*				last;
+	
+	/**
+	 * List of watches (see semWatch()).
+	 */
+	SemWatch*				watches;
 } Semaphore;
 
 /**
@@ -196,6 +225,18 @@ void semTerminate(Semaphore *sem);
  */
 int semPoll(int numSems, Semaphore **sems, uint8_t *bitmap, int flags, uint64_t nanotimeout);
 
+/**
+ * Start watching a semaphore. 'watch->callback' and 'watch->context' must be set by the caller; the callback is
+ * invoked every time semSignal2() or semTerminate() is called on the semaphore, until semUnwatch() is called. This
+ * allows readiness to be tracked without polling (the semaphore is "ready" while its count is nonzero).
+ */
+void semWatch(Semaphore *sem, SemWatch *watch);
+
+/**
+ * Stop watching a semaphore. Once this returns, the callback is not running and will not be called again.
+ */
+void semUnwatch(SemWatch *watch);
+
 /**
  * Switch the given semaphore to debug mode. This enables the debug terminal, and also causes semWait() and semSignal()
  * to print a stack trace and other information whenever they are called on this semaphore. Useful for debugging
@@ -179,6 +179,12 @@ typedef struct
 	uint64_t			sst_frames_total;
 	uint64_t			sst_frames_used;
 	uint64_t			sst_frames_cached;
+	uint64_t			sst_ticks_avoided;
+	uint64_t			sst_shootdowns;
+	uint64_t			sst_shootdown_rate;
+	uint64_t			sst_zero_pooled;
+	uint64_t			sst_zero_hits;
+	uint64_t			sst_zero_misses;
 } SystemState;
 
 typedef struct
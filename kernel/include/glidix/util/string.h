@@ -37,6 +37,21 @@
 
 #define	ULONG_MAX							18446744073709551615UL
 
+/**
+ * How memcpy() and memset() move data (the value of 'stringMode'); string.asm and usercopy.asm
+ * depend on these values.
+ */
+#define	STRING_MODE_QWORDS						0		/* rep movsq, then rep movsb for the rest */
+#define	STRING_MODE_BYTES						1		/* rep movsb only (fast with ERMS) */
+
+/**
+ * CPUID leaf 7 feature flags which make byte-sized string instructions fast.
+ */
+#define	CPUID_7_EBX_ERMS						(1 << 9)
+#define	CPUID_7_EDX_FSRM						(1 << 4)
+
+extern int stringMode;
+
 void   memcpy(void *dst, const void *src, size_t size);
 void   memset(void *dst, char c, size_t size);
 void   strcpy(char *dst, const char *src);
@@ -71,4 +86,10 @@ char *strstr(const char *in, const char *str);				/* init.c */
  */
 int strformat(char *buffer, size_t bufsize, const char *format, ...);
 
+/**
+ * Choose the mode for memcpy() and memset(). If the CPU reports ERMS, both modes are timed on a
+ * few buffer sizes, and the faster one is picked. Defined in string.c.
+ */
+void stringInit();
+
 #endif
@@ -46,10 +46,22 @@ typedef struct TimedEvent_
 	 */
 	struct _Thread*			thread;
 	
+	/**
+	 * Timer wheel slot the event is currently queued on, TIMED_SLOT_NONE if not queued, or
+	 * TIMED_SLOT_EXPIRED if it has expired and is waiting to be delivered.
+	 */
+	int				slot;
+	
 	struct TimedEvent_*		prev;
 	struct TimedEvent_*		next;
 } TimedEvent;
 
+/**
+ * Special values for TimedEvent.slot.
+ */
+#define	TIMED_SLOT_NONE			-1
+#define	TIMED_SLOT_EXPIRED		-2
+
 uint64_t getUptime();			// idt.c
 #define	getTicks getUptime
 uint64_t getNanotime();
@@ -62,7 +74,8 @@ void initRTC();
 
 /**
  * Add a timed event. Only call this when the scheduler is locked (lockSched()). The thread will be woken up when the
- * system timer reaches "nanotime". It may be woken up before that, for other reasons. You must always call timedCancel()
+ * system timer passes "nanotime"; the wakeup may be deferred by up to 1/8 of the remaining time (but never brought
+ * forward), so that nearby deadlines expire on the same tick. It may be woken up before that, for other reasons. You must always call timedCancel()
  * on the event, even if the deadline passed. The TimedEvent structure may be allocated on the stack; it shall not be
  * initialized (this function performs initialization).
  *
@@ -71,12 +84,21 @@ void initRTC();
 void timedPost(TimedEvent *ev, uint64_t nanotime);
 
 /**
- * Remove the event from the queue if it's still there. Always call this after timedPost().
+ * Remove the event from the queue if it's still there. Always call this after timedPost(), with the scheduler
+ * locked. This is O(1).
  */
 void timedCancel(TimedEvent *ev);
 
 /**
- * Called on each tick, with interrupts disabled.
+ * Returns the nanotime at which the timer wheel next needs to be processed (by calling onTick()), or 0 if there are
+ * no pending events. Call with interrupts disabled.
+ */
+uint64_t timedNextExpiry();
+
+/**
+ * Called on each PIT tick (or, once the PIT is stopped, whenever the BSP's APIC timer fires), with interrupts
+ * disabled. Advances the timer wheel, and wakes up the threads whose events
+ * have expired. The scheduler lock is only taken if there is something to wake up.
  */
 void onTick();
 
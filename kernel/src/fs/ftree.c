@@ -247,6 +247,30 @@ uint64_t ftGetPage(FileTree *ft, off_t pos)
 	return frame;
 };
 
+uint64_t ftFindPage(FileTree *ft, off_t pos)
+{
+	if (ft->getpage != NULL) return 0;
+	if (semWaitGen(&ft->lock, 1, SEM_W_NONBLOCK, 0) != 1) return 0;
+	
+	FileNode *node = &ft->top;
+	int i;
+	for (i=0; i<12; i++)
+	{
+		node = node->nodes[(pos >> (12 + 4 * (12 - i))) & 0xF];
+		if (node == NULL) break;
+	};
+	
+	uint64_t frame = 0;
+	if (node != NULL)
+	{
+		frame = node->entries[(pos >> 12) & 0xF];
+		if (frame != 0) piIncref(frame);
+	};
+	
+	semSignal(&ft->lock);
+	return frame;
+};
+
 ssize_t ftRead(FileTree *ft, void *buffer, size_t size, off_t pos)
 {
 	semWait(&ft->lock);
@@ -220,6 +220,66 @@ void procfsDelete(int pid)
 	};
 };
 
+typedef struct
+{
+	char*			text;
+	size_t			size;
+} ProcText;
+
+static void* procfsTextOpen(Inode *inode, int oflags)
+{
+	char* (*gen)() = (char* (*)()) inode->fsdata;
+	
+	ProcText *pt = NEW(ProcText);
+	pt->text = gen();
+	pt->size = strlen(pt->text);
+	return pt;
+};
+
+static void procfsTextClose(Inode *inode, void *filedata)
+{
+	ProcText *pt = (ProcText*) filedata;
+	kfree(pt->text);
+	kfree(pt);
+};
+
+static ssize_t procfsTextRead(Inode *inode, File *fp, void *buffer, size_t size, off_t offset)
+{
+	ProcText *pt = (ProcText*) fp->filedata;
+	if ((size_t) offset >= pt->size) return 0;
+	if ((offset + size) > pt->size) size = pt->size - offset;
+	
+	memcpy(buffer, &pt->text[offset], size);
+	return (ssize_t) size;
+};
+
+void procfsAddText(const char *name, char* (*gen)())
+{
+	char fullpath[64];
+	strformat(fullpath, 64, "/proc/%s", name);
+	
+	Creds *creds = getCurrentThread()->creds;
+	getCurrentThread()->creds = NULL;
+	
+	DentryRef dref = vfsGetDentry(VFS_NULL_IREF, fullpath, 1, NULL);
+	if (dref.dent == NULL)
+	{
+		panic("could not create %s", fullpath);
+	};
+	
+	Inode *inode = vfsCreateInode(NULL, VFS_MODE_REGULAR | 0444);
+	inode->fsdata = (void*) gen;
+	inode->open = procfsTextOpen;
+	inode->close = procfsTextClose;
+	inode->pread = procfsTextRead;
+	inode->flags |= VFS_INODE_NOUNLINK;
+	
+	vfsBindInode(dref, inode);
+	vfsDownrefInode(inode);
+	
+	getCurrentThread()->creds = creds;
+};
+
 void procfsUpdateCreds()
 {
 	Creds *creds = getCurrentThread()->creds;
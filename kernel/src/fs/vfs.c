@@ -35,6 +35,7 @@
 #include <glidix/thread/semaphore.h>
 #include <glidix/util/errno.h>
 #include <glidix/thread/mutex.h>
+#include <glidix/int/equeue.h>
 
 static Semaphore semConst;
 static FileSystem* kernelRootFS;
@@ -1291,6 +1292,7 @@ void vfsClose(File *fp)
 {	
 	if (__sync_add_and_fetch(&fp->refcount, -1) == 0)
 	{
+		if (fp->eqitems != NULL) equeueFileClosed(fp);
 		if (fp->iref.inode->ft != NULL) ftReleaseProcessLocks(fp->iref.inode->ft);	
 		
 		if (fp->iref.inode->close != NULL)
@@ -34,6 +34,7 @@
 #include <glidix/hw/apic.h>
 #include <glidix/hw/pagetab.h>
 #include <glidix/hw/idt.h>
+#include <glidix/hw/clocksource.h>
 
 static uint32_t acpiNumTables;
 static uint32_t *acpiTables;
@@ -318,6 +319,17 @@ void acpiInit()
 				if (rhead.len == 0) break;
 				searching += rhead.len;
 			};
+		}
+		else if (memcmp(head.sig, "HPET", 4) == 0)
+		{
+			ACPI_HPET hpet;
+			pmem_read(&hpet, payloadPhysAddr, sizeof(ACPI_HPET));
+			
+			// only memory-mapped HPETs make sense
+			if (hpet.spaceID == 0)
+			{
+				hpetDetected(hpet.base);
+			};
 		};
 	};
 	
@@ -0,0 +1,262 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <glidix/hw/clocksource.h>
+#include <glidix/hw/pagetab.h>
+#include <glidix/hw/port.h>
+#include <glidix/util/time.h>
+#include <glidix/display/console.h>
+#include <glidix/util/string.h>
+
+/**
+ * The clock page, alone in its own page frame since it is visible to userspace.
+ */
+static PAGE_ALIGN union
+{
+	ClockPage				page;
+	uint8_t					pad[PAGE_SIZE];
+} clockFrame;
+#define	clockPage				(clockFrame.page)
+
+static volatile uint64_t *hpetRegs = NULL;
+static uint64_t hpetPeriod;				/* femtoseconds per HPET tick */
+static uint64_t hpetBase;				/* HPET counter at nanoBase */
+
+static int hasInvariantTSC()
+{
+	uint32_t eax, ebx, ecx, edx;
+	ASM ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0x80000000));
+	if (eax < 0x80000007)
+	{
+		return 0;
+	};
+	
+	ASM ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0x80000007));
+	return !!(edx & (1 << 8));
+};
+
+static uint64_t rdtsc()
+{
+	uint32_t lo, hi;
+	ASM ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32) | lo;
+};
+
+static uint64_t hpetRead(int reg)
+{
+	return hpetRegs[reg/8];
+};
+
+static void hpetWrite(int reg, uint64_t value)
+{
+	hpetRegs[reg/8] = value;
+};
+
+void hpetDetected(uint64_t base)
+{
+	PTe *pte = VIRT_TO_PTE(HPET_ADDR);
+	pte->present = 1;
+	pte->framePhysAddr = (base >> 12);
+	pte->pcd = 1;
+	pte->rw = 1;
+	refreshAddrSpace();
+	
+	volatile uint64_t *regs = (volatile uint64_t*) (HPET_ADDR + (base & 0xFFF));
+	uint64_t caps = regs[HPET_REG_CAPS/8];
+	uint64_t period = caps >> 32;
+	
+	// the specification limits the period to 100ns; anything else means it's broken. we also don't want to
+	// deal with a 32-bit counter wrapping around every few minutes.
+	if ((period == 0) || (period > 100000000UL) || ((caps & HPET_CAPS_COUNT_64) == 0))
+	{
+		kprintf("HPET at 0x%016lX unusable (caps=0x%016lX)\n", base, caps);
+		return;
+	};
+	
+	hpetRegs = regs;
+	hpetPeriod = period;
+	hpetWrite(HPET_REG_CONFIG, hpetRead(HPET_REG_CONFIG) | HPET_CONFIG_ENABLE);
+	kprintf("HPET at 0x%016lX, %lu Hz\n", base, 1000000000000000UL / period);
+};
+
+/**
+ * Measure the TSC frequency against the HPET.
+ */
+static uint64_t calibrateWithHPET()
+{
+	// 10 ms worth of HPET ticks
+	uint64_t hpetTicks = 10000000000000UL / hpetPeriod;
+	
+	uint64_t hpetStart = hpetRead(HPET_REG_COUNTER);
+	uint64_t tscStart = rdtsc();
+	while ((hpetRead(HPET_REG_COUNTER) - hpetStart) < hpetTicks);
+	uint64_t tscEnd = rdtsc();
+	uint64_t hpetEnd = hpetRead(HPET_REG_COUNTER);
+	
+	uint64_t nanos = (hpetEnd - hpetStart) * hpetPeriod / 1000000;
+	return (tscEnd - tscStart) * NANO_PER_SEC / nanos;
+};
+
+/**
+ * Measure the TSC frequency against PIT channel 2, in one-shot mode, polling its output through port 0x61. The
+ * tick counter (channel 0) only has a 1ms resolution, so it's no good for this.
+ */
+static uint64_t calibrateWithPIT()
+{
+	uint8_t gate = inb(0x61);
+	outb(0x61, (gate & ~0x02) | 0x01);		// speaker off, gate on
+	outb(0x43, 0xB0);				// channel 2, lobyte/hibyte, mode 0
+	
+	// 50 ms
+	uint16_t count = 1193182 / 20;
+	outb(0x42, count & 0xFF);
+	outb(0x42, count >> 8);
+	
+	uint64_t tscStart = rdtsc();
+	while ((inb(0x61) & 0x20) == 0);
+	uint64_t tscEnd = rdtsc();
+	
+	outb(0x61, gate);
+	return (tscEnd - tscStart) * 20;
+};
+
+static void clockBeginUpdate()
+{
+	clockPage.seq++;
+	__sync_synchronize();
+};
+
+static void clockEndUpdate()
+{
+	__sync_synchronize();
+	clockPage.seq++;
+};
+
+uint64_t getNanotime()
+{
+	switch (clockPage.source)
+	{
+	case CLOCK_SOURCE_TSC:
+		return clockPage.nanoBase
+			+ (uint64_t) (((unsigned __int128) (rdtsc() - clockPage.tscBase) * clockPage.mult) >> 32);
+	case CLOCK_SOURCE_HPET:
+		{
+			// split up so that the multiplication can't overflow
+			uint64_t ticks = hpetRead(HPET_REG_COUNTER) - hpetBase;
+			return clockPage.nanoBase + (ticks / 1000000) * hpetPeriod + (ticks % 1000000) * hpetPeriod / 1000000;
+		};
+	default:
+		return getUptime() * (uint64_t)1000000;	// 10^6 nanoseconds in a millisecond because 10^9 in a second
+	};
+};
+
+void clockInit()
+{
+	int invariant = hasInvariantTSC();
+	
+	uint64_t flags = getFlagsRegister();
+	cli();
+	
+	uint64_t tscFreq = 0;
+	if (invariant)
+	{
+		if (hpetRegs != NULL)
+		{
+			tscFreq = calibrateWithHPET();
+		}
+		else
+		{
+			tscFreq = calibrateWithPIT();
+		};
+	};
+	
+	// switch over without going back in time
+	uint64_t now = getNanotime();
+	clockBeginUpdate();
+	if (tscFreq != 0)
+	{
+		clockPage.tscBase = rdtsc();
+		clockPage.mult = (NANO_PER_SEC << 32) / tscFreq;
+		clockPage.freq = tscFreq;
+		clockPage.nanoBase = now;
+		clockPage.source = CLOCK_SOURCE_TSC;
+	}
+	else if (hpetRegs != NULL)
+	{
+		hpetBase = hpetRead(HPET_REG_COUNTER);
+		clockPage.freq = 1000000000000000UL / hpetPeriod;
+		clockPage.nanoBase = now;
+		clockPage.source = CLOCK_SOURCE_HPET;
+	};
+	clockEndUpdate();
+	
+	setFlagsRegister(flags);
+	
+	// map the clock page for userspace; read-only
+	PTe *pte = VIRT_TO_PTE(CLOCK_PAGE_ADDR);
+	pte->framePhysAddr = VIRT_TO_FRAME(&clockFrame);
+	pte->user = 1;
+	pte->present = 1;
+	refreshAddrSpace();
+	
+	kprintf("Clock source: %s (%lu Hz) ", clockSourceName(), clockPage.freq);
+};
+
+void clockSetRealtime(time_t now)
+{
+	int64_t offset = now * (int64_t)NANO_PER_SEC - (int64_t)getNanotime();
+	
+	// the RTC only has a resolution of 1 second, so only step the clock if it's out by more than that;
+	// otherwise the realtime clock would jitter back and forth with every update.
+	int64_t diff = offset - clockPage.realOffset;
+	if ((clockPage.realOffset == 0) || (diff >= (int64_t)NANO_PER_SEC) || (diff <= -(int64_t)NANO_PER_SEC))
+	{
+		clockBeginUpdate();
+		clockPage.realOffset = offset;
+		clockEndUpdate();
+	};
+};
+
+const char* clockSourceName()
+{
+	switch (clockPage.source)
+	{
+	case CLOCK_SOURCE_TSC:
+		return "TSC";
+	case CLOCK_SOURCE_HPET:
+		return "HPET";
+	default:
+		return "PIT";
+	};
+};
+
+int clockHasCounter()
+{
+	return clockPage.source != CLOCK_SOURCE_TICKS;
+};
@@ -122,6 +122,7 @@ void initPerCPU2()
 	msrWrite(MSR_CSTAR, (uint64_t)(&_syscall_entry));		// we don't actually use compat mode
 	msrWrite(MSR_SFMASK, (1 << 9) | (1 << 10));			// disable interrupts on syscall and set DF=0
 	msrWrite(MSR_EFER, msrRead(MSR_EFER) | EFER_SCE | EFER_NXE);
+	vmInitCPU();
 };
 
 extern char trampoline_start;
@@ -316,14 +317,14 @@ CPU *getCurrentCPU()
 	return currentCPU;
 };
 
-void sendHintToCPU(int cpuID)
+static void sendIPI(int cpuID, uint8_t vector)
 {
 	uint64_t retflags = getFlagsRegister();
 	cli();
 	
 	apic->icrHigh = cpuList[cpuID].apicID << 24;
 	__sync_synchronize();
-	apic->icrLow = 0x00004071;	// I_IPI_SCHED_HINT
+	apic->icrLow = 0x00004000 | (uint32_t) vector;
 	__sync_synchronize();
 
 	while (apic->icrLow & (1 << 12))
@@ -334,6 +335,16 @@ void sendHintToCPU(int cpuID)
 	setFlagsRegister(retflags);
 };
 
+void sendHintToCPU(int cpuID)
+{
+	sendIPI(cpuID, I_IPI_SCHED_HINT);
+};
+
+void sendShootdownToCPU(int cpuID)
+{
+	sendIPI(cpuID, I_IPI_SHOOTDOWN);
+};
+
 void sendHintToEveryCPU()
 {
 	if (numCPU == 1) return;
@@ -431,8 +442,9 @@ void cpuBusy()
 void cpuDispatch()
 {
 	if (getCurrentCPU() == NULL) return;
-	if (numCPU == 1) return;
 
+	// if this CPU is idle (even if it's the only one), this makes the idle loop yield once the
+	// current interrupt returns; other CPUs are sent a hint.
 	int i;
 	for (i=0; i<numCPU; i++)
 	{
@@ -450,3 +462,9 @@ int cpuSleeping()
 	if (getCurrentCPU() == NULL) return 1;
 	return cpuReadyBitmap & (1 << getCurrentCPU()->id);
 };
+
+int cpuIsRunning(int id, struct _Thread *thread)
+{
+	if ((id < 0) || (id >= numCPU)) return 0;
+	return cpuList[id].running == thread;
+};
@@ -44,15 +44,18 @@ static void splitPageIndex(uint64_t index, uint64_t *dirIndex, uint64_t *tableIn
 	*dirIndex = (index & 0x1FF);
 };
 
-static PTe *dmaGetPage(uint64_t index)
+/**
+ * Return the page directory entry covering DMA page 'index', creating the page directory if necessary.
+ * If the entry has 'ps' set, it maps a whole 2MB buffer, and there is no page table under it.
+ */
+static PDe *dmaGetDirEntry(uint64_t index)
 {
 	uint64_t dirIndex, tableIndex, pageIndex;
 	splitPageIndex(index, &dirIndex, &tableIndex, &pageIndex);
 	uint64_t base = 0xFFFF838000000000;
 
-	int makeDir=0, makeTable=0;
-
 	PDPT *pdpt = (PDPT*) (base + 0x7FFFFFF000);
+	PD *pd = (PD*) (base + 0x7FFFE00000 + dirIndex * 0x1000);
 	if (!pdpt->entries[dirIndex].present)
 	{
 		pdpt->entries[dirIndex].present = 1;
@@ -60,17 +63,27 @@ static PTe *dmaGetPage(uint64_t index)
 		pdpt->entries[dirIndex].pdPhysAddr = frame;
 		pdpt->entries[dirIndex].rw = 1;
 		refreshAddrSpace();
-		makeDir = 1;
+		memset(pd, 0, 0x1000);
 	};
+	
+	return &pd->entries[tableIndex];
+};
 
-	PD *pd = (PD*) (base + 0x7FFFE00000 + dirIndex * 0x1000);
-	if (makeDir) memset(pd, 0, 0x1000);
-	if (!pd->entries[tableIndex].present)
+static PTe *dmaGetPage(uint64_t index)
+{
+	uint64_t dirIndex, tableIndex, pageIndex;
+	splitPageIndex(index, &dirIndex, &tableIndex, &pageIndex);
+	uint64_t base = 0xFFFF838000000000;
+
+	int makeTable=0;
+
+	PDe *pde = dmaGetDirEntry(index);
+	if (!pde->present)
 	{
-		pd->entries[tableIndex].present = 1;
+		pde->present = 1;
 		uint64_t frame = phmAllocFrame();
-		pd->entries[tableIndex].ptPhysAddr = frame;
-		pd->entries[tableIndex].rw = 1;
+		pde->ptPhysAddr = frame;
+		pde->rw = 1;
 		refreshAddrSpace();
 		makeTable = 1;
 	};
@@ -99,6 +112,9 @@ static int dmaCheckFreePages(uint64_t start, uint64_t count)
 	uint64_t i;
 	for (i=0; i<count; i++)
 	{
+		PDe *pde = dmaGetDirEntry(start+i);
+		if (pde->present && pde->ps) return 0;
+		
 		PTe *pte = dmaGetPage(start+i);
 		if (pte->present) return 0;
 	};
@@ -131,6 +147,37 @@ static uint64_t dmaAllocPages(uint64_t physStart, uint64_t count)
 	return 0;
 };
 
+/**
+ * Map a buffer of exactly 512 frames, starting at the 2MB-aligned 'physStart' (as phmAllocFrameEx() returns
+ * them), with a single 2MB page directory entry. Only directory entries which never had a page table are
+ * used. Returns the first page, or 0 if there is no such entry left.
+ */
+static uint64_t dmaAllocHuge(uint64_t physStart)
+{
+	// the last page directory is the recursive mapping
+	uint64_t slot;
+	for (slot=1; slot<511*512; slot++)
+	{
+		PDe *pde = dmaGetDirEntry(slot << 9);
+		if (!pde->present)
+		{
+			HugePDe huge;
+			memset(&huge, 0, sizeof(HugePDe));
+			huge.present = 1;
+			huge.rw = 1;
+			huge.pcd = 1;	// not caching
+			huge.ps = 1;
+			huge.framePhysAddr = physStart;
+			
+			*((HugePDe*)pde) = huge;
+			refreshAddrSpace();
+			return slot << 9;
+		};
+	};
+	
+	return 0;
+};
+
 int dmaCreateBuffer(DMABuffer *handle, size_t bufsize, int flags)
 {
 	uint64_t numFrames = bufsize / 0x1000;
@@ -156,7 +203,17 @@ int dmaCreateBuffer(DMABuffer *handle, size_t bufsize, int flags)
 		};
 	};
 	
-	uint64_t firstPage = dmaAllocPages(physStart, numFrames);
+	uint64_t firstPage = 0;
+	if (numFrames == 512)
+	{
+		firstPage = dmaAllocHuge(physStart);
+	};
+	
+	if (firstPage == 0)
+	{
+		firstPage = dmaAllocPages(physStart, numFrames);
+	};
+	
 	if (firstPage == 0)
 	{
 		phmFreeFrameEx(physStart, numFrames);
@@ -177,12 +234,20 @@ void dmaReleaseBuffer(DMABuffer *handle)
 	spinlockAcquire(&dmaMemoryLock);
 	phmFreeFrameEx(handle->firstFrame, handle->numFrames);
 	
-	uint64_t i;
-	for (i=0; i<handle->numFrames; i++)
+	PDe *pde = dmaGetDirEntry(handle->firstPage);
+	if (pde->present && pde->ps)
+	{
+		memset(pde, 0, sizeof(PDe));
+	}
+	else
 	{
-		PTe *pte = dmaGetPage(handle->firstPage+i);
-		pte->present = 0;
-		pte->framePhysAddr = 0;
+		uint64_t i;
+		for (i=0; i<handle->numFrames; i++)
+		{
+			PTe *pte = dmaGetPage(handle->firstPage+i);
+			pte->present = 0;
+			pte->framePhysAddr = 0;
+		};
 	};
 	
 	refreshAddrSpace();
@@ -223,10 +288,23 @@ void dmaNextRegion(DMARegion *reg)
 		return;
 	};
 	
-	uint64_t frame = VIRT_TO_FRAME(reg->virtNext);
+	// 2MB pages (such as those of large DMA buffers) are mapped directly by the page directory
+	HugePDe *pde = (HugePDe*) (((reg->virtNext >> 18) & ~0x7UL) | 0xFFFFFFFFC0000000UL);
+	uint64_t frame;
+	size_t sizeNow;
+	if (pde->present && pde->ps)
+	{
+		frame = pde->framePhysAddr + ((reg->virtNext >> 12) & 0x1FF);
+		sizeNow = 0x200000 - (reg->virtNext & 0x1FFFFF);
+	}
+	else
+	{
+		frame = VIRT_TO_FRAME(reg->virtNext);
+		sizeNow = PAGE_SIZE - (reg->virtNext & 0xFFF);
+	};
+	
 	reg->physAddr = (frame << 12) | (reg->virtNext & 0xFFF);
 	
-	size_t sizeNow = PAGE_SIZE - (reg->virtNext & 0xFFF);
 	if (sizeNow > reg->remSize) sizeNow = reg->remSize;
 	if (sizeNow > reg->maxRegion && reg->maxRegion != 0) sizeNow = reg->maxRegion;
 	
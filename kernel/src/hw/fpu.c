@@ -0,0 +1,156 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <glidix/util/common.h>
+#include <glidix/hw/fpu.h>
+#include <glidix/util/memory.h>
+#include <glidix/util/string.h>
+
+/**
+ * Offsets within an FXSAVE/XSAVE area.
+ */
+#define	FPU_OFF_ST			32		/* ST0-ST7 (or MM0-MM7), 16 bytes each */
+#define	FPU_OFF_XMM			160		/* XMM0-XMM15, 16 bytes each */
+#define	FPU_OFF_XSTATE_BV		512		/* first field of the XSAVE header */
+
+int fpuMode = FPU_MODE_FXSAVE;
+size_t fpuStateSize = sizeof(FPURegs);
+
+/**
+ * The XCR0 value chosen by the first CPU, and loaded on every other one.
+ */
+static uint64_t fpuXCR0;
+static int fpuDetected;
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	ASM ("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (subleaf));
+};
+
+void fpuInit()
+{
+	fpuInitCPU();
+	
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if ((ecx & CPUID_1_ECX_XSAVE) == 0)
+	{
+		// FXSAVE only; the defaults stand
+		fpuDetected = 1;
+		return;
+	};
+	
+	uint64_t cr4;
+	ASM ("mov %%cr4, %0" : "=r" (cr4));
+	cr4 |= CR4_OSXSAVE;
+	ASM ("mov %0, %%cr4" : : "r" (cr4));
+	
+	if (!fpuDetected)
+	{
+		cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+		uint64_t supported = ((uint64_t) edx << 32) | eax;
+		
+		// AVX-512 needs all three of its components (and AVX) enabled together
+		fpuXCR0 = supported & (XCR0_X87 | XCR0_SSE | XCR0_AVX);
+		if ((fpuXCR0 & XCR0_AVX) && ((supported & XCR0_AVX512) == XCR0_AVX512))
+		{
+			fpuXCR0 |= XCR0_AVX512;
+		};
+	};
+	
+	ASM ("xsetbv" : : "c" (0), "a" ((uint32_t) fpuXCR0), "d" ((uint32_t) (fpuXCR0 >> 32)));
+	
+	if (!fpuDetected)
+	{
+		// EBX now reports the size of the area needed for the components we enabled
+		cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+		fpuStateSize = ebx;
+		
+		cpuid(0xD, 1, &eax, &ebx, &ecx, &edx);
+		if (eax & 1) fpuMode = FPU_MODE_XSAVEOPT;
+		else fpuMode = FPU_MODE_XSAVE;
+		
+		fpuDetected = 1;
+	};
+};
+
+FPURegs* fpuAlloc()
+{
+	// remember the pointer returned by kmalloc() just before the aligned area
+	char *raw = (char*) kmalloc(fpuStateSize + FPU_ALIGN + sizeof(void*));
+	if (raw == NULL) return NULL;
+	
+	uint64_t addr = ((uint64_t) raw + sizeof(void*) + FPU_ALIGN - 1) & ~((uint64_t) FPU_ALIGN - 1);
+	((void**) addr)[-1] = raw;
+	
+	// the XSAVE header must be zeroed, as XRSTOR faults on garbage in it
+	memset((void*) addr, 0, fpuStateSize);
+	return (FPURegs*) addr;
+};
+
+void fpuFree(FPURegs *regs)
+{
+	if (regs != NULL) kfree(((void**) regs)[-1]);
+};
+
+void fpuGetLegacy(void *out, const FPURegs *area)
+{
+	memcpy(out, area, sizeof(FPURegs));
+	if (fpuMode == FPU_MODE_FXSAVE) return;
+	
+	uint64_t xstateBV = *((const uint64_t*) ((const char*) area + FPU_OFF_XSTATE_BV));
+	FPURegs *legacy = (FPURegs*) out;
+	
+	if ((xstateBV & XCR0_X87) == 0)
+	{
+		legacy->fcw = FPU_DEFAULT_FCW;
+		legacy->fsw = 0;
+		legacy->ftw = 0;
+		legacy->fop = 0;
+		legacy->fpuIP = 0;
+		legacy->cs = 0;
+		legacy->fpuDP = 0;
+		legacy->ds = 0;
+		memset((char*) out + FPU_OFF_ST, 0, 8*16);
+	};
+	
+	if ((xstateBV & XCR0_SSE) == 0)
+	{
+		memset((char*) out + FPU_OFF_XMM, 0, 16*16);
+	};
+};
+
+void fpuSetLegacy(FPURegs *area, const void *in)
+{
+	memcpy(area, in, sizeof(FPURegs));
+	if (fpuMode == FPU_MODE_FXSAVE) return;
+	
+	// make XRSTOR take the x87 and SSE state from the legacy area
+	*((uint64_t*) ((char*) area + FPU_OFF_XSTATE_BV)) |= (XCR0_X87 | XCR0_SSE);
+};
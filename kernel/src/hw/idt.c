@@ -40,6 +40,9 @@
 #include <glidix/hw/pci.h>
 #include <glidix/hw/cpu.h>
 #include <glidix/util/catch.h>
+#include <glidix/util/extable.h>
+#include <glidix/hw/clocksource.h>
+#include <glidix/thread/procmem.h>
 
 IDTEntry idt[256];
 IDTPointer idtPtr;
@@ -116,12 +119,15 @@ extern void isr64();
 extern void isr65();
 extern void isr112();
 extern void isr113();
+extern void isr114();
 extern void irq_ditch();
 
 int kernelDead = 0;
 
 uint64_t getUptime()						// <glidix/time.h>
 {
+	// the PIT may be stopped once there is a counter to read the time from
+	if (clockHasCounter()) return getNanotime() / NT_MILLI(1);
 	return uptime;
 };
 
@@ -228,6 +234,7 @@ void initIDT()
 	setGate(65, isr65);
 	setGate(0x70, isr112);
 	setGate(0x71, isr113);
+	setGate(0x72, isr114);
 	
 	// set up IST for some
 	setGateIST(I_NMI, 1);
@@ -297,6 +304,7 @@ static void onPageFault(Regs *regs)
 
 	if ((getCurrentThread() == NULL) || ((regs->cs & 0xFFFF) == 8))
 	{
+		if (extableFixup(regs)) return;
 		throw(EX_PAGE_FAULT);
 		
 		enableDebugTerm();
@@ -380,6 +388,11 @@ void sendCPUErrorSignal(Regs *regs, int signal, int code, void *addr)
 
 static void onGPF(Regs *regs)
 {
+	if ((regs->cs & 3) == 0)
+	{
+		if (extableFixup(regs)) return;
+	};
+	
 	throw(EX_GPF);
 	
 	if ((regs->cs & 3) == 0)
@@ -492,7 +505,7 @@ void isrHandler(Regs *regs)
 	case I_APIC_TIMER:
 		if (apic->timerCurrentCount == 0)
 		{
-			switchTask(regs);
+			schedTimer(regs);
 		};
 		break;
 	case 15:
@@ -525,9 +538,16 @@ void isrHandler(Regs *regs)
 		break;
 	case I_IPI_SCHED_HINT:
 		// scheduler hint. this basically wakes up a CPU to indicate that the state of
-		// one of its threads has changed and it might need to stop halting. we do nothing
-		// in response.
+		// one of its threads has changed and it might need to stop halting. it may also be
+		// asked to re-arm its timer for an earlier timed event.
+		apic->eoi = 0;
+		schedHint();
+		break;
+	case I_IPI_SHOOTDOWN:
+		// another CPU changed page tables of an address space which might be loaded on
+		// this CPU, and wants us to flush the stale TLB entries
 		apic->eoi = 0;
+		vmShootdownIPI();
 		break;
 	default:
 		if ((regs->intNo >= IRQ0) && (regs->intNo <= IRQ15))
@@ -40,6 +40,16 @@
 uint64_t phmTotalFrames;
 uint64_t phmUsedFrames;
 uint64_t phmCachedFrames;
+uint64_t phmZeroPooled;
+uint64_t phmZeroHits;
+uint64_t phmZeroMisses;
+
+/**
+ * Frames zeroed in advance by this CPU's idle thread (see phmFillZeroPool()). Only touched by
+ * the owning CPU, with interrupts disabled.
+ */
+static PER_CPU uint64_t		zeroPool[ZERO_POOL_SIZE];
+static PER_CPU int		zeroPoolCount;
 
 /**
  * The next frame to return if we are allocating using placement. This is done before
@@ -60,6 +70,11 @@ static uint64_t			memoryMapEnd;
 static uint64_t			numSystemFrames;
 static uint8_t*			frameBitmap = NULL;
 
+/**
+ * One past the highest frame of useable RAM.
+ */
+static uint64_t			ramEndFrame;
+
 /**
  * Lowest frame that could be free (i.e. one that was free during init).
  */
@@ -364,6 +379,45 @@ static uint64_t phmAlloc64()
 	};
 };
 
+/**
+ * Claim an aligned run of 512 free frames (a 2MB page), or return 0 if none is free.
+ */
+static uint64_t phmAlloc512()
+{
+	uint64_t i, j;
+	uint64_t numGroups = numSystemFrames;
+	
+	uint64_t *bitmap64 = (uint64_t*) frameBitmap;
+	for (i=((lowestFreeFrame+511)>>9)<<3; (i+8)<=(numGroups>>6); i+=8)
+	{
+		for (j=0; j<8; j++)
+		{
+			if (bitmap64[i+j] != 0) break;
+		};
+		
+		if (j != 8) continue;
+		
+		// looks free; claim the 8 groups of 64, and give them back if we lose a race
+		for (j=0; j<8; j++)
+		{
+			if (atomic_compare_and_swap64(&bitmap64[i+j], 0, 0xFFFFFFFFFFFFFFFF) != 0) break;
+		};
+		
+		if (j == 8)
+		{
+			__sync_fetch_and_add(&phmUsedFrames, 512);
+			return i << 6;
+		};
+		
+		while (j--)
+		{
+			atomic_compare_and_swap64(&bitmap64[i+j], 0xFFFFFFFFFFFFFFFF, 0);
+		};
+	};
+	
+	return 0;
+};
+
 void initPhysMem2()
 {
 	frameBitmap = (uint8_t*) kmalloc(numSystemFrames/8+1);
@@ -391,6 +445,8 @@ void initPhysMem2()
 					phmTotalFrames++;
 				};
 			};
+			
+			if (endFrame > ramEndFrame) ramEndFrame = endFrame;
 		};
 		
 		mmap = (MultibootMemoryMap*) ((uint64_t) mmap + mmap->size + 4);
@@ -409,6 +465,11 @@ void initPhysMem2()
 	phmUsedFrames = 0;
 };
 
+uint64_t phmGetRAMEnd()
+{
+	return ramEndFrame;
+};
+
 static void loadNextMemory()
 {
 	do
@@ -473,6 +534,54 @@ uint64_t phmAllocZeroFrame()
 	return frame;
 };
 
+/* pagetab.asm */
+void __zeroFrameNT(uint64_t frame);
+
+uint64_t phmTakeZeroFrame()
+{
+	uint64_t frame = 0;
+	
+	uint64_t retflags = getFlagsRegister();
+	cli();
+	if (zeroPoolCount != 0)
+	{
+		frame = zeroPool[--zeroPoolCount];
+	};
+	setFlagsRegister(retflags);
+	
+	if (frame != 0)
+	{
+		__sync_fetch_and_add(&phmZeroPooled, -1);
+		__sync_fetch_and_add(&phmZeroHits, 1);
+		return frame;
+	};
+	
+	__sync_fetch_and_add(&phmZeroMisses, 1);
+	return phmAllocZeroFrame();
+};
+
+int phmFillZeroPool()
+{
+	// only the idle thread of this CPU adds to the pool, so the count cannot grow under us
+	if (zeroPoolCount == ZERO_POOL_SIZE) return 0;
+	
+	// never evict the cache just to keep frames zeroed in advance
+	if ((phmTotalFrames - phmUsedFrames) < ZERO_POOL_MIN_FREE) return 0;
+	
+	uint64_t frame = phmAllocFrame();
+	if (frame == 0) return 0;
+	
+	__zeroFrameNT(frame);
+	
+	uint64_t retflags = getFlagsRegister();
+	cli();
+	zeroPool[zeroPoolCount++] = frame;
+	setFlagsRegister(retflags);
+	
+	__sync_fetch_and_add(&phmZeroPooled, 1);
+	return 1;
+};
+
 uint64_t phmAllocFrameEx(uint64_t count, int flags)
 {
 	if (count == 0) return 0;
@@ -480,9 +589,15 @@ uint64_t phmAllocFrameEx(uint64_t count, int flags)
 	
 	uint64_t actuallyAllocated;
 	uint64_t base;
-	if (count > 64)
+	if (count > 512)
+	{
+		panic("attempted to allocate more than 512 consecutive frames (%d)\n", (int) count);
+	}
+	else if (count > 64)
 	{
-		panic("attempted to allocate more than 64 consecutive frames (%d)\n", (int) count);
+		actuallyAllocated = 512;
+		base = phmAlloc512();
+		if (base == 0) return 0;
 	}
 	else if (count > 32)
 	{
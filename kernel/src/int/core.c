@@ -188,7 +188,7 @@ void coredump(siginfo_t *si, Regs *regs)
 		{
 			if (thread->creds->pid == getCurrentThread()->creds->pid)
 			{
-				memcpy(thput->ct_fpu, &thread->fpuRegs, sizeof(FPURegs));
+				fpuGetLegacy(thput->ct_fpu, thread->fpuRegs);
 				thput->ct_thid = thread->thid;
 				thput->ct_nice = thread->niceVal;
 				thput->ct_rax = thread->regs.rax;
@@ -237,7 +237,7 @@ void coredump(siginfo_t *si, Regs *regs)
 	// make the segment list
 	size_t numSegs = 0;
 	
-	semWait(&pm->lock);
+	rwsemRead(&pm->lock);
 	for (vmseg=pm->segs; vmseg!=NULL; vmseg=vmseg->next)
 	{
 		if (vmseg->flags != 0) numSegs++;
@@ -275,7 +275,7 @@ void coredump(siginfo_t *si, Regs *regs)
 		base += (vmseg->numPages << 12);
 	};
 	
-	semSignal(&pm->lock);
+	rwsemRelease(&pm->lock);
 	
 	// write the segment list
 	vfsPWrite(fp, seglist, sizeof(CoreSegment) * numSegs, offSeglist);
@@ -563,8 +563,9 @@ int elfExec(const char *path, const char *pars, size_t parsz)
 	thread->szExecPars = parsz;
 	memcpy(thread->execPars, pars, parsz);
 
-	// create a new address space
+	// create a new address space; if we were vforked, the parent may now have its own back
 	vmNew();
+	vforkRelease();
 
 	uint8_t zeroPage[0x1000];
 	memset(zeroPage, 0, 0x1000);
@@ -669,11 +670,8 @@ int elfExec(const char *path, const char *pars, size_t parsz)
 	regs.rbp = 0;
 	regs.rdx = 0;
 
-	// initialize MXCSR
-	FPURegs fregs;
-	fpuSave(&fregs);
-	fregs.mxcsr = MX_PM | MX_UM | MX_OM | MX_ZM | MX_DM | MX_IM;
-	fpuLoad(&fregs);
+	// start with a clean FPU state, all exceptions masked
+	fpuResetThread(MX_PM | MX_UM | MX_OM | MX_ZM | MX_DM | MX_IM);
 	
 	// do not block any signals in a new executable by default
 	getCurrentThread()->sigmask = 0;
@@ -0,0 +1,663 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <glidix/int/equeue.h>
+#include <glidix/int/syscall.h>
+#include <glidix/thread/sched.h>
+#include <glidix/thread/semaphore.h>
+#include <glidix/thread/mutex.h>
+#include <glidix/util/memory.h>
+#include <glidix/util/string.h>
+#include <glidix/util/errno.h>
+
+#define	EQ_HASH_SIZE				64
+#define	EQ_NUM_WATCH				(PEI_HANGUP+1)
+#define	EQ_EVENTS_MASK				(POLL_READ | POLL_WRITE | POLL_ERROR | POLL_HANGUP | EQ_EDGE | EQ_ONESHOT)
+
+struct EQueue_;
+typedef struct EQItem_
+{
+	/**
+	 * The queue this item is on, the file description being watched, and the descriptor it was
+	 * registered with.
+	 */
+	struct EQueue_*				eq;
+	File*					fp;
+	int					fd;
+	
+	/**
+	 * POLL_* and EQ_* flags, and user data, as passed to sys_eqctl().
+	 */
+	int					events;
+	uint64_t				udata;
+	
+	/**
+	 * Semaphores (indexed by PEI_*) which signal the events of interest (NULL if none), and the
+	 * watches on them. 'watched' is a bitmap of which watches are active.
+	 */
+	Semaphore*				sems[EQ_NUM_WATCH];
+	SemWatch				watches[EQ_NUM_WATCH];
+	int					watched;
+	
+	/**
+	 * Protected by the queue lock: whether the item is on the ready list, and whether it has been
+	 * disabled by EQ_ONESHOT.
+	 */
+	int					onReady;
+	int					disabled;
+	
+	/**
+	 * Links in the queue's hash table and in the file's list (protected by the registry lock), and in
+	 * the ready list (protected by the queue lock).
+	 */
+	struct EQItem_*				prev;
+	struct EQItem_*				next;
+	struct EQItem_*				fprev;
+	struct EQItem_*				fnext;
+	struct EQItem_*				rprev;
+	struct EQItem_*				rnext;
+} EQItem;
+
+typedef struct EQWaiter_
+{
+	Thread*					thread;
+	int					wake;
+	struct EQWaiter_*			prev;
+	struct EQWaiter_*			next;
+} EQWaiter;
+
+typedef struct EQueue_
+{
+	/**
+	 * Protects the ready list, the readiness state of items, and the waiters. It is taken with
+	 * interrupts disabled, and after the lock of any watched semaphore.
+	 */
+	Spinlock				lock;
+	EQItem*					readyFirst;
+	EQItem*					readyLast;
+	EQWaiter*				waitFirst;
+	EQWaiter*				waitLast;
+	
+	/**
+	 * All items, hashed by file descriptor. Protected by the registry lock.
+	 */
+	EQItem*					buckets[EQ_HASH_SIZE];
+} EQueue;
+
+/**
+ * The registry lock. Protects the set of items on every queue and every file, so that registering, removing, the
+ * closing of a watched file, and the destruction of a queue, are all serialized.
+ */
+static Mutex eqRegLock;
+
+static void eqFree(Inode *inode);
+
+static EQueue* eqGet(File *fp)
+{
+	if (fp->iref.inode->free != eqFree) return NULL;
+	return (EQueue*) fp->iref.inode->fsdata;
+};
+
+static int eqItemLevel(EQItem *item)
+{
+	int level = 0;
+	int i;
+	for (i=0; i<EQ_NUM_WATCH; i++)
+	{
+		if (item->sems[i] != NULL && item->sems[i]->count != 0)
+		{
+			level |= (1 << i);
+		};
+	};
+	
+	return level;
+};
+
+static void eqReadyAppend(EQueue *eq, EQItem *item)
+{
+	item->onReady = 1;
+	item->rnext = NULL;
+	item->rprev = eq->readyLast;
+	if (eq->readyLast == NULL) eq->readyFirst = item;
+	else eq->readyLast->rnext = item;
+	eq->readyLast = item;
+};
+
+static void eqReadyRemove(EQueue *eq, EQItem *item)
+{
+	if (item->rprev == NULL) eq->readyFirst = item->rnext;
+	else item->rprev->rnext = item->rnext;
+	if (item->rnext == NULL) eq->readyLast = item->rprev;
+	else item->rnext->rprev = item->rprev;
+	item->onReady = 0;
+};
+
+/**
+ * Wake up the first thread waiting on the queue, if any. The queue must be locked.
+ */
+static void eqWakeOne(EQueue *eq)
+{
+	EQWaiter *waiter = eq->waitFirst;
+	if (waiter == NULL) return;
+	
+	eq->waitFirst = waiter->next;
+	if (eq->waitFirst == NULL) eq->waitLast = NULL;
+	else eq->waitFirst->prev = NULL;
+	waiter->wake = 1;
+	
+	lockSched();
+	signalThread(waiter->thread);
+	unlockSched();
+};
+
+/**
+ * Put an item on the ready list (unless it's already there, or disabled). The queue must be locked.
+ */
+static void eqMakeReady(EQueue *eq, EQItem *item)
+{
+	if (item->onReady || item->disabled) return;
+	eqReadyAppend(eq, item);
+	eqWakeOne(eq);
+};
+
+static void eqWatchCallback(SemWatch *watch)
+{
+	EQItem *item = (EQItem*) watch->context;
+	EQueue *eq = item->eq;
+	
+	spinlockAcquire(&eq->lock);
+	eqMakeReady(eq, item);
+	spinlockRelease(&eq->lock);
+};
+
+/**
+ * Start watching the semaphores of an item, and queue it if it's already ready. The registry must be locked.
+ */
+static void eqArm(EQItem *item)
+{
+	Semaphore *sems[8];
+	memset(sems, 0, sizeof(sems));
+	item->fp->iref.inode->pollinfo(item->fp->iref.inode, item->fp, sems);
+	
+	// errors and hangups are always reported
+	int interest = item->events | POLL_ERROR | POLL_HANGUP;
+	
+	int i;
+	for (i=0; i<EQ_NUM_WATCH; i++)
+	{
+		item->sems[i] = NULL;
+		if (interest & (1 << i))
+		{
+			item->sems[i] = sems[i];
+		};
+		
+		// the constant semaphore never changes, so there's no point watching it
+		if (item->sems[i] != NULL && item->sems[i] != vfsGetConstSem())
+		{
+			item->watches[i].callback = eqWatchCallback;
+			item->watches[i].context = item;
+			semWatch(item->sems[i], &item->watches[i]);
+			item->watched |= (1 << i);
+		};
+	};
+	
+	// check the current state only after the watches are in place, so no transition is missed
+	cli();
+	spinlockAcquire(&item->eq->lock);
+	item->disabled = 0;
+	if (eqItemLevel(item) != 0) eqMakeReady(item->eq, item);
+	spinlockRelease(&item->eq->lock);
+	sti();
+};
+
+/**
+ * Stop watching the semaphores of an item, and take it off the ready list. The registry must be locked.
+ */
+static void eqDisarm(EQItem *item)
+{
+	int i;
+	for (i=0; i<EQ_NUM_WATCH; i++)
+	{
+		if (item->watched & (1 << i))
+		{
+			semUnwatch(&item->watches[i]);
+		};
+	};
+	
+	item->watched = 0;
+	
+	cli();
+	spinlockAcquire(&item->eq->lock);
+	if (item->onReady) eqReadyRemove(item->eq, item);
+	spinlockRelease(&item->eq->lock);
+	sti();
+};
+
+static EQItem* eqFind(EQueue *eq, int fd, File *fp)
+{
+	EQItem *item;
+	for (item=eq->buckets[fd % EQ_HASH_SIZE]; item!=NULL; item=item->next)
+	{
+		if (item->fd == fd && item->fp == fp) return item;
+	};
+	
+	return NULL;
+};
+
+/**
+ * Remove an item from its queue and file, and free it. The registry must be locked.
+ */
+static void eqDetach(EQItem *item)
+{
+	eqDisarm(item);
+	
+	if (item->prev == NULL) item->eq->buckets[item->fd % EQ_HASH_SIZE] = item->next;
+	else item->prev->next = item->next;
+	if (item->next != NULL) item->next->prev = item->prev;
+	
+	if (item->fprev == NULL) item->fp->eqitems = item->fnext;
+	else item->fprev->fnext = item->fnext;
+	if (item->fnext != NULL) item->fnext->fprev = item->fprev;
+	
+	kfree(item);
+};
+
+static int eqAdd(EQueue *eq, int fd, File *fp, int events, uint64_t udata)
+{
+	if (fp->iref.inode->pollinfo == NULL)
+	{
+		return -EPERM;
+	};
+	
+	if (eqGet(fp) != NULL)
+	{
+		// queues cannot be nested
+		return -EINVAL;
+	};
+	
+	mutexLock(&eqRegLock);
+	if (eqFind(eq, fd, fp) != NULL)
+	{
+		mutexUnlock(&eqRegLock);
+		return -EEXIST;
+	};
+	
+	EQItem *item = NEW(EQItem);
+	memset(item, 0, sizeof(EQItem));
+	item->eq = eq;
+	item->fp = fp;
+	item->fd = fd;
+	item->events = events;
+	item->udata = udata;
+	
+	item->next = eq->buckets[fd % EQ_HASH_SIZE];
+	if (item->next != NULL) item->next->prev = item;
+	eq->buckets[fd % EQ_HASH_SIZE] = item;
+	
+	item->fnext = fp->eqitems;
+	if (item->fnext != NULL) item->fnext->fprev = item;
+	fp->eqitems = item;
+	
+	eqArm(item);
+	mutexUnlock(&eqRegLock);
+	return 0;
+};
+
+static int eqModify(EQueue *eq, int fd, File *fp, int events, uint64_t udata)
+{
+	mutexLock(&eqRegLock);
+	EQItem *item = eqFind(eq, fd, fp);
+	if (item == NULL)
+	{
+		mutexUnlock(&eqRegLock);
+		return -ENOENT;
+	};
+	
+	eqDisarm(item);
+	item->events = events;
+	item->udata = udata;
+	eqArm(item);
+	
+	mutexUnlock(&eqRegLock);
+	return 0;
+};
+
+static int eqDelete(EQueue *eq, int fd, File *fp)
+{
+	mutexLock(&eqRegLock);
+	EQItem *item = eqFind(eq, fd, fp);
+	if (item == NULL)
+	{
+		mutexUnlock(&eqRegLock);
+		return -ENOENT;
+	};
+	
+	eqDetach(item);
+	mutexUnlock(&eqRegLock);
+	return 0;
+};
+
+/**
+ * Take up to 'max' events off the ready list. Level-triggered items which are still ready go back to the end of
+ * the list; items which turn out not to be ready anymore are dropped (they are queued again when one of their
+ * semaphores is signalled). The queue must be locked.
+ */
+static int eqHarvest(EQueue *eq, EQEvent *out, int max)
+{
+	EQItem *keepFirst = NULL;
+	EQItem *keepLast = NULL;
+	int count = 0;
+	
+	while (eq->readyFirst != NULL && count < max)
+	{
+		EQItem *item = eq->readyFirst;
+		eqReadyRemove(eq, item);
+		
+		int level = eqItemLevel(item);
+		if (level == 0) continue;
+		
+		out[count].udata = item->udata;
+		out[count].fd = item->fd;
+		out[count].events = level;
+		count++;
+		
+		if (item->events & EQ_ONESHOT)
+		{
+			item->disabled = 1;
+		}
+		else if ((item->events & EQ_EDGE) == 0)
+		{
+			item->onReady = 1;
+			item->rprev = keepLast;
+			item->rnext = NULL;
+			if (keepLast == NULL) keepFirst = item;
+			else keepLast->rnext = item;
+			keepLast = item;
+		};
+	};
+	
+	if (keepFirst != NULL)
+	{
+		keepFirst->rprev = eq->readyLast;
+		if (eq->readyLast == NULL) eq->readyFirst = keepFirst;
+		else eq->readyLast->rnext = keepFirst;
+		eq->readyLast = keepLast;
+	};
+	
+	return count;
+};
+
+static int eqWait(EQueue *eq, EQEvent *out, int max, int flags, uint64_t nanotimeout)
+{
+	uint64_t deadline = 0;
+	if (nanotimeout != 0)
+	{
+		deadline = getNanotime() + nanotimeout;
+	};
+	
+	cli();
+	spinlockAcquire(&eq->lock);
+	
+	int result;
+	while (1)
+	{
+		result = eqHarvest(eq, out, max);
+		if (result != 0 || (flags & SEM_W_NONBLOCK)) break;
+		
+		EQWaiter waiter;
+		waiter.thread = getCurrentThread();
+		waiter.wake = 0;
+		waiter.next = NULL;
+		waiter.prev = eq->waitLast;
+		if (eq->waitLast == NULL) eq->waitFirst = &waiter;
+		else eq->waitLast->next = &waiter;
+		eq->waitLast = &waiter;
+		
+		lockSched();
+		TimedEvent ev;
+		timedPost(&ev, deadline);
+		
+		while (!waiter.wake)
+		{
+			if (deadline != 0 && getNanotime() >= deadline)
+			{
+				result = -ETIMEDOUT;
+				break;
+			};
+			
+			if ((flags & SEM_W_INTR) && haveReadySigs(getCurrentThread()))
+			{
+				result = -EINTR;
+				break;
+			};
+			
+			waitThread(getCurrentThread());
+			spinlockRelease(&eq->lock);
+			unlockSched();
+			kyield();
+			
+			cli();
+			spinlockAcquire(&eq->lock);
+			lockSched();
+		};
+		
+		timedCancel(&ev);
+		unlockSched();
+		
+		if (!waiter.wake)
+		{
+			// gave up; the waker would have removed us otherwise
+			if (waiter.prev == NULL) eq->waitFirst = waiter.next;
+			else waiter.prev->next = waiter.next;
+			if (waiter.next == NULL) eq->waitLast = waiter.prev;
+			else waiter.next->prev = waiter.prev;
+			break;
+		};
+	};
+	
+	// if anything is still ready, let the next waiter have a look
+	if (eq->readyFirst != NULL) eqWakeOne(eq);
+	
+	spinlockRelease(&eq->lock);
+	sti();
+	
+	if (result == -ETIMEDOUT) result = 0;
+	return result;
+};
+
+static void eqFree(Inode *inode)
+{
+	EQueue *eq = (EQueue*) inode->fsdata;
+	
+	mutexLock(&eqRegLock);
+	int i;
+	for (i=0; i<EQ_HASH_SIZE; i++)
+	{
+		while (eq->buckets[i] != NULL)
+		{
+			eqDetach(eq->buckets[i]);
+		};
+	};
+	mutexUnlock(&eqRegLock);
+	
+	kfree(eq);
+};
+
+void equeueFileClosed(File *fp)
+{
+	mutexLock(&eqRegLock);
+	while (fp->eqitems != NULL)
+	{
+		eqDetach(fp->eqitems);
+	};
+	mutexUnlock(&eqRegLock);
+};
+
+int sys_eqcreate(int flags)
+{
+	if ((flags & ~O_CLOEXEC) != 0)
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	int fd = ftabAlloc(getCurrentThread()->ftab);
+	if (fd == -1)
+	{
+		ERRNO = EMFILE;
+		return -1;
+	};
+	
+	EQueue *eq = NEW(EQueue);
+	memset(eq, 0, sizeof(EQueue));
+	
+	Inode *inode = vfsCreateInode(NULL, VFS_MODE_FIFO | 0600);
+	inode->fsdata = eq;
+	inode->free = eqFree;
+	
+	InodeRef iref;
+	iref.top = NULL;
+	iref.inode = inode;
+	
+	File *fp = vfsOpenInode(iref, O_RDWR, NULL);	/* cannot fail since the inode doesn't implement open() */
+	
+	// O_CLOEXEC == FD_CLOEXEC
+	ftabSet(getCurrentThread()->ftab, fd, fp, flags & O_CLOEXEC);
+	return fd;
+};
+
+int sys_eqctl(int eqfd, int op, int fd, int events, uint64_t udata)
+{
+	if ((events & ~EQ_EVENTS_MASK) != 0)
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	File *eqfp = ftabGet(getCurrentThread()->ftab, eqfd);
+	if (eqfp == NULL)
+	{
+		ERRNO = EBADF;
+		return -1;
+	};
+	
+	EQueue *eq = eqGet(eqfp);
+	if (eq == NULL)
+	{
+		vfsClose(eqfp);
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	File *fp = ftabGet(getCurrentThread()->ftab, fd);
+	if (fp == NULL)
+	{
+		vfsClose(eqfp);
+		ERRNO = EBADF;
+		return -1;
+	};
+	
+	int status;
+	switch (op)
+	{
+	case EQ_ADD:
+		status = eqAdd(eq, fd, fp, events, udata);
+		break;
+	case EQ_MOD:
+		status = eqModify(eq, fd, fp, events, udata);
+		break;
+	case EQ_DEL:
+		status = eqDelete(eq, fd, fp);
+		break;
+	default:
+		status = -EINVAL;
+		break;
+	};
+	
+	vfsClose(fp);
+	vfsClose(eqfp);
+	
+	if (status != 0)
+	{
+		ERRNO = -status;
+		return -1;
+	};
+	
+	return 0;
+};
+
+int sys_eqwait(int eqfd, EQEvent *uevents, int max, int flags, uint64_t nanotimeout)
+{
+	if (max <= 0)
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	if (max > EQ_MAX_EVENTS)
+	{
+		max = EQ_MAX_EVENTS;
+	};
+	
+	File *eqfp = ftabGet(getCurrentThread()->ftab, eqfd);
+	if (eqfp == NULL)
+	{
+		ERRNO = EBADF;
+		return -1;
+	};
+	
+	EQueue *eq = eqGet(eqfp);
+	if (eq == NULL)
+	{
+		vfsClose(eqfp);
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	EQEvent *events = (EQEvent*) kmalloc(sizeof(EQEvent) * max);
+	int count = eqWait(eq, events, max, SEM_W_FILE(flags), nanotimeout);
+	vfsClose(eqfp);
+	
+	if (count < 0)
+	{
+		kfree(events);
+		ERRNO = -count;
+		return -1;
+	};
+	
+	if (memcpy_k2u(uevents, events, sizeof(EQEvent) * count) != 0)
+	{
+		kfree(events);
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	kfree(events);
+	return count;
+};
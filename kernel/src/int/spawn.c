@@ -0,0 +1,318 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <glidix/int/spawn.h>
+#include <glidix/int/syscall.h>
+#include <glidix/int/elf64.h>
+#include <glidix/thread/sched.h>
+#include <glidix/thread/ftab.h>
+#include <glidix/thread/signal.h>
+#include <glidix/fs/vfs.h>
+#include <glidix/term/term.h>
+#include <glidix/util/memory.h>
+#include <glidix/util/string.h>
+#include <glidix/util/errno.h>
+
+static void spawnFree(SpawnInfo *info)
+{
+	kfree(info->actions);
+	kfree(info->paths);
+	kfree(info);
+};
+
+/**
+ * Copy a spawn request from userspace into 'info'. Returns 0 on success, or an errno value.
+ */
+static int spawnCopyIn(SpawnInfo *info, const char *upath, const char *upars, size_t parsz,
+			const SpawnAction *uacts, int nacts, const SpawnAttr *uattr)
+{
+	if (strcpy_u2k(info->path, upath) != 0)
+	{
+		return EFAULT;
+	};
+	
+	if (parsz > sizeof(info->pars))
+	{
+		return EOVERFLOW;
+	};
+	
+	if (memcpy_u2k(info->pars, upars, parsz) != 0)
+	{
+		return EFAULT;
+	};
+	
+	info->parsz = parsz;
+	
+	if (uattr != NULL)
+	{
+		if (memcpy_u2k(&info->attr, uattr, sizeof(SpawnAttr)) != 0)
+		{
+			return EFAULT;
+		};
+		
+		if ((info->attr.flags & SPAWN_ALL) != info->attr.flags)
+		{
+			return EINVAL;
+		};
+	};
+	
+	if ((nacts < 0) || (nacts > SPAWN_MAX_ACTIONS))
+	{
+		return EINVAL;
+	};
+	
+	if (nacts == 0)
+	{
+		return 0;
+	};
+	
+	info->actions = (SpawnAction*) kmalloc(sizeof(SpawnAction) * nacts);
+	info->numActions = nacts;
+	if (memcpy_u2k(info->actions, uacts, sizeof(SpawnAction) * nacts) != 0)
+	{
+		return EFAULT;
+	};
+	
+	int numOpens = 0;
+	int i;
+	for (i=0; i<nacts; i++)
+	{
+		if (info->actions[i].type == SPAWN_OPEN) numOpens++;
+	};
+	
+	if (numOpens != 0)
+	{
+		info->paths = (char*) kmalloc(USER_STRING_MAX * numOpens);
+	};
+	
+	char *put = info->paths;
+	for (i=0; i<nacts; i++)
+	{
+		SpawnAction *act = &info->actions[i];
+		if (act->type == SPAWN_OPEN)
+		{
+			if ((act->oflag & O_ALL) != act->oflag)
+			{
+				return EINVAL;
+			};
+			
+			if ((act->oflag & O_RDWR) == 0)
+			{
+				return EINVAL;
+			};
+			
+			if (strcpy_u2k(put, act->path) != 0)
+			{
+				return EFAULT;
+			};
+			
+			act->path = put;
+			put += USER_STRING_MAX;
+		}
+		else if ((act->type == SPAWN_CLOSE) || (act->type == SPAWN_DUP2))
+		{
+			act->path = NULL;
+		}
+		else
+		{
+			return EINVAL;
+		};
+		
+		if ((act->fd < 0) || ((act->type == SPAWN_DUP2) && (act->newfd < 0)))
+		{
+			return EBADF;
+		};
+	};
+	
+	return 0;
+};
+
+/**
+ * Apply the attributes and file actions of a spawn request to the calling (child) process.
+ * Returns 0 on success, or an errno value.
+ */
+static int spawnSetup(SpawnInfo *info)
+{
+	Thread *me = getCurrentThread();
+	SpawnAttr *attr = &info->attr;
+	
+	if (attr->flags & SPAWN_SETSID)
+	{
+		if (sys_setsid() == -1) return ERRNO;
+	};
+	
+	if (attr->flags & SPAWN_SETPGROUP)
+	{
+		if (sys_setpgid(0, attr->pgroup) == -1) return ERRNO;
+	};
+	
+	if (attr->flags & SPAWN_TCSETPGROUP)
+	{
+		// become the foreground group before the new image gets a chance to read the terminal
+		File *fp = ftabGet(me->ftab, attr->tcfd);
+		if (fp == NULL) return EBADF;
+		
+		int pgid = me->creds->pgid;
+		int status = -1;
+		ERRNO = ENOTTY;
+		if (fp->iref.inode->ioctl != NULL)
+		{
+			status = fp->iref.inode->ioctl(fp->iref.inode, fp, IOCTL_TTY_SETPGID, &pgid);
+		};
+		
+		vfsClose(fp);
+		if (status != 0) return ERRNO;
+	};
+	
+	if (attr->flags & SPAWN_SETSIGDEF)
+	{
+		// the disposition table was created for us by threadClone(), so nobody else sees it
+		int sig;
+		for (sig=1; sig<SIG_NUM; sig++)
+		{
+			if (attr->sigdefault & (1UL << sig))
+			{
+				me->sigdisp->actions[sig].sa_handler = SIG_DFL;
+			};
+		};
+	};
+	
+	if (attr->flags & SPAWN_RESETIDS)
+	{
+		me->creds->euid = me->creds->ruid;
+		me->creds->egid = me->creds->rgid;
+	};
+	
+	int i;
+	for (i=0; i<info->numActions; i++)
+	{
+		SpawnAction *act = &info->actions[i];
+		int error = 0;
+		
+		if (act->type == SPAWN_OPEN)
+		{
+			mode_t mode = act->mode & 0x0FFF & ~(me->creds->umask);
+			File *fp = vfsOpen(VFS_NULL_IREF, act->path, act->oflag, mode, &error);
+			if (fp != NULL)
+			{
+				error = ftabPut(me->ftab, act->fd, fp, act->oflag & O_CLOEXEC);
+				if (error != 0) vfsClose(fp);
+			};
+		}
+		else if (act->type == SPAWN_CLOSE)
+		{
+			// closing a descriptor which is not open is not an error here
+			error = ftabClose(me->ftab, act->fd);
+			if (error == EBADF) error = 0;
+		}
+		else
+		{
+			// a dup2() onto itself just clears FD_CLOEXEC, which ftabPut() does for us
+			File *fp = ftabGet(me->ftab, act->fd);
+			if (fp == NULL)
+			{
+				error = EBADF;
+			}
+			else
+			{
+				error = ftabPut(me->ftab, act->newfd, fp, 0);
+				if (error != 0) vfsClose(fp);
+			};
+		};
+		
+		if (error != 0) return error;
+	};
+	
+	return 0;
+};
+
+/**
+ * Entry point of the child, in kernel mode and without an address space. The parent is blocked until
+ * we call vforkRelease(), either from elfExec() once the new image has its address space, or below if
+ * anything fails; 'info' must not be touched after that.
+ */
+static void spawnStart(SpawnInfo *info)
+{
+	char path[USER_STRING_MAX];
+	char pars[4096];
+	size_t parsz = info->parsz;
+	strcpy(path, info->path);
+	memcpy(pars, info->pars, parsz);
+	
+	int error = spawnSetup(info);
+	if (error == 0)
+	{
+		// only returns on error
+		elfExec(path, pars, parsz);
+		error = ERRNO;
+	};
+	
+	info->error = error;
+	vforkRelease();
+	processExit(WS_EXIT(127));
+};
+
+int sys_spawn(const char *upath, const char *upars, size_t parsz, const SpawnAction *uacts, int nacts,
+		const SpawnAttr *uattr)
+{
+	SpawnInfo *info = NEW(SpawnInfo);
+	memset(info, 0, sizeof(SpawnInfo));
+	
+	int error = spawnCopyIn(info, upath, upars, parsz, uacts, nacts, uattr);
+	if (error != 0)
+	{
+		spawnFree(info);
+		ERRNO = error;
+		return -1;
+	};
+	
+	Regs regs;
+	memset(&regs, 0, sizeof(Regs));
+	switchToKernelSpace(&regs);
+	regs.rip = (uint64_t) &spawnStart;
+	regs.rdi = (uint64_t) info;
+	
+	Thread *me = getCurrentThread();
+	semInit2(&me->vforkWait, 0);
+	int pid = threadClone(&regs, CLONE_SPAWN, NULL);
+	semWait(&me->vforkWait);
+	
+	error = info->error;
+	spawnFree(info);
+	
+	if (error != 0)
+	{
+		int status;
+		processWait(pid, &status, 0);
+		ERRNO = error;
+		return -1;
+	};
+	
+	return pid;
+};
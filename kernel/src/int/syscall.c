@@ -47,7 +47,6 @@
 #include <glidix/net/socket.h>
 #include <glidix/hw/pci.h>
 #include <glidix/util/utsname.h>
-#include <glidix/util/catch.h>
 #include <glidix/storage/storage.h>
 #include <glidix/hw/cpu.h>
 #include <glidix/thread/pageinfo.h>
@@ -56,17 +55,25 @@
 #include <glidix/int/trace.h>
 #include <glidix/fs/procfs.h>
 #include <glidix/usb/usb.h>
+#include <glidix/thread/futex.h>
+#include <glidix/int/equeue.h>
+#include <glidix/int/spawn.h>
 
 /**
  * Options for _glidix_kopt().
  */
 #define	_GLIDIX_KOPT_GFXTERM		0		/* whether the graphics terminal is enabled */
+#define	_GLIDIX_KOPT_LOCKSTAT		1		/* whether lock statistics are collected (/proc/lockstat) */
 
 /**
  * A macro to use in the system call table for unused numbers.
  */
 #define	SYS_NULL					&sysInvalid
 
+/* usercopy.asm */
+int __copyUser(void *dst, const void *src, size_t size);
+int __strcpyUser(char *dst, const char *src, size_t max);
+
 int memcpy_u2k(void *dst_, const void *src_, size_t size)
 {
 	// user to kernel: src is in userspace
@@ -90,17 +97,7 @@ int memcpy_u2k(void *dst_, const void *src_, size_t size)
 		return -1;
 	};
 	
-	int ex = catch();
-	if (ex == 0)
-	{
-		memcpy(dst_, src_, size);
-		uncatch();
-		return 0;
-	}
-	else
-	{
-		return -1;
-	};
+	return __copyUser(dst_, src_, size);
 };
 
 int memcpy_k2u(void *dst_, const void *src_, size_t size)
@@ -126,50 +123,23 @@ int memcpy_k2u(void *dst_, const void *src_, size_t size)
 		return -1;
 	};
 	
-	int ex = catch();
-	if (ex == 0)
-	{
-		memcpy(dst_, src_, size);
-		uncatch();
-		return 0;
-	}
-	else
-	{
-		return -1;
-	};
+	return __copyUser(dst_, src_, size);
 };
 
 int strcpy_u2k(char *dst, const char *src)
 {
 	// src is in userspace
 	uint64_t addr = (uint64_t) src;
-	
-	size_t count = 0;
-	int ex = catch();
-	if (ex == 0)
-	{
-		while (1)
-		{
-			if (addr >= ADDR_MAX)
-			{
-				return -1;
-			};
-		
-			if (count == (USER_STRING_MAX-1))
-			{
-				return -1;
-			};
-		
-			char c = *((char*)addr);
-			addr++;
-			*dst++ = c;
-			if (c == 0) return 0;
-		};
-	}
-	else
+	if ((addr < ADDR_MIN) || (addr >= ADDR_MAX))
 	{
 		return -1;
 	};
+	
+	// do not read past the end of userspace
+	size_t max = USER_STRING_MAX;
+	if ((ADDR_MAX - addr) < max) max = ADDR_MAX - addr;
+	
+	return __strcpyUser(dst, src, max);
 };
 
 void sys_exit(int status)
@@ -1361,6 +1331,124 @@ ssize_t sys_recvfrom(int fd, void *umessage, size_t len, int flags, struct socka
 	return out;
 };
 
+ssize_t sys_sendmsg(int fd, const void *umessage, size_t len, int flags, const int *ufds, int numfds)
+{
+	if ((numfds < 0) || (numfds > SOCK_MAX_FDS))
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	int fds[SOCK_MAX_FDS];
+	if (memcpy_u2k(fds, ufds, sizeof(int) * numfds) != 0)
+	{
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	void *message = kmalloc(len);
+	if (memcpy_u2k(message, umessage, len) != 0)
+	{
+		kfree(message);
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	File *fp = ftabGet(getCurrentThread()->ftab, fd);
+	if (fp == NULL)
+	{
+		ERRNO = EBADF;
+		kfree(message);
+		return -1;
+	};
+	
+	File *fps[SOCK_MAX_FDS];
+	int i;
+	for (i=0; i<numfds; i++)
+	{
+		fps[i] = ftabGet(getCurrentThread()->ftab, fds[i]);
+		if (fps[i] == NULL)
+		{
+			while (i--) vfsClose(fps[i]);
+			vfsClose(fp);
+			kfree(message);
+			ERRNO = EBADF;
+			return -1;
+		};
+	};
+	
+	ssize_t out = SendmsgSocket(fp, message, len, flags, fps, numfds);
+	if (out == -1)
+	{
+		// the socket only takes over the references on success
+		for (i=0; i<numfds; i++) vfsClose(fps[i]);
+	};
+	
+	vfsClose(fp);
+	kfree(message);
+	return out;
+};
+
+ssize_t sys_recvmsg(int fd, void *umessage, size_t len, int flags, int *ufds, int *unumfds)
+{
+	int capacity;
+	if (memcpy_u2k(&capacity, unumfds, sizeof(int)) != 0)
+	{
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	if (capacity < 0) capacity = 0;
+	if (capacity > SOCK_MAX_FDS) capacity = SOCK_MAX_FDS;
+	
+	File *fp = ftabGet(getCurrentThread()->ftab, fd);
+	if (fp == NULL)
+	{
+		ERRNO = EBADF;
+		return -1;
+	};
+	
+	void *message = kmalloc(len);
+	File *fps[SOCK_MAX_FDS];
+	int numfps = capacity;
+	
+	ssize_t out = RecvmsgSocket(fp, message, len, flags, fps, &numfps);
+	vfsClose(fp);
+	
+	if (out == -1)
+	{
+		kfree(message);
+		return -1;
+	};
+	
+	// install the received descriptions; 'numfps' may exceed the capacity, in which case the excess
+	// descriptions were already closed and the caller sees the truncation
+	int fds[SOCK_MAX_FDS];
+	int i;
+	for (i=0; i<numfps && i<capacity; i++)
+	{
+		fds[i] = ftabAlloc(getCurrentThread()->ftab);
+		if (fds[i] == -1)
+		{
+			vfsClose(fps[i]);
+		}
+		else
+		{
+			ftabSet(getCurrentThread()->ftab, fds[i], fps[i], 0);
+		};
+	};
+	
+	// only copy out what was received; with MSG_TRUNC, 'out' may be larger than the buffer
+	size_t received = (size_t) out;
+	if (received > len) received = len;
+	if (umessage != NULL) memcpy_k2u(umessage, message, received);
+	memcpy_k2u(ufds, fds, sizeof(int) * i);
+	memcpy_k2u(unumfds, &numfps, sizeof(int));
+	
+	kfree(message);
+	return out;
+};
+
 int sys_getsockname(int fd, struct sockaddr *uaddr, size_t *uaddrlenptr)
 {
 	struct sockaddr addr;
@@ -1637,6 +1725,58 @@ int sys_fcntl_setfd(int fd, int flags)
 	return 0;
 };
 
+int sys_getrlimit(int resource, struct rlimit *url)
+{
+	struct rlimit rl;
+	if (resource == RLIMIT_NOFILE)
+	{
+		ftabGetLimit(getCurrentThread()->ftab, &rl);
+	}
+	else if ((resource >= 0) && (resource <= RLIMIT_AS))
+	{
+		rl.rlim_cur = RLIM_INFINITY;
+		rl.rlim_max = RLIM_INFINITY;
+	}
+	else
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	if (memcpy_k2u(url, &rl, sizeof(struct rlimit)) != 0)
+	{
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	return 0;
+};
+
+int sys_setrlimit(int resource, const struct rlimit *url)
+{
+	struct rlimit rl;
+	if (memcpy_u2k(&rl, url, sizeof(struct rlimit)) != 0)
+	{
+		ERRNO = EFAULT;
+		return -1;
+	};
+	
+	if (resource != RLIMIT_NOFILE)
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	int error = ftabSetLimit(getCurrentThread()->ftab, &rl);
+	if (error != 0)
+	{
+		ERRNO = error;
+		return -1;
+	};
+	
+	return 0;
+};
+
 int sys_bindif(int fd, const char *uifname)
 {
 	char ifname[USER_STRING_MAX];
@@ -1660,89 +1800,60 @@ int sys_bindif(int fd, const char *uifname)
 
 uint64_t sys_block_on(uint64_t addr, uint64_t expectedVal)
 {
-	// check alignment
-	if (addr & 0x7)
-	{
-		// not 8-byte-aligned
-		return EINVAL;
-	};
-	
-	uint64_t frame = vmGetPhys(addr, PROT_READ);
-	if (frame == 0)
+	int status = futexWait(addr, expectedVal, 0, 0);
+	if ((status == -EINVAL) || (status == -EFAULT))
 	{
-		return EFAULT;
+		return -status;
 	};
 	
-	uint64_t offset = addr & 0xFFF;
-	uint64_t oldFrame = mapTempFrame(frame);
-	
-	uint64_t physAddr = (frame << 12) | offset;
-	uint64_t *ptr = (uint64_t*) tmpframe() + (offset >> 3);
-	
-	cli();
-	lockSched();
-	
-	if ((*ptr) != expectedVal)
+	// spurious wakeups are allowed, so all other outcomes look the same to the caller
+	return 0;
+};
+
+uint64_t sys_unblock(uint64_t addr)
+{
+	int status = futexWake(addr, FUTEX_ALL, 0);
+	if (status < 0)
 	{
-		unlockSched();
-		sti();
-		mapTempFrame(oldFrame);
-		piDecref(frame);
-		return 0;
+		return -status;
 	};
 	
-	getCurrentThread()->blockPhys = physAddr;
-	waitThread(getCurrentThread());
-	unlockSched();
-	kyield();
-
-	getCurrentThread()->blockPhys = 0;
-	mapTempFrame(oldFrame);
-	piDecref(frame);
 	return 0;
 };
 
-uint64_t sys_unblock(uint64_t addr)
+int sys_futex(uint64_t addr, int op, uint64_t val, uint64_t arg, uint64_t addr2)
 {
-	// check alignment
-	if (addr & 0x7)
+	int flags = op & ~FUTEX_OP_MASK;
+	if (flags & ~FUTEX_PRIVATE)
 	{
-		// not 8-byte-aligned
-		return EINVAL;
+		ERRNO = EINVAL;
+		return -1;
 	};
 	
-	uint64_t frame = vmGetPhys(addr, PROT_READ);
-	if (frame == 0)
+	int status;
+	switch (op & FUTEX_OP_MASK)
 	{
-		return EFAULT;
+	case FUTEX_WAIT:
+		status = futexWait(addr, val, arg, flags);
+		break;
+	case FUTEX_WAKE:
+		status = futexWake(addr, (int) val, flags);
+		break;
+	case FUTEX_REQUEUE:
+		status = futexRequeue(addr, (int) val, addr2, (int) arg, flags);
+		break;
+	default:
+		status = -EINVAL;
+		break;
 	};
 	
-	uint64_t offset = addr & 0xFFF;	
-	uint64_t physAddr = (frame << 12) | offset;
-	
-	cli();
-	lockSched();
-	
-	Thread *ct = getCurrentThread();
-	Thread *thread = ct;
-	int shouldResched = 0;
-	do
+	if (status < 0)
 	{
-		if (thread->blockPhys == physAddr)
-		{
-			thread->blockPhys = 0;
-			shouldResched |= signalThread(thread);
-		};
-		
-		thread = thread->next;
-	} while (thread != ct);
+		ERRNO = -status;
+		return -1;
+	};
 	
-	unlockSched();
-	if (shouldResched) kyield();
-	sti();
-
-	piDecref(frame);
-	return 0;
+	return status;
 };
 
 void sysInvalid()
@@ -2010,6 +2121,46 @@ int sys_mprotect(uint64_t base, size_t len, int prot)
 	};
 };
 
+int sys_vfork(uint64_t retaddr)
+{
+	Thread *me = getCurrentThread();
+	Regs regs;
+	initUserRegs(&regs);
+	regs.rbx = me->urbx;
+	regs.rbp = me->urbp;
+	regs.r12 = me->ur12;
+	regs.r13 = me->ur13;
+	regs.r14 = me->ur14;
+	regs.r15 = me->ur15;
+	regs.rflags = getFlagsRegister();
+	regs.fsbase = msrRead(MSR_FS_BASE);
+	regs.gsbase = msrRead(MSR_GS_BASE);
+	
+	// the libc stub has popped its return address off the stack (which the child may
+	// overwrite), so the child returns to it directly
+	regs.rsp = me->ursp;
+	regs.rip = retaddr;
+	
+	semInit2(&me->vforkWait, 0);
+	int pid = threadClone(&regs, CLONE_VFORK, NULL);
+	semWait(&me->vforkWait);
+	return pid;
+};
+
+int sys_madvise(uint64_t base, size_t len, int advice)
+{
+	int status = vmAdvise(base, len, advice);
+	if (status == 0)
+	{
+		return 0;
+	}
+	else
+	{
+		ERRNO = status;
+		return -1;
+	};
+};
+
 int sys_fork()
 {	
 	Thread *me = getCurrentThread();
@@ -2590,6 +2741,11 @@ int sys_kopt(int option, int value)
 		setGfxTerm(value);
 		return 0;
 	}
+	else if (option == _GLIDIX_KOPT_LOCKSTAT)
+	{
+		mutexSetStats(value);
+		return 0;
+	}
 	else
 	{
 		ERRNO = EINVAL;
@@ -2729,61 +2885,73 @@ int sys_mcast(int fd, int op, uint32_t scope, uint64_t addr0, uint64_t addr1)
 	return out;
 };
 
-int sys_fpoll(const uint8_t *ubitmapReq, uint8_t *ubitmapRes, int flags, uint64_t nanotimeout)
+int sys_fpoll(const uint8_t *ubitmapReq, uint8_t *ubitmapRes, int flags, uint64_t nanotimeout, int nfds)
 {
-	uint8_t bitmapReq[MAX_OPEN_FILES];
-	uint8_t bitmapRes[MAX_OPEN_FILES];
+	if ((nfds < 0) || (nfds > FTAB_MAX_FILES))
+	{
+		ERRNO = EINVAL;
+		return -1;
+	};
 	
-	if (memcpy_u2k(bitmapReq, ubitmapReq, MAX_OPEN_FILES) != 0)
+	uint8_t *bitmapReq = (uint8_t*) kmalloc(nfds + 1);
+	if (memcpy_u2k(bitmapReq, ubitmapReq, nfds) != 0)
 	{
+		kfree(bitmapReq);
 		ERRNO = EFAULT;
 		return -1;
 	};
 	
-	memset(bitmapRes, 0, MAX_OPEN_FILES);
-	
-	Semaphore *sems[MAX_OPEN_FILES*8];
-	memset(sems, 0, MAX_OPEN_FILES*8*sizeof(void*));
+	// only build the semaphore array for the descriptors actually requested; index 'n' in the
+	// compact arrays corresponds to descriptor fds[n]
+	int numReq = 0;
+	int i;
+	for (i=0; i<nfds; i++)
+	{
+		if (bitmapReq[i] != 0) numReq++;
+	};
 	
-	File* workingFiles[MAX_OPEN_FILES];
-	memset(workingFiles, 0, MAX_OPEN_FILES*sizeof(File*));
+	int *fds = (int*) kmalloc(sizeof(int) * numReq + 1);
+	File **workingFiles = (File**) kmalloc(sizeof(File*) * numReq + 1);
+	Semaphore **sems = (Semaphore**) kmalloc(sizeof(Semaphore*) * 8 * numReq + 1);
+	uint8_t *bitmapRes = (uint8_t*) kmalloc(numReq + 1);
+	memset(sems, 0, sizeof(Semaphore*) * 8 * numReq);
+	memset(bitmapRes, 0, numReq);
 	
 	// get the file handles
-	int i;
-	for (i=0; i<MAX_OPEN_FILES; i++)
+	int n = 0;
+	for (i=0; i<nfds; i++)
 	{
 		if (bitmapReq[i] != 0)
 		{
-			File *fp = ftabGet(getCurrentThread()->ftab, i);
-			if (fp == NULL)
+			fds[n] = i;
+			workingFiles[n] = ftabGet(getCurrentThread()->ftab, i);
+			if (workingFiles[n] == NULL)
 			{
-				sems[8*i+PEI_INVALID] = vfsGetConstSem();
-			}
-			else
-			{
-				workingFiles[i] = fp;
+				sems[8*n+PEI_INVALID] = vfsGetConstSem();
 			};
+			
+			n++;
 		};
 	};
 
 	// ask all files for their poll information.
-	for (i=0; i<MAX_OPEN_FILES; i++)
+	for (n=0; n<numReq; n++)
 	{
-		if (workingFiles[i] != NULL)
+		if (workingFiles[n] != NULL)
 		{
-			if (workingFiles[i]->iref.inode->pollinfo != NULL)
+			if (workingFiles[n]->iref.inode->pollinfo != NULL)
 			{
-				workingFiles[i]->iref.inode->pollinfo(workingFiles[i]->iref.inode, workingFiles[i], &sems[8*i]);
+				workingFiles[n]->iref.inode->pollinfo(workingFiles[n]->iref.inode, workingFiles[n], &sems[8*n]);
 				
 				// clear the entries which we don't want to occur
-				uint8_t pollFor = bitmapReq[i] | POLL_ERROR | POLL_INVALID | POLL_HANGUP;
+				uint8_t pollFor = bitmapReq[fds[n]] | POLL_ERROR | POLL_INVALID | POLL_HANGUP;
 				
 				int j;
 				for (j=0; j<8; j++)
 				{
 					if ((pollFor & (1 << j)) == 0)
 					{
-						sems[8*i+j] = NULL;
+						sems[8*n+j] = NULL;
 					};
 				};
 			};
@@ -2791,30 +2959,45 @@ int sys_fpoll(const uint8_t *ubitmapReq, uint8_t *ubitmapRes, int flags, uint64_
 	};
 	
 	// wait for something to happen
-	int numFreeSems = semPoll(8*MAX_OPEN_FILES, sems, bitmapRes, SEM_W_FILE(flags), nanotimeout);
+	int numFreeSems = semPoll(8*numReq, sems, bitmapRes, SEM_W_FILE(flags), nanotimeout);
 	
 	// remove our references to the files
-	for (i=0; i<MAX_OPEN_FILES; i++)
+	for (n=0; n<numReq; n++)
 	{
-		if (workingFiles[i] != NULL)
+		if (workingFiles[n] != NULL)
 		{
-			vfsClose(workingFiles[i]);
+			vfsClose(workingFiles[n]);
 		};
 	};
 	
+	// scatter the results back into the full bitmap
+	memset(bitmapReq, 0, nfds);
+	for (n=0; n<numReq; n++)
+	{
+		bitmapReq[fds[n]] = bitmapRes[n];
+	};
+	
+	kfree(fds);
+	kfree(workingFiles);
+	kfree(sems);
+	kfree(bitmapRes);
+	
 	// see if an error occured
 	if (numFreeSems < 0)
 	{
+		kfree(bitmapReq);
 		ERRNO = -numFreeSems;
 		return -1;
 	};
 	
-	if (memcpy_k2u(ubitmapRes, bitmapRes, MAX_OPEN_FILES) != 0)
+	if (memcpy_k2u(ubitmapRes, bitmapReq, nfds) != 0)
 	{
+		kfree(bitmapReq);
 		ERRNO = EFAULT;
 		return -1;
 	};
 	
+	kfree(bitmapReq);
 	return numFreeSems;
 };
 
@@ -2961,6 +3144,11 @@ int sys_routetable(uint64_t family)
 	return sysRouteTable(family);
 };
 
+int sys_neightab()
+{
+	return sysNeighborTable();
+};
+
 int sys_systat(void *buffer, size_t sz)
 {
 	SystemState sst;
@@ -2968,6 +3156,12 @@ int sys_systat(void *buffer, size_t sz)
 	sst.sst_frames_total = phmTotalFrames;
 	sst.sst_frames_used = phmUsedFrames;
 	sst.sst_frames_cached = phmCachedFrames;
+	sst.sst_ticks_avoided = schedTicksAvoided();
+	sst.sst_shootdowns = vmShootdownCount();
+	sst.sst_shootdown_rate = vmShootdownRate();
+	sst.sst_zero_pooled = phmZeroPooled;
+	sst.sst_zero_hits = phmZeroHits;
+	sst.sst_zero_misses = phmZeroMisses;
 	
 	if (sz > sizeof(SystemState))
 	{
@@ -3663,7 +3857,7 @@ int sys_usb_getstr(uint64_t devid, uint8_t index, uint16_t langid, char *ubuffer
  * System call table for fast syscalls, and the number of system calls.
  * Do not use NULL entries! Instead, for unused entries, enter SYS_NULL.
  */
-#define SYSCALL_NUMBER 157
+#define SYSCALL_NUMBER 169
 void* sysTable[SYSCALL_NUMBER] = {
 	&sys_exit,				// 0
 	&sys_write,				// 1
@@ -3822,6 +4016,18 @@ void* sysTable[SYSCALL_NUMBER] = {
 	&sys_usb_devdesc,			// 154
 	&sys_usb_langids,			// 155
 	&sys_usb_getstr,			// 156
+	&sys_sendmsg,				// 157
+	&sys_recvmsg,				// 158
+	&sys_neightab,				// 159
+	&sys_futex,				// 160
+	&sys_eqcreate,				// 161
+	&sys_eqctl,				// 162
+	&sys_eqwait,				// 163
+	&sys_getrlimit,				// 164
+	&sys_setrlimit,				// 165
+	&sys_madvise,				// 166
+	&sys_vfork,				// 167
+	&sys_spawn,				// 168
 };
 uint64_t sysNumber = SYSCALL_NUMBER;
 
@@ -3831,11 +4037,8 @@ uint64_t sysEpilog(uint64_t retval)
 	{
 		if (getCurrentThread()->errnoptr != NULL)
 		{
-			if (catch() == 0)
-			{
-				*(getCurrentThread()->errnoptr) = ERRNO;
-				uncatch();
-			};
+			int error = ERRNO;
+			memcpy_k2u(getCurrentThread()->errnoptr, &error, sizeof(int));	// ignore error
 		};
 	};
 
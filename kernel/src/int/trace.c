@@ -67,7 +67,7 @@ static int tcGetRegs(int thid, MachineState *state)
 			else
 			{
 				result = 0;
-				memcpy(&state->fpuRegs, &thread->fpuRegs, sizeof(FPURegs));
+				fpuGetLegacy(&state->fpuRegs, thread->fpuRegs);
 				state->rflags = thread->regs.rflags;
 				state->rip = thread->regs.rip;
 				state->rdi = thread->regs.rdi;
@@ -36,6 +36,7 @@
 #include <glidix/net/socket.h>
 #include <glidix/thread/mutex.h>
 #include <glidix/thread/semaphore.h>
+#include <glidix/util/time.h>
 
 #define CRCPOLY2 0xEDB88320UL  /* left-right reversal */
 
@@ -64,57 +65,339 @@ static void etherSendRaw(NetIf *netif, const void *frame, size_t framelen)
 	caddr.scap_family = AF_CAPTURE;
 	strcpy(caddr.scap_ifname, netif->name);
 	onTransportPacket((struct sockaddr*)&caddr, (struct sockaddr*)&caddr, sizeof(struct sockaddr_cap),
-		frame, framelen-4, IF_ETHERNET, netif->name);	// without CRC
+		frame, framelen-4, IF_ETHERNET, netif->name, 0);	// without CRC
 
 	netif->ifconfig.ethernet.send(netif, frame, framelen);
 };
 
-static MacResolution *getMacResolution(NetIf *netif, int family, uint8_t *ip)
+/**
+ * A packet waiting for its next hop to be resolved.
+ */
+typedef struct NeighPending_
 {
-	size_t size = 16;
-	if (family == AF_INET) size = 4;
+	struct NeighPending_*			next;
+	uint16_t				type;
+	int					hasOff;
+	NetOffload				off;
+	size_t					size;
+	uint8_t					packet[];
+} NeighPending;
+
+typedef struct Neighbor_
+{
+	struct Neighbor_*			next;
+	int					family;
+	uint8_t					ip[16];
+	MacAddress				mac;
+	int					state;		/* NEIGH_* */
+	
+	/**
+	 * When the entry was last confirmed (or created, while incomplete; or failed), and last used for sending.
+	 */
+	uint64_t				confirmed;
+	uint64_t				used;
 	
-	semWait(&netif->ifconfig.ethernet.resLock);
-	MacResolution *scan;
-	MacResolution *last = NULL;
-	for (scan=netif->ifconfig.ethernet.res; scan!=NULL; scan=scan->next)
+	/**
+	 * Number of solicitations sent in the current state, and when to send the next one.
+	 */
+	int					probes;
+	uint64_t				nextProbe;
+	
+	/**
+	 * Packets waiting for resolution (NEIGH_INCOMPLETE only).
+	 */
+	NeighPending*				pendFirst;
+	NeighPending*				pendLast;
+	int					numPending;
+} Neighbor;
+
+typedef struct NeighTable_
+{
+	Semaphore				lock;
+	int					count;
+	Neighbor*				buckets[NEIGH_HASH_SIZE];
+} NeighTable;
+
+/**
+ * A solicitation to send once the table is unlocked.
+ */
+typedef struct
+{
+	int					family;
+	uint8_t					ip[16];
+} NeighProbe;
+
+static size_t neighAddrSize(int family)
+{
+	return family == AF_INET ? 4 : 16;
+};
+
+static int neighHash(int family, const uint8_t *ip)
+{
+	uint32_t hash = 0;
+	size_t size = neighAddrSize(family);
+	size_t i;
+	for (i=0; i<size; i+=4)
 	{
-		last = scan;
-		if (scan->family == family)
+		hash ^= *((const uint32_t*)&ip[i]);
+	};
+	
+	// multiplicative hashing; the top bits are the best mixed
+	return (int) ((hash * 0x9E3779B1U) >> 26) & (NEIGH_HASH_SIZE - 1);
+};
+
+static Neighbor** neighFind(NeighTable *table, int family, const uint8_t *ip)
+{
+	Neighbor **link;
+	for (link=&table->buckets[neighHash(family, ip)]; *link!=NULL; link=&(*link)->next)
+	{
+		Neighbor *neigh = *link;
+		if ((neigh->family == family) && (memcmp(neigh->ip, ip, neighAddrSize(family)) == 0))
+		{
+			break;
+		};
+	};
+	
+	return link;
+};
+
+static void neighFreePending(NetIf *netif, NeighPending *pend)
+{
+	while (pend != NULL)
+	{
+		NeighPending *next = pend->next;
+		__sync_fetch_and_add(&netif->numDropped, 1);
+		kfree(pend);
+		pend = next;
+	};
+};
+
+/**
+ * Fail packets which were waiting for a neighbor that never answered: as RFC 4861 (7.2.2) asks, the source of
+ * each one is sent an ICMP destination unreachable error. Must not be called with the table locked.
+ */
+static void neighFailPending(NetIf *netif, NeighPending *pend)
+{
+	while (pend != NULL)
+	{
+		NeighPending *next = pend->next;
+		
+		struct sockaddr_in6 dest;
+		memset(&dest, 0, sizeof(struct sockaddr_in6));
+		if ((pend->type == ETHER_TYPE_IP) && (pend->size >= sizeof(IPHeader4)))
 		{
-			if (memcmp(scan->ip, ip, size) == 0)
+			struct sockaddr_in *dest4 = (struct sockaddr_in*) &dest;
+			dest4->sin_family = AF_INET;
+			memcpy(&dest4->sin_addr, &((IPHeader4*)pend->packet)->saddr, 4);
+		}
+		else if ((pend->type == ETHER_TYPE_IPV6) && (pend->size >= sizeof(IPHeader6)))
+		{
+			dest.sin6_family = AF_INET6;
+			memcpy(&dest.sin6_addr, ((IPHeader6*)pend->packet)->saddr, 16);
+		};
+		
+		if (dest.sin6_family != 0)
+		{
+			struct sockaddr fake_src;
+			fake_src.sa_family = AF_UNSPEC;
+			sendErrorPacket(&fake_src, (struct sockaddr*) &dest, EHOSTUNREACH, pend->packet, pend->size);
+		};
+		
+		__sync_fetch_and_add(&netif->numDropped, 1);
+		kfree(pend);
+		pend = next;
+	};
+};
+
+/**
+ * Remove stale entries which have not been used for at least 'minIdle' nanoseconds. Called with the table locked.
+ */
+static void neighEvict(NeighTable *table, uint64_t now, uint64_t minIdle)
+{
+	int i;
+	for (i=0; i<NEIGH_HASH_SIZE; i++)
+	{
+		Neighbor **link = &table->buckets[i];
+		while (*link != NULL)
+		{
+			Neighbor *neigh = *link;
+			if ((neigh->state == NEIGH_STALE) && ((now - neigh->used) >= minIdle))
+			{
+				*link = neigh->next;
+				table->count--;
+				kfree(neigh);
+			}
+			else
 			{
-				semSignal(&netif->ifconfig.ethernet.resLock);
-				return scan;
+				link = &neigh->next;
 			};
 		};
 	};
+};
+
+/**
+ * Make room for a new entry if the table is full: stale entries go first, and if there are none, the least
+ * recently used entry is dropped (along with any packets waiting for it). Called with the table locked.
+ */
+static void neighMakeRoom(NetIf *netif, NeighTable *table, uint64_t now)
+{
+	if (table->count < NEIGH_MAX_ENTRIES)
+	{
+		return;
+	};
+	
+	neighEvict(table, now, 0);
+	if (table->count < NEIGH_MAX_ENTRIES)
+	{
+		return;
+	};
 	
-	// no resolution yet, create a new one
-	MacResolution *macres = NEW(MacResolution);
-	macres->family = family;
-	memset(macres->ip, 0, 16);
-	memcpy(macres->ip, ip, size);
-	memset(&macres->mac, 0, 6);
-	cvInit(&macres->cond);
-	macres->next = NULL;
+	Neighbor **lruLink = NULL;
+	int i;
+	for (i=0; i<NEIGH_HASH_SIZE; i++)
+	{
+		Neighbor **link;
+		for (link=&table->buckets[i]; *link!=NULL; link=&(*link)->next)
+		{
+			if ((lruLink == NULL) || ((*link)->used < (*lruLink)->used))
+			{
+				lruLink = link;
+			};
+		};
+	};
 	
-	if (last == NULL)
+	if (lruLink != NULL)
 	{
-		netif->ifconfig.ethernet.res = macres;
+		Neighbor *neigh = *lruLink;
+		*lruLink = neigh->next;
+		table->count--;
+		neighFreePending(netif, neigh->pendFirst);
+		kfree(neigh);
+	};
+};
+
+NeighTable* etherCreateNeighbors()
+{
+	NeighTable *table = NEW(NeighTable);
+	memset(table, 0, sizeof(NeighTable));
+	semInit(&table->lock);
+	return table;
+};
+
+void etherDestroyNeighbors(NeighTable *table)
+{
+	int i;
+	for (i=0; i<NEIGH_HASH_SIZE; i++)
+	{
+		Neighbor *neigh = table->buckets[i];
+		while (neigh != NULL)
+		{
+			Neighbor *next = neigh->next;
+			NeighPending *pend = neigh->pendFirst;
+			while (pend != NULL)
+			{
+				NeighPending *nextPend = pend->next;
+				kfree(pend);
+				pend = nextPend;
+			};
+			
+			kfree(neigh);
+			neigh = next;
+		};
+	};
+	
+	kfree(table);
+};
+
+/**
+ * Send an ARP request or NDP neighbor solicitation for the given address.
+ */
+static void sendSolicitation(NetIf *netif, int family, const uint8_t *ip)
+{
+	if (family == AF_INET)
+	{
+		ARPPacket arp;
+		memset(&arp, 0, sizeof(ARPPacket));
+		memset(&arp.header.dest, 0xFF, 6);
+		memcpy(&arp.header.src, &netif->ifconfig.ethernet.mac, 6);
+		arp.header.type = __builtin_bswap16(ETHER_TYPE_ARP);
+		arp.htype = __builtin_bswap16(1);
+		arp.ptype = __builtin_bswap16(ETHER_TYPE_IP);
+		arp.hlen = 6;
+		arp.plen = 4;
+		arp.oper = __builtin_bswap16(1);		// request
+		memcpy(&arp.sha, &netif->ifconfig.ethernet.mac, 6);
+		if (netif->ipv4.numAddrs == 0)
+		{
+			memset(arp.spa, 0, 4);
+		}
+		else
+		{
+			memcpy(&arp.spa, &netif->ipv4.addrs[0].addr, 4);
+		};
+		memset(&arp.tha, 0, 6);
+		memcpy(&arp.tpa, ip, 4);
+		arp.crc = ether_checksum(&arp, sizeof(ARPPacket)-4);
+		etherSendRaw(netif, &arp, sizeof(ARPPacket));
 	}
 	else
 	{
-		last->next = macres;
+		static uint8_t solicitedNodePrefix[16] =
+			{0xFF, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xFF, 0x00, 0x00, 0x00};
+		struct sockaddr_in6 ndp_src;
+		memset(&ndp_src, 0, sizeof(struct sockaddr_in6));
+		ndp_src.sin6_family = AF_UNSPEC;
+		
+		struct sockaddr_in6 ndp_dest;
+		memset(&ndp_dest, 0, sizeof(struct sockaddr_in6));
+		ndp_dest.sin6_family = AF_INET6;
+		memcpy(&ndp_dest.sin6_addr, solicitedNodePrefix, 13);
+		memcpy(&ndp_dest.sin6_addr.s6_addr[13], &ip[13], 3);
+		ndp_dest.sin6_scope_id = netif->scopeID;
+		
+		// find out what IPv6 address we should use as the source
+		int status = sendPacket((struct sockaddr*)&ndp_src, (const struct sockaddr*)&ndp_dest,
+			NULL, 0, 0, 0, NULL);
+		if (status == 0)
+		{
+			PseudoHeaderICMPv6 *phead = (PseudoHeaderICMPv6*)
+				kalloca(sizeof(PseudoHeaderICMPv6) + sizeof(NDPNeighborSolicit));
+			memcpy(phead->src, &ndp_src.sin6_addr, 16);
+			memcpy(phead->dest, &ndp_dest.sin6_addr, 16);
+			phead->len = __builtin_bswap32((uint32_t) sizeof(NDPNeighborSolicit));
+			memset(phead->zeroes, 0, 3);
+			phead->proto = IPPROTO_ICMPV6;
+			
+			NDPNeighborSolicit *sol = (NDPNeighborSolicit*) phead->payload;
+			sol->type = 135;
+			sol->code = 0;
+			sol->checksum = 0;
+			sol->resv = 0;
+			memcpy(sol->addr, ip, 16);
+			sol->opt1 = 1;
+			sol->len1 = 1;
+			memcpy(sol->mac, &netif->ifconfig.ethernet.mac, 6);
+			sol->checksum = ipv4_checksum(phead, sizeof(PseudoHeaderICMPv6) + sizeof(NDPNeighborSolicit));
+
+			uint64_t sockopts[GSO_COUNT];
+			memset(sockopts, 0, sizeof(uint64_t)*GSO_COUNT);
+			sockopts[GSO_SNDTIMEO] = NEIGH_RETRANS_TIME;
+			sockopts[GSO_SNDFLAGS] = PKT_DONTROUTE;
+			sockopts[GSO_MULTICAST_HOPS] = 255;
+			sockopts[GSO_UNICAST_HOPS] = 255;
+
+			sendPacketEx((struct sockaddr*)&ndp_src, (const struct sockaddr*)&ndp_dest,
+				sol, sizeof(NDPNeighborSolicit), IPPROTO_ICMPV6, sockopts, NULL);
+		};
 	};
-	
-	semSignal(&netif->ifconfig.ethernet.resLock);
-	return macres;
 };
 
-static int resolveAddress(NetIf *netif, int family, uint8_t *ip, MacAddress *mac, uint64_t nanotimeout)
+/**
+ * Resolve addresses which map onto MAC addresses without asking anyone: broadcast and multicast. Returns 0 if
+ * 'mac' was filled in.
+ */
+static int resolveTrivial(NetIf *netif, int family, const uint8_t *ip, MacAddress *mac)
 {
-	// trivial resolutions
 	if (family == AF_INET)
 	{
 		uint32_t broadcast = 0xFFFFFFFF;
@@ -129,7 +412,7 @@ static int resolveAddress(NetIf *netif, int family, uint8_t *ip, MacAddress *mac
 		{
 			uint32_t laddr = *((uint32_t*)&netif->ipv4.addrs[i].addr);
 			uint32_t mask = *((uint32_t*)&netif->ipv4.addrs[i].mask);
-			uint32_t addr = *((uint32_t*)ip);
+			uint32_t addr = *((const uint32_t*)ip);
 			
 			if ((laddr | (~mask)) == addr)
 			{
@@ -150,113 +433,12 @@ static int resolveAddress(NetIf *netif, int family, uint8_t *ip, MacAddress *mac
 		};
 	};
 	
-	MacResolution *res = getMacResolution(netif, family, ip);
-	if (!res->cond.value)
-	{
-		if (family == AF_INET)
-		{
-			// before waiting, send an ARP request
-			ARPPacket arp;
-			memset(&arp, 0, sizeof(ARPPacket));
-			memset(&arp.header.dest, 0xFF, 6);
-			memcpy(&arp.header.src, &netif->ifconfig.ethernet.mac, 6);
-			arp.header.type = __builtin_bswap16(ETHER_TYPE_ARP);
-			arp.htype = __builtin_bswap16(1);
-			arp.ptype = __builtin_bswap16(ETHER_TYPE_IP);
-			arp.hlen = 6;
-			arp.plen = 4;
-			arp.oper = __builtin_bswap16(1);		// request
-			memcpy(&arp.sha, &netif->ifconfig.ethernet.mac, 6);
-			if (netif->ipv4.numAddrs == 0)
-			{
-				memset(arp.spa, 0, 4);
-			}
-			else
-			{
-				memcpy(&arp.spa, &netif->ipv4.addrs[0].addr, 4);
-			};
-			memset(&arp.tha, 0, 6);
-			memcpy(&arp.tpa, res->ip, 4);
-			arp.crc = ether_checksum(&arp, sizeof(ARPPacket)-4);
-			etherSendRaw(netif, &arp, sizeof(ARPPacket));
-		}
-		else if (family == AF_INET6)
-		{
-			// before waiting, send an NDP neighbor solicitation
-			static uint8_t solicitedNodePrefix[16] =
-				{0xFF, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xFF, 0x00, 0x00, 0x00};
-			struct sockaddr_in6 ndp_src;
-			memset(&ndp_src, 0, sizeof(struct sockaddr_in6));
-			ndp_src.sin6_family = AF_UNSPEC;
-			
-			struct sockaddr_in6 ndp_dest;
-			memset(&ndp_dest, 0, sizeof(struct sockaddr_in6));
-			ndp_dest.sin6_family = AF_INET6;
-			memcpy(&ndp_dest.sin6_addr, solicitedNodePrefix, 13);
-			memcpy(&ndp_dest.sin6_addr.s6_addr[13], &ip[13], 3);
-			ndp_dest.sin6_scope_id = netif->scopeID;
-			
-			// find out what IPv6 address we should use as the source
-			int status = sendPacket((struct sockaddr*)&ndp_src, (const struct sockaddr*)&ndp_dest,
-				NULL, 0, 0, 0, NULL);
-			if (status == 0)
-			{
-				PseudoHeaderICMPv6 *phead = (PseudoHeaderICMPv6*)
-					kalloca(sizeof(PseudoHeaderICMPv6) + sizeof(NDPNeighborSolicit));
-				memcpy(phead->src, &ndp_src.sin6_addr, 16);
-				memcpy(phead->dest, &ndp_dest.sin6_addr, 16);
-				phead->len = __builtin_bswap32((uint32_t) sizeof(NDPNeighborSolicit));
-				memset(phead->zeroes, 0, 3);
-				phead->proto = IPPROTO_ICMPV6;
-				
-				NDPNeighborSolicit *sol = (NDPNeighborSolicit*) phead->payload;
-				sol->type = 135;
-				sol->code = 0;
-				sol->checksum = 0;
-				sol->resv = 0;
-				memcpy(sol->addr, ip, 16);
-				sol->opt1 = 1;
-				sol->len1 = 1;
-				memcpy(sol->mac, &netif->ifconfig.ethernet.mac, 6);
-				sol->checksum = ipv4_checksum(phead, sizeof(PseudoHeaderICMPv6) + sizeof(NDPNeighborSolicit));
-
-				uint64_t sockopts[GSO_COUNT];
-				memset(sockopts, 0, sizeof(uint64_t)*GSO_COUNT);
-				sockopts[GSO_SNDTIMEO] = nanotimeout;
-				sockopts[GSO_SNDFLAGS] = PKT_DONTROUTE;
-				sockopts[GSO_MULTICAST_HOPS] = 255;
-				sockopts[GSO_UNICAST_HOPS] = 255;
-
-				sendPacketEx((struct sockaddr*)&ndp_src, (const struct sockaddr*)&ndp_dest,
-					sol, sizeof(NDPNeighborSolicit), IPPROTO_ICMPV6, sockopts, NULL);
-			};
-		};
-	};
-	
-	if ((nanotimeout == 0) || (nanotimeout > NT_SECS(1)))
-	{
-		nanotimeout = NT_SECS(1);
-	};
-	
-	int status = cvWait(&res->cond, nanotimeout);
-	if (status == 0)
-	{
-		memcpy(mac, &res->mac, 6);
-		return 0;
-	};
-	
-	return -EHOSTUNREACH;
+	return -1;
 };
 
-static int sendPacketToEthernet4(NetIf *netif, const struct sockaddr_in *gateway, const void *packet, size_t packetlen, uint64_t nanotimeout)
+static int sendPacketToMac(NetIf *netif, const MacAddress *mac, uint16_t type, const void *packet, size_t packetlen,
+				const NetOffload *off)
 {
-	MacAddress mac;
-	int status = resolveAddress(netif, AF_INET, (uint8_t*) &gateway->sin_addr, &mac, nanotimeout);
-	if (status != 0)
-	{
-		return status;
-	};
-	
 	size_t sendlen = packetlen;
 	if (sendlen < 46)
 	{
@@ -268,12 +450,45 @@ static int sendPacketToEthernet4(NetIf *netif, const struct sockaddr_in *gateway
 	memset(etherPacket, 0, sizeof(EthernetHeader) + sendlen + 6);			// sending uninitialised data is dangerous
 	EthernetHeader *head = (EthernetHeader*) etherPacket;
 	
-	memcpy(&head->dest, &mac, 6);
+	memcpy(&head->dest, mac, 6);
 	memcpy(&head->src, &netif->ifconfig.ethernet.mac, 6);
-	head->type = __builtin_bswap16(ETHER_TYPE_IP);
+	head->type = __builtin_bswap16(type);
 	
 	memcpy(&head[1], packet, packetlen);
 	
+	if (off != NULL)
+	{
+		NetOffload devoff;
+		memcpy(&devoff, off, sizeof(NetOffload));
+		
+		int caps = 0;
+		if (netif->ifconfig.ethernet.sendOffload != NULL)
+		{
+			caps = netif->ifconfig.ethernet.caps;
+		};
+		
+		netifFinishOffload(&head[1], packetlen, &devoff, caps);
+		if (devoff.flags & (NETIF_OFF_CSUM | NETIF_OFF_TSO))
+		{
+			// the device does the rest, including the CRC; offsets become relative to the frame
+			devoff.l3off += sizeof(EthernetHeader);
+			devoff.l4off += sizeof(EthernetHeader);
+			devoff.csumoff += sizeof(EthernetHeader);
+			devoff.hdrlen += sizeof(EthernetHeader);
+			
+			struct sockaddr_cap caddr;
+			memset(&caddr, 0, sizeof(struct sockaddr_cap));
+			caddr.scap_family = AF_CAPTURE;
+			strcpy(caddr.scap_ifname, netif->name);
+			onTransportPacket((struct sockaddr*)&caddr, (struct sockaddr*)&caddr, sizeof(struct sockaddr_cap),
+				etherPacket, sizeof(EthernetHeader) + sendlen, IF_ETHERNET, netif->name, 0);
+			
+			netif->ifconfig.ethernet.sendOffload(netif, etherPacket, sizeof(EthernetHeader) + sendlen, &devoff);
+			kfree(etherPacket);
+			return 0;
+		};
+	};
+	
 	uint32_t *crcPtr = (uint32_t*) &etherPacket[sizeof(EthernetHeader) + sendlen];
 	*crcPtr = ether_checksum(etherPacket, sizeof(EthernetHeader) + sendlen);
 	
@@ -282,48 +497,128 @@ static int sendPacketToEthernet4(NetIf *netif, const struct sockaddr_in *gateway
 	return 0;
 };
 
-static int sendPacketToEthernet6(NetIf *netif, const struct sockaddr_in6 *gateway, const void *packet, size_t packetlen, uint64_t nanotimeout)
+static int sendPacketToNeighbor(NetIf *netif, int family, const uint8_t *ip, uint16_t type, const void *packet,
+					size_t packetlen, const NetOffload *off)
 {
 	MacAddress mac;
-	int status = resolveAddress(netif, AF_INET6, (uint8_t*) &gateway->sin6_addr, &mac, nanotimeout);
-	if (status != 0)
+	if (resolveTrivial(netif, family, ip, &mac) == 0)
 	{
-		return status;
+		return sendPacketToMac(netif, &mac, type, packet, packetlen, off);
 	};
-
-	size_t sendlen = packetlen;
-	if (sendlen < 46)
+	
+	NeighTable *table = netif->ifconfig.ethernet.neigh;
+	uint64_t now = getNanotime();
+	int solicit = 0;
+	int haveMac = 0;
+	int status = 0;
+	
+	semWait(&table->lock);
+	Neighbor **link = neighFind(table, family, ip);
+	Neighbor *neigh = *link;
+	if (neigh == NULL)
 	{
-		sendlen = 46;
+		neighMakeRoom(netif, table, now);
+		link = neighFind(table, family, ip);
+		
+		neigh = NEW(Neighbor);
+		memset(neigh, 0, sizeof(Neighbor));
+		neigh->family = family;
+		memcpy(neigh->ip, ip, neighAddrSize(family));
+		neigh->state = NEIGH_INCOMPLETE;
+		neigh->confirmed = now;
+		neigh->probes = 1;
+		neigh->nextProbe = now + NEIGH_RETRANS_TIME;
+		*link = neigh;
+		table->count++;
+		solicit = 1;
 	};
 	
-	char *etherPacket = (char*) kmalloc(sizeof(EthernetHeader) + sendlen + 6);
-	memset(etherPacket, 0, sizeof(EthernetHeader) + sendlen + 6);
-	EthernetHeader *head = (EthernetHeader*) etherPacket;
+	neigh->used = now;
+	if ((neigh->state == NEIGH_REACHABLE) && ((now - neigh->confirmed) >= NEIGH_REACHABLE_TIME))
+	{
+		neigh->state = NEIGH_STALE;
+	};
 	
-	memcpy(&head->dest, &mac, 6);
-	memcpy(&head->src, &netif->ifconfig.ethernet.mac, 6);
-	head->type = __builtin_bswap16(ETHER_TYPE_IPV6);
+	switch (neigh->state)
+	{
+	case NEIGH_STALE:
+		// still usable, but check that it's still there
+		neigh->state = NEIGH_PROBE;
+		neigh->probes = 1;
+		neigh->nextProbe = now + NEIGH_RETRANS_TIME;
+		solicit = 1;
+		/* fall through */
+	case NEIGH_REACHABLE:
+	case NEIGH_PROBE:
+		memcpy(&mac, &neigh->mac, 6);
+		haveMac = 1;
+		break;
+	case NEIGH_INCOMPLETE:
+		{
+			NeighPending *pend = (NeighPending*) kmalloc(sizeof(NeighPending) + packetlen);
+			pend->next = NULL;
+			pend->type = type;
+			pend->hasOff = (off != NULL);
+			if (off != NULL) memcpy(&pend->off, off, sizeof(NetOffload));
+			pend->size = packetlen;
+			memcpy(pend->packet, packet, packetlen);
+			
+			if (neigh->pendLast == NULL)
+			{
+				neigh->pendFirst = neigh->pendLast = pend;
+			}
+			else
+			{
+				neigh->pendLast->next = pend;
+				neigh->pendLast = pend;
+			};
+			
+			if (neigh->numPending == NEIGH_QUEUE_MAX)
+			{
+				// drop the oldest one
+				NeighPending *old = neigh->pendFirst;
+				neigh->pendFirst = old->next;
+				kfree(old);
+				__sync_fetch_and_add(&netif->numDropped, 1);
+			}
+			else
+			{
+				neigh->numPending++;
+			};
+		};
+		break;
+	case NEIGH_FAILED:
+		// we recently gave up on it; don't queue anything until the entry expires
+		status = -EHOSTUNREACH;
+		break;
+	};
+	semSignal(&table->lock);
 	
-	memcpy(&head[1], packet, packetlen);
+	if (solicit)
+	{
+		sendSolicitation(netif, family, ip);
+	};
 	
-	uint32_t *crcPtr = (uint32_t*) &etherPacket[sizeof(EthernetHeader) + sendlen];
-	*crcPtr = ether_checksum(etherPacket, sizeof(EthernetHeader)+sendlen);
+	if (haveMac)
+	{
+		return sendPacketToMac(netif, &mac, type, packet, packetlen, off);
+	};
 	
-	etherSendRaw(netif, etherPacket, sizeof(EthernetHeader) + sendlen + 4);
-	kfree(etherPacket);
-	return 0;
+	return status;
 };
 
-int sendPacketToEthernet(NetIf *netif, const struct sockaddr *gateway, const void *packet, size_t packetlen, uint64_t nanotimeout)
+int sendPacketToEthernet(NetIf *netif, const struct sockaddr *gateway, const void *packet, size_t packetlen,
+				const NetOffload *off)
 {
 	if (gateway->sa_family == AF_INET)
 	{
-		return sendPacketToEthernet4(netif, (const struct sockaddr_in*) gateway, packet, packetlen, nanotimeout);
+		const struct sockaddr_in *ingw = (const struct sockaddr_in*) gateway;
+		return sendPacketToNeighbor(netif, AF_INET, (const uint8_t*) &ingw->sin_addr, ETHER_TYPE_IP, packet, packetlen, off);
 	}
 	else if (gateway->sa_family == AF_INET6)
 	{
-		return sendPacketToEthernet6(netif, (const struct sockaddr_in6*) gateway, packet, packetlen, nanotimeout);
+		const struct sockaddr_in6 *ingw = (const struct sockaddr_in6*) gateway;
+		return sendPacketToNeighbor(netif, AF_INET6, (const uint8_t*) &ingw->sin6_addr, ETHER_TYPE_IPV6, packet, packetlen, off);
 	}
 	else
 	{
@@ -331,6 +626,199 @@ int sendPacketToEthernet(NetIf *netif, const struct sockaddr *gateway, const voi
 	};
 };
 
+/**
+ * Record that 'ip' is at 'mac'. If there is no entry yet, one is only created if 'create' is set. Packets
+ * waiting for the resolution are sent.
+ */
+static void neighUpdate(NetIf *netif, int family, const uint8_t *ip, const MacAddress *mac, int create)
+{
+	NeighTable *table = netif->ifconfig.ethernet.neigh;
+	uint64_t now = getNanotime();
+	
+	semWait(&table->lock);
+	Neighbor **link = neighFind(table, family, ip);
+	Neighbor *neigh = *link;
+	if (neigh == NULL)
+	{
+		if (!create)
+		{
+			semSignal(&table->lock);
+			return;
+		};
+		
+		neighMakeRoom(netif, table, now);
+		link = neighFind(table, family, ip);
+		
+		neigh = NEW(Neighbor);
+		memset(neigh, 0, sizeof(Neighbor));
+		neigh->family = family;
+		memcpy(neigh->ip, ip, neighAddrSize(family));
+		neigh->used = now;
+		*link = neigh;
+		table->count++;
+	};
+	
+	memcpy(&neigh->mac, mac, 6);
+	neigh->state = NEIGH_REACHABLE;
+	neigh->confirmed = now;
+	neigh->probes = 0;
+	
+	NeighPending *pend = neigh->pendFirst;
+	neigh->pendFirst = neigh->pendLast = NULL;
+	neigh->numPending = 0;
+	semSignal(&table->lock);
+	
+	while (pend != NULL)
+	{
+		NeighPending *next = pend->next;
+		sendPacketToMac(netif, mac, pend->type, pend->packet, pend->size, pend->hasOff ? &pend->off : NULL);
+		kfree(pend);
+		pend = next;
+	};
+};
+
+void etherNeighborTick(NetIf *netif)
+{
+	NeighTable *table = netif->ifconfig.ethernet.neigh;
+	uint64_t now = getNanotime();
+	
+	NeighProbe probes[16];
+	int numProbes = 0;
+	NeighPending *dropped = NULL;
+	NeighPending *failed = NULL;
+	
+	semWait(&table->lock);
+	int i;
+	for (i=0; i<NEIGH_HASH_SIZE; i++)
+	{
+		Neighbor **link = &table->buckets[i];
+		while (*link != NULL)
+		{
+			Neighbor *neigh = *link;
+			int remove = 0;
+			
+			switch (neigh->state)
+			{
+			case NEIGH_INCOMPLETE:
+			case NEIGH_PROBE:
+				if (now >= neigh->nextProbe)
+				{
+					if ((neigh->probes >= NEIGH_MAX_PROBES) && (neigh->state == NEIGH_INCOMPLETE))
+					{
+						// nobody answered; remember that for a while, so that senders get
+						// an error rather than queueing more packets
+						neigh->state = NEIGH_FAILED;
+						neigh->confirmed = now;
+						
+						if (neigh->pendLast != NULL)
+						{
+							neigh->pendLast->next = failed;
+							failed = neigh->pendFirst;
+						};
+						
+						neigh->pendFirst = neigh->pendLast = NULL;
+						neigh->numPending = 0;
+					}
+					else if (neigh->probes >= NEIGH_MAX_PROBES)
+					{
+						// it went away
+						remove = 1;
+					}
+					else if (numProbes < 16)
+					{
+						neigh->probes++;
+						neigh->nextProbe = now + NEIGH_RETRANS_TIME;
+						probes[numProbes].family = neigh->family;
+						memcpy(probes[numProbes].ip, neigh->ip, 16);
+						numProbes++;
+					};
+				};
+				break;
+			case NEIGH_REACHABLE:
+				if ((now - neigh->confirmed) >= NEIGH_REACHABLE_TIME)
+				{
+					neigh->state = NEIGH_STALE;
+				};
+				break;
+			case NEIGH_STALE:
+				if ((now - neigh->used) >= NEIGH_GC_TIME)
+				{
+					remove = 1;
+				};
+				break;
+			case NEIGH_FAILED:
+				if ((now - neigh->confirmed) >= NEIGH_FAILED_TIME)
+				{
+					remove = 1;
+				};
+				break;
+			};
+			
+			if (remove)
+			{
+				*link = neigh->next;
+				table->count--;
+				
+				if (neigh->pendLast != NULL)
+				{
+					neigh->pendLast->next = dropped;
+					dropped = neigh->pendFirst;
+				};
+				
+				kfree(neigh);
+			}
+			else
+			{
+				link = &neigh->next;
+			};
+		};
+	};
+	semSignal(&table->lock);
+	
+	neighFreePending(netif, dropped);
+	neighFailPending(netif, failed);
+	
+	for (i=0; i<numProbes; i++)
+	{
+		sendSolicitation(netif, probes[i].family, probes[i].ip);
+	};
+};
+
+int etherListNeighbors(NetIf *netif, NeighInfo *info, int max)
+{
+	NeighTable *table = netif->ifconfig.ethernet.neigh;
+	uint64_t now = getNanotime();
+	
+	semWait(&table->lock);
+	int count = table->count;
+	if (info != NULL)
+	{
+		int index = 0;
+		int i;
+		for (i=0; i<NEIGH_HASH_SIZE; i++)
+		{
+			Neighbor *neigh;
+			for (neigh=table->buckets[i]; neigh!=NULL && index<max; neigh=neigh->next)
+			{
+				NeighInfo *out = &info[index++];
+				memset(out, 0, sizeof(NeighInfo));
+				strcpy(out->ifname, netif->name);
+				out->family = neigh->family;
+				out->state = neigh->state;
+				memcpy(out->ip, neigh->ip, 16);
+				memcpy(&out->mac, &neigh->mac, 6);
+				out->queued = (uint16_t) neigh->numPending;
+				out->age = now - neigh->confirmed;
+			};
+		};
+		
+		count = index;
+	};
+	semSignal(&table->lock);
+	
+	return count;
+};
+
 static void onARPPacket(NetIf *netif, ARPPacket *arp)
 {
 	uint16_t op = __builtin_bswap16(arp->oper);
@@ -358,6 +846,9 @@ static void onARPPacket(NetIf *netif, ARPPacket *arp)
 			return;
 		};
 		
+		// they are about to talk to us, so we will most likely need their address too
+		neighUpdate(netif, AF_INET, arp->spa, &arp->sha, 1);
+		
 		ARPPacket reply;
 		memset(&reply, 0, sizeof(ARPPacket));
 		memcpy(&reply.header.dest, &arp->header.src, 6);
@@ -388,27 +879,19 @@ static void onARPPacket(NetIf *netif, ARPPacket *arp)
 			arp->spa[0], arp->spa[1], arp->spa[2], arp->spa[3]
 		);
 		
-		MacResolution *res;
-		for (res=netif->ifconfig.ethernet.res; res!=NULL; res=res->next)
-		{
-			if (res->family == AF_INET)
-			{
-				if (memcmp(res->ip, arp->spa, 4) == 0)
-				{
-					memcpy(&res->mac, &arp->sha, 6);
-					cvSignal(&res->cond);
-					break;
-				};
-			};
-		};
+		// only update neighbors we asked about
+		neighUpdate(netif, AF_INET, arp->spa, &arp->sha, 0);
 	};
 };
 
 void etherAddResolution(struct NetIf_ *netif, int family, const void *ip, const MacAddress *mac)
-{	
-	MacResolution *res = getMacResolution(netif, family, (uint8_t*)ip);
-	memcpy(&res->mac, mac, 6);
-	cvSignal(&res->cond);
+{
+	neighUpdate(netif, family, (const uint8_t*) ip, mac, 1);
+};
+
+void etherUpdateResolution(struct NetIf_ *netif, int family, const void *ip, const MacAddress *mac)
+{
+	neighUpdate(netif, family, (const uint8_t*) ip, mac, 0);
 };
 
 void onEtherFrame(NetIf *netif, const void *frame, size_t framelen, int flags)
@@ -442,7 +925,7 @@ void onEtherFrame(NetIf *netif, const void *frame, size_t framelen, int flags)
 	caddr.scap_family = AF_CAPTURE;
 	strcpy(caddr.scap_ifname, netif->name);
 	onTransportPacket((struct sockaddr*)&caddr, (struct sockaddr*)&caddr, sizeof(struct sockaddr_cap),
-		frame, framelen-4, IF_ETHERNET, netif->name);	// without CRC
+		frame, framelen-4, IF_ETHERNET, netif->name, 0);	// without CRC
 	
 	size_t overheadSize = sizeof(EthernetHeader) + 4;
 	EthernetHeader *head = (EthernetHeader*) frame;
@@ -469,7 +952,14 @@ void onEtherFrame(NetIf *netif, const void *frame, size_t framelen, int flags)
 		break;
 	case ETHER_TYPE_IP:
 	case ETHER_TYPE_IPV6:
-		onPacket(netif, &head[1], framelen-overheadSize);
+		if (flags & ETHER_CSUM_VERIFIED)
+		{
+			onPacketEx(netif, &head[1], framelen-overheadSize, NETIF_RX_CSUM_VERIFIED);
+		}
+		else
+		{
+			onPacket(netif, &head[1], framelen-overheadSize);
+		};
 		break;
 	};
 };
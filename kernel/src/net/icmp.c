@@ -246,7 +246,8 @@ static void handleAdvert(const struct sockaddr_in6 *src, NDPNeighborAdvert *adv)
 		releaseNetIfLock();
 		return;
 	};
-	etherAddResolution(netif, AF_INET6, adv->addr, (MacAddress*) adv->mac);
+	// only update neighbors we already know about (RFC 4861, 7.2.5)
+	etherUpdateResolution(netif, AF_INET6, adv->addr, (MacAddress*) adv->mac);
 	releaseNetIfLock();
 };
 
@@ -35,47 +35,105 @@
 #include <glidix/util/qfile.h>
 #include <glidix/util/memory.h>
 #include <glidix/net/socket.h>
+#include <glidix/net/route.h>
 #include <glidix/display/console.h>
 #include <glidix/thread/mutex.h>
 
 static Mutex iflistLock;
 static NetIf iflist;
 
-uint16_t ipv4_checksum(const void* vdata,size_t length)
+uint32_t ipv4_checksum_partial(uint32_t sum, const void *vdata, size_t length)
 {
-	// Cast the data pointer to one that can be indexed.
-	const char* data=(const char*)vdata;
-
-	// Initialise the accumulator.
-	uint32_t acc=0xffff;
+	const uint8_t *data = (const uint8_t*) vdata;
+	
+	// The one's complement sum does not depend on byte order (RFC 1071), so we add up the data in
+	// native order, 8 bytes at a time, into a 64-bit accumulator. Carries out of bit 63 are added back
+	// in at the bottom (end-around carry), so nothing is lost, and the result is folded to 16 bits at
+	// the end; this way we only do one add per 8 bytes instead of one per byte pair.
+	uint64_t acc = sum;
+	uint64_t word;
+	
+	while (length >= 32)
+	{
+		const uint64_t *words = (const uint64_t*) data;
+		word = words[0]; acc += word; acc += (acc < word);
+		word = words[1]; acc += word; acc += (acc < word);
+		word = words[2]; acc += word; acc += (acc < word);
+		word = words[3]; acc += word; acc += (acc < word);
+		data += 32;
+		length -= 32;
+	};
+	
+	while (length >= 8)
+	{
+		word = *((const uint64_t*)data);
+		acc += word; acc += (acc < word);
+		data += 8;
+		length -= 8;
+	};
+	
+	// fold down to 32 bits so that the tail cannot overflow
+	acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+	acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+	
+	if (length >= 4)
+	{
+		acc += *((const uint32_t*)data);
+		data += 4;
+		length -= 4;
+	};
+	
+	if (length >= 2)
+	{
+		acc += *((const uint16_t*)data);
+		data += 2;
+		length -= 2;
+	};
+	
+	if (length)
+	{
+		// a trailing odd byte is padded with a zero byte after it
+		acc += *data;
+	};
+	
+	while (acc >> 16)
+	{
+		acc = (acc & 0xFFFF) + (acc >> 16);
+	};
+	
+	return (uint32_t) acc;
+};
 
-	// Handle complete 16-bit blocks.
-	size_t i;
-	for (i=0;i+1<length;i+=2) {
-		uint16_t word;
-		memcpy(&word,data+i,2);
-		acc+=__builtin_bswap16(word);
-		if (acc>0xffff)
-		{
-			acc-=0xffff;
-		}
-	}
+uint16_t ipv4_checksum(const void *data, size_t length)
+{
+	// starting at 0xFFFF (negative zero) rather than 0 means an all-zero buffer checksums to 0,
+	// as it always has here; otherwise the result is the same
+	return (uint16_t) ~ipv4_checksum_partial(0xFFFF, data, length);
+};
 
-	// Handle any partial block at the end of the data.
-	if (length&1)
+uint16_t transportChecksum(const struct sockaddr *src, const struct sockaddr *dest, int proto, const void *packet, size_t size)
+{
+	uint32_t sum;
+	if (src->sa_family == AF_INET)
 	{
-		uint16_t word=0;
-		memcpy(&word,data+length-1,1);
-		acc+=__builtin_bswap16(word);
-		if (acc>0xffff)
-		{
-			acc-=0xffff;
-		}
+		sum = ipv4_checksum_partial(0, &((const struct sockaddr_in*)src)->sin_addr, 4);
+		sum = ipv4_checksum_partial(sum, &((const struct sockaddr_in*)dest)->sin_addr, 4);
 	}
-
-	// Return the checksum in network byte order.
-	return __builtin_bswap16(~acc);
-}
+	else
+	{
+		sum = ipv4_checksum_partial(0, &((const struct sockaddr_in6*)src)->sin6_addr, 16);
+		sum = ipv4_checksum_partial(sum, &((const struct sockaddr_in6*)dest)->sin6_addr, 16);
+	};
+	
+	// protocol and length, in network byte order; the IPv6 pseudo-header has a 32-bit length field
+	// and 3 zero bytes before the protocol, but they add up to the same thing
+	uint16_t tail[2];
+	tail[0] = htons((uint16_t) proto);
+	tail[1] = htons((uint16_t) size);
+	sum = ipv4_checksum_partial(sum, tail, 4);
+	
+	return (uint16_t) ~ipv4_checksum_partial(sum, packet, size);
+};
 
 void ipv4_info2header(PacketInfo4 *info, IPHeader4 *head)
 {
@@ -194,13 +252,14 @@ typedef struct lopacket_
 {
 	struct lopacket_* next;
 	size_t size;
+	int flags;
 	char data[];
 } lopacket;
 
 static lopacket *loQueue = NULL;
 
 //static void loopbackSend(NetIf *netif, const void *addr, size_t addrlen, const void *packet, size_t packetlen)
-static void loopbackSend(NetIf *netif, const void *packet, size_t packetlen)
+static void loopbackSend(NetIf *netif, const void *packet, size_t packetlen, const NetOffload *off)
 {
 	// send the frame to capture sockets
 	struct sockaddr_cap caddr;
@@ -208,14 +267,27 @@ static void loopbackSend(NetIf *netif, const void *packet, size_t packetlen)
 	caddr.scap_family = AF_CAPTURE;
 	strcpy(caddr.scap_ifname, netif->name);
 	onTransportPacket((struct sockaddr*)&caddr, (struct sockaddr*)&caddr, sizeof(struct sockaddr_cap),
-		packet, packetlen, IF_LOOPBACK, netif->name);
+		packet, packetlen, IF_LOOPBACK, netif->name, 0);
 		
 	__sync_fetch_and_add(&netif->numTrans, 1);
 	lopacket *newPacket = (lopacket*) kmalloc(sizeof(lopacket) + packetlen);
 	newPacket->next = NULL;
 	newPacket->size = packetlen;
+	newPacket->flags = 0;
 	memcpy(newPacket->data, packet, packetlen);
 	
+	if (off != NULL)
+	{
+		// segmentation is not needed, since the packet never leaves this machine; but the checksum
+		// is still filled in, in case the receiver forwards or reflects the packet. It need not be
+		// verified again on the other side.
+		NetOffload loff;
+		memcpy(&loff, off, sizeof(NetOffload));
+		loff.flags &= ~NETIF_OFF_TSO;
+		netifFinishOffload(newPacket->data, packetlen, &loff, 0);
+		newPacket->flags = NETIF_RX_CSUM_VERIFIED;
+	};
+	
 	semWait(&loLock);
 	if (loQueue == NULL)
 	{
@@ -245,11 +317,34 @@ static void loopbackThread(void *ignore)
 		semSignal(&loLock);
 		
 		// 'iflist' always starts with "lo"
-		onPacket(&iflist, packet->data, packet->size);
+		onPacketEx(&iflist, packet->data, packet->size, packet->flags);
 		kfree(packet);
 	};
 };
 
+/**
+ * Ages neighbor caches and retransmits solicitations on all ethernet interfaces.
+ */
+static void neighborThread(void *ignore)
+{
+	(void)ignore;
+	while (1)
+	{
+		sleep(NEIGH_TICK_MS);
+		
+		mutexLock(&iflistLock);
+		NetIf *netif;
+		for (netif=&iflist; netif!=NULL; netif=netif->next)
+		{
+			if (netif->ifconfig.type == IF_ETHERNET)
+			{
+				etherNeighborTick(netif);
+			};
+		};
+		mutexUnlock(&iflistLock);
+	};
+};
+
 void initSocket();		/* socket.c */
 void initNetIf()
 {
@@ -263,6 +358,9 @@ void initNetIf()
 	pars.stackSize = DEFAULT_STACK_SIZE;
 	pars.name = "inet_loopback";
 	CreateKernelThread(loopbackThread, &pars, NULL);
+	
+	pars.name = "inet_neigh";
+	CreateKernelThread(neighborThread, &pars, NULL);
 
 	// the head of the interface list shall be the local loopback.
 	static IPNetIfAddr4 loaddr4 = {{0x0100007F}, {0x000000FF}, DOM_LOOPBACK};
@@ -299,6 +397,7 @@ void initNetIf()
 	iflist.ipv4.routes = (IPRoute4*) kmalloc(sizeof(IPRoute4));
 	memcpy(iflist.ipv4.routes, &lortab4, sizeof(IPRoute4));
 	iflist.ipv4.numRoutes = 1;
+	iflist.ipv4.capRoutes = 1;
 	
 	//iflist.ipv6.addrs = &loaddr6;
 	iflist.ipv6.addrs = (IPNetIfAddr6*) kmalloc(sizeof(IPNetIfAddr6)*3);
@@ -308,6 +407,7 @@ void initNetIf()
 	iflist.ipv6.routes = (IPRoute6*) kmalloc(sizeof(IPRoute6)*2);
 	memcpy(iflist.ipv6.routes, lortab6, sizeof(IPRoute6)*2);
 	iflist.ipv6.numRoutes = 2;
+	iflist.ipv6.capRoutes = 2;
 	
 	iflist.numTrans = 0;
 	iflist.numRecv = 0;
@@ -319,10 +419,16 @@ void initNetIf()
 	iflist.prev = NULL;
 	iflist.next = NULL;
 	
+	routeRebuild(&iflist);
 	initSocket();
 };
 
 void onPacket(NetIf *netif, const void *packet, size_t packetlen)
+{
+	onPacketEx(netif, packet, packetlen, 0);
+};
+
+void onPacketEx(NetIf *netif, const void *packet, size_t packetlen, int flags)
 {
 	if (packetlen < 1)
 	{
@@ -336,7 +442,7 @@ void onPacket(NetIf *netif, const void *packet, size_t packetlen)
 	caddr.scap_family = AF_CAPTURE;
 	strcpy(caddr.scap_ifname, netif->name);
 	onTransportPacket((struct sockaddr*)&caddr, (struct sockaddr*)&caddr, sizeof(struct sockaddr_cap),
-		packet, packetlen, IPPROTO_IP, netif->name);
+		packet, packetlen, IPPROTO_IP, netif->name, 0);
 
 	uint8_t ipver = ((*((const uint8_t*)packet)) >> 4) & 0xF;
 	if (ipver == 4)
@@ -374,7 +480,7 @@ void onPacket(NetIf *netif, const void *packet, size_t packetlen)
 		memcpy(&addr_dest.sin_addr, &info.daddr, 4);
 		
 		passPacketToSocket((struct sockaddr*) &addr_src, (struct sockaddr*) &addr_dest, sizeof(struct sockaddr_in),
-					packet, packetlen, info.proto, info.dataOffset, netif->name);
+					packet, packetlen, info.proto, info.dataOffset, netif->name, flags);
 	}
 	else if (ipver == 6)
 	{
@@ -412,7 +518,7 @@ void onPacket(NetIf *netif, const void *packet, size_t packetlen)
 		dest_addr.sin6_scope_id = netif->scopeID;
 		
 		passPacketToSocket((struct sockaddr*) &src_addr, (struct sockaddr*) &dest_addr, sizeof(struct sockaddr_in),
-					packet, packetlen, info.proto, info.dataOffset, netif->name);
+					packet, packetlen, info.proto, info.dataOffset, netif->name, flags);
 	}
 	else
 	{
@@ -539,6 +645,65 @@ int sysRouteTable(uint64_t family)
 	return i;
 };
 
+int sysNeighborTable()
+{
+	int i = ftabAlloc(getCurrentThread()->ftab);
+	if (i == -1)
+	{
+		ERRNO = EMFILE;
+		return -1;
+	};
+	
+	mutexLock(&iflistLock);
+	QFileEntry *first = NULL;
+	QFileEntry *last = NULL;
+	
+	NetIf *netif;
+	for (netif=&iflist; netif!=NULL; netif=netif->next)
+	{
+		if (netif->ifconfig.type != IF_ETHERNET)
+		{
+			continue;
+		};
+		
+		// the table may grow between counting and listing; anything extra is simply left out
+		int count = etherListNeighbors(netif, NULL, 0);
+		if (count == 0)
+		{
+			continue;
+		};
+		
+		NeighInfo *info = (NeighInfo*) kmalloc(sizeof(NeighInfo) * count);
+		count = etherListNeighbors(netif, info, count);
+		
+		int j;
+		for (j=0; j<count; j++)
+		{
+			QFileEntry *entry = (QFileEntry*) kmalloc(sizeof(QFileEntry) + sizeof(NeighInfo));
+			entry->next = NULL;
+			entry->size = sizeof(NeighInfo);
+			memcpy(entry->data, &info[j], sizeof(NeighInfo));
+			
+			if (first == NULL)
+			{
+				first = last = entry;
+			}
+			else
+			{
+				last->next = entry;
+				last = entry;
+			};
+		};
+		
+		kfree(info);
+	};
+	
+	mutexUnlock(&iflistLock);
+	
+	ftabSet(getCurrentThread()->ftab, i, qfileCreate(first), FD_CLOEXEC);
+	return i;
+};
+
 int isMatchingMask(const void *a_, const void *b_, const void *mask_, size_t count)
 {
 	const uint8_t *a = (const uint8_t*) a_;
@@ -595,7 +760,169 @@ uint32_t getNextPacketID()
 	return nextPacketID++;
 };
 
-static int sendPacketToInterface(NetIf *netif, const struct sockaddr *gateway, const void *packet, size_t packetlen, uint64_t nanotimeout)
+/**
+ * Returns the size of the largest packet (including the IP header) that we send to the given address family
+ * without fragmenting.
+ */
+static size_t pathMTU(int family)
+{
+	// TODO: proper path MTU discovery!
+	if (family == AF_INET)
+	{
+		return 576;
+	}
+	else
+	{
+		return 1280;
+	};
+};
+
+/**
+ * Returns the offload capabilities of an interface.
+ */
+static int getInterfaceCaps(NetIf *netif)
+{
+	switch (netif->ifconfig.type)
+	{
+	case IF_LOOPBACK:
+		// nothing leaves the machine, so loopbackSend() can skip checksums and segmentation entirely
+		return NETIF_CAP_TXCSUM | NETIF_CAP_RXCSUM | NETIF_CAP_TSO4 | NETIF_CAP_TSO6;
+	case IF_ETHERNET:
+		if (netif->ifconfig.ethernet.sendOffload == NULL)
+		{
+			return 0;
+		};
+		return netif->ifconfig.ethernet.caps;
+	default:
+		return 0;
+	};
+};
+
+/**
+ * Sum of the pseudo-header for the TCP/UDP packet inside the IP packet 'ip', described by 'offflags' (NETIF_OFF_*),
+ * with the transport length 'len'.
+ */
+static uint32_t pseudoHeaderSum(const void *ip, int offflags, size_t len)
+{
+	uint32_t sum;
+	if (offflags & NETIF_OFF_IPV4)
+	{
+		// the source and destination addresses are adjacent in the header
+		sum = ipv4_checksum_partial(0, &((const IPHeader4*)ip)->saddr, 8);
+	}
+	else
+	{
+		sum = ipv4_checksum_partial(0, ((const IPHeader6*)ip)->saddr, 32);
+	};
+	
+	uint16_t tail[2];
+	tail[0] = htons((offflags & NETIF_OFF_TCP) ? IPPROTO_TCP : IPPROTO_UDP);
+	tail[1] = htons((uint16_t) len);
+	return ipv4_checksum_partial(sum, tail, 4);
+};
+
+void netifFinishOffload(void *packet, size_t packetlen, NetOffload *off, int caps)
+{
+	uint8_t *bytes = (uint8_t*) packet;
+	uint16_t *field = (uint16_t*) &bytes[off->csumoff];
+	size_t len = packetlen - off->l4off;
+	
+	if ((off->flags & NETIF_OFF_CSUM) == 0)
+	{
+		return;
+	};
+	
+	if (off->flags & NETIF_OFF_TSO)
+	{
+		// the device adds the length of each segment itself
+		*field = (uint16_t) pseudoHeaderSum(&bytes[off->l3off], off->flags, 0);
+	}
+	else if (caps & NETIF_CAP_TXCSUM)
+	{
+		*field = (uint16_t) pseudoHeaderSum(&bytes[off->l3off], off->flags, len);
+	}
+	else
+	{
+		*field = 0;
+		uint16_t sum = (uint16_t) ~ipv4_checksum_partial(pseudoHeaderSum(&bytes[off->l3off], off->flags, len),
+									&bytes[off->l4off], len);
+		if ((sum == 0) && ((off->flags & NETIF_OFF_TCP) == 0))
+		{
+			// a zero UDP checksum means "no checksum"
+			sum = 0xFFFF;
+		};
+		
+		*field = sum;
+		off->flags &= ~NETIF_OFF_CSUM;
+	};
+};
+
+/**
+ * Fill in 'off' for an outgoing IP packet sent with PKT_CSUM_OFFLOAD and/or PKT_TSO. Returns 0 on success,
+ * or -1 if the packet is not a TCP or UDP packet that we can offload.
+ */
+static int describeOffload(const void *packet, size_t packetlen, int flags, NetOffload *off)
+{
+	const uint8_t *bytes = (const uint8_t*) packet;
+	uint8_t ipver = bytes[0] >> 4;
+	int proto;
+	
+	memset(off, 0, sizeof(NetOffload));
+	if (ipver == 4)
+	{
+		off->flags = NETIF_OFF_IPV4;
+		off->l4off = (bytes[0] & 0xF) * 4;
+		proto = ((const IPHeader4*)packet)->proto;
+	}
+	else if (ipver == 6)
+	{
+		// fragmented packets never get here, so the transport header follows straight away
+		off->l4off = sizeof(IPHeader6);
+		proto = ((const IPHeader6*)packet)->nextHeader;
+	}
+	else
+	{
+		return -1;
+	};
+	
+	if (proto == IPPROTO_TCP)
+	{
+		if (packetlen < (size_t)off->l4off + 20)
+		{
+			return -1;
+		};
+		
+		off->flags |= NETIF_OFF_TCP;
+		off->csumoff = off->l4off + 16;
+		off->hdrlen = off->l4off + (bytes[off->l4off + 12] >> 4) * 4;
+		off->mss = pathMTU(ipver == 4 ? AF_INET : AF_INET6) - off->hdrlen;
+	}
+	else if (proto == IPPROTO_UDP)
+	{
+		off->csumoff = off->l4off + 6;
+		off->hdrlen = off->l4off + 8;
+	}
+	else
+	{
+		return -1;
+	};
+	
+	if (packetlen < off->hdrlen)
+	{
+		return -1;
+	};
+	
+	off->flags |= NETIF_OFF_CSUM;
+	if ((flags & PKT_TSO) && (off->flags & NETIF_OFF_TCP) && ((packetlen - off->hdrlen) > off->mss))
+	{
+		off->flags |= NETIF_OFF_TSO;
+	};
+	
+	return 0;
+};
+
+static int transmitPacket(NetIf *netif, const struct sockaddr *gateway, const void *packet, size_t packetlen,
+				const NetOffload *off, uint64_t nanotimeout)
 {
 	// send the packet to capture sockets
 	struct sockaddr_cap caddr;
@@ -603,22 +930,106 @@ static int sendPacketToInterface(NetIf *netif, const struct sockaddr *gateway, c
 	caddr.scap_family = AF_CAPTURE;
 	strcpy(caddr.scap_ifname, netif->name);
 	onTransportPacket((struct sockaddr*)&caddr, (struct sockaddr*)&caddr, sizeof(struct sockaddr_cap),
-		packet, packetlen, IPPROTO_IP, netif->name);
+		packet, packetlen, IPPROTO_IP, netif->name, 0);
 
 	// this is called when iflistLock is locked, and 'gateway' is supposedly reacheable directly.
 	// depending on the type of interface, different address-resolution methods may be used.
 	switch (netif->ifconfig.type)
 	{
 	case IF_LOOPBACK:
-		loopbackSend(netif, packet, packetlen);
+		loopbackSend(netif, packet, packetlen, off);
 		return 0;
 	case IF_ETHERNET:
-		return sendPacketToEthernet(netif, gateway, packet, packetlen, nanotimeout);
+		return sendPacketToEthernet(netif, gateway, packet, packetlen, off);
 	default:
 		return -EHOSTUNREACH;
 	};
 };
 
+/**
+ * Software fallback for TSO: split the TCP packet into segments of at most 'off->mss' bytes of payload, each
+ * with a copy of the headers, and transmit them one by one.
+ */
+static int segmentPacket(NetIf *netif, const struct sockaddr *gateway, const void *packet, size_t packetlen,
+				const NetOffload *off, uint64_t nanotimeout)
+{
+	const uint8_t *bytes = (const uint8_t*) packet;
+	size_t payloadSize = packetlen - off->hdrlen;
+	uint32_t seqno = ntohl(*((const uint32_t*)&bytes[off->l4off + 4]));
+	
+	NetOffload segoff;
+	memcpy(&segoff, off, sizeof(NetOffload));
+	segoff.flags &= ~NETIF_OFF_TSO;
+	
+	size_t pos;
+	for (pos=0; pos<payloadSize; pos+=off->mss)
+	{
+		size_t chunk = payloadSize - pos;
+		if (chunk > off->mss) chunk = off->mss;
+		
+		uint8_t *seg = (uint8_t*) kmalloc(off->hdrlen + chunk);
+		memcpy(seg, bytes, off->hdrlen);
+		memcpy(&seg[off->hdrlen], &bytes[off->hdrlen + pos], chunk);
+		
+		if (off->flags & NETIF_OFF_IPV4)
+		{
+			IPHeader4 *head = (IPHeader4*) &seg[off->l3off];
+			head->len = htons((uint16_t) (off->hdrlen - off->l3off + chunk));
+			head->id = getNextPacketID();
+			head->checksum = 0;
+			head->checksum = ipv4_checksum(head, off->l4off - off->l3off);
+		}
+		else
+		{
+			IPHeader6 *head = (IPHeader6*) &seg[off->l3off];
+			head->payloadLen = htons((uint16_t) (off->hdrlen - off->l4off + chunk));
+		};
+		
+		*((uint32_t*)&seg[off->l4off + 4]) = htonl(seqno + (uint32_t)pos);
+		if ((pos + chunk) != payloadSize)
+		{
+			// only the last segment keeps FIN and PSH
+			seg[off->l4off + 13] &= ~((1 << 0) | (1 << 3));
+		};
+		
+		int status = transmitPacket(netif, gateway, seg, off->hdrlen + chunk, &segoff, nanotimeout);
+		kfree(seg);
+		
+		if (status != 0)
+		{
+			return status;
+		};
+	};
+	
+	return 0;
+};
+
+static int sendPacketToInterface(NetIf *netif, const struct sockaddr *gateway, const void *packet, size_t packetlen,
+					int flags, uint64_t nanotimeout)
+{
+	if ((flags & (PKT_CSUM_OFFLOAD | PKT_TSO)) == 0)
+	{
+		return transmitPacket(netif, gateway, packet, packetlen, NULL, nanotimeout);
+	};
+	
+	NetOffload off;
+	if (describeOffload(packet, packetlen, flags, &off) != 0)
+	{
+		return -EINVAL;
+	};
+	
+	if (off.flags & NETIF_OFF_TSO)
+	{
+		int tsoCap = (off.flags & NETIF_OFF_IPV4) ? NETIF_CAP_TSO4 : NETIF_CAP_TSO6;
+		if ((getInterfaceCaps(netif) & tsoCap) == 0)
+		{
+			return segmentPacket(netif, gateway, packet, packetlen, &off, nanotimeout);
+		};
+	};
+	
+	return transmitPacket(netif, gateway, packet, packetlen, &off, nanotimeout);
+};
+
 int sendPacket(struct sockaddr *src, const struct sockaddr *dest, const void *packet, size_t packetlen, int flags,
 		uint64_t nanotimeout, const char *ifname)
 {
@@ -633,8 +1044,79 @@ int sendPacket(struct sockaddr *src, const struct sockaddr *dest, const void *pa
 	return sendPacketEx(src, dest, packet, packetlen, proto, opts, ifname);
 };
 
+/**
+ * Lock the interface list in order to send along 'route', the result of routeLookup() (which returned 'status').
+ * If the routing table has changed since the lookup, it is repeated, since the interface may be gone; the table
+ * cannot change again while we hold the lock. Returns the interface to send through, with iflistLock held, or
+ * NULL (and the lock released) if there is no route.
+ */
+static NetIf* lockRoute(const struct sockaddr *dest, const char *ifname, int flags, RouteCache *cache,
+				RouteResult *route, int status)
+{
+	mutexLock(&iflistLock);
+	if ((status == 0) && (route->gen != routeGeneration()))
+	{
+		status = routeLookup(dest, ifname, flags, cache, route);
+	};
+	
+	if (status != 0)
+	{
+		mutexUnlock(&iflistLock);
+		return NULL;
+	};
+	
+	return route->netif;
+};
+
+int getRouteCaps(const struct sockaddr *dest, const char *ifname)
+{
+	struct sockaddr_in dest4;
+	if (isMappedAddress46(dest))
+	{
+		remapAddress64((struct sockaddr_in6*) dest, &dest4);
+		dest = (const struct sockaddr*) &dest4;
+	};
+	
+	if (ifname != NULL)
+	{
+		if (ifname[0] == 0)
+		{
+			ifname = NULL;
+		};
+	};
+	
+	RouteResult route;
+	int status = routeLookup(dest, ifname, 0, NULL, &route);
+	
+	int caps = 0;
+	NetIf *netif = lockRoute(dest, ifname, 0, NULL, &route, status);
+	if (netif != NULL)
+	{
+		caps = getInterfaceCaps(netif);
+		mutexUnlock(&iflistLock);
+	};
+	
+	// only report segmentation offload for the family we'll actually be sending
+	if (dest->sa_family == AF_INET)
+	{
+		caps &= ~NETIF_CAP_TSO6;
+	}
+	else
+	{
+		caps &= ~NETIF_CAP_TSO4;
+	};
+	
+	return caps;
+};
+
 int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *packet, size_t packetlen,
 			int proto, uint64_t *sockopts, const char *ifname)
+{
+	return sendPacketCached(src, dest, packet, packetlen, proto, sockopts, ifname, NULL);
+};
+
+int sendPacketCached(struct sockaddr *src, const struct sockaddr *dest, const void *packet, size_t packetlen,
+			int proto, uint64_t *sockopts, const char *ifname, RouteCache *cache)
 {
 	static uint8_t zeroes[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 	if (ifname != NULL)
@@ -670,8 +1152,8 @@ int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *
 		remapAddress64((struct sockaddr_in6*) dest, (struct sockaddr_in*) &dest4);
 		
 		// send the packet over IPv4
-		int status = sendPacketEx((struct sockaddr*) &src4, (const struct sockaddr*) &dest4, packet, packetlen, proto,
-						sockopts, ifname);
+		int status = sendPacketCached((struct sockaddr*) &src4, (const struct sockaddr*) &dest4, packet, packetlen, proto,
+						sockopts, ifname, cache);
 		
 		// IPv6 sockets that send IPv4 datagrams must become bound to "::" if they are currently unbound
 		if (src->sa_family == AF_UNSPEC)
@@ -690,14 +1172,18 @@ int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *
 		return -EINVAL;
 	};
 	
+	// the route tells us both the default source address and where to send; with a cache and an unchanged
+	// routing table, this does not even walk the table
+	RouteResult route;
+	int routeStatus = routeLookup(dest, ifname, (int) sockopts[GSO_SNDFLAGS], cache, &route);
+	
 	if (src->sa_family == AF_UNSPEC)
 	{
 		if (dest->sa_family == AF_INET)
 		{
 			struct sockaddr_in *insrc = (struct sockaddr_in*) src;
-			struct sockaddr_in *indst = (struct sockaddr_in*) dest;
 			insrc->sin_family = AF_INET;
-			getDefaultAddr4(&insrc->sin_addr, &indst->sin_addr, ifname);
+			memcpy(&insrc->sin_addr, route.src, 4);
 		}
 		else if (dest->sa_family == AF_INET6)
 		{
@@ -705,7 +1191,7 @@ int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *
 			struct sockaddr_in6 *indst = (struct sockaddr_in6*) dest;
 			insrc->sin6_family = AF_INET6;
 			insrc->sin6_scope_id = indst->sin6_scope_id;
-			getDefaultAddr6(&insrc->sin6_addr, &indst->sin6_addr, ifname);
+			memcpy(&insrc->sin6_addr, route.src, 16);
 		}
 		else
 		{
@@ -723,26 +1209,24 @@ int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *
 	if (src->sa_family == AF_INET)
 	{
 		struct sockaddr_in *insrc = (struct sockaddr_in*) src;
-		const struct sockaddr_in *indst = (const struct sockaddr_in*) dest;
 		struct sockaddr_in *inreplace = (struct sockaddr_in*) &src_replace;
 		
 		if (memcmp(&insrc->sin_addr, zeroes, 4) == 0)
 		{
 			memcpy(&src_replace, insrc, sizeof(struct sockaddr));
-			getDefaultAddr4(&inreplace->sin_addr, &indst->sin_addr, ifname);
+			memcpy(&inreplace->sin_addr, route.src, 4);
 			src = &src_replace;
 		};
 	}
 	else
 	{
 		struct sockaddr_in6 *insrc = (struct sockaddr_in6*) src;
-		const struct sockaddr_in6 *indst = (const struct sockaddr_in6*) dest;
 		struct sockaddr_in6 *inreplace = (struct sockaddr_in6*) &src_replace;
 		
 		if (memcmp(&insrc->sin6_addr, zeroes, 16) == 0)
 		{
 			memcpy(&src_replace, insrc, sizeof(struct sockaddr));
-			getDefaultAddr6(&inreplace->sin6_addr, &indst->sin6_addr, ifname);
+			memcpy(&inreplace->sin6_addr, route.src, 16);
 			src = &src_replace;
 		};
 	};
@@ -809,13 +1293,31 @@ int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *
 		};
 	};
 	
-	// TODO: proper path MTU discovery!
-	size_t mtu = 1280;
-	if (dest->sa_family == AF_INET)
+	// checksum offload only makes sense for TCP and UDP, and segmentation offload for TCP
+	if (proto != IPPROTO_TCP)
+	{
+		flags &= ~PKT_TSO;
+		if (proto != IPPROTO_UDP)
+		{
+			flags &= ~PKT_CSUM_OFFLOAD;
+		};
+	};
+	
+	if (flags & PKT_TSO)
 	{
-		mtu = 576;
+		size_t tsoMax = NETIF_TSO_MAX;
+		if ((flags & PKT_HDRINC) == 0)
+		{
+			tsoMax -= (dest->sa_family == AF_INET ? 20 : 40);
+		};
+		
+		if (packetlen > tsoMax)
+		{
+			return -E2BIG;
+		};
 	};
 	
+	size_t mtu = pathMTU(dest->sa_family);
 	if ((flags & PKT_HDRINC) == 0)
 	{
 		if (dest->sa_family == AF_INET)
@@ -828,13 +1330,36 @@ int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *
 		};
 	};
 	
-	if (packetlen > mtu)
+	if ((packetlen > mtu) && ((flags & PKT_TSO) == 0))
 	{
 		if (flags & PKT_DONTFRAG)
 		{
 			return -E2BIG;
 		};
 		
+		if (flags & PKT_CSUM_OFFLOAD)
+		{
+			// the checksum covers the whole datagram, so it cannot be left to the device once we fragment
+			uint8_t *copy = (uint8_t*) kmalloc(packetlen);
+			memcpy(copy, packet, packetlen);
+			
+			size_t csumoff = (proto == IPPROTO_TCP) ? 16 : 6;
+			*((uint16_t*)&copy[csumoff]) = 0;
+			uint16_t sum = transportChecksum(src, dest, proto, copy, packetlen);
+			if ((sum == 0) && (proto == IPPROTO_UDP))
+			{
+				sum = 0xFFFF;
+			};
+			*((uint16_t*)&copy[csumoff]) = sum;
+			
+			uint64_t newopts[GSO_COUNT];
+			memcpy(newopts, sockopts, sizeof(uint64_t)*GSO_COUNT);
+			newopts[GSO_SNDFLAGS] = (uint64_t) (flags & ~PKT_CSUM_OFFLOAD);
+			int status = sendPacketCached(src, dest, copy, packetlen, proto, newopts, ifname, cache);
+			kfree(copy);
+			return status;
+		};
+		
 		// we're fragmenting, so for IPv6 we must also append a fragment extension header!
 		if (dest->sa_family == AF_INET6)
 		{
@@ -910,7 +1435,7 @@ int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *
 			uint64_t newopts[GSO_COUNT];
 			memcpy(newopts, sockopts, sizeof(uint64_t)*GSO_COUNT);
 			newopts[GSO_SNDFLAGS] = flags | PKT_HDRINC;
-			int status = sendPacketEx(src, dest, encapPacket, encapSize, proto, newopts, ifname);
+			int status = sendPacketCached(src, dest, encapPacket, encapSize, proto, newopts, ifname, cache);
 			kfree(encapPacket);
 			
 			if (status != 0) return status;
@@ -969,137 +1494,23 @@ int sendPacketEx(struct sockaddr *src, const struct sockaddr *dest, const void *
 		uint64_t newopts[GSO_COUNT];
 		memcpy(newopts, sockopts, sizeof(uint64_t)*GSO_COUNT);
 		newopts[GSO_SNDFLAGS] = (uint64_t)flags | PKT_HDRINC;
-		int status = sendPacketEx(src, dest, encapPacket, encapSize, proto, newopts, ifname);
+		int status = sendPacketCached(src, dest, encapPacket, encapSize, proto, newopts, ifname, cache);
 		kfree(encapPacket);
 		return status;
 	};
 	
-	// at this point, we have an IP packet with a complete header, which we just have to send to an interface.
-	// so we look through the routing tables, select an interface, and attempt to transmit by using address
-	// resolution.
-	mutexLock(&iflistLock);
-	
-	NetIf *netif;
-	for (netif=&iflist; netif!=NULL; netif=netif->next)
+	// at this point, we have an IP packet with a complete header, which we just have to send to the interface
+	// we routed to, and attempt to transmit by using address resolution.
+	NetIf *netif = lockRoute(dest, ifname, flags, cache, &route, routeStatus);
+	if (netif == NULL)
 	{
-		int useThisOne = 1;
-		
-		if (ifname != NULL)
-		{
-			if (strcmp(ifname, netif->name) != 0)
-			{
-				useThisOne = 0;
-			};
-		};
-		
-		if (dest->sa_family == AF_INET6)
-		{
-			const struct sockaddr_in6 *indst = (const struct sockaddr_in6*) dest;
-			if (indst->sin6_scope_id != 0)
-			{
-				if (indst->sin6_scope_id != netif->scopeID)
-				{
-					useThisOne = 0;
-				};
-			};
-		};
-		
-		if (useThisOne)
-		{
-			if (dest->sa_family == AF_INET)
-			{
-				const struct sockaddr_in *indst = (const struct sockaddr_in*) dest;
-				struct sockaddr_in gateway;
-				gateway.sin_family = AF_INET;
-				
-				int gatewayFound = 0;
-				int i;
-				
-				if (flags & PKT_DONTROUTE)
-				{
-					gatewayFound = 1;
-					memcpy(&gateway, indst, sizeof(struct sockaddr_in));
-				}
-				else
-				{
-					for (i=0; i<netif->ipv4.numRoutes; i++)
-					{
-						IPRoute4 *route = &netif->ipv4.routes[i];
-						if (isMatchingMask(&route->dest, &indst->sin_addr, &route->mask, 4))
-						{
-							if (memcmp(&route->gateway, zeroes, 4) == 0)
-							{
-								memcpy(&gateway.sin_addr, &indst->sin_addr, 4);
-							}
-							else
-							{
-								memcpy(&gateway.sin_addr, &route->gateway, 4);
-							};
-						
-							gatewayFound = 1;
-							break;
-						};
-					};
-				};
-				
-				if (gatewayFound)
-				{
-					int status = sendPacketToInterface(netif, (struct sockaddr*) &gateway,
-										packet, packetlen, sockopts[GSO_SNDTIMEO]);
-					mutexUnlock(&iflistLock);
-					return status;
-				};
-			}
-			else
-			{
-				const struct sockaddr_in6 *indst = (const struct sockaddr_in6*) dest;
-				struct sockaddr_in6 gateway;
-				gateway.sin6_family = AF_INET6;
-				
-				int gatewayFound = 0;
-				int i;
-				
-				if (flags & PKT_DONTROUTE)
-				{
-					gatewayFound = 1;
-					memcpy(&gateway, indst, sizeof(struct sockaddr_in6));
-				}
-				else
-				{
-					for (i=0; i<netif->ipv6.numRoutes; i++)
-					{
-						IPRoute6 *route = &netif->ipv6.routes[i];
-						if (isMatchingMask(&route->dest, &indst->sin6_addr, &route->mask, 16))
-						{
-							if (memcmp(&route->gateway, zeroes, 16) == 0)
-							{
-								memcpy(&gateway.sin6_addr, &indst->sin6_addr, 16);
-							}
-							else
-							{
-								memcpy(&gateway.sin6_addr, &route->gateway, 16);
-							};
-							
-							gateway.sin6_scope_id = netif->scopeID;
-							gatewayFound = 1;
-							break;
-						};
-					};
-				};
-				
-				if (gatewayFound)
-				{
-					int status = sendPacketToInterface(netif, (struct sockaddr*) &gateway,
-										packet, packetlen, sockopts[GSO_SNDTIMEO]);
-					mutexUnlock(&iflistLock);
-					return status;
-				};
-			};
-		};
+		return -ENETUNREACH;
 	};
 	
+	int status = sendPacketToInterface(netif, (struct sockaddr*) &route.gateway, packet, packetlen, flags,
+						sockopts[GSO_SNDTIMEO]);
 	mutexUnlock(&iflistLock);
-	return -ENETUNREACH;
+	return status;
 };
 
 void getDefaultAddr4(struct in_addr *src, const struct in_addr *dest, const char *ifname)
@@ -1112,51 +1523,14 @@ void getDefaultAddr4(struct in_addr *src, const struct in_addr *dest, const char
 		};
 	};
 	
-	uint32_t addr = *((uint32_t*)dest);
-
-	mutexLock(&iflistLock);
-	
-	NetIf *netif;
-	for (netif=&iflist; netif!=NULL; netif=netif->next)
-	{
-		if (ifname != NULL)
-		{
-			if (strcmp(netif->name, ifname) != 0)
-			{
-				continue;
-			};
-		};
-		
-		int i;
-		for (i=0; i<netif->ipv4.numRoutes; i++)
-		{
-			IPRoute4 *route = &netif->ipv4.routes[i];
-
-			uint32_t dest = *((uint32_t*)&route->dest);
-			uint32_t mask = *((uint32_t*)&route->mask);
-			
-			if ((addr & mask) == (dest & mask))
-			{	
-				int j;
-				for (j=0; j<netif->ipv4.numAddrs; j++)
-				{
-					if (netif->ipv4.addrs[j].domain == route->domain)
-					{
-						memcpy(src, &netif->ipv4.addrs[j].addr, 4);
-						mutexUnlock(&iflistLock);
-						return;
-					};
-				};
-				
-				memset(src, 0, 4);
-				mutexUnlock(&iflistLock);
-				return;
-			};
-		};
-	};
+	struct sockaddr_in indst;
+	memset(&indst, 0, sizeof(struct sockaddr_in));
+	indst.sin_family = AF_INET;
+	memcpy(&indst.sin_addr, dest, 4);
 	
-	memset(src, 0, 4);
-	mutexUnlock(&iflistLock);
+	RouteResult route;
+	routeLookup((struct sockaddr*) &indst, ifname, 0, NULL, &route);
+	memcpy(src, route.src, 4);
 };
 
 void getDefaultAddr6(struct in6_addr *src, const struct in6_addr *dest, const char *ifname)
@@ -1168,52 +1542,15 @@ void getDefaultAddr6(struct in6_addr *src, const struct in6_addr *dest, const ch
 			ifname = NULL;
 		};
 	};
-
-	uint64_t *addr = ((uint64_t*)dest);
-	
-	mutexLock(&iflistLock);
 	
-	NetIf *netif = &iflist;
-	for (netif=&iflist; netif!=NULL; netif=netif->next)
-	{
-		if (ifname != NULL)
-		{
-			if (strcmp(netif->name, ifname) != 0)
-			{
-				continue;
-			};
-		};
-		
-		int i;
-		for (i=0; i<netif->ipv6.numRoutes; i++)
-		{
-			IPRoute6 *route = &netif->ipv6.routes[i];
-
-			uint64_t *dest = ((uint64_t*)&route->dest);
-			uint64_t *mask = ((uint64_t*)&route->mask);
-
-			if (((addr[0] & mask[0]) == (dest[0] & mask[0])) && ((addr[1] & mask[1]) == (dest[1] & mask[1])))
-			{	
-				int j;
-				for (j=0; j<netif->ipv6.numAddrs; j++)
-				{
-					if (netif->ipv6.addrs[j].domain == route->domain)
-					{
-						memcpy(src, &netif->ipv6.addrs[j].addr, 16);
-						mutexUnlock(&iflistLock);
-						return;
-					};
-				};
-				
-				memset(src, 0, 16);
-				mutexUnlock(&iflistLock);
-				return;
-			};
-		};
-	};
+	struct sockaddr_in6 indst;
+	memset(&indst, 0, sizeof(struct sockaddr_in6));
+	indst.sin6_family = AF_INET6;
+	memcpy(&indst.sin6_addr, dest, 16);
 	
-	memset(src, 0, 16);
-	mutexUnlock(&iflistLock);
+	RouteResult route;
+	routeLookup((struct sockaddr*) &indst, ifname, 0, NULL, &route);
+	memcpy(src, route.src, 16);
 };
 
 int route_add(int family, int pos, gen_route *route)
@@ -1240,50 +1577,62 @@ int route_add(int family, int pos, gen_route *route)
 			if (family == AF_INET)
 			{
 				in_route *inroute = (in_route*) route;
+				if (netif->ipv4.numRoutes == netif->ipv4.capRoutes)
+				{
+					// grow geometrically, so that adding many routes is not quadratic
+					netif->ipv4.capRoutes = netif->ipv4.capRoutes * 2 + 4;
+					netif->ipv4.routes = (IPRoute4*) krealloc(netif->ipv4.routes,
+									sizeof(IPRoute4)*netif->ipv4.capRoutes);
+				};
+				
 				netif->ipv4.numRoutes++;
-				IPRoute4 *oldRoutes = netif->ipv4.routes;
-				netif->ipv4.routes = (IPRoute4*) kmalloc(sizeof(IPRoute4)*netif->ipv4.numRoutes);
-				if (pos == -1)
+				if ((pos == -1) || (pos > (netif->ipv4.numRoutes - 1)))
 				{
 					pos = netif->ipv4.numRoutes - 1;
 				};
-				if (pos > (netif->ipv4.numRoutes - 1))
+				
+				int i;
+				for (i=netif->ipv4.numRoutes-1; i>pos; i--)
 				{
-					pos = netif->ipv4.numRoutes - 1;
+					memcpy(&netif->ipv4.routes[i], &netif->ipv4.routes[i-1], sizeof(IPRoute4));
 				};
 				
-				memcpy(netif->ipv4.routes, oldRoutes, sizeof(IPRoute4)*pos);
-				memcpy(&netif->ipv4.routes[pos+1], &oldRoutes[pos], sizeof(IPRoute4)*(netif->ipv4.numRoutes-1-pos));
 				memcpy(&netif->ipv4.routes[pos].dest, &inroute->dest, 4);
 				memcpy(&netif->ipv4.routes[pos].mask, &inroute->mask, 4);
 				memcpy(&netif->ipv4.routes[pos].gateway, &inroute->gateway, 4);
 				netif->ipv4.routes[pos].domain = inroute->domain;
-				kfree(oldRoutes);
+				routeRebuild(&iflist);
 				mutexUnlock(&iflistLock);
 				return 0;
 			}
 			else if (family == AF_INET6)
 			{
 				in6_route *inroute = (in6_route*) route;
+				if (netif->ipv6.numRoutes == netif->ipv6.capRoutes)
+				{
+					// grow geometrically, so that adding many routes is not quadratic
+					netif->ipv6.capRoutes = netif->ipv6.capRoutes * 2 + 4;
+					netif->ipv6.routes = (IPRoute6*) krealloc(netif->ipv6.routes,
+									sizeof(IPRoute6)*netif->ipv6.capRoutes);
+				};
+				
 				netif->ipv6.numRoutes++;
-				IPRoute6 *oldRoutes = netif->ipv6.routes;
-				netif->ipv6.routes = (IPRoute6*) kmalloc(sizeof(IPRoute6)*netif->ipv6.numRoutes);
-				if (pos == -1)
+				if ((pos == -1) || (pos > (netif->ipv6.numRoutes - 1)))
 				{
 					pos = netif->ipv6.numRoutes - 1;
 				};
-				if (pos > (netif->ipv6.numRoutes - 1))
+				
+				int i;
+				for (i=netif->ipv6.numRoutes-1; i>pos; i--)
 				{
-					pos = netif->ipv6.numRoutes - 1;
+					memcpy(&netif->ipv6.routes[i], &netif->ipv6.routes[i-1], sizeof(IPRoute6));
 				};
 				
-				memcpy(netif->ipv6.routes, oldRoutes, sizeof(IPRoute6)*pos);
-				memcpy(&netif->ipv6.routes[pos+1], &oldRoutes[pos], sizeof(IPRoute6)*(netif->ipv6.numRoutes-1-pos));
 				memcpy(&netif->ipv6.routes[pos].dest, &inroute->dest, 16);
 				memcpy(&netif->ipv6.routes[pos].mask, &inroute->mask, 16);
 				memcpy(&netif->ipv6.routes[pos].gateway, &inroute->gateway, 16);
 				netif->ipv6.routes[pos].domain = inroute->domain;
-				kfree(oldRoutes);
+				routeRebuild(&iflist);
 				mutexUnlock(&iflistLock);
 				return 0;
 			};
@@ -1328,7 +1677,9 @@ int route_clear(int family, const char *ifname)
 				};
 				
 				netif->ipv4.numRoutes = 0;
+				netif->ipv4.capRoutes = 0;
 				netif->ipv4.routes = NULL;
+				routeRebuild(&iflist);
 				mutexUnlock(&iflistLock);
 				return 0;
 			}
@@ -1340,7 +1691,9 @@ int route_clear(int family, const char *ifname)
 				};
 				
 				netif->ipv6.numRoutes = 0;
+				netif->ipv6.capRoutes = 0;
 				netif->ipv6.routes = NULL;
+				routeRebuild(&iflist);
 				mutexUnlock(&iflistLock);
 				return 0;
 			};
@@ -1565,7 +1918,7 @@ NetIf *CreateNetworkInterface(void *drvdata, NetIfConfig *ifconfig)
 	
 	if (ifconfig->type == IF_ETHERNET)
 	{
-		semInit(&netif->ifconfig.ethernet.resLock);
+		netif->ifconfig.ethernet.neigh = etherCreateNeighbors();
 	};
 	
 	NetIf *last = &iflist;
@@ -1577,6 +1930,7 @@ NetIf *CreateNetworkInterface(void *drvdata, NetIfConfig *ifconfig)
 	last->next = netif;
 	netif->prev = last;
 	
+	routeRebuild(&iflist);
 	mutexUnlock(&iflistLock);
 	return netif;
 };
@@ -1586,8 +1940,14 @@ void DeleteNetworkInterface(NetIf *netif)
 	mutexLock(&iflistLock);
 	if (netif->prev != NULL) netif->prev->next = netif->next;
 	if (netif->next != NULL) netif->next->prev = netif->prev;
+	routeRebuild(&iflist);
 	mutexUnlock(&iflistLock);
 	
+	if (netif->ifconfig.type == IF_ETHERNET)
+	{
+		etherDestroyNeighbors(netif->ifconfig.ethernet.neigh);
+	};
+	
 	kfree(netif);
 };
 
@@ -1715,6 +2075,7 @@ int netconf_addr(int family, const char *ifname, const void *buffer, size_t size
 				netif->ipv4.addrs = (IPNetIfAddr4*) kmalloc(size);
 				memcpy(netif->ipv4.addrs, buffer, size);
 				
+				routeRebuild(&iflist);
 				mutexUnlock(&iflistLock);
 				return 0;
 			}
@@ -1730,6 +2091,7 @@ int netconf_addr(int family, const char *ifname, const void *buffer, size_t size
 				netif->ipv6.addrs = (IPNetIfAddr6*) kmalloc(size);
 				memcpy(netif->ipv6.addrs, buffer, size);
 				
+				routeRebuild(&iflist);
 				mutexUnlock(&iflistLock);
 				return 0;
 			};
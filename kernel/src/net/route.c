@@ -0,0 +1,557 @@
+/*
+	Glidix kernel
+	
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <glidix/net/route.h>
+#include <glidix/net/netif.h>
+#include <glidix/util/string.h>
+#include <glidix/util/memory.h>
+#include <glidix/util/errno.h>
+
+/**
+ * A route attached to a trie node. The interface name and scope are copied in so that lookups never have to
+ * dereference the interface.
+ */
+typedef struct RouteEntry_
+{
+	struct RouteEntry_*			next;
+	NetIf*					netif;
+	char					ifname[16];
+	uint32_t				scopeID;
+	int					direct;		/* no gateway; send straight to the destination */
+	uint8_t					gateway[16];
+	uint8_t					src[16];
+} RouteEntry;
+
+/**
+ * Trie node. The node covers all addresses whose first 'len' bits are equal to those of 'key'; the children cover
+ * the addresses where the next bit is 0 and 1 respectively, and only nodes where prefixes diverge or where routes
+ * are attached exist (path compression).
+ */
+typedef struct RouteNode_
+{
+	struct RouteNode_*			child[2];
+	uint8_t					key[16];
+	int					len;
+	RouteEntry*				entries;
+	RouteEntry*				lastEntry;
+} RouteNode;
+
+/**
+ * Interface list as of the time the table was built, for PKT_DONTROUTE.
+ */
+typedef struct
+{
+	NetIf*					netif;
+	char					ifname[16];
+	uint32_t				scopeID;
+} RouteIface;
+
+typedef struct
+{
+	int					refcount;
+	uint64_t				gen;
+	RouteNode*				root4;
+	RouteNode*				root6;
+	RouteIface*				ifaces;
+	int					numIfaces;
+} RouteTable;
+
+static Spinlock tableLock;
+static RouteTable *currentTable;
+static volatile uint64_t currentGen;
+static uint64_t nextGen = 1;
+
+static int getBit(const uint8_t *key, int index)
+{
+	return (key[index >> 3] >> (7 - (index & 7))) & 1;
+};
+
+/**
+ * Return the number of leading bits (at most 'max') which are equal in 'a' and 'b'.
+ */
+static int commonPrefix(const uint8_t *a, const uint8_t *b, int max)
+{
+	int count = 0;
+	int i;
+	for (i=0; count<max; i++)
+	{
+		uint8_t diff = a[i] ^ b[i];
+		if (diff == 0)
+		{
+			count += 8;
+		}
+		else
+		{
+			count += __builtin_clz((unsigned int) diff) - 24;
+			break;
+		};
+	};
+	
+	if (count > max) count = max;
+	return count;
+};
+
+/**
+ * Return the length of a prefix given as a netmask (the number of leading 1 bits).
+ */
+static int maskLength(const uint8_t *mask, int bytes)
+{
+	int len = 0;
+	int i;
+	for (i=0; i<bytes; i++)
+	{
+		if (mask[i] == 0xFF)
+		{
+			len += 8;
+		}
+		else
+		{
+			len += __builtin_clz((unsigned int) (uint8_t) ~mask[i]) - 24;
+			break;
+		};
+	};
+	
+	return len;
+};
+
+static RouteNode* newNode(const uint8_t *key, int len)
+{
+	RouteNode *node = NEW(RouteNode);
+	memset(node, 0, sizeof(RouteNode));
+	node->len = len;
+	
+	int i;
+	for (i=0; i<len; i+=8)
+	{
+		uint8_t byte = key[i >> 3];
+		if ((len - i) < 8)
+		{
+			byte &= (uint8_t) (0xFF << (8 - (len - i)));
+		};
+		
+		node->key[i >> 3] = byte;
+	};
+	
+	return node;
+};
+
+static void appendEntry(RouteNode *node, RouteEntry *entry)
+{
+	entry->next = NULL;
+	if (node->lastEntry == NULL)
+	{
+		node->entries = node->lastEntry = entry;
+	}
+	else
+	{
+		node->lastEntry->next = entry;
+		node->lastEntry = entry;
+	};
+};
+
+static void trieInsert(RouteNode **link, const uint8_t *key, int len, RouteEntry *entry)
+{
+	while (1)
+	{
+		RouteNode *node = *link;
+		if (node == NULL)
+		{
+			node = newNode(key, len);
+			appendEntry(node, entry);
+			*link = node;
+			return;
+		};
+		
+		int common = commonPrefix(node->key, key, node->len < len ? node->len : len);
+		if (common == node->len)
+		{
+			if (common == len)
+			{
+				appendEntry(node, entry);
+				return;
+			};
+			
+			// this node's prefix contains ours; go further down
+			link = &node->child[getBit(key, node->len)];
+			continue;
+		};
+		
+		if (common == len)
+		{
+			// our prefix contains this node's; insert above it
+			RouteNode *parent = newNode(key, len);
+			parent->child[getBit(node->key, len)] = node;
+			appendEntry(parent, entry);
+			*link = parent;
+			return;
+		};
+		
+		// the prefixes diverge at bit 'common'
+		RouteNode *branch = newNode(key, common);
+		RouteNode *leaf = newNode(key, len);
+		appendEntry(leaf, entry);
+		branch->child[getBit(node->key, common)] = node;
+		branch->child[getBit(key, common)] = leaf;
+		*link = branch;
+		return;
+	};
+};
+
+static void trieFree(RouteNode *node)
+{
+	if (node == NULL) return;
+	
+	trieFree(node->child[0]);
+	trieFree(node->child[1]);
+	
+	RouteEntry *entry = node->entries;
+	while (entry != NULL)
+	{
+		RouteEntry *next = entry->next;
+		kfree(entry);
+		entry = next;
+	};
+	
+	kfree(node);
+};
+
+static int entryMatches(const char *ifname, uint32_t scopeID, const char *entIfname, uint32_t entScopeID)
+{
+	if ((ifname != NULL) && (strcmp(ifname, entIfname) != 0))
+	{
+		return 0;
+	};
+	
+	if ((scopeID != 0) && (scopeID != entScopeID))
+	{
+		return 0;
+	};
+	
+	return 1;
+};
+
+/**
+ * Find the highest-priority entry for the longest prefix containing 'addr', on an interface which fits the
+ * filter. Returns NULL if there is none.
+ */
+static RouteEntry* trieLookup(RouteNode *node, const uint8_t *addr, int bits, const char *ifname, uint32_t scopeID)
+{
+	RouteEntry *best = NULL;
+	while (node != NULL)
+	{
+		if (commonPrefix(node->key, addr, node->len) != node->len)
+		{
+			break;
+		};
+		
+		RouteEntry *entry;
+		for (entry=node->entries; entry!=NULL; entry=entry->next)
+		{
+			if (entryMatches(ifname, scopeID, entry->ifname, entry->scopeID))
+			{
+				best = entry;
+				break;
+			};
+		};
+		
+		if (node->len == bits)
+		{
+			break;
+		};
+		
+		node = node->child[getBit(addr, node->len)];
+	};
+	
+	return best;
+};
+
+static RouteEntry* newEntry(NetIf *netif, const void *gateway, const void *src, size_t addrlen)
+{
+	static uint8_t zeroes[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	
+	RouteEntry *entry = NEW(RouteEntry);
+	memset(entry, 0, sizeof(RouteEntry));
+	entry->netif = netif;
+	strcpy(entry->ifname, netif->name);
+	entry->scopeID = netif->scopeID;
+	entry->direct = (memcmp(gateway, zeroes, addrlen) == 0);
+	memcpy(entry->gateway, gateway, addrlen);
+	if (src != NULL) memcpy(entry->src, src, addrlen);
+	return entry;
+};
+
+static void freeTable(RouteTable *table)
+{
+	trieFree(table->root4);
+	trieFree(table->root6);
+	kfree(table->ifaces);
+	kfree(table);
+};
+
+static RouteTable* acquireTable()
+{
+	spinlockAcquire(&tableLock);
+	RouteTable *table = currentTable;
+	if (table != NULL) __sync_fetch_and_add(&table->refcount, 1);
+	spinlockRelease(&tableLock);
+	return table;
+};
+
+static void releaseTable(RouteTable *table)
+{
+	if (__sync_add_and_fetch(&table->refcount, -1) == 0)
+	{
+		freeTable(table);
+	};
+};
+
+void routeRebuild(NetIf *iflist)
+{
+	RouteTable *table = NEW(RouteTable);
+	memset(table, 0, sizeof(RouteTable));
+	table->refcount = 1;
+	table->gen = nextGen++;
+	
+	NetIf *netif;
+	for (netif=iflist; netif!=NULL; netif=netif->next)
+	{
+		table->numIfaces++;
+	};
+	
+	table->ifaces = (RouteIface*) kmalloc(sizeof(RouteIface) * table->numIfaces);
+	
+	int index = 0;
+	for (netif=iflist; netif!=NULL; netif=netif->next)
+	{
+		RouteIface *iface = &table->ifaces[index++];
+		iface->netif = netif;
+		strcpy(iface->ifname, netif->name);
+		iface->scopeID = netif->scopeID;
+		
+		int i, j;
+		for (i=0; i<netif->ipv4.numRoutes; i++)
+		{
+			IPRoute4 *route = &netif->ipv4.routes[i];
+			
+			const void *src = NULL;
+			for (j=0; j<netif->ipv4.numAddrs; j++)
+			{
+				if (netif->ipv4.addrs[j].domain == route->domain)
+				{
+					src = &netif->ipv4.addrs[j].addr;
+					break;
+				};
+			};
+			
+			uint8_t key[16];
+			memset(key, 0, 16);
+			memcpy(key, &route->dest, 4);
+			trieInsert(&table->root4, key, maskLength((uint8_t*) &route->mask, 4),
+					newEntry(netif, &route->gateway, src, 4));
+		};
+		
+		for (i=0; i<netif->ipv6.numRoutes; i++)
+		{
+			IPRoute6 *route = &netif->ipv6.routes[i];
+			
+			const void *src = NULL;
+			for (j=0; j<netif->ipv6.numAddrs; j++)
+			{
+				if (netif->ipv6.addrs[j].domain == route->domain)
+				{
+					src = &netif->ipv6.addrs[j].addr;
+					break;
+				};
+			};
+			
+			trieInsert(&table->root6, (uint8_t*) &route->dest, maskLength((uint8_t*) &route->mask, 16),
+					newEntry(netif, &route->gateway, src, 16));
+		};
+	};
+	
+	spinlockAcquire(&tableLock);
+	RouteTable *old = currentTable;
+	currentTable = table;
+	currentGen = table->gen;
+	spinlockRelease(&tableLock);
+	
+	if (old != NULL) releaseTable(old);
+};
+
+uint64_t routeGeneration()
+{
+	return currentGen;
+};
+
+static int isSameDest(const struct sockaddr *a, const struct sockaddr *b)
+{
+	if (a->sa_family != b->sa_family)
+	{
+		return 0;
+	};
+	
+	if (a->sa_family == AF_INET)
+	{
+		return ((const struct sockaddr_in*)a)->sin_addr.s_addr == ((const struct sockaddr_in*)b)->sin_addr.s_addr;
+	}
+	else
+	{
+		const struct sockaddr_in6 *a6 = (const struct sockaddr_in6*) a;
+		const struct sockaddr_in6 *b6 = (const struct sockaddr_in6*) b;
+		return (memcmp(&a6->sin6_addr, &b6->sin6_addr, 16) == 0) && (a6->sin6_scope_id == b6->sin6_scope_id);
+	};
+};
+
+int routeLookup(const struct sockaddr *dest, const char *ifname, int flags, RouteCache *cache, RouteResult *out)
+{
+	memset(out, 0, sizeof(RouteResult));
+	flags &= PKT_DONTROUTE;
+	if ((dest->sa_family != AF_INET) && (dest->sa_family != AF_INET6))
+	{
+		return -EINVAL;
+	};
+	
+	if (cache != NULL)
+	{
+		int hit = 0;
+		spinlockAcquire(&cache->lock);
+		if ((cache->res.gen == currentGen) && (cache->flags == flags) && isSameDest((struct sockaddr*) &cache->dest, dest)
+			&& (strcmp(cache->ifname, ifname == NULL ? "" : ifname) == 0))
+		{
+			memcpy(out, &cache->res, sizeof(RouteResult));
+			hit = 1;
+		};
+		spinlockRelease(&cache->lock);
+		
+		if (hit) return 0;
+	};
+	
+	RouteTable *table = acquireTable();
+	if (table == NULL)
+	{
+		return -ENETUNREACH;
+	};
+	
+	out->gen = table->gen;
+	
+	RouteEntry *entry;
+	uint32_t scopeID = 0;
+	if (dest->sa_family == AF_INET)
+	{
+		const struct sockaddr_in *indst = (const struct sockaddr_in*) dest;
+		uint8_t addr[16];
+		memset(addr, 0, 16);
+		memcpy(addr, &indst->sin_addr, 4);
+		entry = trieLookup(table->root4, addr, 32, ifname, 0);
+	}
+	else
+	{
+		const struct sockaddr_in6 *indst = (const struct sockaddr_in6*) dest;
+		scopeID = indst->sin6_scope_id;
+		entry = trieLookup(table->root6, (const uint8_t*) &indst->sin6_addr, 128, ifname, scopeID);
+	};
+	
+	if (entry != NULL)
+	{
+		memcpy(out->src, entry->src, 16);
+	};
+	
+	if (flags & PKT_DONTROUTE)
+	{
+		// the first interface which fits, and the destination is the next hop
+		entry = NULL;
+		int i;
+		for (i=0; i<table->numIfaces; i++)
+		{
+			RouteIface *iface = &table->ifaces[i];
+			if (entryMatches(ifname, scopeID, iface->ifname, iface->scopeID))
+			{
+				out->netif = iface->netif;
+				break;
+			};
+		};
+		
+		if (dest->sa_family == AF_INET)
+		{
+			memcpy(&out->gateway, dest, sizeof(struct sockaddr_in));
+		}
+		else
+		{
+			memcpy(&out->gateway, dest, sizeof(struct sockaddr_in6));
+		};
+	}
+	else if (entry != NULL)
+	{
+		out->netif = entry->netif;
+		if (dest->sa_family == AF_INET)
+		{
+			const struct sockaddr_in *indst = (const struct sockaddr_in*) dest;
+			struct sockaddr_in *ingw = (struct sockaddr_in*) &out->gateway;
+			ingw->sin_family = AF_INET;
+			
+			if (entry->direct) memcpy(&ingw->sin_addr, &indst->sin_addr, 4);
+			else memcpy(&ingw->sin_addr, entry->gateway, 4);
+		}
+		else
+		{
+			const struct sockaddr_in6 *indst = (const struct sockaddr_in6*) dest;
+			struct sockaddr_in6 *ingw = &out->gateway;
+			ingw->sin6_family = AF_INET6;
+			
+			if (entry->direct) memcpy(&ingw->sin6_addr, &indst->sin6_addr, 16);
+			else memcpy(&ingw->sin6_addr, entry->gateway, 16);
+			ingw->sin6_scope_id = entry->scopeID;
+		};
+	};
+	
+	releaseTable(table);
+	
+	if (out->netif == NULL)
+	{
+		return -ENETUNREACH;
+	};
+	
+	if (cache != NULL)
+	{
+		spinlockAcquire(&cache->lock);
+		cache->flags = flags;
+		strcpy(cache->ifname, ifname == NULL ? "" : ifname);
+		if (dest->sa_family == AF_INET)
+		{
+			memcpy(&cache->dest, dest, sizeof(struct sockaddr_in));
+		}
+		else
+		{
+			memcpy(&cache->dest, dest, sizeof(struct sockaddr_in6));
+		};
+		memcpy(&cache->res, out, sizeof(RouteResult));
+		spinlockRelease(&cache->lock);
+	};
+	
+	return 0;
+};
@@ -378,6 +378,42 @@ ssize_t RecvfromSocket(File *fp, void *message, size_t len, int flags, struct so
 	return result;
 };
 
+ssize_t SendmsgSocket(File *fp, const void *message, size_t len, int flags, File **fps, int numfps)
+{
+	if ((fp->oflags & O_SOCKET) == 0)
+	{
+		ERRNO = ENOTSOCK;
+		return -1;
+	};
+	
+	Socket *sock = (Socket*) fp->iref.inode->fsdata;
+	if (sock->sendmsg == NULL)
+	{
+		ERRNO = EOPNOTSUPP;
+		return -1;
+	};
+	
+	return sock->sendmsg(sock, message, len, flags, fps, numfps);
+};
+
+ssize_t RecvmsgSocket(File *fp, void *message, size_t len, int flags, File **fps, int *numfps)
+{
+	if ((fp->oflags & O_SOCKET) == 0)
+	{
+		ERRNO = ENOTSOCK;
+		return -1;
+	};
+	
+	Socket *sock = (Socket*) fp->iref.inode->fsdata;
+	if (sock->recvmsg == NULL)
+	{
+		ERRNO = EOPNOTSUPP;
+		return -1;
+	};
+	
+	return sock->recvmsg(sock, message, len, flags, fps, numfps);
+};
+
 int SocketGetsockname(File *fp, struct sockaddr *addr, size_t *addrlen)
 {
 	if ((fp->oflags & O_SOCKET) == 0)
@@ -498,7 +534,7 @@ int isValidAddr(const struct sockaddr *addr)
 };
 
 void passPacketToSocket(const struct sockaddr *src, const struct sockaddr *dest, size_t addrlen,
-			const void *packet, size_t size, int proto, uint64_t dataOffset, const char *ifname)
+			const void *packet, size_t size, int proto, uint64_t dataOffset, const char *ifname, int flags)
 {
 	if (!isValidAddr(dest))
 	{
@@ -633,11 +669,23 @@ void passPacketToSocket(const struct sockaddr *src, const struct sockaddr *dest,
 	};
 	
 	if (realSize > size) return;
-	onTransportPacket(src, dest, addrlen, (char*)packet + dataOffset, realSize, proto, ifname);
+	onTransportPacket(src, dest, addrlen, (char*)packet + dataOffset, realSize, proto, ifname, flags);
 };
 
-void onTransportPacket(const struct sockaddr *src, const struct sockaddr *dest, size_t addrlen, const void *packet, size_t size, int proto, const char *ifname)
+void onTransportPacket(const struct sockaddr *src, const struct sockaddr *dest, size_t addrlen, const void *packet, size_t size, int proto, const char *ifname, int flags)
 {
+	if ((proto == IPPROTO_TCP) && ((flags & NETIF_RX_CSUM_VERIFIED) == 0))
+	{
+		if ((src->sa_family == AF_INET) || (src->sa_family == AF_INET6))
+		{
+			if (transportChecksum(src, dest, IPPROTO_TCP, packet, size) != 0)
+			{
+				// drop the corrupted segment
+				return;
+			};
+		};
+	};
+	
 	semWait(&sockLock);
 	
 	Socket *sock = &sockList;
@@ -869,6 +917,12 @@ int SetSocketOption(File *fp, int proto, int option, uint64_t value)
 		return -1;
 	};
 	
+	if (option == GSO_SNDFLAGS)
+	{
+		// offload flags promise that the packet is well-formed; only the kernel's own protocols may set them
+		value &= ~((uint64_t) PKT_KERNEL_ONLY);
+	};
+	
 	sock->options[option] = value;
 	return 0;
 };
@@ -33,6 +33,7 @@
 #include <glidix/util/errno.h>
 #include <glidix/thread/semaphore.h>
 #include <glidix/net/netif.h>
+#include <glidix/net/route.h>
 #include <glidix/display/console.h>
 #include <glidix/util/common.h>
 #include <glidix/util/random.h>
@@ -70,6 +71,13 @@
  */
 #define	TCP_BUFFER_SIZE				0xFFFF
 
+/**
+ * Maximum amount of data we put in one segment; when the route supports segmentation offload, we pass much
+ * larger segments down and let the interface split them (leaving room for the IP and TCP headers).
+ */
+#define	TCP_SEGMENT_SIZE			512
+#define	TCP_SEGMENT_SIZE_TSO			(NETIF_TSO_MAX - 128)
+
 typedef struct
 {
 	uint16_t				srcport;
@@ -221,6 +229,18 @@ typedef struct
 	 */
 	Semaphore				semConnWaiting;
 	TCPPending*				firstPending;
+	
+	/**
+	 * Offload capabilities (NETIF_CAP_*) of the route to the peer, and the resulting maximum amount of
+	 * data per segment. Set by the handler thread when it starts.
+	 */
+	int					caps;
+	size_t					maxSegment;
+	
+	/**
+	 * Cached route to the peer, so that sending segments does not walk the routing table.
+	 */
+	RouteCache				routeCache;
 } TCPSocket;
 
 Socket *CreateTCPSocket();
@@ -348,43 +368,33 @@ static void ChecksumOutbound(TCPOutbound *ob)
 	ob->segment->checksum = ipv4_checksum(ob->data, ob->pseudoSize);
 };
 
-static uint16_t ValidateChecksum(const struct sockaddr *src, const struct sockaddr *dest, const void *packet, size_t packetSize)
+/**
+ * Send an outbound segment to the peer. The checksum is left to the interface (and possibly the segmentation,
+ * if the segment is large) whenever the route supports it.
+ */
+static int SendOutbound(TCPSocket *tcpsock, TCPOutbound *ob)
 {
-	if (src->sa_family == AF_INET)
-	{
-		const struct sockaddr_in *insrc = (const struct sockaddr_in*) src;
-		const struct sockaddr_in *indst = (const struct sockaddr_in*) dest;
-		
-		TCPEncap4 *encap = (TCPEncap4*) kalloca(sizeof(TCPEncap4) + packetSize - sizeof(TCPSegment));
-		memset(encap, 0, sizeof(TCPEncap4));
-		memcpy(&encap->seg, packet, packetSize);
-		encap->saddr = insrc->sin_addr.s_addr;
-		encap->daddr = indst->sin_addr.s_addr;
-		encap->proto = IPPROTO_TCP;
-		encap->len = htons((uint16_t) packetSize);
-		
-		return ipv4_checksum(encap, sizeof(TCPEncap4) + packetSize - sizeof(TCPSegment));
-	}
-	else if (src->sa_family == AF_INET6)
+	Socket *sock = (Socket*) tcpsock;
+	uint64_t sockopts[GSO_COUNT];
+	memcpy(sockopts, sock->options, sizeof(uint64_t)*GSO_COUNT);
+	
+	if (tcpsock->caps & (NETIF_CAP_TXCSUM | NETIF_CAP_TSO4 | NETIF_CAP_TSO6))
 	{
-		const struct sockaddr_in6 *insrc = (const struct sockaddr_in6*) src;
-		const struct sockaddr_in6 *indst = (const struct sockaddr_in6*) dest;
+		ob->segment->checksum = 0;
+		sockopts[GSO_SNDFLAGS] |= PKT_CSUM_OFFLOAD;
 		
-		TCPEncap6 *encap = (TCPEncap6*) kalloca(sizeof(TCPEncap6) + packetSize - sizeof(TCPSegment));
-		memset(encap, 0, sizeof(TCPEncap6));
-		memcpy(&encap->seg, packet, packetSize);
-		memcpy(encap->saddr, &insrc->sin6_addr, 16);
-		memcpy(encap->daddr, &indst->sin6_addr, 16);
-		encap->proto = IPPROTO_TCP;
-		encap->len = htonl((uint32_t) packetSize);
-		
-		return ipv4_checksum(encap, sizeof(TCPEncap6) + packetSize - sizeof(TCPSegment));
+		if (ob->size > (sizeof(TCPSegment) + TCP_SEGMENT_SIZE))
+		{
+			sockopts[GSO_SNDFLAGS] |= PKT_TSO;
+		};
 	}
 	else
 	{
-		panic("invalid address family passed to ValidateChecksum()");
-		return 0;
+		ChecksumOutbound(ob);
 	};
+	
+	return sendPacketCached(&tcpsock->sockname, &tcpsock->peername, ob->segment, ob->size,
+				IPPROTO_TCP, sockopts, sock->ifname, &tcpsock->routeCache);
 };
 
 static void tcpThread(void *context)
@@ -396,6 +406,13 @@ static void tcpThread(void *context)
 
 	detachMe();
 	
+	tcpsock->caps = getRouteCaps(&tcpsock->peername, sock->ifname);
+	tcpsock->maxSegment = TCP_SEGMENT_SIZE;
+	if (tcpsock->caps & (NETIF_CAP_TSO4 | NETIF_CAP_TSO6))
+	{
+		tcpsock->maxSegment = TCP_SEGMENT_SIZE_TSO;
+	};
+	
 	uint16_t srcport, dstport;
 	if (sock->domain == AF_INET)
 	{
@@ -435,11 +452,7 @@ static void tcpThread(void *context)
 		while (((getNanotime() < deadline) || (deadline == 0)) && (retransCount--))
 		{
 			tcpsock->currentOut->segment->ackno = htonl(tcpsock->nextAckNo);
-			ChecksumOutbound(tcpsock->currentOut);
-			
-			int status = sendPacketEx(&tcpsock->sockname, &tcpsock->peername,
-							tcpsock->currentOut->segment, tcpsock->currentOut->size,
-							IPPROTO_TCP, sock->options, sock->ifname);
+			int status = SendOutbound(tcpsock, tcpsock->currentOut);
 
 			if (status != 0)
 			{
@@ -547,7 +560,7 @@ static void tcpThread(void *context)
 					semWaitGen(&tcpsock->semAckOut, -1, 0, 0);
 				};
 				
-				int count = semWaitGen(&tcpsock->semSendFetch, 512, 0, 0);
+				int count = semWaitGen(&tcpsock->semSendFetch, (int) tcpsock->maxSegment, 0, 0);
 				
 				TCPOutbound *ob = CreateOutbound(&tcpsock->sockname, &tcpsock->peername, (size_t)count);
 				ob->segment->srcport = srcport;
@@ -592,11 +605,7 @@ static void tcpThread(void *context)
 				ack->dataOffsetNS = 0x50;
 				ack->flags = TCP_ACK;
 				ack->winsz = htons(TCP_BUFFER_SIZE);
-				ChecksumOutbound(ob);
-				
-				sendPacketEx(&tcpsock->sockname, &tcpsock->peername,
-						ob->segment, ob->size,
-						IPPROTO_TCP, sock->options, sock->ifname);
+				SendOutbound(tcpsock, ob);
 				
 				kfree(ob);
 			};
@@ -641,11 +650,7 @@ static void tcpThread(void *context)
 				ack->dataOffsetNS = 0x50;
 				ack->flags = TCP_FIN | TCP_ACK;
 				ack->winsz = htons(TCP_BUFFER_SIZE);
-				ChecksumOutbound(ob);
-		
-				sendPacketEx(&tcpsock->sockname, &tcpsock->peername,
-						ob->segment, ob->size,
-						IPPROTO_TCP, sock->options, sock->ifname);
+				SendOutbound(tcpsock, ob);
 		
 				kfree(ob);
 			};
@@ -741,7 +746,6 @@ static int tcpsock_connect(Socket *sock, const struct sockaddr *addr, size_t siz
 	syn->dataOffsetNS = 0x50;
 	syn->flags = TCP_SYN;
 	syn->winsz = htons(TCP_BUFFER_SIZE);
-	ChecksumOutbound(tcpsock->currentOut);
 	
 	KernelThreadParams pars;
 	memset(&pars, 0, sizeof(KernelThreadParams));
@@ -917,11 +921,6 @@ static int tcpsock_packet(Socket *sock, const struct sockaddr *src, const struct
 			return SOCK_STOP;
 		};
 	
-		if (ValidateChecksum(src, dest, packet, size) != 0)
-		{
-			return SOCK_CONT;
-		};
-		
 		uint16_t localPort, remotePort;
 		if (sock->domain == AF_INET)
 		{
@@ -1397,7 +1396,6 @@ static Socket* tcpsock_accept(Socket *sock, struct sockaddr *addr, size_t *addrl
 	syn->dataOffsetNS = 0x50;
 	syn->flags = TCP_SYN | TCP_ACK;
 	syn->winsz = htons(TCP_BUFFER_SIZE);
-	ChecksumOutbound(tcpclient->currentOut);
 	
 	KernelThreadParams pars;
 	memset(&pars, 0, sizeof(KernelThreadParams));
@@ -33,6 +33,7 @@
 #include <glidix/util/errno.h>
 #include <glidix/thread/semaphore.h>
 #include <glidix/net/netif.h>
+#include <glidix/net/route.h>
 #include <glidix/display/console.h>
 #include <glidix/util/common.h>
 
@@ -77,6 +78,11 @@ typedef struct
 	UDPInbound*				last;
 	UDPGroup*				groups;
 	size_t					numGroups;
+	
+	/**
+	 * Cached route to the peer, used when sending without an explicit destination.
+	 */
+	RouteCache				routeCache;
 } UDPSocket;
 
 typedef struct
@@ -88,20 +94,6 @@ typedef struct
 	uint8_t					payload[];
 } PACKED UDPPacket;
 
-/**
- * UDP packet with IPv6 pseudo-header for checksum calculation.
- */
-typedef struct
-{
-	uint8_t					srcaddr[16];
-	uint8_t					dstaddr[16];
-	uint16_t				udplenHigh;		// this is always zeroes
-	uint16_t				udplen;
-	uint8_t					zeroes[3];
-	uint8_t					proto;			// IPPROTO_UDP
-	UDPPacket				packet;
-} UDPEncap;
-
 static int udpsock_bind(Socket *sock, const struct sockaddr *addr, size_t addrlen)
 {
 	UDPSocket *udpsock = (UDPSocket*) sock;
@@ -294,55 +286,11 @@ static void udpsock_close(Socket *sock)
 	FreeSocket(sock);
 };
 
-static uint16_t udpChecksum4(const struct sockaddr_in *src, const struct sockaddr_in *dest, const void *msg, size_t size)
-{
-	// TODO: compute checksum
-	return 0;
-};
-
-static uint16_t udpChecksum6(const struct sockaddr_in6 *insrc, const struct sockaddr_in6 *indst, const void *msg, size_t size, const char *ifname)
-{
-	static uint8_t zeroes[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-	
-	if (isMappedAddress46((const struct sockaddr*)indst))
-	{
-		struct sockaddr_in src4, dst4;
-		remapAddress64(insrc, &src4);
-		remapAddress64(indst, &dst4);
-		return udpChecksum4(&src4, &dst4, msg, size);
-	};
-	
-	// we have to do this because the checksum requires the source address to be known.
-	struct sockaddr_in6 copyaddr;
-	if (memcmp(&insrc->sin6_addr, zeroes, 16) == 0)
-	{
-		memcpy(&copyaddr, insrc, sizeof(struct sockaddr_in6));
-		getDefaultAddr6(&copyaddr.sin6_addr, &indst->sin6_addr, ifname);
-		insrc = &copyaddr;
-	};
-	
-	size_t packetSize = sizeof(UDPPacket) + size;
-	UDPEncap *encap = (UDPEncap*) kmalloc(sizeof(UDPEncap) + size);
-	memset(encap, 0, sizeof(UDPEncap));
-	memcpy(encap->srcaddr, &insrc->sin6_addr, 16);
-	memcpy(encap->dstaddr, &indst->sin6_addr, 16);
-	encap->udplen = __builtin_bswap16(packetSize);
-	encap->proto = IPPROTO_UDP;
-	encap->packet.srcport = insrc->sin6_port;
-	encap->packet.dstport = indst->sin6_port;
-	encap->packet.len = encap->udplen;
-	encap->packet.checksum = 0;
-	memcpy(encap->packet.payload, msg, size);
-	uint16_t checksum = ipv4_checksum(encap, sizeof(UDPEncap) + size);
-	
-	kfree(encap);
-	return checksum;
-};
-
 static ssize_t udpsock_sendto(Socket *sock, const void *message, size_t msgsize, int flags, const struct sockaddr *addr, size_t addrlen)
 {
 	UDPSocket *udpsock = (UDPSocket*) sock;
 	struct sockaddr destaddr;
+	RouteCache *cache = NULL;
 	
 	if (udpsock->shutflags & SHUT_WR)
 	{
@@ -381,6 +329,7 @@ static ssize_t udpsock_sendto(Socket *sock, const void *message, size_t msgsize,
 		};
 		
 		memcpy(&destaddr, &udpsock->peername, INET_SOCKADDR_LEN);
+		cache = &udpsock->routeCache;
 	};
 	
 	if (destaddr.sa_family != sock->domain)
@@ -421,10 +370,13 @@ static ssize_t udpsock_sendto(Socket *sock, const void *message, size_t msgsize,
 		packet->checksum = 0;
 		memcpy(packet->payload, message, msgsize);
 		
-		packet->checksum = udpChecksum4(insrc, indst, message, msgsize);
+		// the checksum is filled in once the source address is known, by the interface if it can do it
+		uint64_t sockopts[GSO_COUNT];
+		memcpy(sockopts, sock->options, sizeof(uint64_t)*GSO_COUNT);
+		sockopts[GSO_SNDFLAGS] |= PKT_CSUM_OFFLOAD;
 		
-		int status = sendPacketEx(&udpsock->sockname, &destaddr, packet, sizeof(UDPPacket) + msgsize,
-					IPPROTO_UDP, sock->options, sock->ifname);
+		int status = sendPacketCached(&udpsock->sockname, &destaddr, packet, sizeof(UDPPacket) + msgsize,
+					IPPROTO_UDP, sockopts, sock->ifname, cache);
 					
 		kfree(packet);
 		
@@ -447,10 +399,14 @@ static ssize_t udpsock_sendto(Socket *sock, const void *message, size_t msgsize,
 		packet->checksum = 0;
 		memcpy(packet->payload, message, msgsize);
 		
-		packet->checksum = udpChecksum6(insrc, indst, message, msgsize, sock->ifname);
+		// the checksum is mandatory over IPv6; it is filled in once the source address is known, by the
+		// interface if it can do it
+		uint64_t sockopts[GSO_COUNT];
+		memcpy(sockopts, sock->options, sizeof(uint64_t)*GSO_COUNT);
+		sockopts[GSO_SNDFLAGS] |= PKT_CSUM_OFFLOAD;
 		
-		int status = sendPacketEx(&udpsock->sockname, &destaddr, packet, sizeof(UDPPacket) + msgsize,
-					IPPROTO_UDP, sock->options, sock->ifname);
+		int status = sendPacketCached(&udpsock->sockname, &destaddr, packet, sizeof(UDPPacket) + msgsize,
+					IPPROTO_UDP, sockopts, sock->ifname, cache);
 		kfree(packet);
 		
 		if (status < 0)
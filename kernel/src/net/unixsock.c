@@ -40,6 +40,27 @@
 #define	STATE_LISTENING				1
 #define	STATE_CONNECTED				2
 
+/**
+ * Size of the receive ring buffer of each SOCK_STREAM socket. The ring is only allocated once data is first
+ * sent to the socket, so listening sockets and connections that never carry data do not pay for it.
+ */
+#define	UNIX_STREAM_BUFFER_SIZE			0x10000
+
+/**
+ * Maximum number of bytes of unread messages queued on a SOCK_SEQPACKET socket before senders have to wait,
+ * and the maximum size of a single message. Each message is charged for its header too, so that empty
+ * messages cannot be queued without bound.
+ */
+#define	UNIX_SEQ_QUEUE_BYTES			0x40000
+#define	UNIX_SEQ_MSG_MAX			0x10000
+#define	UNIX_SEQ_MSG_COST(size)			(sizeof(Message) + (size))
+
+/**
+ * Whether the socket is connection-oriented (all currently supported types are); those share the 'seq'
+ * part of UnixSocket.
+ */
+#define	UNIX_IS_CONN(sock)			(((sock)->type == SOCK_SEQPACKET) || ((sock)->type == SOCK_STREAM))
+
 /**
  * Represents a message in the queue.
  */
@@ -47,10 +68,29 @@ typedef struct Message_
 {
 	struct Message_*			next;
 	struct sockaddr_un			src;
+	
+	/**
+	 * File descriptions passed along with the message (SCM_RIGHTS); NULL if none.
+	 */
+	File**					files;
+	int					numFiles;
+	
 	size_t					size;
 	uint8_t					payload[];
 } Message;
 
+/**
+ * File descriptions passed along with data on a stream socket. They are received together with the byte
+ * at position 'pos' in the stream (counting from the start of the connection).
+ */
+typedef struct FileBatch_
+{
+	struct FileBatch_*			next;
+	uint64_t				pos;
+	File**					files;
+	int					numFiles;
+} FileBatch;
+
 /**
  * Represents a waiting connection.
  */
@@ -65,7 +105,7 @@ typedef union
 	Socket					header_;
 	
 	/**
-	 * If header_.type == SOCK_SEQPACKET.
+	 * If header_.type == SOCK_SEQPACKET or header_.type == SOCK_STREAM.
 	 */
 	struct
 	{
@@ -100,12 +140,47 @@ typedef union
 		struct sockaddr			name;
 		
 		/**
-		 * List of incoming packets, and the counter.
+		 * (SOCK_SEQPACKET) List of incoming packets, and the counter.
 		 */
 		Semaphore			semMsgIn;
 		Message*			msgFirst;
 		Message*			msgLast;
 		
+		/**
+		 * (SOCK_SEQPACKET) Counts the number of bytes that may still be queued on this socket before
+		 * senders have to wait (see UNIX_SEQ_MSG_COST), and the lock that senders hold while collecting
+		 * space, so that two senders cannot each hold part of the budget and wait on each other.
+		 */
+		Semaphore			semMsgSpace;
+		Semaphore			semSendLock;
+		
+		/**
+		 * (SOCK_STREAM) The receive buffer, the semaphore that counts the number of bytes that can
+		 * still be put in, a semaphore that counts the number of bytes that may be fetched, and the
+		 * put/fetch pointers. This is a ring buffer of UNIX_STREAM_BUFFER_SIZE bytes, NULL until data
+		 * is first sent to the socket.
+		 */
+		uint8_t*			bufRecv;
+		Semaphore			semRecvPut;
+		Semaphore			semRecvFetch;
+		size_t				idxRecvPut;
+		size_t				idxRecvFetch;
+		
+		/**
+		 * (SOCK_STREAM) Total number of bytes ever put into and fetched from the receive buffer, and
+		 * the queue of file descriptions waiting to be received along with the data.
+		 */
+		uint64_t			cntRecvPutTotal;
+		uint64_t			cntRecvFetchTotal;
+		FileBatch*			batchFirst;
+		FileBatch*			batchLast;
+		
+		/**
+		 * Number of queued messages or file batches that carry file descriptions; see
+		 * unixsock_can_pass().
+		 */
+		int				numInflight;
+		
 		/**
 		 * Inode for the other side of the connection.
 		 */
@@ -113,6 +188,121 @@ typedef union
 	} seq;
 } UnixSocket;
 
+/**
+ * Make a copy of the list of file descriptions to pass; this takes over the references. Returns NULL if
+ * 'numfps' is zero.
+ */
+static File** unixsock_copy_files(File **fps, int numfps)
+{
+	if (numfps == 0)
+	{
+		return NULL;
+	};
+	
+	File **files = (File**) kmalloc(sizeof(File*) * numfps);
+	memcpy(files, fps, sizeof(File*) * numfps);
+	return files;
+};
+
+/**
+ * Decide whether the description 'fp' may be passed over the connection between 'unixsock' and the socket
+ * 'peer'. Passing a unix socket keeps it, and its peer, alive until the message is received; if the
+ * description ends up queued on a socket that it keeps alive, nothing ever frees it. To rule out such
+ * cycles, we refuse to pass either end of this connection, and any unix socket which (or whose peer)
+ * has descriptions in flight itself or connections waiting to be accepted.
+ */
+static int unixsock_can_pass(UnixSocket *unixsock, Inode *peer, File *fp)
+{
+	if ((fp->oflags & O_SOCKET) == 0)
+	{
+		return 1;
+	};
+	
+	Inode *inode = fp->iref.inode;
+	if ((inode == unixsock->seq.sysobj) || (inode == peer))
+	{
+		return 0;
+	};
+	
+	Socket *sock = (Socket*) inode->fsdata;
+	if ((sock->domain != AF_UNIX) || (!UNIX_IS_CONN(sock)))
+	{
+		return 1;
+	};
+	
+	UnixSocket *other = (UnixSocket*) sock;
+	Inode *otherPeer = NULL;
+	
+	semWait(&other->seq.lock);
+	int ok = (other->seq.numInflight == 0) && (other->seq.connFirst == NULL);
+	if ((ok) && (other->seq.state == STATE_CONNECTED))
+	{
+		otherPeer = other->seq.peer;
+		vfsUprefInode(otherPeer);
+	};
+	semSignal(&other->seq.lock);
+	
+	if (otherPeer != NULL)
+	{
+		UnixSocket *otherUnix = (UnixSocket*) otherPeer->fsdata;
+		semWait(&otherUnix->seq.lock);
+		ok = (otherUnix->seq.numInflight == 0);
+		semSignal(&otherUnix->seq.lock);
+		vfsDownrefInode(otherPeer);
+	};
+	
+	return ok;
+};
+
+/**
+ * Check that all of the 'numfps' descriptions in 'fps' may be passed to 'peer' (see unixsock_can_pass()).
+ * Returns 0 if so; otherwise, sets ERRNO and returns -1.
+ */
+static int unixsock_check_files(UnixSocket *unixsock, Inode *peer, File **fps, int numfps)
+{
+	int i;
+	for (i=0; i<numfps; i++)
+	{
+		if (!unixsock_can_pass(unixsock, peer, fps[i]))
+		{
+			ERRNO = EBUSY;
+			return -1;
+		};
+	};
+	
+	return 0;
+};
+
+/**
+ * Hand over passed file descriptions to the receiver: at most '*numfps' are stored into 'fps' (which may be
+ * NULL), and the rest are closed. '*numfps' is set to the number of descriptions that were passed. This must
+ * not be called with any socket locks held, since closing a description may close a socket.
+ */
+static void unixsock_give_files(File **files, int numFiles, File **fps, int *numfps)
+{
+	int capacity = 0;
+	if (numfps != NULL)
+	{
+		capacity = *numfps;
+		*numfps = numFiles;
+	};
+	
+	int i;
+	for (i=0; i<numFiles; i++)
+	{
+		if ((fps != NULL) && (i < capacity))
+		{
+			fps[i] = files[i];
+		}
+		else
+		{
+			vfsClose(files[i]);
+		};
+	};
+	
+	kfree(files);
+};
+
 static int unixsock_bind(Socket *sock, const struct sockaddr *addr, size_t addrlen)
 {
 	UnixSocket *unixsock = (UnixSocket*) sock;
@@ -156,7 +346,7 @@ static int unixsock_bind(Socket *sock, const struct sockaddr *addr, size_t addrl
 	};
 	
 	// we can bind to it now
-	if (sock->type == SOCK_SEQPACKET)
+	if (UNIX_IS_CONN(sock))
 	{
 		if (unixsock->seq.name.sa_family != AF_UNSPEC)
 		{
@@ -188,12 +378,142 @@ static int unixsock_bind(Socket *sock, const struct sockaddr *addr, size_t addrl
 	return -1;
 };
 
-static ssize_t unixsock_sendto(Socket *sock, const void *message, size_t size, int flags, const struct sockaddr *addr, size_t addrlen)
+static ssize_t unixsock_stream_send(Socket *sock, const void *message, size_t size, File **fps, int numfps)
 {
 	UnixSocket *unixsock = (UnixSocket*) sock;
 	
+	if ((size == 0) && (numfps != 0))
+	{
+		// files travel with the first byte of the data
+		ERRNO = EINVAL;
+		return -1;
+	};
+	
+	semWait(&unixsock->seq.lock);
+	if (unixsock->seq.state != STATE_CONNECTED)
+	{
+		semSignal(&unixsock->seq.lock);
+		
+		ERRNO = ENOTCONN;
+		return -1;
+	};
+	
+	Inode *sysobj = unixsock->seq.peer;
+	vfsUprefInode(sysobj);
+	semSignal(&unixsock->seq.lock);
+	
+	if (unixsock_check_files(unixsock, sysobj, fps, numfps) != 0)
+	{
+		vfsDownrefInode(sysobj);
+		return -1;
+	};
+	
+	UnixSocket *peer = (UnixSocket*) sysobj->fsdata;
+	const uint8_t *scan = (const uint8_t*) message;
+	size_t sizeSent = 0;
+	
+	while (sizeSent < size)
+	{
+		size_t sizeLeft = size - sizeSent;
+		if (sizeLeft > UNIX_STREAM_BUFFER_SIZE)
+		{
+			sizeLeft = UNIX_STREAM_BUFFER_SIZE;
+		};
+		
+		// wait for space in the peer's buffer; once some data was sent, we return rather than block
+		int wflags = SEM_W_FILE(sock->fp->oflags);
+		if (sizeSent != 0)
+		{
+			wflags |= SEM_W_NONBLOCK;
+		};
+		
+		int count = semWaitGen(&peer->seq.semRecvPut, (int) sizeLeft, wflags, sock->options[GSO_SNDTIMEO]);
+		if (count < 0)
+		{
+			if (sizeSent != 0) break;
+			
+			vfsDownrefInode(sysobj);
+			ERRNO = -count;
+			return -1;
+		};
+		
+		semWait(&peer->seq.lock);
+		if ((count == 0) || (peer->seq.state != STATE_CONNECTED))
+		{
+			// it dropped the connection
+			semSignal(&peer->seq.lock);
+			vfsDownrefInode(sysobj);
+			
+			if (sizeSent != 0) return (ssize_t) sizeSent;
+			ERRNO = EPIPE;
+			return -1;
+		};
+		
+		if (peer->seq.bufRecv == NULL)
+		{
+			peer->seq.bufRecv = (uint8_t*) kmalloc(UNIX_STREAM_BUFFER_SIZE);
+		};
+		
+		if ((sizeSent == 0) && (numfps != 0))
+		{
+			FileBatch *batch = NEW(FileBatch);
+			batch->next = NULL;
+			batch->pos = peer->seq.cntRecvPutTotal;
+			batch->files = unixsock_copy_files(fps, numfps);
+			batch->numFiles = numfps;
+			peer->seq.numInflight++;
+			
+			if (peer->seq.batchLast == NULL)
+			{
+				peer->seq.batchFirst = peer->seq.batchLast = batch;
+			}
+			else
+			{
+				peer->seq.batchLast->next = batch;
+				peer->seq.batchLast = batch;
+			};
+		};
+		
+		size_t toCopy = (size_t) count;
+		peer->seq.cntRecvPutTotal += toCopy;
+		while (toCopy != 0)
+		{
+			size_t chunk = UNIX_STREAM_BUFFER_SIZE - peer->seq.idxRecvPut;
+			if (chunk > toCopy) chunk = toCopy;
+			
+			memcpy(&peer->seq.bufRecv[peer->seq.idxRecvPut], scan, chunk);
+			peer->seq.idxRecvPut = (peer->seq.idxRecvPut + chunk) % UNIX_STREAM_BUFFER_SIZE;
+			scan += chunk;
+			toCopy -= chunk;
+		};
+		
+		semSignal2(&peer->seq.semRecvFetch, count);
+		semSignal(&peer->seq.lock);
+		
+		sizeSent += (size_t) count;
+	};
+	
+	vfsDownrefInode(sysobj);
+	return (ssize_t) sizeSent;
+};
+
+static ssize_t unixsock_sendmsg(Socket *sock, const void *message, size_t size, int flags, File **fps, int numfps)
+{
+	UnixSocket *unixsock = (UnixSocket*) sock;
+	
+	if (sock->type == SOCK_STREAM)
+	{
+		return unixsock_stream_send(sock, message, size, fps, numfps);
+	};
+	
 	if (sock->type == SOCK_SEQPACKET)
 	{
+		if (size > UNIX_SEQ_MSG_MAX)
+		{
+			ERRNO = EMSGSIZE;
+			return -1;
+		};
+		
 		semWait(&unixsock->seq.lock);
 		if (unixsock->seq.state != STATE_CONNECTED)
 		{
@@ -210,24 +530,66 @@ static ssize_t unixsock_sendto(Socket *sock, const void *message, size_t size, i
 		memcpy(&myName, &unixsock->seq.name, sizeof(struct sockaddr_un));
 		semSignal(&unixsock->seq.lock);
 		
+		if (unixsock_check_files(unixsock, sysobj, fps, numfps) != 0)
+		{
+			vfsDownrefInode(sysobj);
+			return -1;
+		};
+		
 		UnixSocket *peer = (UnixSocket*) sysobj->fsdata;
+		
+		// wait until the peer has room for the whole message
+		int status = semWaitGen(&peer->seq.semSendLock, 1, SEM_W_FILE(sock->fp->oflags), sock->options[GSO_SNDTIMEO]);
+		if (status < 0)
+		{
+			vfsDownrefInode(sysobj);
+			ERRNO = -status;
+			return -1;
+		};
+		
+		int cost = (int) UNIX_SEQ_MSG_COST(size);
+		int got = 0;
+		while (got < cost)
+		{
+			status = semWaitGen(&peer->seq.semMsgSpace, cost - got, SEM_W_FILE(sock->fp->oflags),
+						sock->options[GSO_SNDTIMEO]);
+			if (status <= 0) break;
+			got += status;
+		};
+		
+		semSignal(&peer->seq.semSendLock);
 		semWait(&peer->seq.lock);
 		
-		if (peer->seq.state != STATE_CONNECTED)
+		if ((got < cost) || (peer->seq.state != STATE_CONNECTED))
 		{
-			// it dropped the connection
+			// give back the space we collected, unless it dropped the connection (which terminates
+			// the semaphore)
+			if ((got != 0) && (peer->seq.state == STATE_CONNECTED))
+			{
+				semSignal2(&peer->seq.semMsgSpace, got);
+			};
+			
 			semSignal(&peer->seq.lock);
 			vfsDownrefInode(sysobj);
-			ERRNO = ECONNRESET;
+			
+			if (status < 0) ERRNO = -status;
+			else ERRNO = ECONNRESET;
 			return -1;
 		};
 		
 		Message *msg = (Message*) kmalloc(sizeof(Message) + size);
 		msg->next = NULL;
 		memcpy(&msg->src, &myName, sizeof(struct sockaddr_un));
+		msg->files = unixsock_copy_files(fps, numfps);
+		msg->numFiles = numfps;
 		msg->size = size;
 		memcpy(msg->payload, message, size);
 		
+		if (msg->files != NULL)
+		{
+			peer->seq.numInflight++;
+		};
+		
 		if (peer->seq.msgLast == NULL)
 		{
 			peer->seq.msgFirst = peer->seq.msgLast = msg;
@@ -249,11 +611,131 @@ static ssize_t unixsock_sendto(Socket *sock, const void *message, size_t size, i
 	return -1;
 };
 
-static ssize_t unixsock_recvfrom(Socket *sock, void *buffer, size_t len, int flags, struct sockaddr *addr, size_t *addrlen)
+static ssize_t unixsock_sendto(Socket *sock, const void *message, size_t size, int flags, const struct sockaddr *addr, size_t addrlen)
+{
+	return unixsock_sendmsg(sock, message, size, flags, NULL, 0);
+};
+
+static ssize_t unixsock_stream_recv(Socket *sock, void *buffer, size_t len, int flags, File **fps, int *numfps)
 {
 	UnixSocket *unixsock = (UnixSocket*) sock;
 	
-	if (sock->type == SOCK_SEQPACKET)
+	if (unixsock->seq.state != STATE_CONNECTED)
+	{
+		ERRNO = ENOTCONN;
+		return -1;
+	};
+	
+	if (len > UNIX_STREAM_BUFFER_SIZE)
+	{
+		len = UNIX_STREAM_BUFFER_SIZE;
+	};
+	
+	int count = semWaitGen(&unixsock->seq.semRecvFetch, (int) len, SEM_W_FILE(sock->fp->oflags), sock->options[GSO_RCVTIMEO]);
+	if (count < 0)
+	{
+		ERRNO = -count;
+		return -1;
+	};
+	
+	if (count == 0)
+	{
+		// EOF
+		if (numfps != NULL) *numfps = 0;
+		return 0;
+	};
+	
+	semWait(&unixsock->seq.lock);
+	
+	// if files were sent along with the first byte we are reading, they are received now; and we never read
+	// past the start of data that came with more files, so that those are received together with their data
+	FileBatch *batch = unixsock->seq.batchFirst;
+	FileBatch *recvBatch = NULL;
+	if ((batch != NULL) && (batch->pos == unixsock->seq.cntRecvFetchTotal))
+	{
+		if ((flags & MSG_PEEK) == 0)
+		{
+			recvBatch = batch;
+			unixsock->seq.numInflight--;
+			unixsock->seq.batchFirst = batch->next;
+			if (unixsock->seq.batchFirst == NULL) unixsock->seq.batchLast = NULL;
+		};
+		
+		batch = batch->next;
+	};
+	
+	if (batch != NULL)
+	{
+		uint64_t maxCount = batch->pos - unixsock->seq.cntRecvFetchTotal;
+		if ((uint64_t) count > maxCount)
+		{
+			semSignal2(&unixsock->seq.semRecvFetch, count - (int) maxCount);
+			count = (int) maxCount;
+		};
+	};
+	
+	uint8_t *put = (uint8_t*) buffer;
+	size_t idx = unixsock->seq.idxRecvFetch;
+	size_t toCopy = (size_t) count;
+	while (toCopy != 0)
+	{
+		size_t chunk = UNIX_STREAM_BUFFER_SIZE - idx;
+		if (chunk > toCopy) chunk = toCopy;
+		
+		memcpy(put, &unixsock->seq.bufRecv[idx], chunk);
+		idx = (idx + chunk) % UNIX_STREAM_BUFFER_SIZE;
+		put += chunk;
+		toCopy -= chunk;
+	};
+	
+	if ((flags & MSG_PEEK) == 0)
+	{
+		unixsock->seq.idxRecvFetch = idx;
+		unixsock->seq.cntRecvFetchTotal += (uint64_t) count;
+		semSignal2(&unixsock->seq.semRecvPut, count);
+	}
+	else
+	{
+		// just peeking; return the bytes
+		semSignal2(&unixsock->seq.semRecvFetch, count);
+	};
+	
+	semSignal(&unixsock->seq.lock);
+	
+	if (numfps != NULL)
+	{
+		*numfps = 0;
+	};
+	
+	if (recvBatch != NULL)
+	{
+		unixsock_give_files(recvBatch->files, recvBatch->numFiles, fps, numfps);
+		kfree(recvBatch);
+	};
+	
+	return (ssize_t) count;
+};
+
+/**
+ * Common implementation of recvfrom() and recvmsg(); 'numfps' is NULL for recvfrom(), in which case any
+ * file descriptions passed with the data are closed.
+ */
+static ssize_t unixsock_recv(Socket *sock, void *buffer, size_t len, int flags, struct sockaddr *addr, size_t *addrlen,
+				File **fps, int *numfps)
+{
+	UnixSocket *unixsock = (UnixSocket*) sock;
+	
+	if (sock->type == SOCK_STREAM)
+	{
+		if (addrlen != NULL)
+		{
+			// stream sockets do not report a source address
+			*addrlen = 0;
+		};
+		
+		return unixsock_stream_recv(sock, buffer, len, flags, fps, numfps);
+	}
+	else if (sock->type == SOCK_SEQPACKET)
 	{
 		if (unixsock->seq.state != STATE_CONNECTED)
 		{
@@ -271,15 +753,17 @@ static ssize_t unixsock_recvfrom(Socket *sock, void *buffer, size_t len, int fla
 		if (status == 0)
 		{
 			// EOF
+			if (numfps != NULL) *numfps = 0;
 			return 0;
 		};
 		
 		semWait(&unixsock->seq.lock);
 		Message *msg = unixsock->seq.msgFirst;
-				
-		if (len > msg->size)
+		
+		size_t msgSize = msg->size;
+		if (len > msgSize)
 		{
-			len = msg->size;
+			len = msgSize;
 		};
 		
 		size_t realAddrLen = 3 + strlen(msg->src.sun_path);
@@ -306,6 +790,11 @@ static ssize_t unixsock_recvfrom(Socket *sock, void *buffer, size_t len, int fla
 		
 		memcpy(buffer, msg->payload, len);
 		
+		if (numfps != NULL)
+		{
+			*numfps = 0;
+		};
+		
 		if ((flags & MSG_PEEK) == 0)
 		{
 			unixsock->seq.msgFirst = msg->next;
@@ -314,15 +803,34 @@ static ssize_t unixsock_recvfrom(Socket *sock, void *buffer, size_t len, int fla
 				unixsock->seq.msgLast = NULL;
 			};
 			
+			if (msg->files != NULL)
+			{
+				unixsock->seq.numInflight--;
+			};
+			
+			semSignal2(&unixsock->seq.semMsgSpace, (int) UNIX_SEQ_MSG_COST(msg->size));
+			semSignal(&unixsock->seq.lock);
+			
+			if (msg->files != NULL)
+			{
+				unixsock_give_files(msg->files, msg->numFiles, fps, numfps);
+			};
+			
 			kfree(msg);
 		}
 		else
 		{
 			// just peeking; return the message
 			semSignal2(&unixsock->seq.semMsgIn, 1);
+			semSignal(&unixsock->seq.lock);
+		};
+		
+		if (flags & MSG_TRUNC)
+		{
+			// report the full size even if the message did not fit
+			return (ssize_t) msgSize;
 		};
 		
-		semSignal(&unixsock->seq.lock);
 		return (ssize_t) len;
 	}
 	else
@@ -332,26 +840,71 @@ static ssize_t unixsock_recvfrom(Socket *sock, void *buffer, size_t len, int fla
 	};
 };
 
+static ssize_t unixsock_recvfrom(Socket *sock, void *buffer, size_t len, int flags, struct sockaddr *addr, size_t *addrlen)
+{
+	return unixsock_recv(sock, buffer, len, flags, addr, addrlen, NULL, NULL);
+};
+
+static ssize_t unixsock_recvmsg(Socket *sock, void *buffer, size_t len, int flags, File **fps, int *numfps)
+{
+	return unixsock_recv(sock, buffer, len, flags, NULL, NULL, fps, numfps);
+};
+
 static void unixsock_free(Inode *sysobj)
 {
 	// we can safely free the socket now
 	// (the file descriptor for it is definitely closed, because otherwise the reference
 	// count of the sysobj would not drop to zero)
-	// TODO: clean up the queue and stuff
+	// TODO: clean up the connection queue
 	Socket *sock = (Socket*) sysobj->fsdata;
+	UnixSocket *unixsock = (UnixSocket*) sock;
+	
+	// drop any messages and files that were never received
+	while (unixsock->seq.msgFirst != NULL)
+	{
+		Message *msg = unixsock->seq.msgFirst;
+		unixsock->seq.msgFirst = msg->next;
+		
+		if (msg->files != NULL)
+		{
+			unixsock_give_files(msg->files, msg->numFiles, NULL, NULL);
+		};
+		
+		kfree(msg);
+	};
+	
+	while (unixsock->seq.batchFirst != NULL)
+	{
+		FileBatch *batch = unixsock->seq.batchFirst;
+		unixsock->seq.batchFirst = batch->next;
+		unixsock_give_files(batch->files, batch->numFiles, NULL, NULL);
+		kfree(batch);
+	};
+	
+	kfree(unixsock->seq.bufRecv);
 	FreeSocket(sock);
 };
 
 static void unixsock_close(Socket *sock)
 {
 	UnixSocket *unixsock = (UnixSocket*) sock;
-	if (sock->type == SOCK_SEQPACKET)
+	if (UNIX_IS_CONN(sock))
 	{
 		if (unixsock->seq.state == STATE_CONNECTED)
 		{
 			semWait(&unixsock->seq.lock);
 			unixsock->seq.state = STATE_CLOSED;
 			
+			// wake up anyone waiting to send to us
+			if (sock->type == SOCK_STREAM)
+			{
+				semTerminate(&unixsock->seq.semRecvPut);
+			}
+			else
+			{
+				semTerminate(&unixsock->seq.semMsgSpace);
+			};
+			
 			Inode *sysobj = unixsock->seq.peer;
 			// don't incref: we're destroying the refrence
 			
@@ -359,7 +912,14 @@ static void unixsock_close(Socket *sock)
 			
 			UnixSocket *peer = (UnixSocket*) sysobj->fsdata;
 			semWait(&peer->seq.lock);
-			semTerminate(&peer->seq.semMsgIn);
+			if (sock->type == SOCK_STREAM)
+			{
+				semTerminate(&peer->seq.semRecvFetch);
+			}
+			else
+			{
+				semTerminate(&peer->seq.semMsgIn);
+			};
 			semSignal(&peer->seq.lock);
 			
 			vfsDownrefInode(sysobj);
@@ -392,7 +952,7 @@ static int unixsock_getpeername(Socket *sock, struct sockaddr *addr, size_t *add
 	
 	UnixSocket *unixsock = (UnixSocket*) sock;
 	
-	if (sock->type == SOCK_SEQPACKET)
+	if (UNIX_IS_CONN(sock))
 	{
 		semWait(&unixsock->seq.lock);
 		if (unixsock->seq.state != STATE_CONNECTED)
@@ -427,7 +987,7 @@ static int unixsock_listen(Socket *sock, int backlog)
 {
 	UnixSocket *unixsock = (UnixSocket*) sock;
 	
-	if (sock->type == SOCK_SEQPACKET)
+	if (UNIX_IS_CONN(sock))
 	{
 		semWait(&unixsock->seq.lock);
 		if (unixsock->seq.state != STATE_CLOSED)
@@ -451,12 +1011,13 @@ static void unixsock_pollinfo(Socket *sock, Semaphore **sems)
 {
 	UnixSocket *unixsock = (UnixSocket*) sock;
 	
-	if (sock->type == SOCK_SEQPACKET)
+	if (UNIX_IS_CONN(sock))
 	{
 		sems[PEI_WRITE] = vfsGetConstSem();
 	
 		semWait(&unixsock->seq.lock);
 		
+		UnixSocket *peer;
 		switch (unixsock->seq.state)
 		{
 		case STATE_CLOSED:
@@ -466,7 +1027,18 @@ static void unixsock_pollinfo(Socket *sock, Semaphore **sems)
 			sems[PEI_READ] = &unixsock->seq.semConnWaiting;
 			break;
 		case STATE_CONNECTED:
-			sems[PEI_READ] = &unixsock->seq.semMsgIn;
+			// we hold a reference to the peer while connected
+			peer = (UnixSocket*) unixsock->seq.peer->fsdata;
+			if (sock->type == SOCK_STREAM)
+			{
+				sems[PEI_READ] = &unixsock->seq.semRecvFetch;
+				sems[PEI_WRITE] = &peer->seq.semRecvPut;
+			}
+			else
+			{
+				sems[PEI_READ] = &unixsock->seq.semMsgIn;
+				sems[PEI_WRITE] = &peer->seq.semMsgSpace;
+			};
 			break;
 		};
 		
@@ -479,7 +1051,7 @@ static int unixsock_connect(Socket *sock, const struct sockaddr *addr, size_t ad
 {
 	UnixSocket *unixsock = (UnixSocket*) sock;
 	
-	if (sock->type == SOCK_SEQPACKET)
+	if (UNIX_IS_CONN(sock))
 	{
 		if (addr->sa_family != AF_UNIX)
 		{
@@ -533,7 +1105,7 @@ static int unixsock_connect(Socket *sock, const struct sockaddr *addr, size_t ad
 		};
 		
 		Socket *listensock = (Socket*) sysobj->fsdata;
-		if ((listensock->domain != AF_UNIX) || (listensock->type != SOCK_SEQPACKET))
+		if ((listensock->domain != AF_UNIX) || (listensock->type != sock->type))
 		{
 			vfsDownrefInode(sysobj);
 			ERRNO = ECONNREFUSED;
@@ -552,7 +1124,7 @@ static int unixsock_connect(Socket *sock, const struct sockaddr *addr, size_t ad
 		};
 		
 		// make a new socket and connect it to us
-		UnixSocket *newunix = CreateUnixSocket(SOCK_SEQPACKET);
+		UnixSocket *newunix = CreateUnixSocket(sock->type);
 		newunix->seq.state = STATE_CONNECTED;
 		newunix->seq.peer = unixsock->seq.sysobj;
 		vfsUprefInode(unixsock->seq.sysobj);
@@ -560,7 +1132,7 @@ static int unixsock_connect(Socket *sock, const struct sockaddr *addr, size_t ad
 		
 		Socket *newsock = (Socket*) newunix;
 		newsock->domain = AF_UNIX;
-		newsock->type = SOCK_SEQPACKET;
+		newsock->type = sock->type;
 		
 		ConnWaiting *queue = NEW(ConnWaiting);
 		queue->next = NULL;
@@ -595,7 +1167,7 @@ Socket* unixsock_accept(Socket *sock, struct sockaddr *addr, size_t *addrlenptr)
 {
 	UnixSocket *unixsock = (UnixSocket*) sock;
 	
-	if (sock->type == SOCK_SEQPACKET)
+	if (UNIX_IS_CONN(sock))
 	{
 		if (unixsock->seq.state != STATE_LISTENING)
 		{
@@ -645,7 +1217,7 @@ Socket* unixsock_accept(Socket *sock, struct sockaddr *addr, size_t *addrlenptr)
 
 UnixSocket* CreateUnixSocket(int type)
 {
-	if (type != SOCK_SEQPACKET)
+	if ((type != SOCK_SEQPACKET) && (type != SOCK_STREAM))
 	{
 		ERRNO = EPROTONOSUPPORT;
 		return NULL;
@@ -654,14 +1226,25 @@ UnixSocket* CreateUnixSocket(int type)
 	UnixSocket *unixsock = NEW(UnixSocket);
 	memset(unixsock, 0, sizeof(UnixSocket));
 	
+	unixsock->seq.sysobj = vfsCreateInode(NULL, VFS_MODE_SOCKET | 0666);
+	unixsock->seq.sysobj->fsdata = unixsock;
+	unixsock->seq.sysobj->free = unixsock_free;
+	unixsock->seq.state = STATE_CLOSED;
+	semInit(&unixsock->seq.lock);
+	
 	if (type == SOCK_SEQPACKET)
 	{
-		unixsock->seq.sysobj = vfsCreateInode(NULL, VFS_MODE_SOCKET | 0666);
-		unixsock->seq.sysobj->fsdata = unixsock;
-		unixsock->seq.sysobj->free = unixsock_free;
-		unixsock->seq.state = STATE_CLOSED;
-		semInit(&unixsock->seq.lock);
 		semInit2(&unixsock->seq.semMsgIn, 0);
+		semInit2(&unixsock->seq.semMsgSpace, UNIX_SEQ_QUEUE_BYTES);
+		semInit(&unixsock->seq.semSendLock);
+	}
+	else
+	{
+		unixsock->seq.bufRecv = NULL;
+		semInit2(&unixsock->seq.semRecvPut, UNIX_STREAM_BUFFER_SIZE);
+		semInit2(&unixsock->seq.semRecvFetch, 0);
+		unixsock->seq.idxRecvPut = 0;
+		unixsock->seq.idxRecvFetch = 0;
 	};
 	
 	Socket *sock = (Socket*) unixsock;
@@ -675,6 +1258,8 @@ UnixSocket* CreateUnixSocket(int type)
 	sock->pollinfo = unixsock_pollinfo;
 	sock->connect = unixsock_connect;
 	sock->accept = unixsock_accept;
+	sock->sendmsg = unixsock_sendmsg;
+	sock->recvmsg = unixsock_recvmsg;
 	
 	return unixsock;
 };
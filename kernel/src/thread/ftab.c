@@ -26,6 +26,7 @@
 	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+
 #include <glidix/thread/ftab.h>
 #include <glidix/util/memory.h>
 #include <glidix/util/string.h>
@@ -35,11 +36,124 @@
 
 #define	FILE_RESERVE				((File*)1)
 
+/**
+ * The descriptor array is read without the table lock: ftabGet() enters a read-side critical section by
+ * incrementing the reader count of the current epoch, and leaves it by decrementing the same count. A
+ * writer (which always holds the lock) first makes its change visible (removes a file from a slot, or
+ * publishes a new array), then calls ftabSynchronize(), which waits until both reader counts have been
+ * seen at zero; any reader which could still see the old value has then left, and the removed file may be
+ * closed, or the old array freed. The epoch is flipped before each wait, so that new readers go to the
+ * other count and cannot hold the writer up forever.
+ */
+static int ftabReadLock(FileTable *ftab)
+{
+	int idx = ftab->epoch;
+	__sync_fetch_and_add(&ftab->readers[idx], 1);		// also a full barrier
+	return idx;
+};
+
+static void ftabReadUnlock(FileTable *ftab, int idx)
+{
+	__sync_fetch_and_add(&ftab->readers[idx], -1);
+};
+
+static void ftabSynchronize(FileTable *ftab)
+{
+	int i;
+	for (i=0; i<2; i++)
+	{
+		int old = ftab->epoch;
+		ftab->epoch = old ^ 1;
+		__sync_synchronize();
+		
+		while (ftab->readers[old] != 0)
+		{
+			kyield();
+		};
+	};
+};
+
+static FileSlots* ftabNewSlots(int size)
+{
+	FileSlots *slots = (FileSlots*) kmalloc(sizeof(FileSlots) + sizeof(FileSlot) * size);
+	slots->size = size;
+	memset(slots->ents, 0, sizeof(FileSlot) * size);		// all description pointers start as NULL
+	return slots;
+};
+
+static void ftabMarkUsed(FileTable *ftab, int fd)
+{
+	ftab->usedMap[fd / 64] |= (1UL << (fd % 64));
+};
+
+static void ftabMarkFree(FileTable *ftab, int fd)
+{
+	ftab->usedMap[fd / 64] &= ~(1UL << (fd % 64));
+	if ((fd / 64) < ftab->lowWord) ftab->lowWord = fd / 64;
+};
+
+/**
+ * Return the lowest free descriptor, or the current size of the array if all slots are used. Must be
+ * called with the lock held.
+ */
+static int ftabFindFree(FileTable *ftab)
+{
+	int numWords = ftab->slots->size / 64;
+	int i;
+	for (i=ftab->lowWord; i<numWords; i++)
+	{
+		if (ftab->usedMap[i] != ~0UL)
+		{
+			ftab->lowWord = i;
+			return i * 64 + __builtin_ctzl(~ftab->usedMap[i]);
+		};
+	};
+	
+	ftab->lowWord = numWords;
+	return numWords * 64;
+};
+
+/**
+ * Grow the descriptor array so that it has at least 'minSize' slots. 'minSize' must not exceed
+ * FTAB_MAX_FILES. Must be called with the lock held.
+ */
+static void ftabGrow(FileTable *ftab, int minSize)
+{
+	FileSlots *old = ftab->slots;
+	if (old->size >= minSize) return;
+	
+	int newSize = old->size;
+	while (newSize < minSize) newSize *= 2;
+	if (newSize > FTAB_MAX_FILES) newSize = FTAB_MAX_FILES;
+	
+	FileSlots *new = ftabNewSlots(newSize);
+	memcpy(new->ents, old->ents, sizeof(FileSlot) * old->size);
+	
+	uint64_t *newMap = (uint64_t*) kmalloc(newSize / 8);
+	memset(newMap, 0, newSize / 8);
+	memcpy(newMap, ftab->usedMap, old->size / 8);
+	kfree(ftab->usedMap);
+	ftab->usedMap = newMap;
+	
+	__sync_synchronize();
+	ftab->slots = new;
+	ftabSynchronize(ftab);
+	kfree(old);
+};
+
 FileTable *ftabCreate()
 {
 	FileTable *ftab = (FileTable*) kmalloc(sizeof(FileTable));
 	ftab->refcount = 1;
-	memset(ftab->list, 0, sizeof(ftab->list));		// all description pointers start as NULL
+	ftab->slots = ftabNewSlots(FTAB_MIN_SLOTS);
+	ftab->usedMap = (uint64_t*) kmalloc(FTAB_MIN_SLOTS / 8);
+	memset(ftab->usedMap, 0, FTAB_MIN_SLOTS / 8);
+	ftab->lowWord = 0;
+	ftab->limit = MAX_OPEN_FILES;
+	ftab->hardLimit = FTAB_MAX_FILES;
+	ftab->epoch = 0;
+	ftab->readers[0] = 0;
+	ftab->readers[1] = 0;
 	semInit(&ftab->lock);
 
 	return ftab;
@@ -54,16 +168,20 @@ void ftabDownref(FileTable *ftab)
 {
 	if (__sync_add_and_fetch(&ftab->refcount, -1) == 0)
 	{
+		// no thread uses the table anymore, so there are no readers either
+		FileSlots *slots = ftab->slots;
 		int i;
-		for (i=0; i<MAX_OPEN_FILES; i++)
+		for (i=0; i<slots->size; i++)
 		{
-			File *fp = ftab->list[i].fp;
-			if (fp != NULL)
+			File *fp = slots->ents[i].fp;
+			if ((fp != NULL) && (fp != FILE_RESERVE))
 			{
 				vfsClose(fp);
 			};
 		};
 
+		kfree(slots);
+		kfree(ftab->usedMap);
 		kfree(ftab);
 	};
 };
@@ -73,15 +191,20 @@ FileTable *ftabDup(FileTable *old)
 	FileTable *new = ftabCreate();
 
 	semWait(&old->lock);
+	ftabGrow(new, old->slots->size);
+	new->limit = old->limit;
+	new->hardLimit = old->hardLimit;
+	
 	int i;
-	for (i=0; i<MAX_OPEN_FILES; i++)
+	for (i=0; i<old->slots->size; i++)
 	{
-		File *fold = old->list[i].fp;
-		if (fold != NULL)
+		File *fold = old->slots->ents[i].fp;
+		if ((fold != NULL) && (fold != FILE_RESERVE))
 		{
 			vfsDup(fold);
-			new->list[i].fp = fold;
-			new->list[i].flags = old->list[i].flags;
+			new->slots->ents[i].fp = fold;
+			new->slots->ents[i].flags = old->slots->ents[i].flags;
+			ftabMarkUsed(new, i);
 		};
 	};
 	semSignal(&old->lock);
@@ -91,21 +214,23 @@ FileTable *ftabDup(FileTable *old)
 
 File* ftabGet(FileTable *ftab, int fd)
 {
-	if ((fd < 0) || (fd >= MAX_OPEN_FILES))
+	if (fd < 0)
 	{
 		return NULL;
 	};
 	
-	semWait(&ftab->lock);
-	File *fp = ftab->list[fd].fp;
-	if ((fp == NULL) || (fp == FILE_RESERVE))
+	int idx = ftabReadLock(ftab);
+	FileSlots *slots = ftab->slots;
+	File *fp = NULL;
+	if (fd < slots->size)
 	{
-		semSignal(&ftab->lock);
-		return NULL;
+		fp = slots->ents[fd].fp;
+		if (fp == FILE_RESERVE) fp = NULL;
+		
+		// a writer which removed this file waits for us before closing it, so it is still valid
+		if (fp != NULL) vfsDup(fp);
 	};
-	
-	vfsDup(fp);
-	semSignal(&ftab->lock);
+	ftabReadUnlock(ftab, idx);
 	
 	return fp;
 };
@@ -114,78 +239,95 @@ int ftabAlloc(FileTable *ftab)
 {
 	semWait(&ftab->lock);
 	
-	int fd;
-	for (fd=0; fd<MAX_OPEN_FILES; fd++)
+	int fd = ftabFindFree(ftab);
+	if (fd >= ftab->limit)
 	{
-		if (ftab->list[fd].fp == NULL)
-		{
-			ftab->list[fd].fp = FILE_RESERVE;
-			semSignal(&ftab->lock);
-			return fd;
-		};
+		semSignal(&ftab->lock);
+		return -1;
 	};
 	
+	ftabGrow(ftab, fd+1);
+	ftab->slots->ents[fd].fp = FILE_RESERVE;
+	ftabMarkUsed(ftab, fd);
+	
 	semSignal(&ftab->lock);
-	return -1;
+	return fd;
 };
 
 void ftabSet(FileTable *ftab, int fd, File *fp, int flags)
 {
 	semWait(&ftab->lock);
-	if (ftab->list[fd].fp != FILE_RESERVE)
+	FileSlot *slot = &ftab->slots->ents[fd];
+	if (slot->fp != FILE_RESERVE)
 	{
 		panic("ftabSet called on a non-reserved descriptor");
 	};
 	
-	ftab->list[fd].fp = fp;
-	ftab->list[fd].flags = flags;
+	slot->flags = flags;
+	__sync_synchronize();
+	slot->fp = fp;
+	if (fp == NULL) ftabMarkFree(ftab, fd);
 	semSignal(&ftab->lock);
 };
 
 int ftabClose(FileTable *ftab, int fd)
 {
-	if ((fd < 0) || (fd >= MAX_OPEN_FILES))
+	if (fd < 0)
 	{
 		return EBADF;
 	};
 	
 	semWait(&ftab->lock);
-	if (ftab->list[fd].fp == FILE_RESERVE)
+	if (fd >= ftab->slots->size)
 	{
 		semSignal(&ftab->lock);
 		return EBADF;
 	};
 	
-	File *old = ftab->list[fd].fp;
-	ftab->list[fd].fp = NULL;
-	semSignal(&ftab->lock);
-	
-	if (old != NULL)
+	File *old = ftab->slots->ents[fd].fp;
+	if ((old == NULL) || (old == FILE_RESERVE))
 	{
-		vfsClose(old);
-	}
-	else return EBADF;
+		semSignal(&ftab->lock);
+		return EBADF;
+	};
 	
+	ftab->slots->ents[fd].fp = NULL;
+	ftabMarkFree(ftab, fd);
+	ftabSynchronize(ftab);
+	semSignal(&ftab->lock);
+	
+	vfsClose(old);
 	return 0;
 };
 
 int ftabPut(FileTable *ftab, int fd, File *fp, int flags)
 {
-	if ((fd < 0) || (fd >= MAX_OPEN_FILES))
+	if (fd < 0)
 	{
 		return EBADF;
 	};
 	
 	semWait(&ftab->lock);
-	File *old = ftab->list[fd].fp;
+	if (fd >= ftab->limit)
+	{
+		semSignal(&ftab->lock);
+		return EBADF;
+	};
+	
+	ftabGrow(ftab, fd+1);
+	FileSlot *slot = &ftab->slots->ents[fd];
+	File *old = slot->fp;
 	if (old == FILE_RESERVE)
 	{
 		semSignal(&ftab->lock);
 		return EBUSY;
 	};
 	
-	ftab->list[fd].fp = fp;
-	ftab->list[fd].flags = flags;
+	slot->flags = flags;
+	__sync_synchronize();
+	slot->fp = fp;
+	ftabMarkUsed(ftab, fd);
+	if (old != NULL) ftabSynchronize(ftab);
 	semSignal(&ftab->lock);
 	
 	if (old != NULL) vfsClose(old);
@@ -196,46 +338,114 @@ void ftabCloseOnExec(FileTable *ftab)
 {
 	semWait(&ftab->lock);
 	
+	FileSlots *slots = ftab->slots;
+	File **toClose = (File**) kmalloc(sizeof(File*) * slots->size);
+	int numClose = 0;
+	
 	int i;
-	for (i=0; i<MAX_OPEN_FILES; i++)
+	for (i=0; i<slots->size; i++)
 	{
-		File *fp = ftab->list[i].fp;
-		if (fp != NULL)
+		File *fp = slots->ents[i].fp;
+		if ((fp != NULL) && (fp != FILE_RESERVE))
 		{
-			if (ftab->list[i].flags & FD_CLOEXEC)
+			if (slots->ents[i].flags & FD_CLOEXEC)
 			{
-				ftab->list[i].fp = NULL;
-				vfsClose(fp);
+				slots->ents[i].fp = NULL;
+				ftabMarkFree(ftab, i);
+				toClose[numClose++] = fp;
 			};
 		};
 	};
 	
+	if (numClose != 0) ftabSynchronize(ftab);
 	semSignal(&ftab->lock);
+	
+	for (i=0; i<numClose; i++)
+	{
+		vfsClose(toClose[i]);
+	};
+	
+	kfree(toClose);
 };
 
 int ftabGetFlags(FileTable *ftab, int fd)
 {
-	if ((fd < 0) || (fd >= MAX_OPEN_FILES))
+	if (fd < 0)
 	{
 		return -1;
 	};
 
-	semWait(&ftab->lock);
-	int flags = ftab->list[fd].flags;
-	semSignal(&ftab->lock);
+	int flags = -1;
+	int idx = ftabReadLock(ftab);
+	FileSlots *slots = ftab->slots;
+	if (fd < slots->size)
+	{
+		File *fp = slots->ents[fd].fp;
+		if ((fp != NULL) && (fp != FILE_RESERVE))
+		{
+			flags = slots->ents[fd].flags;
+		};
+	};
+	ftabReadUnlock(ftab, idx);
 	
 	return flags;
 };
 
 int ftabSetFlags(FileTable *ftab, int fd, int flags)
 {
-	if ((fd < 0) || (fd >= MAX_OPEN_FILES))
+	if (fd < 0)
 	{
 		return EBADF;
 	};
 	
 	semWait(&ftab->lock);
-	ftab->list[fd].flags = flags;
+	if (fd >= ftab->slots->size)
+	{
+		semSignal(&ftab->lock);
+		return EBADF;
+	};
+	
+	File *fp = ftab->slots->ents[fd].fp;
+	if ((fp == NULL) || (fp == FILE_RESERVE))
+	{
+		semSignal(&ftab->lock);
+		return EBADF;
+	};
+	
+	ftab->slots->ents[fd].flags = flags;
+	semSignal(&ftab->lock);
+	
+	return 0;
+};
+
+void ftabGetLimit(FileTable *ftab, struct rlimit *rl)
+{
+	semWait(&ftab->lock);
+	rl->rlim_cur = ftab->limit;
+	rl->rlim_max = ftab->hardLimit;
+	semSignal(&ftab->lock);
+};
+
+int ftabSetLimit(FileTable *ftab, const struct rlimit *rl)
+{
+	if (rl->rlim_cur > rl->rlim_max)
+	{
+		return EINVAL;
+	};
+	
+	// RLIM_INFINITY and anything else too large means "as many as possible"
+	int cur = (rl->rlim_cur > FTAB_MAX_FILES) ? FTAB_MAX_FILES : (int) rl->rlim_cur;
+	int max = (rl->rlim_max > FTAB_MAX_FILES) ? FTAB_MAX_FILES : (int) rl->rlim_max;
+	
+	semWait(&ftab->lock);
+	if ((max > ftab->hardLimit) && (getCurrentThread()->creds->euid != 0))
+	{
+		semSignal(&ftab->lock);
+		return EPERM;
+	};
+	
+	ftab->limit = cur;
+	ftab->hardLimit = max;
 	semSignal(&ftab->lock);
 	
 	return 0;
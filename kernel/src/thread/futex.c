@@ -0,0 +1,467 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <glidix/thread/futex.h>
+#include <glidix/thread/sched.h>
+#include <glidix/thread/spinlock.h>
+#include <glidix/thread/procmem.h>
+#include <glidix/thread/pageinfo.h>
+#include <glidix/int/syscall.h>
+#include <glidix/util/time.h>
+#include <glidix/util/errno.h>
+#include <glidix/util/string.h>
+
+/**
+ * Identifies a futex. For private futexes, 'mm' is the process memory and 'addr' is the virtual address; for
+ * shared ones, 'mm' is NULL and 'addr' is the physical address.
+ */
+typedef struct
+{
+	void*					mm;
+	uint64_t				addr;
+} FutexKey;
+
+struct FutexBucket_;
+typedef struct FutexWaiter_
+{
+	struct FutexWaiter_*			prev;
+	struct FutexWaiter_*			next;
+	
+	/**
+	 * The bucket we are currently queued in, and the key we are sleeping on. Both may be changed by a requeue,
+	 * which holds the locks of both the old and new bucket while doing so.
+	 */
+	struct FutexBucket_* volatile		bucket;
+	FutexKey				key;
+	
+	Thread*					thread;
+	
+	/**
+	 * Set to 1 by the waker, after it removes us from the queue.
+	 */
+	int					woken;
+} FutexWaiter;
+
+typedef struct FutexBucket_
+{
+	Spinlock				lock;
+	FutexWaiter*				first;
+	FutexWaiter*				last;
+} FutexBucket;
+
+static FutexBucket futexTable[FUTEX_HASH_SIZE];
+
+/**
+ * Number of threads in futexWait() on a shared futex; while it is 0, futexInvalidateFrame() has nothing to do.
+ */
+static int futexSharedWaiters;
+
+static FutexBucket* futexHash(const FutexKey *key)
+{
+	uint64_t hash = (key->addr >> 3) ^ ((uint64_t) key->mm >> 4);
+	hash *= 0x9E3779B97F4A7C15UL;
+	return &futexTable[(hash >> 56) & (FUTEX_HASH_SIZE - 1)];
+};
+
+/**
+ * Find the key for the futex at the given user address. For shared futexes this takes a reference to the frame,
+ * which must be dropped with futexPutKey().
+ */
+static int futexGetKey(uint64_t addr, int flags, FutexKey *key)
+{
+	if (addr & 0x7)
+	{
+		// not 8-byte-aligned
+		return -EINVAL;
+	};
+	
+	if ((addr < ADDR_MIN) || (addr >= ADDR_MAX))
+	{
+		return -EFAULT;
+	};
+	
+	if (flags & FUTEX_PRIVATE)
+	{
+		key->mm = getCurrentThread()->pm;
+		key->addr = addr;
+	}
+	else
+	{
+		uint64_t frame = vmGetPhys(addr, PROT_READ);
+		if (frame == 0)
+		{
+			return -EFAULT;
+		};
+		
+		key->mm = NULL;
+		key->addr = (frame << 12) | (addr & 0xFFF);
+	};
+	
+	return 0;
+};
+
+static void futexPutKey(const FutexKey *key)
+{
+	if (key->mm == NULL)
+	{
+		piDecref(key->addr >> 12);
+	};
+};
+
+static int futexKeyEqual(const FutexKey *a, const FutexKey *b)
+{
+	return (a->mm == b->mm) && (a->addr == b->addr);
+};
+
+static void futexEnqueue(FutexBucket *bucket, FutexWaiter *waiter)
+{
+	waiter->bucket = bucket;
+	waiter->next = NULL;
+	waiter->prev = bucket->last;
+	
+	if (bucket->last == NULL)
+	{
+		bucket->first = bucket->last = waiter;
+	}
+	else
+	{
+		bucket->last->next = waiter;
+		bucket->last = waiter;
+	};
+};
+
+static void futexDequeue(FutexBucket *bucket, FutexWaiter *waiter)
+{
+	if (waiter->prev != NULL) waiter->prev->next = waiter->next;
+	if (waiter->next != NULL) waiter->next->prev = waiter->prev;
+	if (bucket->first == waiter) bucket->first = waiter->next;
+	if (bucket->last == waiter) bucket->last = waiter->prev;
+};
+
+/**
+ * Lock the bucket which the waiter is queued in, taking into account that it may be requeued concurrently.
+ * Call with interrupts disabled.
+ */
+static FutexBucket* futexLockWaiter(FutexWaiter *waiter)
+{
+	while (1)
+	{
+		FutexBucket *bucket = waiter->bucket;
+		spinlockAcquire(&bucket->lock);
+		if (waiter->bucket == bucket)
+		{
+			return bucket;
+		};
+		
+		spinlockRelease(&bucket->lock);
+	};
+};
+
+/**
+ * Wake up at most 'count' waiters on 'key' in the (locked) bucket. Call with the scheduler locked. Returns the
+ * number woken; '*resched' is set if we should yield afterwards.
+ */
+static int futexWakeLocked(FutexBucket *bucket, const FutexKey *key, int count, int *resched)
+{
+	int woken = 0;
+	FutexWaiter *waiter = bucket->first;
+	while ((waiter != NULL) && (woken < count))
+	{
+		FutexWaiter *next = waiter->next;
+		if (futexKeyEqual(&waiter->key, key))
+		{
+			futexDequeue(bucket, waiter);
+			
+			// the waiter cannot return until we release the bucket lock, so 'waiter' is still valid
+			waiter->woken = 1;
+			*resched |= signalThread(waiter->thread);
+			woken++;
+		};
+		
+		waiter = next;
+	};
+	
+	return woken;
+};
+
+int futexWait(uint64_t addr, uint64_t expected, uint64_t nanotimeout, int flags)
+{
+	FutexKey key;
+	int status = futexGetKey(addr, flags, &key);
+	if (status != 0)
+	{
+		return status;
+	};
+	
+	uint64_t deadline;
+	if (nanotimeout == 0)
+	{
+		deadline = 0;
+	}
+	else
+	{
+		deadline = getNanotime() + nanotimeout;
+	};
+	
+	FutexWaiter waiter;
+	memcpy(&waiter.key, &key, sizeof(FutexKey));
+	waiter.thread = getCurrentThread();
+	waiter.woken = 0;
+	
+	if (key.mm == NULL)
+	{
+		__sync_fetch_and_add(&futexSharedWaiters, 1);
+	};
+	
+	// queue ourselves before reading the value: reading may fault, so we can't hold the lock while doing it, but
+	// this way a waker which changes the value after we read it is guaranteed to find us in the queue.
+	cli();
+	FutexBucket *bucket = futexHash(&key);
+	spinlockAcquire(&bucket->lock);
+	futexEnqueue(bucket, &waiter);
+	spinlockRelease(&bucket->lock);
+	sti();
+	__sync_synchronize();
+	
+	uint64_t value;
+	if (memcpy_u2k(&value, (void*) addr, 8) != 0)
+	{
+		status = -EFAULT;
+	}
+	else if (value != expected)
+	{
+		status = -EAGAIN;
+	};
+	
+	cli();
+	bucket = futexLockWaiter(&waiter);
+	if (status == 0)
+	{
+		lockSched();
+		TimedEvent ev;
+		timedPost(&ev, deadline);
+		
+		while (!waiter.woken)
+		{
+			if ((deadline != 0) && (getNanotime() >= deadline))
+			{
+				status = -ETIMEDOUT;
+				break;
+			};
+			
+			if (haveReadySigs(getCurrentThread()))
+			{
+				status = -EINTR;
+				break;
+			};
+			
+			waitThread(getCurrentThread());
+			spinlockRelease(&bucket->lock);
+			unlockSched();
+			kyield();
+			
+			cli();
+			bucket = futexLockWaiter(&waiter);
+			lockSched();
+		};
+		
+		timedCancel(&ev);
+		unlockSched();
+	};
+	
+	if (waiter.woken)
+	{
+		// a wakeup takes priority over everything else, so that it is never lost
+		status = 0;
+	}
+	else
+	{
+		futexDequeue(bucket, &waiter);
+	};
+	
+	spinlockRelease(&bucket->lock);
+	sti();
+	
+	if (key.mm == NULL)
+	{
+		__sync_fetch_and_add(&futexSharedWaiters, -1);
+	};
+	
+	futexPutKey(&key);
+	return status;
+};
+
+int futexWake(uint64_t addr, int count, int flags)
+{
+	if (count < 0)
+	{
+		return -EINVAL;
+	};
+	
+	FutexKey key;
+	int status = futexGetKey(addr, flags, &key);
+	if (status != 0)
+	{
+		return status;
+	};
+	
+	FutexBucket *bucket = futexHash(&key);
+	int resched = 0;
+	
+	cli();
+	spinlockAcquire(&bucket->lock);
+	lockSched();
+	int woken = futexWakeLocked(bucket, &key, count, &resched);
+	unlockSched();
+	spinlockRelease(&bucket->lock);
+	if (resched) kyield();
+	sti();
+	
+	futexPutKey(&key);
+	return woken;
+};
+
+int futexRequeue(uint64_t addr, int count, uint64_t addr2, int requeue, int flags)
+{
+	if ((count < 0) || (requeue < 0))
+	{
+		return -EINVAL;
+	};
+	
+	FutexKey key;
+	int status = futexGetKey(addr, flags, &key);
+	if (status != 0)
+	{
+		return status;
+	};
+	
+	FutexKey key2;
+	status = futexGetKey(addr2, flags, &key2);
+	if (status != 0)
+	{
+		futexPutKey(&key);
+		return status;
+	};
+	
+	FutexBucket *bucket = futexHash(&key);
+	FutexBucket *bucket2 = futexHash(&key2);
+	int resched = 0;
+	
+	// always lock the buckets in the same order to avoid deadlocks
+	cli();
+	if (bucket < bucket2)
+	{
+		spinlockAcquire(&bucket->lock);
+		spinlockAcquire(&bucket2->lock);
+	}
+	else if (bucket > bucket2)
+	{
+		spinlockAcquire(&bucket2->lock);
+		spinlockAcquire(&bucket->lock);
+	}
+	else
+	{
+		spinlockAcquire(&bucket->lock);
+	};
+	
+	lockSched();
+	int woken = futexWakeLocked(bucket, &key, count, &resched);
+	unlockSched();
+	
+	FutexWaiter *waiter = bucket->first;
+	while ((waiter != NULL) && (requeue > 0))
+	{
+		FutexWaiter *next = waiter->next;
+		if (futexKeyEqual(&waiter->key, &key))
+		{
+			futexDequeue(bucket, waiter);
+			memcpy(&waiter->key, &key2, sizeof(FutexKey));
+			futexEnqueue(bucket2, waiter);
+			requeue--;
+		};
+		
+		waiter = next;
+	};
+	
+	if (bucket != bucket2) spinlockRelease(&bucket2->lock);
+	spinlockRelease(&bucket->lock);
+	if (resched) kyield();
+	sti();
+	
+	futexPutKey(&key);
+	futexPutKey(&key2);
+	return woken;
+};
+
+void futexInvalidateFrame(uint64_t frame)
+{
+	// this is called on every copy-on-write break, and there are usually no shared waiters at all
+	if (__atomic_load_n(&futexSharedWaiters, __ATOMIC_ACQUIRE) == 0)
+	{
+		return;
+	};
+	
+	uint64_t rflags = getFlagsRegister();
+	int resched = 0;
+	
+	int i;
+	for (i=0; i<FUTEX_HASH_SIZE; i++)
+	{
+		FutexBucket *bucket = &futexTable[i];
+		
+		cli();
+		spinlockAcquire(&bucket->lock);
+		lockSched();
+		
+		FutexWaiter *waiter = bucket->first;
+		while (waiter != NULL)
+		{
+			FutexWaiter *next = waiter->next;
+			if ((waiter->key.mm == NULL) && ((waiter->key.addr >> 12) == frame))
+			{
+				futexDequeue(bucket, waiter);
+				waiter->woken = 1;
+				resched |= signalThread(waiter->thread);
+			};
+			
+			waiter = next;
+		};
+		
+		unlockSched();
+		spinlockRelease(&bucket->lock);
+		setFlagsRegister(rflags);
+	};
+	
+	if (resched)
+	{
+		cli();
+		kyield();
+		setFlagsRegister(rflags);
+	};
+};
@@ -26,17 +26,115 @@
 	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+
 #include <glidix/thread/mutex.h>
 #include <glidix/display/console.h>
 #include <glidix/util/string.h>
+#include <glidix/util/memory.h>
+#include <glidix/util/time.h>
 #include <glidix/thread/sched.h>
+#include <glidix/hw/cpu.h>
+
+/**
+ * Lock statistics, per call site of mutexLock(). The table is open-addressed and statically allocated,
+ * since the heap itself is protected by a mutex; entries are claimed under statLock, and never released.
+ */
+static volatile int statsEnabled;
+static MutexStat mutexStats[MUTEX_STAT_MAX];
+static Spinlock statLock;
+
+static int myCPU()
+{
+	CPU *cpu = getCurrentCPU();
+	if (cpu == NULL) return -1;
+	return cpu->id;
+};
+
+static MutexStat* mutexGetStat(const char *aid, int lineno)
+{
+	uint64_t hash = ((uint64_t) aid * 31 + (uint64_t) lineno) % MUTEX_STAT_MAX;
+	
+	int i;
+	for (i=0; i<MUTEX_STAT_MAX; i++)
+	{
+		MutexStat *st = &mutexStats[(hash + i) % MUTEX_STAT_MAX];
+		if (!st->used)
+		{
+			uint64_t flags = getFlagsRegister();
+			cli();
+			spinlockAcquire(&statLock);
+			
+			if (!st->used)
+			{
+				st->aid = aid;
+				st->lineno = lineno;
+				__sync_synchronize();
+				st->used = 1;
+			};
+			
+			spinlockRelease(&statLock);
+			setFlagsRegister(flags);
+		};
+		
+		if ((st->aid == aid) && (st->lineno == lineno))
+		{
+			return st;
+		};
+	};
+	
+	// the table is full
+	return NULL;
+};
+
+static void mutexRecord(const char *aid, int lineno, int contended, int slept, uint64_t start)
+{
+	MutexStat *st = mutexGetStat(aid, lineno);
+	if (st == NULL) return;
+	
+	__sync_fetch_and_add(&st->acquired, 1);
+	if (contended)
+	{
+		uint64_t waited = getNanotime() - start;
+		__sync_fetch_and_add(&st->contended, 1);
+		if (!slept) __sync_fetch_and_add(&st->spun, 1);
+		__sync_fetch_and_add(&st->waitNanos, waited);
+		
+		uint64_t max;
+		do
+		{
+			max = st->maxWaitNanos;
+			if (waited <= max) break;
+		} while (__sync_val_compare_and_swap(&st->maxWaitNanos, max, waited) != max);
+	};
+};
+
+/**
+ * Spin while the mutex is owned by a thread running on another CPU, as it will probably release it soon,
+ * and sleeping would cost 2 context switches. We give up once there are sleeping waiters (ownership is then
+ * handed to them in order, so spinning cannot get us the mutex), if the owner is not running, or after
+ * MUTEX_SPIN_MAX iterations.
+ */
+static void mutexSpin(Mutex *mutex)
+{
+	int spins;
+	for (spins=0; spins<MUTEX_SPIN_MAX; spins++)
+	{
+		Thread *owner = mutex->owner;
+		if (owner == NULL) return;
+		if (mutex->first != NULL) return;
+		if (!cpuIsRunning(mutex->ownerCPU, owner)) return;
+		
+		ASM ("pause");
+	};
+};
 
 void mutexInit(Mutex *mutex)
 {
 	memset(mutex, 0, sizeof(Mutex));
+	mutex->ownerCPU = -1;
 };
 
-void mutexLock(Mutex *mutex)
+void _mutexLock(Mutex *mutex, const char *aid, int lineno)
 {
 	if (kernelDead) return;
 	
@@ -52,6 +150,15 @@ void mutexLock(Mutex *mutex)
 		return;
 	};
 	
+	int contended = 0;
+	uint64_t start = 0;
+	if (mutex->owner != NULL)
+	{
+		contended = 1;
+		if (statsEnabled) start = getNanotime();
+		mutexSpin(mutex);
+	};
+	
 	// take the lock
 	uint64_t flags = getFlagsRegister();
 	cli();
@@ -60,13 +167,17 @@ void mutexLock(Mutex *mutex)
 	if (mutex->owner == NULL)
 	{
 		mutex->owner = getCurrentThread();
+		mutex->ownerCPU = myCPU();
 		mutex->numLocks = 1;
 		spinlockRelease(&mutex->lock);
 		setFlagsRegister(flags);
+		
+		if (statsEnabled) mutexRecord(aid, lineno, contended, 0, start);
 		return;
 	};
 	
 	// couldn't immediately acquire, add us to the queue
+	if ((!contended) && (statsEnabled)) start = getNanotime();
 	MutexWaiter waiter;
 	waiter.thread = getCurrentThread();
 	waiter.next = NULL;
@@ -94,10 +205,12 @@ void mutexLock(Mutex *mutex)
 	
 	// mutex->owner was set by the previous owner to us when they set awaken to 1
 	// and also they removed out waiter from the queue
+	mutex->ownerCPU = myCPU();
 	spinlockRelease(&mutex->lock);
 	setFlagsRegister(flags);
 	
 	mutex->numLocks = 1;
+	if (statsEnabled) mutexRecord(aid, lineno, 1, 1, start);
 };
 
 int mutexTryLock(Mutex *mutex)
@@ -116,6 +229,7 @@ int mutexTryLock(Mutex *mutex)
 	if (mutex->owner == NULL)
 	{
 		mutex->owner = getCurrentThread();
+		mutex->ownerCPU = myCPU();
 		mutex->numLocks = 1;
 		spinlockRelease(&mutex->lock);
 		sti();
@@ -155,6 +269,7 @@ void mutexUnlock(Mutex *mutex)
 		mutex->first->awaken = 1;
 		signalThread(mutex->first->thread);
 		mutex->owner = mutex->first->thread;
+		mutex->ownerCPU = -1;
 		mutex->first = mutex->first->next;
 	}
 	else
@@ -165,3 +280,92 @@ void mutexUnlock(Mutex *mutex)
 	spinlockRelease(&mutex->lock);
 	setFlagsRegister(flags);
 };
+
+void mutexSetStats(int enable)
+{
+	if (enable)
+	{
+		statsEnabled = 0;
+		
+		uint64_t flags = getFlagsRegister();
+		cli();
+		spinlockAcquire(&statLock);
+		memset(mutexStats, 0, sizeof(mutexStats));
+		spinlockRelease(&statLock);
+		setFlagsRegister(flags);
+	};
+	
+	statsEnabled = enable;
+};
+
+static char* statPutNum(char *put, uint64_t num)
+{
+	char digits[24];
+	int count = 0;
+	do
+	{
+		digits[count++] = '0' + (num % 10);
+		num /= 10;
+	} while (num != 0);
+	
+	*put++ = '\t';
+	while (count--) *put++ = digits[count];
+	return put;
+};
+
+/**
+ * Copy entry 'index' of the statistics table into 'out' under statLock, so that a concurrent reset by
+ * mutexSetStats() cannot leave us with half an entry. Returns nonzero if the entry is in use.
+ */
+static int mutexStatCopy(int index, MutexStat *out)
+{
+	uint64_t flags = getFlagsRegister();
+	cli();
+	spinlockAcquire(&statLock);
+	memcpy(out, &mutexStats[index], sizeof(MutexStat));
+	spinlockRelease(&statLock);
+	setFlagsRegister(flags);
+	
+	return out->used && (out->aid != NULL);
+};
+
+char* mutexStatText()
+{
+	// each line is the file name, and then at most 6 numbers of at most 21 characters each
+	size_t bufsize = 256;
+	MutexStat copy;
+	int i;
+	for (i=0; i<MUTEX_STAT_MAX; i++)
+	{
+		if (mutexStatCopy(i, &copy)) bufsize += strlen(copy.aid) + 6 * 22 + 2;
+	};
+	
+	char *buffer = (char*) kmalloc(bufsize);
+	char *put = buffer;
+	
+	strformat(put, 256, "# lock statistics are %s (kernel option 1)\n# CALLER\tLINE\tACQUIRED\tCONTENDED\tSPUN\tWAIT_NS\tMAX_WAIT_NS\n",
+		statsEnabled ? "enabled" : "disabled");
+	put += strlen(put);
+	
+	for (i=0; i<MUTEX_STAT_MAX; i++)
+	{
+		MutexStat *st = &copy;
+		if (!mutexStatCopy(i, st)) continue;
+		
+		// new call sites may have appeared since we sized the buffer
+		if ((size_t)(put - buffer) + strlen(st->aid) + 6 * 22 + 2 >= bufsize) break;
+		
+		strcpy(put, st->aid);
+		put += strlen(put);
+		put = statPutNum(put, st->lineno);
+		put = statPutNum(put, st->acquired);
+		put = statPutNum(put, st->contended);
+		put = statPutNum(put, st->spun);
+		put = statPutNum(put, st->waitNanos);
+		put = statPutNum(put, st->maxWaitNanos);
+		*put++ = '\n';
+	};
+	
+	*put = 0;
+	return buffer;
+};
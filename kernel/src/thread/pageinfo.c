@@ -27,59 +27,55 @@
 */
 
 #include <glidix/thread/pageinfo.h>
-#include <glidix/thread/mutex.h>
 #include <glidix/util/memory.h>
 #include <glidix/hw/physmem.h>
 #include <glidix/util/string.h>
 #include <glidix/display/console.h>
 #include <glidix/util/common.h>
 
-static Mutex piLock;
-static PageInfoNode piRoot;
+/**
+ * The entry of every frame of RAM, indexed by frame number, and the number of entries.
+ */
+static uint64_t *piTable;
+static uint64_t piNumFrames;
+
+/**
+ * Frames past the end of RAM can only be device memory, which is always static (see piStaticFrame());
+ * they all share this entry. Its reference count is so high that it never drops to 0.
+ */
+static uint64_t piDeviceEntry = 0xFFFFFF | PI_CACHE;
 
 void piInit()
 {
-	mutexInit(&piLock);
-	memset(&piRoot, 0, sizeof(PageInfoNode));
+	piNumFrames = phmGetRAMEnd();
+	piTable = (uint64_t*) kmalloc(8 * piNumFrames);
+	if (piTable == NULL)
+	{
+		panic("cannot allocate the page info table for %lu frames", piNumFrames);
+	};
+	
+	memset(piTable, 0, 8 * piNumFrames);
+};
+
+static inline uint64_t* piEntry(uint64_t frame)
+{
+	if (frame >= piNumFrames) return &piDeviceEntry;
+	return &piTable[frame];
 };
 
 uint64_t piNew(uint64_t flags)
 {
-	uint64_t frame = phmAllocZeroFrame();
+	uint64_t frame = phmTakeZeroFrame();
 	if (frame == 0) return 0;
 	
-	mutexLock(&piLock);
-	uint64_t i;
-	PageInfoNode *node = &piRoot;
-	for (i=0; i<3; i++)
-	{
-		uint64_t index = (frame >> (9 * (3-i))) & 0x1FF;
-		if (node->entries[index] == 0)
-		{
-			PageInfoNode *newNode = NEW(PageInfoNode);
-			memset(newNode, 0, sizeof(PageInfoNode));
-			
-			node->entries[index] = (uint64_t) newNode;
-			node = newNode;
-		}
-		else
-		{
-			node = (PageInfoNode*) node->entries[index];
-		};
-	};
-	
-	uint64_t index = frame & 0x1FF;
-	node->entries[index] = 1UL | flags;
-	mutexUnlock(&piLock);
-	
+	// nobody else can see the frame yet
+	piTable[frame] = 1UL | flags;
 	return frame;
 };
 
 void piIncref(uint64_t frame)
 {
-	uint64_t newEnt = __sync_add_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		1);
+	uint64_t newEnt = __sync_add_and_fetch(piEntry(frame), 1);
 	
 	if ((newEnt & 0xFFFFFFFF) == 1)
 	{
@@ -89,9 +85,7 @@ void piIncref(uint64_t frame)
 
 void piDecref(uint64_t frame)
 {
-	uint64_t newEnt = __sync_add_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		-1);
+	uint64_t newEnt = __sync_add_and_fetch(piEntry(frame), -1);
 
 	if ((newEnt & 0xFFFFFFFF) == 0)
 	{
@@ -108,21 +102,17 @@ void piDecref(uint64_t frame)
 
 void piMarkDirty(uint64_t frame)
 {
-	__sync_or_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		PI_DIRTY);
+	__sync_or_and_fetch(piEntry(frame), PI_DIRTY);
 };
 
 void piMarkAccessed(uint64_t frame)
 {
-	__sync_or_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		PI_ACCESSED);
+	__sync_or_and_fetch(piEntry(frame), PI_ACCESSED);
 };
 
 int piNeedsCopyOnWrite(uint64_t frame)
 {
-	uint64_t val = piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF];
+	uint64_t val = *piEntry(frame);
 	
 	if ((val & 0xFFFFFFFF) == 1)
 	{
@@ -134,9 +124,7 @@ int piNeedsCopyOnWrite(uint64_t frame)
 
 void piUncache(uint64_t frame)
 {
-	uint64_t newEnt = __sync_and_and_fetch(
-		&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF],
-		~PI_CACHE);
+	uint64_t newEnt = __sync_and_and_fetch(piEntry(frame), ~PI_CACHE);
 
 	if ((newEnt & 0xFFFFFFFF) == 0)
 	{
@@ -147,39 +135,131 @@ void piUncache(uint64_t frame)
 
 int piCheckFlush(uint64_t frame)
 {
-	uint64_t val = __sync_fetch_and_and(&piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF], ~PI_DIRTY);
+	uint64_t val = __sync_fetch_and_and(piEntry(frame), ~PI_DIRTY);
 	
 	return !!(val & PI_DIRTY);
 };
 
 void piStaticFrame(uint64_t frame)
 {
-	mutexLock(&piLock);
+	if (frame < piNumFrames)
+	{
+		piTable[frame] = 0xFFFFFF | PI_CACHE;
+	};
+};
+
+uint64_t piGetInfo(uint64_t frame)
+{
+	return *piEntry(frame);
+};
+
+/* pagetab.asm */
+void __zeroFrame(uint64_t frame);
+
+uint64_t piNewHuge(uint64_t flags)
+{
+	uint64_t frame = phmAllocFrameEx(512, 0);
+	if (frame == 0) return 0;
+	
 	uint64_t i;
-	PageInfoNode *node = &piRoot;
-	for (i=0; i<3; i++)
+	for (i=0; i<512; i++)
+	{
+		__zeroFrame(frame+i);
+	};
+	
+	piTable[frame] = 1UL | PI_HUGE | flags;
+	for (i=1; i<512; i++)
 	{
-		uint64_t index = (frame >> (9 * (3-i))) & 0x1FF;
-		if (node->entries[index] == 0)
+		piTable[frame+i] = 0;
+	};
+	
+	return frame;
+};
+
+/**
+ * Wait until the first entry of a page created by piNewHuge() is not being split, and return its value.
+ */
+static uint64_t piHugeRead(uint64_t frame)
+{
+	uint64_t val;
+	while ((val = __atomic_load_n(&piTable[frame], __ATOMIC_ACQUIRE)) & PI_SPLITTING)
+	{
+		ASM ("pause");
+	};
+	
+	return val;
+};
+
+void piHugeIncref(uint64_t frame)
+{
+	while (1)
+	{
+		uint64_t val = piHugeRead(frame);
+		if ((val & PI_HUGE) == 0) break;
+		if (__sync_bool_compare_and_swap(&piTable[frame], val, val+1)) return;
+	};
+	
+	uint64_t i;
+	for (i=0; i<512; i++)
+	{
+		piIncref(frame+i);
+	};
+};
+
+void piHugeDecref(uint64_t frame)
+{
+	while (1)
+	{
+		uint64_t val = piHugeRead(frame);
+		if ((val & PI_HUGE) == 0) break;
+		
+		if ((val & 0xFFFFFFFF) == 1)
 		{
-			PageInfoNode *newNode = NEW(PageInfoNode);
-			memset(newNode, 0, sizeof(PageInfoNode));
-			
-			node->entries[index] = (uint64_t) newNode;
-			node = newNode;
+			if (__sync_bool_compare_and_swap(&piTable[frame], val, 0))
+			{
+				phmFreeFrameEx(frame, 512);
+				return;
+			};
 		}
 		else
 		{
-			node = (PageInfoNode*) node->entries[index];
+			if (__sync_bool_compare_and_swap(&piTable[frame], val, val-1)) return;
 		};
 	};
 	
-	uint64_t index = frame & 0x1FF;
-	node->entries[index] = 0xFFFFFF | PI_CACHE;
-	mutexUnlock(&piLock);
+	uint64_t i;
+	for (i=0; i<512; i++)
+	{
+		piDecref(frame+i);
+	};
 };
 
-uint64_t piGetInfo(uint64_t frame)
+void piHugeSplit(uint64_t frame)
 {
-	return piRoot.branches[(frame>>27)&0x1FF]->branches[(frame>>18)&0x1FF]->branches[(frame>>9)&0x1FF]->entries[frame&0x1FF];
+	uint64_t val;
+	do
+	{
+		val = piHugeRead(frame);
+		if ((val & PI_HUGE) == 0) return;
+	} while (!__sync_bool_compare_and_swap(&piTable[frame], val, val | PI_SPLITTING));
+	
+	// the other entries are unused until the split is visible, so nobody else touches them;
+	// and PI_SPLITTING holds off every change to the first one
+	uint64_t ent = val & ~PI_HUGE;
+	uint64_t i;
+	for (i=1; i<512; i++)
+	{
+		piTable[frame+i] = ent;
+	};
+	
+	__atomic_store_n(&piTable[frame], ent, __ATOMIC_RELEASE);
+};
+
+int piHugeNeedsCopyOnWrite(uint64_t frame)
+{
+	uint64_t val = piHugeRead(frame);
+	
+	// a page which was split may be shared frame-by-frame, so always copy it
+	if ((val & PI_HUGE) && ((val & 0xFFFFFFFF) == 1)) return 0;
+	return 1;
 };
@@ -35,10 +35,91 @@
 #include <glidix/util/memory.h>
 #include <glidix/util/string.h>
 #include <glidix/thread/pageinfo.h>
+#include <glidix/thread/futex.h>
 #include <glidix/display/console.h>
 #include <glidix/util/catch.h>
+#include <glidix/util/extable.h>
+#include <glidix/util/time.h>
+#include <glidix/hw/cpu.h>
 
-static PTe *getPage(uint64_t addr, int make)
+/**
+ * TLB shootdown operations.
+ */
+#define	TLB_RANGE				0		/* invalidate a range of pages */
+#define	TLB_DETACH				1		/* unload the address space (it is being deleted) */
+
+/**
+ * The address space currently loaded on this CPU. It stays loaded while kernel threads run, so it may
+ * differ from the current thread's address space.
+ */
+static PER_CPU ProcMem *activePM;
+
+/**
+ * A PCID held by a CPU: 'ctx' identifies the address space it was given to (0 if none), and 'tlbGen'
+ * is the TLB generation of that address space up to which the entries tagged with this PCID are known
+ * to be valid.
+ */
+typedef struct
+{
+	uint64_t				ctx;
+	uint64_t				tlbGen;
+} PCIDSlot;
+
+/**
+ * Per-CPU PCID state. 'pcidCurrent' is the PCID in use (0 before the first switch), and 'pcidNext'
+ * is the index of the slot to recycle next.
+ */
+static PER_CPU int pcidEnabled;
+static PER_CPU PCIDSlot pcidSlots[VM_NUM_PCIDS];
+static PER_CPU int pcidCurrent;
+static PER_CPU int pcidNext;
+
+/**
+ * Source of context IDs.
+ */
+static uint64_t vmNextCtx;
+
+/**
+ * Set once the kernel's own mappings have been made global.
+ */
+static int vmGlobalDone;
+
+/**
+ * The shootdown in progress. Only one may be in progress at a time: the initiator holds 'tlbLock' until
+ * every CPU in 'tlbPending' has done its part and cleared its bit.
+ */
+static Spinlock tlbLock;
+static ProcMem *tlbReqPM;
+static uint64_t tlbReqGen;
+static int tlbReqOp;
+static uint64_t tlbReqStart;
+static uint64_t tlbReqEnd;
+static volatile uint32_t tlbPending;
+
+/**
+ * Shootdown statistics, protected by 'tlbLock'. 'tlbSecond' is the second (of uptime) in which
+ * 'tlbThisSecond' shootdowns were counted so far; 'tlbLastSecond' is the count for the second before.
+ */
+static uint64_t tlbCount;
+static uint64_t tlbSecond;
+static uint64_t tlbThisSecond;
+static uint64_t tlbLastSecond;
+
+/**
+ * A range of pages whose TLB entries must be invalidated. Collected while changing page tables, so that
+ * one munmap() or mprotect() costs one shootdown instead of one per page.
+ */
+typedef struct
+{
+	uint64_t				start;
+	uint64_t				end;
+} TLBBatch;
+
+/**
+ * Return the page directory entry covering the given address, creating the page directory if 'make'
+ * is nonzero; or NULL if there isn't one.
+ */
+static PDe *getPDE(uint64_t addr, int make)
 {
 	addr &= ~0xFFF;
 	
@@ -47,7 +128,7 @@ static PTe *getPage(uint64_t addr, int make)
 	{
 		if (make)
 		{
-			pdpte->pdPhysAddr = phmAllocZeroFrame();
+			pdpte->pdPhysAddr = phmTakeZeroFrame();
 			pdpte->user = 1;
 			pdpte->rw = 1;
 			pdpte->present = 1;
@@ -59,12 +140,31 @@ static PTe *getPage(uint64_t addr, int make)
 		};
 	};
 	
-	PDe *pde = (PDe*) (((addr >> 18) | 0xffffffffc0000000UL) & ~0x7);
+	return (PDe*) (((addr >> 18) | 0xffffffffc0000000UL) & ~0x7);
+};
+
+/**
+ * Return the page table entry for the given address, creating the page tables if 'make' is nonzero;
+ * or NULL if there isn't one. Huge pages must be split before asking to make a page table under them.
+ */
+static PTe *getPage(uint64_t addr, int make)
+{
+	addr &= ~0xFFF;
+	
+	PDe *pde = getPDE(addr, make);
+	if (pde == NULL) return NULL;
+	
+	if (pde->ps)
+	{
+		if (make) panic("getPage(0x%016lx) called on a huge page", addr);
+		return NULL;
+	};
+	
 	if (!pde->present)
 	{
 		if (make)
 		{
-			pde->ptPhysAddr = phmAllocZeroFrame();
+			pde->ptPhysAddr = phmTakeZeroFrame();
 			pde->user = 1;
 			pde->rw = 1;
 			pde->present = 1;
@@ -79,25 +179,380 @@ static PTe *getPage(uint64_t addr, int make)
 	return (PTe*) (((addr >> 9) | 0xffffff8000000000UL) & ~0x7);
 };
 
-static void invalidatePage(uint64_t addr)
+/**
+ * Flush the non-global TLB entries of the current address space (and PCID).
+ */
+static void vmReloadCR3()
+{
+	uint64_t cr3;
+	ASM ("mov %%cr3, %0" : "=r" (cr3));
+	ASM ("mov %0, %%cr3" : : "r" (cr3) : "memory");
+};
+
+/**
+ * Set the G bit on every page of the kernel image mapping (PML4 entry 256), so that it survives CR3
+ * reloads and is shared by all PCIDs. The other kernel regions set it when mapping their pages.
+ */
+static void vmMarkKernelGlobal()
+{
+	uint64_t base = 0xFFFF800000000000UL;
+	PDPT *pdpt = (PDPT*) VIRT_TO_PDPTE(base);
+	
+	int i, j, k;
+	for (i=0; i<512; i++)
+	{
+		if (!pdpt->entries[i].present) continue;
+		
+		PD *pd = (PD*) VIRT_TO_PDE(base + ((uint64_t)i << 30));
+		for (j=0; j<512; j++)
+		{
+			if (!pd->entries[j].present) continue;
+			
+			if (pd->entries[j].ps)
+			{
+				// 2MB page; the G bit is bit 8 as in a PTE
+				*((uint64_t*)&pd->entries[j]) |= (1UL << 8);
+				continue;
+			};
+			
+			PT *pt = (PT*) VIRT_TO_PTE(base + ((uint64_t)i << 30) + ((uint64_t)j << 21));
+			for (k=0; k<512; k++)
+			{
+				if (pt->entries[k].present) pt->entries[k].global = 1;
+			};
+		};
+	};
+	
+	refreshAddrSpace();
+};
+
+void vmInitCPU()
 {
-	// TODO: inter-CPU TLB flush
-	invlpg((void*)addr);
+	uint32_t eax, ebx, ecx, edx;
+	ASM ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1), "c" (0));
+	
+	if (!vmGlobalDone)
+	{
+		vmGlobalDone = 1;
+		vmMarkKernelGlobal();
+	};
+	
+	uint64_t cr4;
+	ASM ("mov %%cr4, %0" : "=r" (cr4));
+	cr4 |= CR4_PGE;
+	if (ecx & CPUID_1_ECX_PCID)
+	{
+		// CR3 holds PCID 0 at this point, as required to set PCIDE
+		cr4 |= CR4_PCIDE;
+		pcidEnabled = 1;
+	};
+	ASM ("mov %0, %%cr4" : : "r" (cr4) : "memory");
+};
+
+/**
+ * Unload the active address space from the calling CPU. Called with interrupts disabled.
+ */
+static void vmUnload()
+{
+	PML4 *pml4 = getPML4();
+	pml4->entries[0].present = 0;
+	pml4->entries[0].pdptPhysAddr = 0;
+	vmReloadCR3();
+	
+	if (activePM != NULL) __sync_fetch_and_and(&activePM->cpuMask, ~(1U << getCurrentCPU()->id));
+	activePM = NULL;
+};
+
+/**
+ * Perform a TLB shootdown operation on the calling CPU, if it has 'pm' loaded. 'gen' is the TLB
+ * generation of 'pm' which the shootdown brings us up to. Called with interrupts disabled.
+ */
+static void tlbFlushLocal(ProcMem *pm, int op, uint64_t start, uint64_t end, uint64_t gen)
+{
+	if (activePM != pm) return;
+	
+	if (op == TLB_DETACH)
+	{
+		vmUnload();
+		if (pcidCurrent != 0) pcidSlots[pcidCurrent-1].ctx = 0;
+		return;
+	}
+	else if (((end - start) >> 12) > VM_FLUSH_MAX_PAGES)
+	{
+		vmReloadCR3();
+	}
+	else
+	{
+		uint64_t addr;
+		for (addr=start; addr<end; addr+=0x1000)
+		{
+			invlpg((void*)addr);
+		};
+	};
+	
+	if (pcidCurrent != 0) pcidSlots[pcidCurrent-1].tlbGen = gen;
+};
+
+/**
+ * Do our part of the shootdown in progress, if we are one of its targets. Called with interrupts
+ * disabled.
+ */
+static void tlbServe()
+{
+	uint32_t cpuBit = 1U << getCurrentCPU()->id;
+	if (tlbPending & cpuBit)
+	{
+		tlbFlushLocal(tlbReqPM, tlbReqOp, tlbReqStart, tlbReqEnd, tlbReqGen);
+		__sync_fetch_and_and(&tlbPending, ~cpuBit);
+	};
+};
+
+void vmShootdownIPI()
+{
+	tlbServe();
+};
+
+/**
+ * Invalidate the TLB entries for pages in the range [start, end) of 'pm' on every CPU which may hold
+ * them (if 'op' is TLB_RANGE), or make every CPU unload 'pm' (if 'op' is TLB_DETACH). Returns once all
+ * CPUs have done so.
+ */
+static void vmShootdown(ProcMem *pm, int op, uint64_t start, uint64_t end)
+{
+	uint64_t retflags = getFlagsRegister();
+	cli();
+	
+	// another CPU may be waiting for us to take part in its shootdown, so serve it while
+	// we wait for the lock
+	while (spinlockTry(&tlbLock) != 0)
+	{
+		tlbServe();
+	};
+	
+	// CPUs which hold a PCID for this address space but do not have it loaded will see the
+	// new generation when they switch back to it, and flush then
+	uint64_t gen = __sync_add_and_fetch(&pm->tlbGen, 1);
+	uint32_t targets = pm->cpuMask & ~(1U << getCurrentCPU()->id);
+	if (targets != 0)
+	{
+		tlbReqPM = pm;
+		tlbReqGen = gen;
+		tlbReqOp = op;
+		tlbReqStart = start;
+		tlbReqEnd = end;
+		__sync_synchronize();
+		tlbPending = targets;
+		__sync_synchronize();
+		
+		int i;
+		for (i=0; i<32; i++)
+		{
+			if (targets & (1U << i))
+			{
+				sendShootdownToCPU(i);
+			};
+		};
+	};
+	
+	tlbFlushLocal(pm, op, start, end, gen);
+	
+	if (targets != 0)
+	{
+		while (tlbPending != 0)
+		{
+			__sync_synchronize();
+		};
+		
+		uint64_t now = getNanotime() / 1000000000;
+		if (now != tlbSecond)
+		{
+			if (now == tlbSecond+1) tlbLastSecond = tlbThisSecond;
+			else tlbLastSecond = 0;
+			tlbThisSecond = 0;
+			tlbSecond = now;
+		};
+		
+		tlbThisSecond++;
+		tlbCount++;
+	};
+	
+	spinlockRelease(&tlbLock);
+	setFlagsRegister(retflags);
+};
+
+uint64_t vmShootdownCount()
+{
+	return tlbCount;
+};
+
+uint64_t vmShootdownRate()
+{
+	uint64_t now = getNanotime() / 1000000000;
+	if (now == tlbSecond) return tlbLastSecond;
+	else if (now == tlbSecond+1) return tlbThisSecond;
+	else return 0;
+};
+
+static void tlbBatchInit(TLBBatch *batch)
+{
+	batch->start = batch->end = 0;
+};
+
+static void tlbBatchAdd(TLBBatch *batch, uint64_t addr)
+{
+	addr &= ~0xFFFUL;
+	if (batch->start == batch->end)
+	{
+		batch->start = addr;
+		batch->end = addr + 0x1000;
+	}
+	else
+	{
+		if (addr < batch->start) batch->start = addr;
+		if ((addr + 0x1000) > batch->end) batch->end = addr + 0x1000;
+	};
+};
+
+/**
+ * Shoot down everything collected in the batch, and empty it.
+ */
+static void tlbBatchFlush(ProcMem *pm, TLBBatch *batch)
+{
+	if (batch->start != batch->end)
+	{
+		vmShootdown(pm, TLB_RANGE, batch->start, batch->end);
+	};
+	
+	tlbBatchInit(batch);
+};
+
+/**
+ * Return the huge page mapped at the given address, or NULL if it is not mapped by a huge page.
+ */
+static HugePDe *getHugePage(uint64_t addr)
+{
+	PDe *pde = getPDE(addr, 0);
+	if (pde == NULL) return NULL;
+	if (!pde->ps) return NULL;
+	return (HugePDe*) pde;
+};
+
+/**
+ * Replace the huge page mapping at 'base' (2MB-aligned) with a page table mapping each of its frames
+ * with the same permissions, so that the pages can be changed individually. Called with the segment list
+ * locked for writing, or locked for reading with 'ptLock' held.
+ */
+static void vmSplitHuge(ProcMem *pm, uint64_t base)
+{
+	HugePDe *hpde = getHugePage(base);
+	HugePDe old = *hpde;
+	piHugeSplit(old.framePhysAddr);
+	
+	PT pt;
+	memset(&pt, 0, sizeof(PT));
+	
+	int i;
+	for (i=0; i<512; i++)
+	{
+		PTe *pte = &pt.entries[i];
+		pte->present = old.present;
+		pte->rw = old.rw;
+		pte->user = old.user;
+		pte->accessed = old.accessed;
+		pte->dirty = old.dirty;
+		pte->framePhysAddr = old.framePhysAddr + i;
+		pte->gx_r = old.gx_r;
+		pte->gx_w = old.gx_w;
+		pte->gx_x = old.gx_x;
+		pte->gx_loaded = old.gx_loaded;
+		pte->gx_cow = old.gx_cow;
+		pte->gx_shared = old.gx_shared;
+		pte->gx_perm_ovr = 1;
+		pte->xd = old.xd;
+	};
+	
+	uint64_t frame = phmAllocFrame();
+	frameWrite(frame, &pt);
+	
+	PDe pde;
+	memset(&pde, 0, sizeof(PDe));
+	pde.ptPhysAddr = frame;
+	pde.user = 1;
+	pde.rw = 1;
+	pde.present = 1;
+	*((uint64_t*)hpde) = *((uint64_t*)&pde);
+	
+	// the translations are the same, but stale 2MB TLB entries must not coexist with the
+	// new 4KB ones
+	vmShootdown(pm, TLB_RANGE, base, base + VM_HUGE_SIZE);
+};
+
+/**
+ * If the given address is inside (and not at the start of) a huge page, split that page.
+ */
+static void vmSplitHugeAt(ProcMem *pm, uint64_t addr)
+{
+	if ((addr & (VM_HUGE_SIZE-1)) == 0) return;
+	
+	uint64_t base = addr & ~(VM_HUGE_SIZE-1);
+	if (getHugePage(base) != NULL) vmSplitHuge(pm, base);
 };
 
 static void unmapArea(uint64_t base, uint64_t size)
 {
+	ProcMem *pm = getCurrentThread()->pm;
+	TLBBatch batch;
+	tlbBatchInit(&batch);
+	
+	// huge pages which are only partly unmapped must be split first
+	vmSplitHugeAt(pm, base);
+	vmSplitHugeAt(pm, base+size);
+	
+	// make the pages inaccessible first, and only release the frames once no CPU can
+	// have them in its TLB anymore
 	uint64_t pos;
 	for (pos=base; pos<(base+size); pos+=0x1000)
 	{
+		HugePDe *hpde = getHugePage(pos);
+		if (hpde != NULL)
+		{
+			hpde->present = 0;
+			tlbBatchAdd(&batch, pos);
+			tlbBatchAdd(&batch, pos + VM_HUGE_SIZE - 0x1000);
+			pos += VM_HUGE_SIZE - 0x1000;
+			continue;
+		};
+		
 		PTe *pte = getPage(pos, 0);
 		if (pte != NULL)
 		{
 			if (pte->gx_loaded)
 			{
 				pte->present = 0;
+				tlbBatchAdd(&batch, pos);
+			};
+		};
+	};
+	
+	tlbBatchFlush(pm, &batch);
+	
+	for (pos=base; pos<(base+size); pos+=0x1000)
+	{
+		HugePDe *hpde = getHugePage(pos);
+		if (hpde != NULL)
+		{
+			piHugeDecref(hpde->framePhysAddr);
+			*((uint64_t*)hpde) = 0;
+			pos += VM_HUGE_SIZE - 0x1000;
+			continue;
+		};
+		
+		PTe *pte = getPage(pos, 0);
+		if (pte != NULL)
+		{
+			if (pte->gx_loaded)
+			{
 				pte->gx_loaded = 0;
-				invalidatePage(pos);
 				if (pte->accessed) piMarkAccessed(pte->framePhysAddr);
 				if (pte->dirty) piMarkDirty(pte->framePhysAddr);
 				piDecref(pte->framePhysAddr);
@@ -107,15 +562,200 @@ static void unmapArea(uint64_t base, uint64_t size)
 	};
 };
 
+/**
+ * Source of ProcMem generation numbers.
+ */
+static uint64_t vmNextGen;
+
+static int segHeight(Segment *seg)
+{
+	if (seg == NULL) return 0;
+	return seg->height;
+};
+
+static void segUpdate(Segment *seg)
+{
+	int left = segHeight(seg->left);
+	int right = segHeight(seg->right);
+	seg->height = (left > right ? left : right) + 1;
+};
+
+static Segment* segRotateRight(Segment *seg)
+{
+	Segment *top = seg->left;
+	seg->left = top->right;
+	top->right = seg;
+	segUpdate(seg);
+	segUpdate(top);
+	return top;
+};
+
+static Segment* segRotateLeft(Segment *seg)
+{
+	Segment *top = seg->right;
+	seg->right = top->left;
+	top->left = seg;
+	segUpdate(seg);
+	segUpdate(top);
+	return top;
+};
+
+static Segment* segBalance(Segment *seg)
+{
+	segUpdate(seg);
+	int balance = segHeight(seg->left) - segHeight(seg->right);
+	
+	if (balance > 1)
+	{
+		if (segHeight(seg->left->left) < segHeight(seg->left->right))
+		{
+			seg->left = segRotateLeft(seg->left);
+		};
+		
+		return segRotateRight(seg);
+	};
+	
+	if (balance < -1)
+	{
+		if (segHeight(seg->right->right) < segHeight(seg->right->left))
+		{
+			seg->right = segRotateRight(seg->right);
+		};
+		
+		return segRotateLeft(seg);
+	};
+	
+	return seg;
+};
+
+static Segment* segInsert(Segment *root, Segment *seg)
+{
+	if (root == NULL)
+	{
+		seg->left = seg->right = NULL;
+		seg->height = 1;
+		return seg;
+	};
+	
+	if (seg->start < root->start) root->left = segInsert(root->left, seg);
+	else root->right = segInsert(root->right, seg);
+	
+	return segBalance(root);
+};
+
+static Segment* segRemoveMin(Segment *root, Segment **minOut)
+{
+	if (root->left == NULL)
+	{
+		*minOut = root;
+		return root->right;
+	};
+	
+	root->left = segRemoveMin(root->left, minOut);
+	return segBalance(root);
+};
+
+static Segment* segRemove(Segment *root, Segment *seg)
+{
+	assert(root != NULL);
+	
+	if (seg->start < root->start)
+	{
+		root->left = segRemove(root->left, seg);
+	}
+	else if (seg->start > root->start)
+	{
+		root->right = segRemove(root->right, seg);
+	}
+	else
+	{
+		if (root->right == NULL) return root->left;
+		
+		Segment *min;
+		Segment *right = segRemoveMin(root->right, &min);
+		min->left = root->left;
+		min->right = right;
+		return segBalance(min);
+	};
+	
+	return segBalance(root);
+};
+
+/**
+ * Add a segment to the tree; its 'start' must already be set, and must not be the start of any
+ * segment already in the tree.
+ */
+static void vmInsertSeg(ProcMem *pm, Segment *seg)
+{
+	pm->tree = segInsert(pm->tree, seg);
+};
+
+/**
+ * Remove a segment from the tree; its 'start' must not have changed since it was inserted.
+ */
+static void vmRemoveSeg(ProcMem *pm, Segment *seg)
+{
+	pm->tree = segRemove(pm->tree, seg);
+};
+
+/**
+ * Called with the segment list locked for writing, whenever segments are changed, to invalidate the
+ * per-thread segment caches.
+ */
+static void vmChanged(ProcMem *pm)
+{
+	pm->gen = __sync_add_and_fetch(&vmNextGen, 1);
+};
+
+/**
+ * Find the segment containing the given address. Called with the segment list locked (for reading or
+ * writing). The segment is remembered by the calling thread, and tried first next time.
+ */
+static Segment* vmFindSegment(ProcMem *pm, uint64_t addr)
+{
+	Thread *ct = getCurrentThread();
+	Segment *seg = ct->segCache;
+	if ((seg != NULL) && (ct->segCacheGen == pm->gen))
+	{
+		if ((addr >= seg->start) && (addr < (seg->start + (seg->numPages << 12))))
+		{
+			return seg;
+		};
+	};
+	
+	// the segments cover the whole address space, so the one we want is the last one starting at
+	// or below the address
+	Segment *found = NULL;
+	seg = pm->tree;
+	while (seg != NULL)
+	{
+		if (seg->start <= addr)
+		{
+			found = seg;
+			seg = seg->right;
+		}
+		else
+		{
+			seg = seg->left;
+		};
+	};
+	
+	assert(found != NULL);
+	ct->segCache = found;
+	ct->segCacheGen = pm->gen;
+	return found;
+};
+
 int vmNew()
 {
 	Thread *ct = getCurrentThread();
 	ProcMem *oldPM = ct->pm;
 	ct->pm = NULL;
 	
-	PML4 *pml4 = getPML4();
-	pml4->entries[0].present = 0;
-	pml4->entries[0].pdptPhysAddr = 0;
+	uint64_t retflags = getFlagsRegister();
+	cli();
+	vmUnload();
+	setFlagsRegister(retflags);
 	
 	if (oldPM != NULL)
 	{
@@ -128,7 +768,8 @@ int vmNew()
 		return -1;
 	};
 	
-	semInit(&pm->lock);
+	rwsemInit(&pm->lock);
+	mutexInit(&pm->ptLock);
 	
 	// create the initial blank segment
 	Segment *seg = NEW(Segment);
@@ -139,23 +780,25 @@ int vmNew()
 	};
 	
 	seg->prev = seg->next = NULL;
+	seg->start = 0;
 	seg->numPages = 0x8000000;
 	seg->ft = NULL;
 	seg->flags = 0;
 	seg->prot = 0;
+	seg->advice = MADV_NORMAL;
 	
 	pm->segs = seg;
+	pm->tree = NULL;
+	vmInsertSeg(pm, seg);
+	vmChanged(pm);
 	pm->refcount = 1;
-	pm->phys = phmAllocZeroFrame();
+	pm->phys = phmTakeZeroFrame();
+	pm->cpuMask = 0;
+	pm->ctx = __sync_add_and_fetch(&vmNextCtx, 1);
+	pm->tlbGen = 0;
 	
 	ct->pm = pm;
-	
-	pml4->entries[0].pdptPhysAddr = pm->phys;
-	pml4->entries[0].user = 1;
-	pml4->entries[0].rw = 1;
-	pml4->entries[0].present = 1;
-	
-	refreshAddrSpace();
+	vmSwitch(pm);
 	return 0;
 };
 
@@ -166,7 +809,7 @@ static FileTree* getTree(File *fp)
 	return ft;
 };
 
-uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t off)
+static uint64_t vmMapArea(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t off)
 {
 	//vmDump(getCurrentThread()->pm, addr);
 	
@@ -274,32 +917,71 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 	{
 		// find an available mapping at the highest possible address
 		ProcMem *pm = getCurrentThread()->pm;
-		semWait(&pm->lock);
+		rwsemWrite(&pm->lock);
 		
 		// get the last segment
 		Segment *seg = pm->segs;
 		while (seg->next != NULL) seg = seg->next;
 		
+		// anonymous private mappings big enough to hold a huge page are placed on a 2MB
+		// boundary, so that they can use huge pages
+		uint64_t alignMask = 0xFFF;
+		if ((fp == NULL) && (flags & MAP_PRIVATE) && (numPages >= VM_HUGE_PAGES))
+		{
+			alignMask = VM_HUGE_SIZE - 1;
+		};
+		
 		// find the furthest FREE segment that can storethe required
 		// number of pages, or return ENOMEM.
-		uint64_t pos = 0x8000000000 - (seg->numPages << 12);
-		while ((seg->flags != 0) || (seg->numPages < numPages))
+		uint64_t pos;
+		while (1)
 		{
+			if ((seg->flags == 0) && (seg->numPages >= numPages))
+			{
+				pos = (seg->start + ((seg->numPages - numPages) << 12)) & ~alignMask;
+				if (pos >= seg->start) break;
+			};
+			
 			if (seg->prev == NULL)
 			{
-				semSignal(&pm->lock);
+				rwsemRelease(&pm->lock);
 				return ENOMEM;
 			};
 			
 			seg = seg->prev;
-			pos -= seg->numPages << 12;
 		};
 		
+		if (pos < ADDR_MIN)
+		{
+			rwsemRelease(&pm->lock);
+			return ENOMEM;
+		};
+		
+		// leave the space after an aligned mapping free
+		uint64_t tailPages = seg->numPages - ((pos - seg->start) >> 12) - numPages;
+		if (tailPages != 0)
+		{
+			Segment *tail = NEW(Segment);
+			memcpy(tail, seg, sizeof(Segment));
+			tail->start = pos + (numPages << 12);
+			tail->numPages = tailPages;
+			
+			tail->prev = seg;
+			tail->next = seg->next;
+			if (seg->next != NULL) seg->next->prev = tail;
+			seg->next = tail;
+			
+			seg->numPages -= tailPages;
+			vmInsertSeg(pm, tail);
+		};
+		
+		pos = seg->start;
+		
 		if (seg->numPages == numPages)
 		{
 			if (pos < ADDR_MIN)
 			{
-				semSignal(&pm->lock);
+				rwsemRelease(&pm->lock);
 				return ENOMEM;
 			};
 			
@@ -312,18 +994,20 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 			seg->flags = flags;
 			seg->prot = prot;
 			seg->access = access;
+			seg->advice = MADV_NORMAL;
 		}
 		else
 		{
 			pos += ((seg->numPages - numPages) << 12);
 			if (pos < ADDR_MIN)
 			{
-				semSignal(&pm->lock);
+				rwsemRelease(&pm->lock);
 				return ENOMEM;
 			};
 			
 			// split segment into 2
 			Segment *newSeg = NEW(Segment);
+			newSeg->start = pos;
 			newSeg->prev = seg;
 			newSeg->next = seg->next;
 			
@@ -337,17 +1021,20 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 			newSeg->numPages = numPages;
 			newSeg->ft = NULL;
 			if (fp != NULL) newSeg->ft = getTree(fp);
-			if (anonShared) seg->ft = ftCreate(FT_ANON);
+			if (anonShared) newSeg->ft = ftCreate(FT_ANON);
 			newSeg->offset = off;
 			newSeg->creator = creator;
 			newSeg->flags = flags;
 			newSeg->prot = prot;
 			newSeg->access = access;
+			newSeg->advice = MADV_NORMAL;
 			
 			seg->numPages -= numPages;
+			vmInsertSeg(pm, newSeg);
 		};
 		
-		semSignal(&pm->lock);
+		vmChanged(pm);
+		rwsemRelease(&pm->lock);
 		return pos;
 	}
 	else
@@ -369,22 +1056,10 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 		
 		// first find the segment which contains 'addr'.
 		ProcMem *pm = getCurrentThread()->pm;
-		semWait(&pm->lock);
+		rwsemWrite(&pm->lock);
 		
-		uint64_t pos = 0;
-		Segment *seg = pm->segs;
-		
-		while ((pos+(seg->numPages<<12)) <= addr)
-		{
-			if (seg->next == NULL)
-			{
-				semSignal(&pm->lock);
-				return ENOMEM;
-			};
-			
-			pos += (seg->numPages << 12);
-			seg = seg->next;
-		};
+		Segment *seg = vmFindSegment(pm, addr);
+		uint64_t pos = seg->start;
 		
 		if ((pos == addr) && (seg->numPages == numPages))
 		{
@@ -407,6 +1082,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 			seg->flags = flags;
 			seg->prot = prot;
 			seg->access = access;
+			seg->advice = MADV_NORMAL;
 		}
 		else
 		{
@@ -423,12 +1099,14 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 				newSeg->numPages -= offsetPages;
 				seg->numPages = offsetPages;
 				newSeg->offset += (offsetPages << 12);
+				newSeg->start = addr;
 				
 				newSeg->next = seg->next;
 				if (newSeg->next != NULL) newSeg->next->prev = newSeg;
 				
 				newSeg->prev = seg;
 				seg->next = newSeg;
+				vmInsertSeg(pm, newSeg);
 				
 				seg = newSeg;
 			};
@@ -442,6 +1120,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 				
 				newSeg->numPages = seg->numPages - numPages;
 				newSeg->offset += (numPages << 12);
+				newSeg->start = seg->start + (numPages << 12);
 				
 				seg->numPages = numPages;
 				
@@ -450,6 +1129,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 				
 				newSeg->prev = seg;
 				seg->next = newSeg;
+				vmInsertSeg(pm, newSeg);
 			};
 			
 			// if too small, consume further segments until necessary space is found
@@ -462,7 +1142,7 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 				{
 					if (seg->next->flags != 0)
 					{
-						unmapArea(addr + (seg->numPages << 12), seg->numPages << 12);
+						unmapArea(addr + (seg->numPages << 12), seg->next->numPages << 12);
 					};
 					
 					if (seg->next->ft != NULL) ftDown(seg->next->ft);
@@ -473,11 +1153,13 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 					seg->next = next->next;
 					if (seg->next != NULL) seg->next->prev = seg;
 					
+					vmRemoveSeg(pm, next);
 					kfree(next);
 				}
 				else
 				{
 					seg->next->offset += pagesNeeded << 12;
+					seg->next->start += pagesNeeded << 12;
 					seg->next->numPages -= pagesNeeded;
 					seg->numPages += pagesNeeded;
 				};
@@ -498,90 +1180,137 @@ uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t o
 			seg->flags = flags;
 			seg->prot = prot;
 			seg->access = access;
+			seg->advice = MADV_NORMAL;
 		};
 		
-		semSignal(&pm->lock);
+		vmChanged(pm);
+		rwsemRelease(&pm->lock);
 		return addr;
 	};
 };
 
-static void invalidateBlocks(uint64_t frame)
+/**
+ * Outcomes of vmResolveLocked() and vmResolve().
+ */
+#define	VM_RESOLVED				0		/* page is now accessible */
+#define	VM_MAPERR				1		/* address not mapped */
+#define	VM_ACCERR				2		/* access not permitted */
+#define	VM_BUSERR				3		/* page could not be loaded */
+#define	VM_IO					4		/* page must be read from a file first */
+#define	VM_SMALL				5		/* use 4KB pages instead (vmResolveHuge() only) */
+
+/**
+ * A page being read from a file while the locks are dropped.
+ */
+typedef struct
 {
-	Thread *ct = getCurrentThread();
-	Thread *thread = ct;
-	
-	uint64_t rflags = getFlagsRegister();
-	cli();
-	lockSched();
-	
-	int shouldResched = 0;
-	do
-	{
-		if ((thread->blockPhys >> 12) == frame)
-		{
-			thread->blockPhys = 0;
-			shouldResched |= signalThread(thread);
-		};
-		
-		thread = thread->next;
-	} while (thread != ct);
-	
-	unlockSched();
-	if (shouldResched) kyield();
-	setFlagsRegister(rflags);
+	FileTree*				ft;
+	off_t					offset;
+	uint64_t				frame;		// 0 if not yet read
+} FaultIO;
+
+/**
+ * Return nonzero if the 2MB block containing 'addr' may be mapped by a huge page in the given segment.
+ */
+static int vmHugeAllowed(Segment *seg, uint64_t addr)
+{
+	if (seg->advice == MADV_NOHUGEPAGE) return 0;
+	if (seg->ft != NULL) return 0;
+	if ((seg->flags & MAP_PRIVATE) == 0) return 0;
+	
+	uint64_t base = addr & ~(VM_HUGE_SIZE-1);
+	if (base < seg->start) return 0;
+	if ((base + VM_HUGE_SIZE) > (seg->start + (seg->numPages << 12))) return 0;
+	return 1;
 };
 
-void vmFault(Regs *regs, uint64_t faultAddr, int flags)
+/**
+ * Called by vmResolveLocked() for faults on huge pages: 'pde' is either a huge page mapping, or an empty
+ * entry to be filled with a new huge page. Returns VM_RESOLVED or VM_ACCERR; or VM_SMALL if we couldn't
+ * get a huge page, in which case the caller should use 4KB pages (splitting the huge page if there is one).
+ */
+static int vmResolveHuge(ProcMem *pm, Segment *seg, PDe *pde, uint64_t faultAddr, int requiredPerms, int breakCow)
 {
-	if ((faultAddr < ADDR_MIN) || (faultAddr >= ADDR_MAX))
+	uint64_t base = faultAddr & ~(VM_HUGE_SIZE-1);
+	HugePDe *hpde = (HugePDe*) pde;
+	
+	if (!pde->ps)
 	{
-		throw(EX_PAGE_FAULT);
+		// the permissions can only be changed per-page by vmProtect(), which creates a
+		// page table, so for a new huge page they are those of the segment
+		if ((seg->prot & PROT_READ) == 0) return VM_ACCERR;
+		if ((requiredPerms & PROT_WRITE) && (seg->prot & PROT_WRITE) == 0) return VM_ACCERR;
+		if ((requiredPerms & PROT_EXEC) && (seg->prot & PROT_EXEC) == 0) return VM_ACCERR;
 		
-		siginfo_t si;
-		memset(&si, 0, sizeof(siginfo_t));
-		si.si_signo = SIGSEGV;
-		si.si_code = SEGV_MAPERR;
-		si.si_addr = (void*) faultAddr;
+		uint64_t frame = piNewHuge(0);
+		if (frame == 0) return VM_SMALL;
 		
-		cli();
-		lockSched();
-		sendSignal(getCurrentThread(), &si);
-		switchTaskUnlocked(regs);
+		HugePDe newPDE;
+		memset(&newPDE, 0, sizeof(HugePDe));
+		newPDE.framePhysAddr = frame;
+		newPDE.gx_r = 1;
+		newPDE.gx_w = !!(seg->prot & PROT_WRITE);
+		newPDE.gx_x = !!(seg->prot & PROT_EXEC);
+		newPDE.gx_perm_ovr = 1;
+		newPDE.gx_loaded = 1;
+		newPDE.gx_cow = 1;
+		newPDE.xd = !newPDE.gx_x;
+		newPDE.user = 1;
+		newPDE.ps = 1;
+		newPDE.present = 1;
+		*((uint64_t*)hpde) = *((uint64_t*)&newPDE);
 	};
 	
-	ProcMem *pm = getCurrentThread()->pm;
-	semWait(&pm->lock);
-	
-	// try finding the segment in question
-	uint64_t pos = 0;
-	Segment *seg = pm->segs;
+	if (!hpde->gx_r) return VM_ACCERR;
+	if ((requiredPerms & PROT_WRITE) && !hpde->gx_w) return VM_ACCERR;
+	if ((requiredPerms & PROT_EXEC) && !hpde->gx_x) return VM_ACCERR;
 	
-	while ((pos+(seg->numPages<<12)) <= faultAddr)
+	if (breakCow && hpde->gx_cow)
 	{
-		pos += seg->numPages << 12;
-		seg = seg->next;
-	};
-	
-	// if unmapped, send the SIGSEGV signal
-	if (seg->flags == 0)
-	{
-		semSignal(&pm->lock);
-		throw(EX_PAGE_FAULT);
-		
-		siginfo_t si;
-		memset(&si, 0, sizeof(siginfo_t));
-		si.si_signo = SIGSEGV;
-		si.si_code = SEGV_MAPERR;
-		si.si_addr = (void*) faultAddr;
+		uint64_t old = hpde->framePhysAddr;
+		if (piHugeNeedsCopyOnWrite(old))
+		{
+			uint64_t frame = piNewHuge(0);
+			if (frame == 0) return VM_SMALL;
+			
+			// 2MB would flush most of the cache, so bypass it
+			uint64_t i;
+			for (i=0; i<VM_HUGE_PAGES; i++)
+			{
+				frameWriteNT(frame+i, (void*)(base + (i << 12)));
+			};
+			
+			hpde->framePhysAddr = frame;
+			hpde->gx_cow = 0;
+			hpde->rw = 1;
+			
+			vmShootdown(pm, TLB_RANGE, base, base + VM_HUGE_SIZE);
+			piHugeDecref(old);
+			
+			for (i=0; i<VM_HUGE_PAGES; i++)
+			{
+				futexInvalidateFrame(old+i);
+			};
+		};
 		
-		cli();
-		lockSched();
-		sendSignal(getCurrentThread(), &si);
-		switchTaskUnlocked(regs);
+		hpde->gx_cow = 0;
+		hpde->rw = 1;
 	};
 	
-	// set permission if currently unset
-	PTe *pte = getPage(faultAddr, 1);
+	// vmProtect() may have widened the permissions since the page was last accessible
+	hpde->present = 1;
+	if (hpde->gx_w && !hpde->gx_cow) hpde->rw = 1;
+	
+	invlpg((void*)faultAddr);
+	return VM_RESOLVED;
+};
+
+/**
+ * Give a page which has not been touched yet the permissions of its segment, unless they were already
+ * set (e.g. by vmProtect()).
+ */
+static void vmInitPerms(Segment *seg, PTe *pte)
+{
 	if (!pte->gx_perm_ovr)
 	{
 		pte->gx_perm_ovr = 1;
@@ -600,11 +1329,101 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 			pte->gx_x = 1;
 		};
 	};
+};
+
+/**
+ * Map 'frame' at a page which was not loaded yet; the page table takes over the caller's reference to
+ * the frame. The caller must invalidate the page if it may have been cached as not-present.
+ */
+static void vmSetLoaded(Segment *seg, PTe *pte, uint64_t frame)
+{
+	pte->framePhysAddr = frame;
+	pte->gx_shared = !!(seg->flags & MAP_SHARED);
+	pte->gx_cow = 0;
+	if (seg->flags & MAP_PRIVATE)
+	{
+		pte->gx_cow = 1;
+		pte->rw = 0;
+	}
+	else if (pte->gx_w)
+	{
+		pte->rw = 1;
+	};
+	
+	if (!pte->gx_x) pte->xd = 1;
+	if (pte->gx_r) pte->present = 1;
+	pte->user = 1;
+	pte->gx_loaded = 1;
+};
+
+/**
+ * Called with the same locks as vmResolveLocked(), after a read fault loaded the page at 'faultAddr' from
+ * the file tree of 'seg'. Also maps the other pages of the surrounding VM_FAULT_AROUND-page window which are
+ * already in the file cache, so that touching a library or data file page by page does not trap on every
+ * page. This never waits for I/O or for the tree lock; pages it cannot get cheaply are left to fault.
+ */
+static void vmFaultAround(Segment *seg, uint64_t faultAddr)
+{
+	uint64_t segEnd = seg->start + (seg->numPages << 12);
+	uint64_t start = faultAddr & ~((VM_FAULT_AROUND << 12) - 1);
+	uint64_t end = start + (VM_FAULT_AROUND << 12);
+	if (start < seg->start) start = seg->start;
+	if (end > segEnd) end = segEnd;
+	
+	// the window is within the page table of 'faultAddr', which we just used
+	uint64_t addr;
+	for (addr=start; addr<end; addr+=0x1000)
+	{
+		PTe *pte = getPage(addr, 1);
+		if (pte->gx_loaded) continue;
+		
+		vmInitPerms(seg, pte);
+		if (!pte->gx_r) continue;
+		
+		uint64_t frame = ftFindPage(seg->ft, seg->offset + (addr - seg->start));
+		if (frame == 0) continue;
+		
+		vmSetLoaded(seg, pte, frame);
+	};
+};
+
+/**
+ * Called with the segment list locked for reading, and 'ptLock' held. See vmResolve(). If the page must be
+ * read from a file, and 'io' does not already hold that page, this fills in 'io' (holding a reference
+ * to the tree) and returns VM_IO.
+ */
+static int vmResolveLocked(ProcMem *pm, uint64_t faultAddr, int requiredPerms, int breakCow, FaultIO *io, uint64_t *frameOut)
+{
+	Segment *seg = vmFindSegment(pm, faultAddr);
+	uint64_t pos = seg->start;
+	
+	if (seg->flags == 0)
+	{
+		return VM_MAPERR;
+	};
+	
+	// try a huge page; a caller which wants the frame needs a 4KB page, which it can hold a
+	// reference to
+	PDe *pde = getPDE(faultAddr, 1);
+	if (pde->ps || (!pde->present && vmHugeAllowed(seg, faultAddr)))
+	{
+		if (frameOut == NULL)
+		{
+			int status = vmResolveHuge(pm, seg, pde, faultAddr, requiredPerms, breakCow);
+			if (status != VM_SMALL) return status;
+		};
+		
+		if (pde->ps) vmSplitHuge(pm, faultAddr & ~(VM_HUGE_SIZE-1));
+	};
+	
+	// set permission if currently unset
+	PTe *pte = getPage(faultAddr, 1);
+	vmInitPerms(seg, pte);
 	
 	// check permissions
 	int allowed = 1;
 	
-	if (flags & PF_WRITE)
+	if (requiredPerms & PROT_WRITE)
 	{
 		if (!pte->gx_w)
 		{
@@ -617,7 +1436,7 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 		allowed = 0;
 	};
 	
-	if (flags & PF_FETCH)
+	if (requiredPerms & PROT_EXEC)
 	{
 		if (!pte->gx_x)
 		{
@@ -627,137 +1446,228 @@ void vmFault(Regs *regs, uint64_t faultAddr, int flags)
 	
 	if (!allowed)
 	{
-		semSignal(&pm->lock);
-		throw(EX_PAGE_FAULT);
-		
-		if ((regs->cs & 3) == 0)
-		{
-			panic("page fault in kernel, address 0x%08lX", faultAddr);
-		};
-		
-		siginfo_t si;
-		memset(&si, 0, sizeof(siginfo_t));
-		si.si_signo = SIGSEGV;
-		si.si_code = SEGV_ACCERR;
-		si.si_addr = (void*) faultAddr;
-		
-		cli();
-		lockSched();
-		sendSignal(getCurrentThread(), &si);
-		switchTaskUnlocked(regs);
+		return VM_ACCERR;
 	};
 	
 	// if the page is not yet loaded, load it
 	if (!pte->gx_loaded)
 	{
+		uint64_t frame;
 		if (seg->ft != NULL)
 		{
 			off_t offset = seg->offset + ((faultAddr & ~0xFFF) - pos);
-			uint64_t frame = ftGetPage(seg->ft, offset);
-			
-			if (frame == 0)
+			if ((io->frame != 0) && (io->ft == seg->ft) && (io->offset == offset))
 			{
-				semSignal(&pm->lock);
-				throw(EX_PAGE_FAULT);
-
-				siginfo_t si;
-				memset(&si, 0, sizeof(siginfo_t));
-				si.si_signo = SIGBUS;
-				si.si_code = BUS_OBJERR;
-		
-				cli();
-				lockSched();
-				sendSignal(getCurrentThread(), &si);
-				switchTaskUnlocked(regs);
+				// we read this page in while the locks were dropped
+				frame = io->frame;
+				io->frame = 0;
+			}
+			else
+			{
+				// the caller must read it in without the locks (or the segment changed
+				// while it did so, and we need a different page now)
+				if (io->frame != 0) piDecref(io->frame);
+				if (io->ft != NULL) ftDown(io->ft);
+				
+				ftUp(seg->ft);
+				io->ft = seg->ft;
+				io->offset = offset;
+				io->frame = 0;
+				return VM_IO;
 			};
-			
-			pte->framePhysAddr = frame;
 		}
 		else
 		{
-			uint64_t frame = piNew(0);
+			frame = piNew(0);
 			if (frame == 0)
 			{
-				semSignal(&pm->lock);
-				throw(EX_PAGE_FAULT);
-
-				siginfo_t si;
-				memset(&si, 0, sizeof(siginfo_t));
-				si.si_signo = SIGBUS;
-				si.si_code = BUS_OBJERR;
+				return VM_BUSERR;
+			};
+		};
+		
+		vmSetLoaded(seg, pte, frame);
 		
-				cli();
-				lockSched();
-				sendSignal(getCurrentThread(), &si);
-				switchTaskUnlocked(regs);
+		// invalidate the page on the CURRENT CPU, in case we need copy-on-write
+		// below
+		invlpg((void*)faultAddr);
+		
+		if ((seg->ft != NULL) && (!breakCow))
+		{
+			vmFaultAround(seg, faultAddr);
+		};
+	};
+	
+	// check for copy-on-write faults
+	if (breakCow)
+	{
+		if (pte->gx_cow)
+		{
+			if (piNeedsCopyOnWrite(pte->framePhysAddr))
+			{
+				uint64_t frame = piNew(0);
+				if (frame == 0)
+				{
+					return VM_BUSERR;
+				};
+			
+				frameWrite(frame, (void*)(faultAddr & ~0xFFF));
+			
+				uint64_t old = pte->framePhysAddr;
+				pte->framePhysAddr = frame;
+				pte->gx_cow = 0;
+				pte->rw = 1;
+				
+				// other threads may still be reading the old frame through stale
+				// TLB entries on other CPUs; flush them before letting go of it
+				vmShootdown(pm, TLB_RANGE, faultAddr & ~0xFFFUL, (faultAddr & ~0xFFFUL) + 0x1000);
+				piDecref(old);
+				
+				futexInvalidateFrame(old);
 			};
 			
-			pte->framePhysAddr = frame;
+			pte->gx_cow = 0;
+			pte->rw = 1;
 		};
+	};
+	
+	// finally we must invalidate the page; the permissions were only widened, so other
+	// CPUs at worst take a spurious fault on a stale entry
+	invlpg((void*)faultAddr);
+	
+	if (frameOut != NULL)
+	{
+		*frameOut = pte->framePhysAddr;
+		piIncref(*frameOut);
+	};
+	
+	return VM_RESOLVED;
+};
+
+/**
+ * Make the page containing 'faultAddr' in the calling process accessible with the permissions in 'requiredPerms'
+ * (a bitwise-OR of PROT_*), loading it if necessary, and performing copy-on-write if 'breakCow' is nonzero.
+ * The segment list is only locked for reading, so multiple threads may fault at once; when a page must be read
+ * from a file, all locks are dropped while that happens, and the lookup is then repeated. If 'frameOut' is not
+ * NULL, the frame is stored there on success, with its reference count incremented. Returns VM_RESOLVED on
+ * success, or VM_MAPERR, VM_ACCERR or VM_BUSERR.
+ */
+static int vmResolve(uint64_t faultAddr, int requiredPerms, int breakCow, uint64_t *frameOut)
+{
+	ProcMem *pm = getCurrentThread()->pm;
+	
+	FaultIO io;
+	io.ft = NULL;
+	io.offset = 0;
+	io.frame = 0;
+	
+	int status;
+	while (1)
+	{
+		rwsemRead(&pm->lock);
+		mutexLock(&pm->ptLock);
+		status = vmResolveLocked(pm, faultAddr, requiredPerms, breakCow, &io, frameOut);
+		mutexUnlock(&pm->ptLock);
+		rwsemRelease(&pm->lock);
+		
+		if (status != VM_IO) break;
+		
+		io.frame = ftGetPage(io.ft, io.offset);
+		if (io.frame == 0)
+		{
+			status = VM_BUSERR;
+			break;
+		};
+	};
+	
+	if (io.frame != 0) piDecref(io.frame);
+	if (io.ft != NULL) ftDown(io.ft);
+	return status;
+};
+
+/**
+ * Prefault a mapping just established with MAP_POPULATE, in one pass, so that the caller does not take a
+ * fault on each page later. Private writable mappings are made writable (copied) right away. Errors are
+ * ignored; the pages concerned will simply fault when touched.
+ */
+static void vmPopulate(uint64_t addr, size_t len, int prot, int flags)
+{
+	if ((prot & PROT_ALL) == 0) return;
+	
+	int requiredPerms = PROT_READ;
+	int breakCow = 0;
+	if ((prot & PROT_WRITE) && (flags & MAP_PRIVATE))
+	{
+		requiredPerms |= PROT_WRITE;
+		breakCow = 1;
+	};
+	
+	uint64_t end = addr + ((len + 0xFFF) & ~0xFFFUL);
+	for (; addr<end; addr+=0x1000)
+	{
+		vmResolve(addr, requiredPerms, breakCow, NULL);
+	};
+};
+
+uint64_t vmMap(uint64_t addr, size_t len, int prot, int flags, File *fp, off_t off)
+{
+	uint64_t result = vmMapArea(addr, len, prot, flags & ~MAP_POPULATE, fp, off);
+	if ((result >= ADDR_MIN) && (flags & MAP_POPULATE))
+	{
+		vmPopulate(result, len, prot, flags);
+	};
+	
+	return result;
+};
 
-		pte->gx_shared = !!(seg->flags & MAP_SHARED);
-		pte->gx_cow = 0;
-		if (seg->flags & MAP_PRIVATE)
-		{
-			pte->gx_cow = 1;
-			pte->rw = 0;
-		}
-		else if (pte->gx_w)
-		{
-			pte->rw = 1;
-		};
-		
-		if (!pte->gx_x) pte->xd = 1;
-		if (pte->gx_r) pte->present = 1;
-		pte->user = 1;
-		pte->gx_loaded = 1;
+void vmFault(Regs *regs, uint64_t faultAddr, int flags)
+{
+	int status = VM_MAPERR;
+	if ((faultAddr >= ADDR_MIN) && (faultAddr < ADDR_MAX))
+	{
+		int requiredPerms = PROT_READ;
+		if (flags & PF_WRITE) requiredPerms |= PROT_WRITE;
+		if (flags & PF_FETCH) requiredPerms |= PROT_EXEC;
 		
-		// invalidate the page on the CURRENT CPU, in case we need copy-on-write
-		// below
-		invlpg((void*)faultAddr);
+		status = vmResolve(faultAddr, requiredPerms, flags & PF_WRITE, NULL);
+		if (status == VM_RESOLVED) return;
 	};
 	
-	// check for copy-on-write faults
-	if (flags & PF_WRITE)
+	if ((regs->cs & 3) == 0)
 	{
-		if (pte->gx_cow)
+		if (extableFixup(regs)) return;
+	};
+	
+	throw(EX_PAGE_FAULT);
+	
+	siginfo_t si;
+	memset(&si, 0, sizeof(siginfo_t));
+	si.si_addr = (void*) faultAddr;
+	
+	if (status == VM_MAPERR)
+	{
+		si.si_signo = SIGSEGV;
+		si.si_code = SEGV_MAPERR;
+	}
+	else if (status == VM_ACCERR)
+	{
+		if ((regs->cs & 3) == 0)
 		{
-			if (piNeedsCopyOnWrite(pte->framePhysAddr))
-			{
-				uint64_t frame = piNew(0);
-				if (frame == 0)
-				{
-					semSignal(&pm->lock);
-					throw(EX_PAGE_FAULT);
-
-					siginfo_t si;
-					memset(&si, 0, sizeof(siginfo_t));
-					si.si_signo = SIGBUS;
-					si.si_code = BUS_OBJERR;
-		
-					cli();
-					lockSched();
-					sendSignal(getCurrentThread(), &si);
-					switchTaskUnlocked(regs);
-				};
-			
-				frameWrite(frame, (void*)(faultAddr & ~0xFFF));
-			
-				uint64_t old = pte->framePhysAddr;
-				pte->framePhysAddr = frame;
-				piDecref(old);
-				
-				invalidateBlocks(old);
-			};
-			
-			pte->gx_cow = 0;
-			pte->rw = 1;
+			panic("page fault in kernel, address 0x%08lX", faultAddr);
 		};
+		
+		si.si_signo = SIGSEGV;
+		si.si_code = SEGV_ACCERR;
+	}
+	else
+	{
+		si.si_signo = SIGBUS;
+		si.si_code = BUS_OBJERR;
 	};
 	
-	// finally we must invalidate the page
-	invalidatePage(faultAddr);
-	semSignal(&pm->lock);
+	cli();
+	lockSched();
+	sendSignal(getCurrentThread(), &si);
+	switchTaskUnlocked(regs);
 };
 
 int vmProtect(uint64_t base, size_t len, int prot)
@@ -788,10 +1698,13 @@ int vmProtect(uint64_t base, size_t len, int prot)
 	};
 	
 	ProcMem *pm = getCurrentThread()->pm;
-	semWait(&pm->lock);
+	rwsemWrite(&pm->lock);
 	
-	uint64_t pos = 0;
-	Segment *seg = pm->segs;
+	Segment *seg = vmFindSegment(pm, base);
+	uint64_t pos = seg->start;
+	
+	TLBBatch batch;
+	tlbBatchInit(&batch);
 	
 	uint64_t addr;
 	for (addr=base; addr<(base+len); addr+=0x1000)
@@ -804,7 +1717,8 @@ int vmProtect(uint64_t base, size_t len, int prot)
 		
 		if (seg->flags == 0)
 		{
-			semSignal(&pm->lock);
+			tlbBatchFlush(pm, &batch);
+			rwsemRelease(&pm->lock);
 			return ENOMEM;
 		};
 		
@@ -817,12 +1731,35 @@ int vmProtect(uint64_t base, size_t len, int prot)
 				if ((seg->access & O_WRONLY) == 0)
 				{
 					// not allowed, sorry
-					semSignal(&pm->lock);
+					tlbBatchFlush(pm, &batch);
+					rwsemRelease(&pm->lock);
 					return EACCES;
 				};
 			};
 		};
 		
+		// huge pages entirely within the range keep being huge; others must be split
+		HugePDe *hpde = getHugePage(addr);
+		if (hpde != NULL)
+		{
+			if (((addr & (VM_HUGE_SIZE-1)) == 0) && ((addr + VM_HUGE_SIZE) <= (base+len)))
+			{
+				hpde->gx_r = !!(prot & PROT_READ);
+				hpde->gx_w = !!(prot & PROT_WRITE);
+				hpde->gx_x = !!(prot & PROT_EXEC);
+				hpde->present = hpde->gx_r;
+				if (!hpde->gx_w) hpde->rw = 0;
+				hpde->xd = !hpde->gx_x;
+				
+				tlbBatchAdd(&batch, addr);
+				tlbBatchAdd(&batch, addr + VM_HUGE_SIZE - 0x1000);
+				addr += VM_HUGE_SIZE - 0x1000;
+				continue;
+			};
+			
+			vmSplitHuge(pm, addr & ~(VM_HUGE_SIZE-1));
+		};
+		
 		// set the permissions
 		PTe *pte = getPage(addr, 1);
 		pte->gx_perm_ovr = 1;
@@ -848,19 +1785,100 @@ int vmProtect(uint64_t base, size_t len, int prot)
 			};
 		};
 		
-		invalidatePage(addr);
+		tlbBatchAdd(&batch, addr);
+	};
+	
+	tlbBatchFlush(pm, &batch);
+	rwsemRelease(&pm->lock);
+	return 0;
+};
+
+/**
+ * Make sure a segment starts at the given (page-aligned) address, splitting the segment containing it
+ * if necessary, and return that segment. Called with the segment list locked for writing.
+ */
+static Segment* vmSplitSeg(ProcMem *pm, uint64_t addr)
+{
+	Segment *seg = vmFindSegment(pm, addr);
+	if (seg->start == addr) return seg;
+	
+	uint64_t offsetPages = (addr - seg->start) >> 12;
+	
+	Segment *newSeg = NEW(Segment);
+	memcpy(newSeg, seg, sizeof(Segment));
+	if (newSeg->ft != NULL) ftUp(newSeg->ft);
+	
+	newSeg->numPages -= offsetPages;
+	seg->numPages = offsetPages;
+	newSeg->offset += (offsetPages << 12);
+	newSeg->start = addr;
+	
+	newSeg->next = seg->next;
+	if (newSeg->next != NULL) newSeg->next->prev = newSeg;
+	
+	newSeg->prev = seg;
+	seg->next = newSeg;
+	vmInsertSeg(pm, newSeg);
+	
+	return newSeg;
+};
+
+int vmAdvise(uint64_t base, size_t len, int advice)
+{
+	if ((advice != MADV_NORMAL) && (advice != MADV_HUGEPAGE) && (advice != MADV_NOHUGEPAGE))
+	{
+		return EINVAL;
+	};
+	
+	if (base & 0xFFF)
+	{
+		return EINVAL;
+	};
+	
+	len = (len + 0xFFF) & ~0xFFFUL;
+	if ((base < ADDR_MIN) || (base >= ADDR_MAX) || (len > (ADDR_MAX - base)))
+	{
+		return ENOMEM;
+	};
+	
+	if (len == 0)
+	{
+		return 0;
+	};
+	
+	ProcMem *pm = getCurrentThread()->pm;
+	rwsemWrite(&pm->lock);
+	
+	// the whole range must be mapped
+	Segment *seg;
+	for (seg=vmFindSegment(pm, base); (seg != NULL) && (seg->start < (base+len)); seg=seg->next)
+	{
+		if (seg->flags == 0)
+		{
+			rwsemRelease(&pm->lock);
+			return ENOMEM;
+		};
 	};
 	
+	// the advice only affects future faults; huge pages already mapped stay
+	if ((base+len) < ADDR_MAX) vmSplitSeg(pm, base+len);
+	for (seg=vmSplitSeg(pm, base); (seg != NULL) && (seg->start < (base+len)); seg=seg->next)
+	{
+		seg->advice = advice;
+	};
+	
+	vmChanged(pm);
+	rwsemRelease(&pm->lock);
 	return 0;
 };
 
 void vmUnmapThread()
 {
 	ProcMem *pm = getCurrentThread()->pm;
+	if (pm == NULL) return;		/* a spawned child which failed before exec */
 	
-	semWait(&pm->lock);
+	rwsemWrite(&pm->lock);
 	
-	uint64_t pos = 0;
 	Segment *seg = pm->segs;
 	
 	Thread *ct = getCurrentThread();
@@ -870,7 +1888,7 @@ void vmUnmapThread()
 		{
 			if (seg->creator == ct)
 			{
-				unmapArea(pos, seg->numPages << 12);
+				unmapArea(seg->start, seg->numPages << 12);
 				if (seg->ft != NULL)
 				{
 					ftDown(seg->ft);
@@ -890,6 +1908,7 @@ void vmUnmapThread()
 						seg->prev->numPages += seg->numPages;
 						
 						Segment *prev = seg->prev;
+						vmRemoveSeg(pm, seg);
 						kfree(seg);
 						seg = prev;
 					};
@@ -902,6 +1921,7 @@ void vmUnmapThread()
 						seg->numPages += seg->next->numPages;
 						
 						Segment *next = seg->next->next;
+						vmRemoveSeg(pm, seg->next);
 						kfree(seg->next);
 						seg->next = next;
 						if (next != NULL) next->prev = seg;
@@ -910,11 +1930,11 @@ void vmUnmapThread()
 			};
 		};
 		
-		pos += seg->numPages << 12;
 		seg = seg->next;
 	};
 	
-	semSignal(&pm->lock);
+	vmChanged(pm);
+	rwsemRelease(&pm->lock);
 };
 
 static uint64_t clonePT(PT *pt)
@@ -952,7 +1972,20 @@ static uint64_t clonePD(PD *pd)
 	int i;
 	for (i=0; i<512; i++)
 	{
-		if (pd->entries[i].present)
+		if (pd->entries[i].ps)
+		{
+			// huge pages are shared copy-on-write just like the entries of a page table
+			HugePDe *hpde = (HugePDe*) &pd->entries[i];
+			if (!hpde->gx_shared)
+			{
+				hpde->rw = 0;
+				hpde->gx_cow = 1;
+			};
+			
+			piHugeIncref(hpde->framePhysAddr);
+			copy.entries[i] = pd->entries[i];
+		}
+		else if (pd->entries[i].present)
 		{
 			copy.entries[i].rw = 1;
 			copy.entries[i].user = 1;
@@ -997,8 +2030,10 @@ ProcMem* vmClone()
 	ProcMem *pm = getCurrentThread()->pm;
 	ProcMem *newPM = NEW(ProcMem);
 	
-	semInit(&newPM->lock);
-	if (pm != NULL) semWait(&pm->lock);
+	rwsemInit(&newPM->lock);
+	mutexInit(&newPM->ptLock);
+	newPM->tree = NULL;
+	if (pm != NULL) rwsemWrite(&pm->lock);
 	
 	Segment *lastSeg = NULL;
 	
@@ -1032,7 +2067,8 @@ ProcMem* vmClone()
 				newSeg->next = NULL;
 				lastSeg->next = newSeg;
 			};
-		
+			
+			vmInsertSeg(newPM, newSeg);
 			lastSeg = newSeg;
 		};
 	}
@@ -1040,20 +2076,32 @@ ProcMem* vmClone()
 	{
 		Segment *seg = NEW(Segment);
 		seg->prev = seg->next = NULL;
+		seg->start = 0;
 		seg->numPages = 0x8000000;
 		seg->ft = NULL;
 		seg->flags = 0;
 		seg->prot = 0;
+		seg->advice = MADV_NORMAL;
 	
 		newPM->segs = seg;
+		vmInsertSeg(newPM, seg);
 	};
 	
+	vmChanged(newPM);
+	
 	newPM->refcount = 1;
+	newPM->cpuMask = 0;
+	newPM->ctx = __sync_add_and_fetch(&vmNextCtx, 1);
+	newPM->tlbGen = 0;
 	if (pm != NULL) newPM->phys = clonePDPT((PDPT*) 0xFFFFFFFFFFE00000);	/* first PDPT */
-	else newPM->phys = phmAllocZeroFrame();
-	refreshAddrSpace();
+	else newPM->phys = phmTakeZeroFrame();
 	
-	if (pm != NULL) semSignal(&pm->lock);
+	// our pages are now read-only (copy-on-write), which other threads of this process must
+	// see as well
+	if (pm != NULL) vmShootdown(pm, TLB_RANGE, 0, ADDR_MAX);
+	else refreshAddrSpace();
+	
+	if (pm != NULL) rwsemRelease(&pm->lock);
 	return newPM;
 };
 
@@ -1089,7 +2137,11 @@ void deletePD(uint64_t frame)
 	int i;
 	for (i=0; i<512; i++)
 	{
-		if (pd.entries[i].present)
+		if (pd.entries[i].ps)
+		{
+			piHugeDecref(((HugePDe*) &pd.entries[i])->framePhysAddr);
+		}
+		else if (pd.entries[i].present)
 		{
 			deletePT(pd.entries[i].ptPhysAddr);
 		};
@@ -1116,6 +2168,8 @@ void vmDown(ProcMem *pm)
 {
 	if (__sync_add_and_fetch(&pm->refcount, -1) == 0)
 	{
+		// CPUs which last ran this process still have its page tables loaded
+		vmShootdown(pm, TLB_DETACH, 0, 0);
 		deletePDPT(pm->phys);
 		
 		Segment *seg = pm->segs;
@@ -1131,13 +2185,70 @@ void vmDown(ProcMem *pm)
 
 void vmSwitch(ProcMem *pm)
 {
+	uint64_t retflags = getFlagsRegister();
+	cli();
+	
+	if (activePM == pm)
+	{
+		// already loaded (e.g. switching between threads of the same process, or back from
+		// a kernel thread); shootdowns kept the TLB up to date, so keep it
+		setFlagsRegister(retflags);
+		return;
+	};
+	
+	uint32_t cpuBit = 1U << getCurrentCPU()->id;
+	if (activePM != NULL) __sync_fetch_and_and(&activePM->cpuMask, ~cpuBit);
+	__sync_fetch_and_or(&pm->cpuMask, cpuBit);
+	activePM = pm;
+	
 	PML4 *pml4 = getPML4();
 	pml4->entries[0].pdptPhysAddr = pm->phys;
 	pml4->entries[0].user = 1;
 	pml4->entries[0].rw = 1;
 	pml4->entries[0].present = 1;
 	
-	refreshAddrSpace();
+	if (pcidEnabled)
+	{
+		// read the generation only after setting our bit in the mask; a shootdown which
+		// misses us has already incremented it
+		uint64_t gen = pm->tlbGen;
+		uint64_t cr3;
+		ASM ("mov %%cr3, %0" : "=r" (cr3));
+		cr3 &= ~0xFFFUL;
+		
+		int i;
+		for (i=0; i<VM_NUM_PCIDS; i++)
+		{
+			if (pcidSlots[i].ctx == pm->ctx) break;
+		};
+		
+		if ((i != VM_NUM_PCIDS) && (pcidSlots[i].tlbGen == gen))
+		{
+			// the entries tagged with this PCID are still valid; don't flush them
+			cr3 |= (1UL << 63);
+		}
+		else
+		{
+			if (i == VM_NUM_PCIDS)
+			{
+				i = pcidNext;
+				pcidNext = (pcidNext + 1) % VM_NUM_PCIDS;
+			};
+			
+			pcidSlots[i].ctx = pm->ctx;
+			pcidSlots[i].tlbGen = gen;
+		};
+		
+		pcidCurrent = i + 1;
+		cr3 |= (uint64_t) pcidCurrent;
+		ASM ("mov %0, %%cr3" : : "r" (cr3) : "memory");
+	}
+	else
+	{
+		vmReloadCR3();
+	};
+	
+	setFlagsRegister(retflags);
 };
 
 void vmDump(ProcMem *pm, uint64_t addr)
@@ -1181,154 +2292,11 @@ uint64_t vmGetPhys(uint64_t faultAddr, int requiredPerms)
 		return 0;
 	};
 	
-	ProcMem *pm = getCurrentThread()->pm;
-	semWait(&pm->lock);
-	
-	// try finding the segment in question
-	uint64_t pos = 0;
-	Segment *seg = pm->segs;
-	
-	while ((pos+(seg->numPages<<12)) <= faultAddr)
-	{
-		pos += seg->numPages << 12;
-		seg = seg->next;
-	};
-	
-	if (seg->flags == 0)
-	{
-		semSignal(&pm->lock);
-		return 0;
-	};
-	
-	// set permission if currently unset
-	PTe *pte = getPage(faultAddr, 1);
-	if (!pte->gx_perm_ovr)
-	{
-		pte->gx_perm_ovr = 1;
-		if (seg->prot & PROT_READ)
-		{
-			pte->gx_r = 1;
-		};
-		
-		if (seg->prot & PROT_WRITE)
-		{
-			pte->gx_w = 1;
-		};
-		
-		if (seg->prot & PROT_EXEC)
-		{
-			pte->gx_x = 1;
-		};
-	};
-	
-	// check permissions
-	int allowed = 1;
-	
-	if (requiredPerms & PROT_WRITE)
-	{
-		if (!pte->gx_w)
-		{
-			allowed = 0;
-		};
-	};
-	
-	if (!pte->gx_r)
-	{
-		allowed = 0;
-	};
-	
-	if (requiredPerms & PROT_EXEC)
-	{
-		if (!pte->gx_x)
-		{
-			allowed = 0;
-		};
-	};
-	
-	if (!allowed)
+	uint64_t frame;
+	if (vmResolve(faultAddr, requiredPerms, 1, &frame) != VM_RESOLVED)
 	{
-		semSignal(&pm->lock);
 		return 0;
 	};
 	
-	// if the page is not yet loaded, load it
-	if (!pte->gx_loaded)
-	{
-		if (seg->ft != NULL)
-		{
-			off_t offset = seg->offset + ((faultAddr & ~0xFFF) - pos);
-			uint64_t frame = ftGetPage(seg->ft, offset);
-			
-			if (frame == 0)
-			{
-				semSignal(&pm->lock);
-				return 0;
-			};
-			
-			pte->framePhysAddr = frame;
-		}
-		else
-		{
-			uint64_t frame = piNew(0);
-			if (frame == 0)
-			{
-				semSignal(&pm->lock);
-				return 0;
-			};
-			
-			pte->framePhysAddr = frame;
-		};
-
-		pte->gx_shared = !!(seg->flags & MAP_SHARED);
-		pte->gx_cow = 0;
-		if (seg->flags & MAP_PRIVATE)
-		{
-			pte->gx_cow = 1;
-			pte->rw = 0;
-		}
-		else if (pte->gx_w)
-		{
-			pte->rw = 1;
-		};
-		
-		if (!pte->gx_x) pte->xd = 1;
-		if (pte->gx_r) pte->present = 1;
-		pte->user = 1;
-		pte->gx_loaded = 1;
-		
-		// invalidate the page on the CURRENT CPU, in case we need copy-on-write
-		// below
-		invlpg((void*)faultAddr);
-	};
-	
-	// check for copy-on-write faults
-	if (pte->gx_cow)
-	{
-		if (piNeedsCopyOnWrite(pte->framePhysAddr))
-		{
-			uint64_t frame = piNew(0);
-			if (frame == 0)
-			{
-				semSignal(&pm->lock);
-				return 0;
-			};
-		
-			frameWrite(frame, (void*)(faultAddr & ~0xFFF));
-		
-			uint64_t old = pte->framePhysAddr;
-			pte->framePhysAddr = frame;
-			piDecref(old);
-		};
-		
-		pte->gx_cow = 0;
-		pte->rw = 1;
-	};
-	
-	// finally we must invalidate the page
-	invalidatePage(faultAddr);
-	uint64_t result = pte->framePhysAddr;
-	piIncref(result);
-	semSignal(&pm->lock);
-	
-	return result;
+	return frame;
 };
@@ -0,0 +1,151 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <glidix/thread/rwsem.h>
+#include <glidix/thread/sched.h>
+#include <glidix/util/string.h>
+#include <glidix/display/console.h>
+
+void rwsemInit(RWSem *sem)
+{
+	memset(sem, 0, sizeof(RWSem));
+};
+
+static void rwsemAcquire(RWSem *sem, int write)
+{
+	uint64_t flags = getFlagsRegister();
+	cli();
+	spinlockAcquire(&sem->lock);
+	
+	if (sem->first == NULL)
+	{
+		if ((write) && (sem->count == 0))
+		{
+			sem->count = -1;
+			spinlockRelease(&sem->lock);
+			setFlagsRegister(flags);
+			return;
+		};
+		
+		if ((!write) && (sem->count >= 0))
+		{
+			sem->count++;
+			spinlockRelease(&sem->lock);
+			setFlagsRegister(flags);
+			return;
+		};
+	};
+	
+	// couldn't immediately acquire, add us to the queue
+	RWWaiter waiter;
+	waiter.thread = getCurrentThread();
+	waiter.next = NULL;
+	waiter.write = write;
+	waiter.awaken = 0;
+	
+	if (sem->first == NULL)
+	{
+		sem->first = sem->last = &waiter;
+	}
+	else
+	{
+		sem->last->next = &waiter;
+		sem->last = &waiter;
+	};
+	
+	while (!waiter.awaken)
+	{
+		waitThread(getCurrentThread());
+		spinlockRelease(&sem->lock);
+		kyield();
+		
+		cli();
+		spinlockAcquire(&sem->lock);
+	};
+	
+	// 'count' was already updated on our behalf by rwsemRelease(), which also removed
+	// us from the queue
+	spinlockRelease(&sem->lock);
+	setFlagsRegister(flags);
+};
+
+void rwsemRead(RWSem *sem)
+{
+	rwsemAcquire(sem, 0);
+};
+
+void rwsemWrite(RWSem *sem)
+{
+	rwsemAcquire(sem, 1);
+};
+
+void rwsemRelease(RWSem *sem)
+{
+	uint64_t flags = getFlagsRegister();
+	cli();
+	spinlockAcquire(&sem->lock);
+	
+	if (sem->count == 0)
+	{
+		panic("rwsemRelease called on a free semaphore");
+	};
+	
+	if (sem->count == -1) sem->count = 0;
+	else sem->count--;
+	
+	if (sem->count == 0)
+	{
+		if ((sem->first != NULL) && (sem->first->write))
+		{
+			// hand over to the writer at the head of the queue
+			RWWaiter *waiter = sem->first;
+			sem->first = waiter->next;
+			sem->count = -1;
+			
+			waiter->awaken = 1;
+			signalThread(waiter->thread);
+		}
+		else
+		{
+			// hand over to all readers at the head of the queue
+			while ((sem->first != NULL) && (!sem->first->write))
+			{
+				RWWaiter *waiter = sem->first;
+				sem->first = waiter->next;
+				sem->count++;
+				
+				waiter->awaken = 1;
+				signalThread(waiter->thread);
+			};
+		};
+	};
+	
+	spinlockRelease(&sem->lock);
+	setFlagsRegister(flags);
+};
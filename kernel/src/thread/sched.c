@@ -43,6 +43,7 @@
 #include <glidix/int/trace.h>
 #include <glidix/fs/ftree.h>
 #include <glidix/fs/procfs.h>
+#include <glidix/hw/physmem.h>
 
 Thread firstThread;
 PER_CPU Thread *currentThread;		// don't make it static; used by syscall.asm
@@ -57,6 +58,29 @@ void kmain2();
 uint32_t quantumTicks;			// initialised by init.c, how many APIC timer ticks to do per process.
 extern PER_CPU TSS* localTSSPtr;
 
+#define	QUANTUM_NANOS				NT_MILLI(QUANTUM_MILLI)
+
+/**
+ * The APIC timer is one-shot. Each CPU arms it for the end of the running thread's slice, and leaves it
+ * disarmed while idle. Once the PIT is stopped (schedTickless), the BSP also arms it for the next timed event,
+ * and processes the timer wheel when it fires; keeperDeadline is what the BSP's timer is armed for (0 if
+ * disarmed), so that other CPUs know when an event they post needs the BSP to re-arm.
+ */
+static int schedTickless;
+static Spinlock keeperLock;
+static uint64_t keeperDeadline;
+static PER_CPU uint64_t sliceStart;		// when the current slice (or idle period) started
+static PER_CPU uint64_t sliceEnd;		// when the current slice ends; 0 while idle
+static PER_CPU uint64_t idleMark;		// when avoided ticks were last counted, while idle
+
+/**
+ * The thread whose FPU state was last loaded into this CPU's registers. If we switch back to it
+ * and it has not run anywhere else in the meantime, its state is still there and needs no reload.
+ */
+static PER_CPU Thread *fpuOwner;
+static volatile ATOMIC(uint64_t) ticksAvoided;
+static void startSlice();
+
 static Spinlock expireLock;
 static Thread *threadSysMan;
 
@@ -308,12 +332,12 @@ void initSched()
 	// create a new stack for this initial process
 	firstThread.stack = kmalloc(DEFAULT_STACK_SIZE);
 	firstThread.stackSize = DEFAULT_STACK_SIZE;
-	fpuSave(&firstThread.fpuRegs);
+	firstThread.fpuRegs = fpuAlloc();
+	firstThread.fpuCPU = -1;
 	firstThread.catchRegs[7] = 0;
 	
 	// the value of registers do not matter except RSP and RIP,
 	// also the startup function should never return.
-	memset(&firstThread.fpuRegs, 0, 512);
 	memset(&firstThread.regs, 0, sizeof(Regs));
 	firstThread.regs.fsbase = 0;
 	firstThread.regs.gsbase = 0;
@@ -364,10 +388,145 @@ void initSched()
 	
 	// switch to this new thread's context
 	currentThread = &firstThread;
-	apic->timerInitCount = quantumTicks;
+	startSlice();
 	switchContext(&firstThread.regs);
 };
 
+static int isTimekeeper()
+{
+	return getCurrentCPU() == NULL || getCurrentCPU()->id == 0;
+};
+
+static uint32_t nanosToApic(uint64_t nanos)
+{
+	uint64_t quanta = nanos / QUANTUM_NANOS;
+	if (quanta >= 0xFFFFFFFFUL / quantumTicks) return 0xFFFFFFFF;
+	
+	uint64_t count = quanta * quantumTicks + (nanos % QUANTUM_NANOS) * quantumTicks / QUANTUM_NANOS;
+	if (count == 0) count = 1;
+	if (count > 0xFFFFFFFFUL) count = 0xFFFFFFFF;
+	return (uint32_t) count;
+};
+
+/**
+ * Arm this CPU's APIC timer for the next thing it must do. Call with interrupts disabled.
+ */
+static void armTimer()
+{
+	uint64_t deadline = sliceEnd;
+	int keeper = schedTickless && isTimekeeper();
+	if (keeper)
+	{
+		spinlockAcquire(&keeperLock);
+		uint64_t next = timedNextExpiry();
+		if (next != 0 && (deadline == 0 || next < deadline)) deadline = next;
+		keeperDeadline = deadline;
+	};
+	
+	uint64_t now = getNanotime();
+	if (deadline == 0) apic->timerInitCount = 0;
+	else if (deadline <= now) apic->timerInitCount = 1;
+	else apic->timerInitCount = nanosToApic(deadline - now);
+	
+	if (keeper) spinlockRelease(&keeperLock);
+};
+
+/**
+ * Start a new slice for currentThread (an idle period for the idle thread), and arm the timer accordingly.
+ */
+static void startSlice()
+{
+	sliceStart = getNanotime();
+	if (currentThread != NULL && currentThread == idleThread)
+	{
+		sliceEnd = 0;
+		idleMark = sliceStart;
+	}
+	else
+	{
+		sliceEnd = sliceStart + QUANTUM_NANOS;
+	};
+	
+	armTimer();
+};
+
+/**
+ * Count the periodic ticks this CPU did not take while idle, since the last count. If 'woken' is set, one
+ * interrupt was actually taken.
+ */
+static void countAvoidedTicks(uint64_t now, int woken)
+{
+	// a periodic timer would have interrupted this CPU once per quantum, and the BSP once per
+	// millisecond while the PIT was running
+	uint64_t period = (schedTickless && isTimekeeper()) ? NT_MILLI(1) : QUANTUM_NANOS;
+	if (idleMark != 0)
+	{
+		uint64_t ticks = (now - idleMark) / period;
+		if (woken && ticks != 0) ticks--;
+		__sync_fetch_and_add(&ticksAvoided, ticks);
+	};
+	
+	idleMark = now;
+};
+
+void schedSetTickless()
+{
+	schedTickless = 1;
+};
+
+uint64_t schedTicksAvoided()
+{
+	return ticksAvoided;
+};
+
+void schedTimer(Regs *regs)
+{
+	if (schedTickless && isTimekeeper())
+	{
+		onTick();
+		cli();
+	};
+	
+	if (currentThread != NULL && currentThread == idleThread)
+	{
+		// the idle loop yields by itself if anything was woken up
+		countAvoidedTicks(getNanotime(), 1);
+		armTimer();
+	}
+	else if (currentThread == NULL || getNanotime() >= sliceEnd)
+	{
+		switchTask(regs);
+	}
+	else
+	{
+		// woken up early for a timed event
+		armTimer();
+	};
+};
+
+void schedHint()
+{
+	if (schedTickless && isTimekeeper())
+	{
+		armTimer();
+	};
+};
+
+void schedTimerHint(uint64_t nanotime)
+{
+	if (!schedTickless) return;
+	
+	spinlockAcquire(&keeperLock);
+	int earlier = keeperDeadline == 0 || nanotime < keeperDeadline;
+	spinlockRelease(&keeperLock);
+	
+	if (earlier)
+	{
+		if (isTimekeeper()) armTimer();
+		else sendHintToCPU(0);
+	};
+};
+
 static Spinlock sysManReadySignal;
 static int numThreadsToClean;
 static void sysManFunc(void *ignore)
@@ -427,6 +586,7 @@ static void sysManFunc(void *ignore)
 				};
 				
 				kfree(threadFound->stack);
+				fpuFree(threadFound->fpuRegs);
 				if (threadFound->pm != NULL) vmDown(threadFound->pm);
 				if (threadFound->ftab != NULL) ftabDownref(threadFound->ftab);
 				if (threadFound->execPars != NULL) kfree(threadFound->execPars);
@@ -450,10 +610,17 @@ static void idleThreadFunc()
 {
 	while (1)
 	{
+		// zero frames for the page fault path while there is nothing else to do
+		while (cpuSleeping() && phmFillZeroPool());
+		
+		// test and halt with interrupts disabled, so that a wakeup arriving in between is not
+		// lost; "sti" only takes effect after the "hlt".
+		cli();
 		while (cpuSleeping())
 		{
-			hlt();
+			ASM ("sti; hlt; cli");
 		};
+		sti();
 		
 		kyield();
 	};
@@ -517,6 +684,49 @@ void initSchedAP()
 
 extern void reloadTR();
 
+static int fpuCurrentCPU()
+{
+	CPU *cpu = getCurrentCPU();
+	if (cpu == NULL) return 0;
+	return cpu->id;
+};
+
+/**
+ * Make sure the FPU registers hold the state of the given thread, which is about to run on
+ * this CPU. Kernel threads never touch the FPU, so their (meaningless) state is never loaded,
+ * and they leave the previous owner's registers intact.
+ */
+static void fpuSwitchIn(Thread *thread)
+{
+	if (thread->pm == NULL) return;
+	
+	int cpu = fpuCurrentCPU();
+	if (fpuOwner == thread && thread->fpuCPU == cpu) return;
+	
+	fpuLoad(thread->fpuRegs);
+	fpuOwner = thread;
+	thread->fpuCPU = cpu;
+};
+
+void fpuResetThread(uint32_t mxcsr)
+{
+	uint64_t flags = getFlagsRegister();
+	cli();
+	
+	FPURegs legacy;
+	memset(&legacy, 0, sizeof(FPURegs));
+	legacy.fcw = FPU_DEFAULT_FCW;
+	legacy.mxcsr = mxcsr;
+	
+	memset(currentThread->fpuRegs, 0, fpuStateSize);
+	fpuSetLegacy(currentThread->fpuRegs, &legacy);
+	fpuLoad(currentThread->fpuRegs);
+	fpuOwner = currentThread;
+	currentThread->fpuCPU = fpuCurrentCPU();
+	
+	setFlagsRegister(flags);
+};
+
 static void jumpToTask()
 {
 	// set /proc/self target on current CPU
@@ -538,8 +748,8 @@ static void jumpToTask()
 	currentThread->regs.rflags |= (1 << 9);
 
 	// switch context
-	fpuLoad(&currentThread->fpuRegs);
-	apic->timerInitCount = quantumTicks;
+	fpuSwitchIn(currentThread);
+	startSlice();
 	switchContext(&currentThread->regs);
 };
 
@@ -578,7 +788,9 @@ static int getPrio(Thread *thread)
 void switchTaskUnlocked(Regs *regs)
 {
 	// get number of ticks used
-	uint64_t ticks = quantumTicks - apic->timerCurrentCount;
+	uint64_t now = getNanotime();
+	uint64_t ticks = nanosToApic(now - sliceStart);
+	if (currentThread == idleThread) countAvoidedTicks(now, 0);
 	currentThread->ps.ps_ticks += ticks;
 	currentThread->ps.ps_entries++;
 	
@@ -593,7 +805,7 @@ void switchTaskUnlocked(Regs *regs)
 	};
 	
 	// remember the context of this thread.
-	fpuSave(&currentThread->fpuRegs);
+	if (currentThread->pm != NULL) fpuSave(currentThread->fpuRegs);
 	memcpy(&currentThread->regs, regs, sizeof(Regs));
 
 	// put the current thread back into the queue if still running
@@ -650,6 +862,7 @@ void switchTaskUnlocked(Regs *regs)
 		};
 	};
 
+	if (getCurrentCPU() != NULL) getCurrentCPU()->running = currentThread;
 	spinlockRelease(&schedLock);
 	
 	// the scheduler lock is now released, but we know the thread is not terminated,
@@ -663,7 +876,7 @@ void switchTask(Regs *regs)
 	cli();
 	if (currentThread == NULL)
 	{
-		apic->timerInitCount = quantumTicks;
+		startSlice();
 		return;
 	};
 	
@@ -747,6 +960,7 @@ void ReleaseKernelThread(Thread *thread)
 	
 	// release the stack and thread description
 	kfree(thread->stack);
+	fpuFree(thread->fpuRegs);
 	kfree(thread);
 };
 
@@ -775,8 +989,9 @@ Thread* CreateKernelThread(KernelThreadEntry entry, KernelThreadParams *params,
 	thread->catchRegs[7] = 0;
 	thread->stack = kmalloc(stackSize);
 	thread->stackSize = stackSize;
+	thread->fpuRegs = fpuAlloc();
+	thread->fpuCPU = -1;
 
-	memset(&thread->fpuRegs, 0, 512);
 	memset(&thread->regs, 0, sizeof(Regs));
 	thread->regs.rip = (uint64_t) entry;
 	thread->regs.rsp = (((uint64_t) thread->stack + thread->stackSize) & ~0xF) - 8;
@@ -818,9 +1033,6 @@ Thread* CreateKernelThread(KernelThreadEntry entry, KernelThreadParams *params,
 	thread->ps.ps_entries = 0;
 	thread->ps.ps_quantum = quantumTicks;
 	
-	// doesn't block on anything
-	thread->blockPhys = 0;
-	
 	// no debugging
 	thread->debugFlags = 0;
 
@@ -929,12 +1141,14 @@ int threadClone(Regs *regs, int flags, MachineState *state)
 	Thread *thread = (Thread*) kmalloc(sizeof(Thread));
 	memset(thread, 0, sizeof(Thread));
 	thread->catchRegs[7] = 0;
-	fpuSave(&thread->fpuRegs);
+	thread->fpuRegs = fpuAlloc();
+	thread->fpuCPU = -1;
+	if (currentThread->pm != NULL) fpuSave(thread->fpuRegs);
 	memcpy(&thread->regs, regs, sizeof(Regs));
 
 	if (state != NULL)
 	{
-		memcpy(&thread->fpuRegs, &state->fpuRegs, 512);
+		fpuSetLegacy(thread->fpuRegs, &state->fpuRegs);
 		thread->regs.fsbase = state->fsbase;
 		thread->regs.gsbase = state->gsbase;
 		thread->regs.rdi = state->rdi;
@@ -960,6 +1174,11 @@ int threadClone(Regs *regs, int flags, MachineState *state)
 	// kernel stack
 	thread->stack = kmalloc(DEFAULT_STACK_SIZE);
 	thread->stackSize = DEFAULT_STACK_SIZE;
+	if (flags & CLONE_SPAWN)
+	{
+		thread->regs.rsp = (((uint64_t) thread->stack + thread->stackSize) & ~0xF) - 8;
+		*((uint64_t*)thread->regs.rsp) = 0;
+	};
 
 	strcpy(thread->name, currentThread->name);
 	thread->flags = 0;
@@ -975,7 +1194,23 @@ int threadClone(Regs *regs, int flags, MachineState *state)
 	}
 	else
 	{
-		thread->pm = vmClone();
+		if (flags & CLONE_VFORK)
+		{
+			// borrow our address space until the child execs or exits
+			vmUp(currentThread->pm);
+			thread->pm = currentThread->pm;
+			thread->vforkDone = &currentThread->vforkWait;
+		}
+		else if (flags & CLONE_SPAWN)
+		{
+			// the child gets an address space when it execs
+			thread->pm = NULL;
+			thread->vforkDone = &currentThread->vforkWait;
+		}
+		else
+		{
+			thread->pm = vmClone();
+		};
 		
 		thread->sigdisp = sigdispCreate();
 		if (currentThread->sigdisp != NULL)
@@ -1102,9 +1337,6 @@ int threadClone(Regs *regs, int flags, MachineState *state)
 	thread->ps.ps_ticks = 0;
 	thread->ps.ps_entries = 0;
 	thread->ps.ps_quantum = quantumTicks;
-	
-	// initialize block address
-	thread->blockPhys = 0;
 
 	// stop-on-exec if we are being spawned by a debugger
 	thread->debugFlags = 0;
@@ -1147,12 +1379,24 @@ int threadClone(Regs *regs, int flags, MachineState *state)
 	};
 };
 
+void vforkRelease()
+{
+	Semaphore *done = currentThread->vforkDone;
+	if (done != NULL)
+	{
+		currentThread->vforkDone = NULL;
+		semSignal(done);
+	};
+};
+
 void threadExitEx(uint64_t retval)
 {
 	if (currentThread->creds == NULL)
 	{
 		panic("a kernel thread called threadExitEx()");
 	};
+	
+	vforkRelease();
 
 	if (currentThread->debugFlags & DBG_DEBUG_MODE)
 	{
@@ -1839,6 +2083,7 @@ uint64_t mapTempFrame(uint64_t frame)
 	
 	uint64_t old = pte->framePhysAddr;
 	pte->framePhysAddr = frame;
+	pte->global = 1;
 	
 	invlpg(tmpframe());
 	return old;
@@ -46,6 +46,48 @@ void semInit2(Semaphore *sem, int count)
 	sem->flags = 0;
 	sem->first = NULL;
 	sem->last = NULL;
+	sem->watches = NULL;
+};
+
+static void semNotify(Semaphore *sem)
+{
+	SemWatch *watch;
+	for (watch=sem->watches; watch!=NULL; watch=watch->next)
+	{
+		watch->callback(watch);
+	};
+};
+
+void semWatch(Semaphore *sem, SemWatch *watch)
+{
+	uint64_t flags = getFlagsRegister();
+	cli();
+	spinlockAcquire(&sem->lock);
+	
+	watch->sem = sem;
+	watch->prev = NULL;
+	watch->next = sem->watches;
+	if (sem->watches != NULL) sem->watches->prev = watch;
+	sem->watches = watch;
+	
+	spinlockRelease(&sem->lock);
+	setFlagsRegister(flags);
+};
+
+void semUnwatch(SemWatch *watch)
+{
+	Semaphore *sem = watch->sem;
+	
+	uint64_t flags = getFlagsRegister();
+	cli();
+	spinlockAcquire(&sem->lock);
+	
+	if (watch->prev != NULL) watch->prev->next = watch->next;
+	else sem->watches = watch->next;
+	if (watch->next != NULL) watch->next->prev = watch->prev;
+	
+	spinlockRelease(&sem->lock);
+	setFlagsRegister(flags);
 };
 
 int semWaitGen(Semaphore *sem, int count, int flags, uint64_t nanotimeout)
@@ -207,7 +249,9 @@ int semWaitGen(Semaphore *sem, int count, int flags, uint64_t nanotimeout)
 	}
 	else if (sem->flags & SEM_TERMINATED)
 	{
+		// drained; it now reports end-of-file, which counts as becoming ready again
 		sem->count = -1;
+		semNotify(sem);
 	};
 	
 	spinlockRelease(&sem->lock);
@@ -265,6 +309,7 @@ void semSignal2(Semaphore *sem, int count)
 	
 	int doResched = 0;
 	sem->count += count;
+	semNotify(sem);
 	if (sem->first != NULL)
 	{
 		Thread *thread = sem->first->thread;
@@ -313,6 +358,7 @@ void semTerminate(Semaphore *sem)
 		};
 	};
 	
+	semNotify(sem);
 	spinlockRelease(&sem->lock);
 	if (doResched) kyield();
 	sti();
@@ -73,9 +73,11 @@ void jumpToHandler(SignalStackFrame *frame, uint64_t handler)
 		processExit(WS_SIG(SIGABRT));
 	};
 	
-	// now push the FPU registers; this must be 16-byte aligned.
-	uint64_t addrFPU = (addrInfo - 512) & ~0xF;
-	if (memcpy_k2u((void*)addrFPU, &frame->mstate, 512) != 0)
+	// now push the FPU registers. this is the whole state area (not just the legacy part in the
+	// frame), so that the handler cannot clobber the upper halves of the interrupted code's vector
+	// registers; it is what the scheduler saved for us, and must be 64-byte aligned for XRSTOR.
+	uint64_t addrFPU = (addrInfo - fpuStateSize) & ~((uint64_t)FPU_ALIGN - 1);
+	if (memcpy_k2u((void*)addrFPU, getCurrentThread()->fpuRegs, fpuStateSize) != 0)
 	{
 		processExit(WS_SIG(SIGABRT));
 	};
@@ -126,6 +128,7 @@ void jumpToHandler(SignalStackFrame *frame, uint64_t handler)
 	regs.rbx = addrFPU;
 	regs.r12 = addrGPR;
 	regs.r13 = frame->sigmask;
+	regs.r14 = fpuMode;
 	regs.fsbase = msrRead(MSR_FS_BASE);
 	regs.gsbase = msrRead(MSR_GS_BASE);
 	switchContext(&regs);
@@ -313,7 +316,7 @@ void dispatchSignal()
 	SignalStackFrame *frame = (SignalStackFrame*) frameAddr;
 	frame->trapSigRet = (uint64_t)(&usup_sigret) - (uint64_t)(&usup_start) + 0xFFFF808000003000UL;
 	frame->sigmask = thread->sigmask;
-	memcpy(&frame->mstate.fpuRegs, &thread->fpuRegs, sizeof(FPURegs));
+	fpuGetLegacy(&frame->mstate.fpuRegs, thread->fpuRegs);
 	frame->mstate.rdi = thread->regs.rdi;
 	frame->mstate.rsi = thread->regs.rsi;
 	frame->mstate.rbp = thread->regs.rbp;
@@ -478,7 +481,7 @@ void sigret(void *ret)
 	regs.r14 = frame->mstate.r14;
 	regs.r15 = frame->mstate.r15;
 	regs.rflags = (frame->mstate.rflags & OK_USER_FLAGS) | (getFlagsRegister() & ~OK_USER_FLAGS) | (1 << 9);
-	fpuLoad(&frame->mstate.fpuRegs);
+	fpuLoadLegacy(&frame->mstate.fpuRegs);
 	getCurrentThread()->sigmask = frame->sigmask;
 	switchContext(&regs);
 };
@@ -79,6 +79,7 @@ void initMemoryPhase2()
 	{
 		pt->entries[i].present = 1;
 		pt->entries[i].rw = 1;
+		pt->entries[i].global = 1;
 		pt->entries[i].framePhysAddr = phmAllocFrame();
 	};
 
@@ -137,6 +138,7 @@ void expandHeap()
 	{
 		pt->entries[i].present = 1;
 		pt->entries[i].rw = 1;
+		pt->entries[i].global = 1;
 		pt->entries[i].framePhysAddr = phmAllocFrame();
 	};
 	
@@ -130,6 +130,7 @@ static void mapPages(void *ptr_, size_t size)
 		{
 			pte->framePhysAddr = phmAllocFrame();
 			pte->rw = 1;
+			pte->global = 1;
 			pte->present = 1;
 			
 			invlpg((void*)addr);
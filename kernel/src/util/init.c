@@ -63,6 +63,7 @@
 #include <glidix/hw/msr.h>
 #include <glidix/humin/ptr.h>
 #include <glidix/display/bootfb.h>
+#include <glidix/hw/clocksource.h>
 
 #define ACPI_OSC_QUERY_INDEX				0
 #define ACPI_OSC_SUPPORT_INDEX				1
@@ -372,6 +373,10 @@ void kmain(KernelBootInfo *info)
 	kprintf("Initializing the FPU... ");
 	fpuInit();
 	DONE();
+	
+	kprintf("Choosing the memory copy method... ");
+	stringInit();
+	DONE();
 
 	kprintf("Initializing the PIT... ");
 	uint16_t divisor = 1193180 / 1000;		// 1000 Hz
@@ -386,13 +391,29 @@ void kmain(KernelBootInfo *info)
 	sti();
 	apic->timerDivide = 3;
 	apic->timerInitCount = 0xFFFFFFFF;
-	sleep(35);
+	sleep(QUANTUM_MILLI);
 	apic->lvtTimer = 0;
 	quantumTicks = 0xFFFFFFFF - apic->timerCurrentCount;
 	apic->timerInitCount = 0;
 	// put the timer in single-shot mode at the appropriate interrupt vector.
 	apic->lvtTimer = I_APIC_TIMER;
 	DONE();
+	
+	kprintf("Initializing the clock source... ");
+	clockInit();
+	DONE();
+	
+	if (clockHasCounter())
+	{
+		// the time can now be read without the PIT, and timed events are driven by the APIC
+		// timer; put channel 0 into one-shot mode so that it stops interrupting us
+		kprintf("Stopping the PIT... ");
+		outb(0x43, 0x30);
+		outb(0x40, 0);
+		outb(0x40, 0);
+		schedSetTickless();
+		DONE();
+	};
 
 	kprintf("Initializing the scheduler and syscalls... ");
 	initPerCPU2();
@@ -482,6 +503,7 @@ void kmain2()
 
 	kprintf("Initializing the procfs... ");
 	initProcfs();
+	procfsAddText("lockstat", mutexStatText);
 	DONE();
 
 	initDevfs();
@@ -66,6 +66,7 @@ void ispInit()
 	ispPTE = &pt->entries[0];
 	ispPTE->present = 1;
 	ispPTE->rw = 1;
+	ispPTE->global = 1;
 	ispPTE->framePhysAddr = 0;
 
 	// APIC register space - also make sure it is in the default place.
@@ -74,7 +75,7 @@ void ispInit()
 	pt->entries[1].pcd = 1;
 	pt->entries[1].rw = 1;
 
-	// 2 unused, for now.
+	// 2 is the clock page, mapped by clockInit().
 	
 	// user support page; executable userspace code
 	pt->entries[3].present = 1;
@@ -105,7 +106,7 @@ void *ispGetPointer()
 void ispSetFrame(uint64_t frame)
 {
 	ispPTE->framePhysAddr = frame;
-	refreshAddrSpace();
+	invlpg(ispGetPointer());
 };
 
 void ispLock()
@@ -0,0 +1,137 @@
+/*
+	Glidix kernel
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <glidix/util/string.h>
+#include <glidix/util/memory.h>
+#include <glidix/util/common.h>
+#include <glidix/display/console.h>
+
+/**
+ * Sizes of the copies timed by stringInit(), and how many times each one is repeated (the fastest
+ * run counts, so that an interrupt does not skew the result).
+ */
+static const size_t stringBenchSizes[] = {64, 4096, 65536};
+#define	STRING_BENCH_SIZES		3
+#define	STRING_BENCH_MAX		65536
+#define	STRING_BENCH_RUNS		8
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	ASM ("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (subleaf));
+};
+
+static uint64_t rdtsc()
+{
+	uint32_t lo, hi;
+	ASM ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+};
+
+/**
+ * Return the fewest TSC ticks taken by memcpy() to copy 'size' bytes in the current mode.
+ */
+static uint64_t stringTime(void *dst, const void *src, size_t size)
+{
+	uint64_t best = ~0UL;
+	int i;
+	for (i=0; i<STRING_BENCH_RUNS; i++)
+	{
+		uint64_t start = rdtsc();
+		memcpy(dst, src, size);
+		uint64_t ticks = rdtsc() - start;
+		
+		if (ticks < best) best = ticks;
+	};
+	
+	return best;
+};
+
+void stringInit()
+{
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 7)
+	{
+		kprintf("rep movsq (no ERMS) ");
+		return;
+	};
+	
+	cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+	if ((ebx & CPUID_7_EBX_ERMS) == 0)
+	{
+		kprintf("rep movsq (no ERMS) ");
+		return;
+	};
+	
+	int fsrm = !!(edx & CPUID_7_EDX_FSRM);
+	char *src = (char*) kmalloc(STRING_BENCH_MAX);
+	char *dst = (char*) kmalloc(STRING_BENCH_MAX);
+	if ((src == NULL) || (dst == NULL))
+	{
+		// trust the CPU
+		kfree(src);
+		kfree(dst);
+		stringMode = STRING_MODE_BYTES;
+		kprintf("rep movsb (ERMS, not timed) ");
+		return;
+	};
+	
+	memset(src, 0x5A, STRING_BENCH_MAX);
+	
+	// each size is a vote for the mode which copied it faster; ties go to ERMS
+	int votes = 0;
+	int i;
+	for (i=0; i<STRING_BENCH_SIZES; i++)
+	{
+		size_t size = stringBenchSizes[i];
+		
+		stringMode = STRING_MODE_QWORDS;
+		uint64_t qwordTicks = stringTime(dst, src, size);
+		
+		stringMode = STRING_MODE_BYTES;
+		uint64_t byteTicks = stringTime(dst, src, size);
+		
+		kprintf("[%lu: movsb=%lu movsq=%lu] ", size, byteTicks, qwordTicks);
+		if (byteTicks <= qwordTicks) votes++;
+		else votes--;
+	};
+	
+	kfree(src);
+	kfree(dst);
+	
+	if (votes >= 0)
+	{
+		stringMode = STRING_MODE_BYTES;
+		kprintf("rep movsb (ERMS%s) ", fsrm ? ", FSRM" : "");
+	}
+	else
+	{
+		stringMode = STRING_MODE_QWORDS;
+		kprintf("rep movsq (ERMS slower) ");
+	};
+};
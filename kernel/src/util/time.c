@@ -32,6 +32,7 @@
 #include <glidix/hw/port.h>
 #include <glidix/thread/semaphore.h>
 #include <glidix/util/string.h>
+#include <glidix/hw/clocksource.h>
 
 #define	SECONDS_PER_HOUR				3600
 #define	SECONDS_PER_MINUTE				60
@@ -73,8 +74,7 @@ void sleep(int ticks)
 	}
 	else
 	{
-		uint64_t then = getUptime() + (uint64_t)ticks;
-		uint64_t nanoThen = then * (uint64_t)1000000;
+		uint64_t nanoThen = getNanotime() + NT_MILLI(ticks);
 
 		cli();
 		lockSched();
@@ -182,6 +182,8 @@ static void rtcThread(void *data)
 		timeUpdateStamp = getUptime();
 		spinlockRelease(&timeLock);
 		
+		clockSetRealtime(currentTime);
+		
 		sleep(RTC_UPDATE_INTERVAL);
 	};
 };
@@ -196,93 +198,306 @@ void initRTC()
 	CreateKernelThread(rtcThread, &rtcPars, NULL);
 };
 
-uint64_t getNanotime()
+/**
+ * Timed events are kept on a hierarchical timer wheel, with a resolution of 1 millisecond. There are WHEEL_DEPTH
+ * levels of WHEEL_LVL_SIZE slots each; every level is 8 times coarser than the one below it. An event is placed on
+ * the lowest level that can hold its deadline, rounded up to the granularity of that level, and is never moved
+ * afterwards; so posting and cancelling are O(1), and the rounding acts as timer slack: deadlines which are close
+ * together (relative to how far away they are) land in the same slot and expire on the same tick.
+ */
+#define	WHEEL_CLK_SHIFT					3
+#define	WHEEL_CLK_MASK					((1UL << WHEEL_CLK_SHIFT) - 1)
+#define	WHEEL_LVL_BITS					6
+#define	WHEEL_LVL_SIZE					(1UL << WHEEL_LVL_BITS)
+#define	WHEEL_LVL_MASK					(WHEEL_LVL_SIZE - 1)
+#define	WHEEL_DEPTH					8
+#define	WHEEL_SIZE					(WHEEL_LVL_SIZE * WHEEL_DEPTH)
+#define	WHEEL_LVL_SHIFT(n)				((n) * WHEEL_CLK_SHIFT)
+#define	WHEEL_LVL_GRAN(n)				(1UL << WHEEL_LVL_SHIFT(n))
+#define	WHEEL_LVL_START(n)				((WHEEL_LVL_SIZE - 1) << (((n) - 1) * WHEEL_CLK_SHIFT))
+#define	WHEEL_CUTOFF					WHEEL_LVL_START(WHEEL_DEPTH)
+#define	WHEEL_MAX					(WHEEL_CUTOFF - WHEEL_LVL_GRAN(WHEEL_DEPTH - 1))
+
+/**
+ * Protects the wheel. If the scheduler lock is also needed, it must be acquired first.
+ */
+static Spinlock wheelLock;
+
+/**
+ * The wheel itself, a bitmap of non-empty slots for each level, the next tick (in milliseconds of nanotime) which
+ * has not been processed yet, and the number of events on the wheel.
+ */
+static TimedEvent* wheelSlots[WHEEL_SIZE];
+static uint64_t wheelPending[WHEEL_DEPTH];
+static uint64_t wheelClk;
+static int wheelCount;
+
+/**
+ * Events which have expired but whose threads have not been woken up yet.
+ */
+static TimedEvent* wheelExpired;
+
+static void wheelLink(TimedEvent **head, TimedEvent *ev)
+{
+	ev->prev = NULL;
+	ev->next = *head;
+	if (*head != NULL) (*head)->prev = ev;
+	*head = ev;
+};
+
+static void wheelUnlink(TimedEvent **head, TimedEvent *ev)
+{
+	if (ev->prev != NULL) ev->prev->next = ev->next;
+	else *head = ev->next;
+	if (ev->next != NULL) ev->next->prev = ev->prev;
+	ev->prev = ev->next = NULL;
+};
+
+static int wheelIndexAt(uint64_t expires, int lvl, uint64_t *due)
+{
+	// round up, so that the slot is never processed before the deadline
+	expires = (expires >> WHEEL_LVL_SHIFT(lvl)) + 1;
+	*due = expires << WHEEL_LVL_SHIFT(lvl);
+	return lvl * WHEEL_LVL_SIZE + (expires & WHEEL_LVL_MASK);
+};
+
+/**
+ * Return the slot for an event expiring at tick "expires", and set "*due" to the tick at which that slot will be
+ * processed.
+ */
+static int wheelIndex(uint64_t expires, uint64_t *due)
+{
+	if (expires < wheelClk)
+	{
+		// already expired; deliver on the next tick
+		*due = wheelClk;
+		return wheelClk & WHEEL_LVL_MASK;
+	};
+	
+	uint64_t delta = expires - wheelClk;
+	int lvl;
+	for (lvl=0; lvl<WHEEL_DEPTH-1; lvl++)
+	{
+		if (delta < WHEEL_LVL_START(lvl+1))
+		{
+			return wheelIndexAt(expires, lvl, due);
+		};
+	};
+	
+	// too far in the future: park it in the furthest slot, onTick() will requeue it if it
+	// expires too early
+	if (delta >= WHEEL_CUTOFF)
+	{
+		expires = wheelClk + WHEEL_MAX;
+	};
+	
+	return wheelIndexAt(expires, WHEEL_DEPTH-1, due);
+};
+
+/**
+ * Put an event on the wheel, and return the tick at which it will be processed. The wheel must be locked.
+ */
+static uint64_t wheelInsert(TimedEvent *ev)
+{
+	uint64_t due;
+	int slot = wheelIndex(ev->nanotime / NT_MILLI(1), &due);
+	ev->slot = slot;
+	wheelLink(&wheelSlots[slot], ev);
+	wheelPending[slot / WHEEL_LVL_SIZE] |= (1UL << (slot % WHEEL_LVL_SIZE));
+	wheelCount++;
+	return due;
+};
+
+/**
+ * Take an event off the wheel. The wheel must be locked.
+ */
+static void wheelRemove(TimedEvent *ev)
+{
+	wheelUnlink(&wheelSlots[ev->slot], ev);
+	if (wheelSlots[ev->slot] == NULL)
+	{
+		wheelPending[ev->slot / WHEEL_LVL_SIZE] &= ~(1UL << (ev->slot % WHEEL_LVL_SIZE));
+	};
+	
+	wheelCount--;
+};
+
+/**
+ * Move everything which expires on tick "clk" to the expired list. The wheel must be locked.
+ */
+static void wheelCollect(uint64_t clk)
+{
+	int lvl;
+	for (lvl=0; lvl<WHEEL_DEPTH; lvl++)
+	{
+		int slot = lvl * WHEEL_LVL_SIZE + (clk & WHEEL_LVL_MASK);
+		while (wheelSlots[slot] != NULL)
+		{
+			TimedEvent *ev = wheelSlots[slot];
+			wheelRemove(ev);
+			
+			ev->slot = TIMED_SLOT_EXPIRED;
+			wheelLink(&wheelExpired, ev);
+		};
+		
+		// the next level is only due when all the lower bits have wrapped around
+		if (clk & WHEEL_CLK_MASK) break;
+		clk >>= WHEEL_CLK_SHIFT;
+	};
+};
+
+/**
+ * Return the first tick at or after "wheelClk" which has a non-empty slot due. The wheel must be locked, and must
+ * not be empty.
+ */
+static uint64_t wheelNextDue()
 {
-	uint64_t out = getUptime();
-	return out * (uint64_t)1000000;		// 10^6 nanoseconds in a millisecond because 10^9 in a second
+	uint64_t next = ~0UL;
+	int lvl;
+	for (lvl=0; lvl<WHEEL_DEPTH; lvl++)
+	{
+		uint64_t pending = wheelPending[lvl];
+		if (pending == 0) continue;
+		
+		// the first value of this level's clock which has not been processed yet, and the
+		// first non-empty slot at or after it (circularly)
+		uint64_t lvlClk = (wheelClk + WHEEL_LVL_GRAN(lvl) - 1) >> WHEEL_LVL_SHIFT(lvl);
+		int pos = lvlClk & WHEEL_LVL_MASK;
+		if (pos != 0) pending = (pending >> pos) | (pending << (WHEEL_LVL_SIZE - pos));
+		
+		uint64_t due = (lvlClk + __builtin_ctzl(pending)) << WHEEL_LVL_SHIFT(lvl);
+		if (due < next) next = due;
+	};
+	
+	return next;
 };
 
-static TimedEvent *timedEvents = NULL;
 void timedPost(TimedEvent *ev, uint64_t nanotime)
 {
 	ev->nanotime = nanotime;
 	ev->thread = getCurrentThread();
+	ev->slot = TIMED_SLOT_NONE;
+	ev->prev = ev->next = NULL;
 
 	if (nanotime == 0)
 	{
-		ev->prev = ev->next = NULL;
 		return;
 	};
 	
-	if (timedEvents == NULL)
+	spinlockAcquire(&wheelLock);
+	if (wheelCount == 0)
+	{
+		// nothing is pending, so the wheel can jump straight to the present
+		uint64_t now = getNanotime() / NT_MILLI(1);
+		if (now > wheelClk) wheelClk = now;
+	};
+	
+	uint64_t due = wheelInsert(ev);
+	spinlockRelease(&wheelLock);
+	
+	// make sure something will be awake to process it
+	schedTimerHint(NT_MILLI(due));
+};
+
+void timedCancel(TimedEvent *ev)
+{
+	spinlockAcquire(&wheelLock);
+	if (ev->slot == TIMED_SLOT_EXPIRED)
 	{
-		ev->prev = ev->next = NULL;
-		timedEvents = ev;
+		wheelUnlink(&wheelExpired, ev);
 	}
-	else
+	else if (ev->slot != TIMED_SLOT_NONE)
 	{
-		if (nanotime <= timedEvents->nanotime)
-		{
-			//ev->prev = timedEvents;
-			//ev->next = timedEvents->next;
-			//timedEvents = ev;
-			timedEvents->prev = ev;
-			ev->prev = NULL;
-			ev->next = timedEvents;
-			timedEvents = ev;
-			return;
-		};
-		
-		TimedEvent *scan = timedEvents;
-		while (1)
-		{
-			if (scan->next == NULL)
-			{
-				ev->prev = scan;
-				ev->next = NULL;
-				scan->next = ev;
-				return;
-			}
-			else
-			{
-				if ((scan->nanotime <= nanotime) && (scan->next->nanotime >= nanotime))
-				{
-					ev->next = scan->next;
-					ev->prev = scan;
-					scan->next->prev = ev;
-					scan->next = ev;
-					return;
-				};
-				
-				scan = scan->next;
-			};
-		};
+		wheelRemove(ev);
 	};
+	
+	ev->slot = TIMED_SLOT_NONE;
+	spinlockRelease(&wheelLock);
 };
 
-void timedCancel(TimedEvent *ev)
+uint64_t timedNextExpiry()
 {
-	if (timedEvents == ev) timedEvents = ev->next;
-	if (ev->prev != NULL) ev->prev->next = ev->next;
-	if (ev->next != NULL) ev->next->prev = ev->prev;
+	spinlockAcquire(&wheelLock);
+	if (wheelExpired != NULL)
+	{
+		spinlockRelease(&wheelLock);
+		return 1;
+	};
+	
+	if (wheelCount == 0)
+	{
+		spinlockRelease(&wheelLock);
+		return 0;
+	};
+	
+	uint64_t next = wheelNextDue();
+	spinlockRelease(&wheelLock);
+	return NT_MILLI(next);
 };
 
 void onTick()
 {
+	uint64_t now = getNanotime();
+	uint64_t nowTick = now / NT_MILLI(1);
+	
+	// advance the wheel without touching the scheduler. after a long tickless idle, most of the
+	// ticks we missed have nothing due, so jump from one occupied slot to the next rather than
+	// stepping through every millisecond.
+	spinlockAcquire(&wheelLock);
+	while (wheelClk <= nowTick)
+	{
+		if (wheelCount == 0)
+		{
+			wheelClk = nowTick + 1;
+			break;
+		};
+		
+		uint64_t next = wheelNextDue();
+		if (next > nowTick)
+		{
+			wheelClk = nowTick + 1;
+			break;
+		};
+		
+		if (next > wheelClk) wheelClk = next;
+		wheelCollect(wheelClk++);
+	};
+	
+	int anyExpired = wheelExpired != NULL;
+	spinlockRelease(&wheelLock);
+	
+	if (!anyExpired) return;
+	
+	// wake up the whole batch under a single acquisition of the scheduler lock. the owners of
+	// the events cannot call timedCancel() meanwhile, since that requires the scheduler lock;
+	// but signalThread() may cancel an alarm, so the wheel is not held while calling it.
 	lockSched();
 	
 	int doResched = 0;
 	while (1)
 	{
-		if (timedEvents == NULL) break;
-		if (getNanotime() <= timedEvents->nanotime) break;
+		spinlockAcquire(&wheelLock);
+		TimedEvent *ev = wheelExpired;
+		if (ev == NULL)
+		{
+			spinlockRelease(&wheelLock);
+			break;
+		};
+		
+		wheelUnlink(&wheelExpired, ev);
+		if (now <= ev->nanotime)
+		{
+			// parked beyond the range of the wheel; not due yet. the timer is re-armed after
+			// this tick, so there is no need to hint the scheduler.
+			wheelInsert(ev);
+			spinlockRelease(&wheelLock);
+			continue;
+		};
+		
+		ev->slot = TIMED_SLOT_NONE;
+		spinlockRelease(&wheelLock);
 		
-		TimedEvent *ev = timedEvents;
-		Thread *thread = ev->thread;
-		timedEvents = ev->next;
-		if (timedEvents != NULL) timedEvents->prev = NULL;
-		ev->prev = ev->next = NULL;
-		doResched = doResched || signalThread(thread);
+		doResched = signalThread(ev->thread) || doResched;
 	};
 	
 	unlockSched();
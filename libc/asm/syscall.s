@@ -23,6 +23,21 @@ __syscall:
 	ret
 .size __syscall, .-__syscall
 
+/**
+ * The child of vfork() runs on our stack until it calls exec or _exit, so it would overwrite our
+ * return address; keep it in R9 instead (which survives system calls), and have the kernel return
+ * the child straight to it.
+ */
+.globl vfork
+.type vfork, @function
+vfork:
+	pop	%rdi
+	mov	%rdi,	%r9
+	mov	$167,	%rax
+	syscall
+	jmp	*%r9
+.size vfork, .-vfork
+
 GLIDIX_SYSCALL	0,	_exit
 GLIDIX_SYSCALL	1,	write
 GLIDIX_SYSCALL	2,	_glidix_exec
@@ -165,3 +180,15 @@ GLIDIX_SYSCALL	149,	rmdir
 
 GLIDIX_SYSCALL	151,	_glidix_pathctlat
 GLIDIX_SYSCALL	152,	_glidix_pathctl
+
+GLIDIX_SYSCALL	157,	_glidix_sendmsg
+GLIDIX_SYSCALL	158,	_glidix_recvmsg
+GLIDIX_SYSCALL	159,	_glidix_neightab
+GLIDIX_SYSCALL	160,	_glidix_futex
+GLIDIX_SYSCALL	161,	_glidix_eqcreate
+GLIDIX_SYSCALL	162,	_glidix_eqctl
+GLIDIX_SYSCALL	163,	_glidix_eqwait
+GLIDIX_SYSCALL	164,	getrlimit
+GLIDIX_SYSCALL	165,	setrlimit
+GLIDIX_SYSCALL	166,	madvise
+GLIDIX_SYSCALL	168,	_glidix_spawn
@@ -55,22 +55,47 @@ extern "C" {
 #define	PTHREAD_PRIO_NONE				0
 
 #define	PTHREAD_MUTEX_INITIALIZER			{0, 0, 0, 0, 0}
+#define	PTHREAD_COND_INITIALIZER			{0, 0}
+#define	PTHREAD_RWLOCK_INITIALIZER			{PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, \
+							PTHREAD_COND_INITIALIZER, 0, 0, 0}
+
+#define	PTHREAD_PROCESS_PRIVATE				0
+#define	PTHREAD_PROCESS_SHARED				1
+
+#define	PTHREAD_BARRIER_SERIAL_THREAD			-1
+
+/**
+ * Upper limit on the number of times pthread_mutex_lock() polls a contended mutex before sleeping.
+ */
+#define	PTHREAD_MUTEX_SPIN_MAX				100
+
+/**
+ * Flag OR'ed into the type of a process-shared mutex. Its futex is keyed on the physical address rather
+ * than on the address space, so that processes mapping the same memory wake each other up.
+ */
+#define	__PTHREAD_MUTEX_PSHARED				0x100
 
 typedef struct
 {
 	int						__type;
 	int						__protocol;
 	int						__prioceiling;
-	int						__resv[13];
+	int						__pshared;
+	int						__resv[12];
 } pthread_mutexattr_t;
 
 typedef struct
 {
 	/**
-	 * Used to implement the bakery algorithm.
+	 * The futex word: 0 = unlocked, 1 = locked, 2 = locked and there may be threads sleeping on it.
 	 */
-	volatile uint64_t				__tickets;
-	volatile uint64_t				__cakes;
+	volatile uint64_t				__futex;
+	
+	/**
+	 * Running average of how long we had to spin before getting the mutex; decides how long to spin
+	 * next time before going to sleep.
+	 */
+	volatile int					__spins;
 
 	/**
 	 * Type of mutex.
@@ -89,6 +114,64 @@ typedef struct
 	volatile int					__count;
 } pthread_mutex_t;
 
+typedef struct
+{
+	int						__pshared;
+	int						__resv[15];
+} pthread_condattr_t;
+
+typedef struct
+{
+	/**
+	 * The futex word; incremented each time the condition is signalled.
+	 */
+	volatile uint64_t				__seq;
+	
+	/**
+	 * The mutex used by the last waiter; a broadcast moves the waiters onto it instead of waking them
+	 * all up just to fight over the mutex.
+	 */
+	pthread_mutex_t* volatile			__mutex;
+} pthread_cond_t;
+
+typedef struct
+{
+	int						__pshared;
+	int						__resv[15];
+} pthread_rwlockattr_t;
+
+typedef struct
+{
+	pthread_mutex_t					__lock;
+	pthread_cond_t					__readable;
+	pthread_cond_t					__writable;
+	
+	/**
+	 * Number of threads holding a read lock, number of writers waiting for the lock, and the thread
+	 * holding the write lock (0 if none).
+	 */
+	int						__readers;
+	int						__waitingWriters;
+	pthread_t					__writer;
+} pthread_rwlock_t;
+
+typedef struct
+{
+	int						__pshared;
+	int						__resv[15];
+} pthread_barrierattr_t;
+
+typedef struct
+{
+	pthread_mutex_t					__lock;
+	pthread_cond_t					__cond;
+	unsigned int					__count;
+	unsigned int					__waiting;
+	uint64_t					__generation;
+} pthread_barrier_t;
+
+typedef volatile int pthread_spinlock_t;
+
 struct __pthread_key_mapping
 {
 	struct __pthread_key_mapping* __next;
@@ -104,6 +187,8 @@ struct __pthread_key
 
 typedef struct __pthread_key *pthread_key_t;
 
+struct timespec;
+
 /* implemented by libglidix directly */
 int		pthread_create(pthread_t *thread, const pthread_attr_t *attr, void*(*start_routine)(void*), void *arg);
 pthread_t	pthread_self();
@@ -136,6 +221,35 @@ int		pthread_mutex_trylock(pthread_mutex_t *mutex);
 int		pthread_mutex_unlock(pthread_mutex_t *mutex);
 int		pthread_mutexattr_gettype(const pthread_mutexattr_t *attr, int *type);
 int		pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type);
+int		pthread_mutexattr_getpshared(const pthread_mutexattr_t *attr, int *pshared);
+int		pthread_mutexattr_setpshared(pthread_mutexattr_t *attr, int pshared);
+int		pthread_condattr_init(pthread_condattr_t *attr);
+int		pthread_condattr_destroy(pthread_condattr_t *attr);
+int		pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
+int		pthread_cond_destroy(pthread_cond_t *cond);
+int		pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int		pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime);
+int		pthread_cond_signal(pthread_cond_t *cond);
+int		pthread_cond_broadcast(pthread_cond_t *cond);
+int		pthread_rwlockattr_init(pthread_rwlockattr_t *attr);
+int		pthread_rwlockattr_destroy(pthread_rwlockattr_t *attr);
+int		pthread_rwlock_init(pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr);
+int		pthread_rwlock_destroy(pthread_rwlock_t *rwlock);
+int		pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
+int		pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock);
+int		pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
+int		pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock);
+int		pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
+int		pthread_barrierattr_init(pthread_barrierattr_t *attr);
+int		pthread_barrierattr_destroy(pthread_barrierattr_t *attr);
+int		pthread_barrier_init(pthread_barrier_t *barrier, const pthread_barrierattr_t *attr, unsigned int count);
+int		pthread_barrier_destroy(pthread_barrier_t *barrier);
+int		pthread_barrier_wait(pthread_barrier_t *barrier);
+int		pthread_spin_init(pthread_spinlock_t *lock, int pshared);
+int		pthread_spin_destroy(pthread_spinlock_t *lock);
+int		pthread_spin_lock(pthread_spinlock_t *lock);
+int		pthread_spin_trylock(pthread_spinlock_t *lock);
+int		pthread_spin_unlock(pthread_spinlock_t *lock);
 int		pthread_key_create(pthread_key_t *keyOut, void (*dest)(void*));
 int		pthread_setspecific(pthread_key_t key, const void *value);
 void*		pthread_getspecific(pthread_key_t key);
@@ -0,0 +1,113 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SPAWN_H
+#define _SPAWN_H
+
+#include <sys/types.h>
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define	POSIX_SPAWN_RESETIDS			0x01
+#define	POSIX_SPAWN_SETPGROUP			0x02
+#define	POSIX_SPAWN_SETSIGDEF			0x04
+#define	POSIX_SPAWN_SETSIGMASK			0x08
+#define	POSIX_SPAWN_SETSID			0x80
+#define	POSIX_SPAWN_TCSETPGROUP			0x100
+
+/**
+ * A queued file action; must match 'SpawnAction' in the kernel.
+ */
+struct __spawn_action
+{
+	int					__type;
+	int					__fd;
+	int					__newfd;
+	int					__oflag;
+	mode_t					__mode;
+	char*					__path;
+};
+
+typedef struct
+{
+	int					__count;
+	int					__alloc;
+	struct __spawn_action*			__actions;
+} posix_spawn_file_actions_t;
+
+/**
+ * Must match 'SpawnAttr' in the kernel.
+ */
+typedef struct
+{
+	int					__flags;
+	pid_t					__pgroup;
+	sigset_t				__sigdefault;
+	sigset_t				__sigmask;
+	int					__tcfd;
+} posix_spawnattr_t;
+
+/* implemented by the runtime */
+int	posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions,
+		const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+int	posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions,
+		const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+
+int	posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions);
+int	posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions);
+int	posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions, int fildes,
+		const char *path, int oflag, mode_t mode);
+int	posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions, int fildes);
+int	posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions, int fildes, int newfildes);
+
+int	posix_spawnattr_init(posix_spawnattr_t *attr);
+int	posix_spawnattr_destroy(posix_spawnattr_t *attr);
+int	posix_spawnattr_getflags(const posix_spawnattr_t *attr, short *flags);
+int	posix_spawnattr_setflags(posix_spawnattr_t *attr, short flags);
+int	posix_spawnattr_getpgroup(const posix_spawnattr_t *attr, pid_t *pgroup);
+int	posix_spawnattr_setpgroup(posix_spawnattr_t *attr, pid_t pgroup);
+int	posix_spawnattr_getsigdefault(const posix_spawnattr_t *attr, sigset_t *sigdefault);
+int	posix_spawnattr_setsigdefault(posix_spawnattr_t *attr, const sigset_t *sigdefault);
+int	posix_spawnattr_getsigmask(const posix_spawnattr_t *attr, sigset_t *sigmask);
+int	posix_spawnattr_setsigmask(posix_spawnattr_t *attr, const sigset_t *sigmask);
+
+/**
+ * With POSIX_SPAWN_TCSETPGROUP, the child makes its process group the foreground group of the
+ * terminal open as 'tcfd' (after POSIX_SPAWN_SETPGROUP), before the new image starts.
+ */
+int	posix_spawnattr_tcgetpgrp_np(const posix_spawnattr_t *attr, int *tcfd);
+int	posix_spawnattr_tcsetpgrp_np(posix_spawnattr_t *attr, int tcfd);
+
+#ifdef __cplusplus
+};	/* extern "C" */
+#endif
+
+#endif
@@ -186,6 +186,18 @@
 #define	__SYS_usb_devdesc			154
 #define	__SYS_usb_langids			155
 #define	__SYS_usb_getstr			156
+#define	__SYS_sendmsg				157
+#define	__SYS_recvmsg				158
+#define	__SYS_neightab				159
+#define	__SYS_futex				160
+#define	__SYS_eqcreate				161
+#define	__SYS_eqctl				162
+#define	__SYS_eqwait				163
+#define	__SYS_getrlimit				164
+#define	__SYS_setrlimit				165
+#define	__SYS_madvise				166
+#define	__SYS_vfork				167
+#define	__SYS_spawn				168
 
 /* flags for __SYS_mv */
 #define	__MV_EXCL				(1 << 0)
@@ -0,0 +1,90 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SYS_EPOLL_H
+#define _SYS_EPOLL_H
+
+#include <inttypes.h>
+#include <poll.h>
+#include <fcntl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Events; these are the same as the poll() events. EPOLLERR and EPOLLHUP are always reported.
+ */
+#define	EPOLLIN					POLLIN
+#define	EPOLLOUT				POLLOUT
+#define	EPOLLERR				POLLERR
+#define	EPOLLHUP				POLLHUP
+
+/**
+ * Flags.
+ */
+#define	EPOLLET					(1U << 16)		/* edge-triggered */
+#define	EPOLLONESHOT				(1U << 17)		/* disable after one event */
+
+/**
+ * Operations for epoll_ctl().
+ */
+#define	EPOLL_CTL_ADD				1
+#define	EPOLL_CTL_DEL				2
+#define	EPOLL_CTL_MOD				3
+
+/**
+ * Flags for epoll_create1().
+ */
+#define	EPOLL_CLOEXEC				O_CLOEXEC
+
+typedef union epoll_data
+{
+	void*					ptr;
+	int					fd;
+	uint32_t				u32;
+	uint64_t				u64;
+} epoll_data_t;
+
+struct epoll_event
+{
+	uint32_t				events;
+	epoll_data_t				data;
+};
+
+/* implemented by the runtime */
+int epoll_create(int size);
+int epoll_create1(int flags);
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+#ifdef __cplusplus
+};	/* extern "C" */
+#endif
+
+#endif
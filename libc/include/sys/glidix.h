@@ -74,6 +74,74 @@ typedef struct
 	uint64_t			flags;
 } _glidix_gen_route;
 
+/**
+ * Neighbor cache entry states (_glidix_neigh.state).
+ */
+#define	_GLIDIX_NEIGH_INCOMPLETE		0
+#define	_GLIDIX_NEIGH_REACHABLE			1
+#define	_GLIDIX_NEIGH_STALE			2
+#define	_GLIDIX_NEIGH_PROBE			3
+#define	_GLIDIX_NEIGH_FAILED			4
+
+typedef struct
+{
+	char				ifname[16];
+	int				family;
+	int				state;
+	uint8_t				ip[16];
+	uint8_t				mac[6];
+	uint16_t			queued;
+	uint64_t			age;
+} _glidix_neigh;
+
+/**
+ * The clock page, mapped read-only into every process by the kernel.
+ */
+#define	_GLIDIX_CLOCK_PAGE			0xFFFF808000002000UL
+
+#define	_GLIDIX_CLOCK_TICKS			0
+#define	_GLIDIX_CLOCK_HPET			1
+#define	_GLIDIX_CLOCK_TSC			2
+
+typedef struct
+{
+	volatile uint32_t			seq;
+	uint32_t				source;
+	uint64_t				tscBase;
+	uint64_t				nanoBase;
+	uint64_t				mult;
+	int64_t					realOffset;
+	uint64_t				freq;
+} _glidix_clockpage;
+
+/**
+ * Futex operations for _glidix_futex().
+ */
+#define	_GLIDIX_FUTEX_WAIT			0
+#define	_GLIDIX_FUTEX_WAKE			1
+#define	_GLIDIX_FUTEX_REQUEUE			2
+#define	_GLIDIX_FUTEX_PRIVATE			0x80
+
+/**
+ * Event queue operations and flags for _glidix_eqctl(). The flags are ORed with the POLL* events of interest;
+ * items are level-triggered by default.
+ */
+#define	_GLIDIX_EQ_ADD				0
+#define	_GLIDIX_EQ_MOD				1
+#define	_GLIDIX_EQ_DEL				2
+#define	_GLIDIX_EQ_EDGE				(1 << 16)
+#define	_GLIDIX_EQ_ONESHOT			(1 << 17)
+
+/**
+ * An event returned by _glidix_eqwait().
+ */
+typedef struct
+{
+	uint64_t				udata;
+	int					fd;
+	int					events;
+} _glidix_eqevent;
+
 typedef union
 {
 	int				type;	
@@ -86,6 +154,7 @@ typedef union
 	{
 		int			type;
 		uint8_t			mac[6];
+		int			caps;
 	} ethernet;
 
 	struct
@@ -175,6 +244,11 @@ extern "C" {
 #define	IF_ETHERNET			1		/* ethernet controller */
 #define	IF_TUNNEL			2		/* software tunnel */
 
+#define	NETIF_CAP_TXCSUM		(1 << 0)	/* inserts TCP/UDP checksums into outgoing packets */
+#define	NETIF_CAP_RXCSUM		(1 << 1)	/* verifies TCP/UDP checksums of incoming packets */
+#define	NETIF_CAP_TSO4			(1 << 2)	/* TCP segmentation offload over IPv4 */
+#define	NETIF_CAP_TSO6			(1 << 3)	/* TCP segmentation offload over IPv6 */
+
 #define	_GLIDIX_INSMOD_VERBOSE				(1 << 0)
 
 #define	_GLIDIX_RMMOD_VERBOSE				(1 << 0)
@@ -198,6 +272,7 @@ extern "C" {
 #define	_GLIDIX_MQ_HANGUP				2
 
 #define	_GLIDIX_KOPT_GFXTERM				0
+#define	_GLIDIX_KOPT_LOCKSTAT				1
 
 #define	_GLIDIX_DOM_GLOBAL				0	/* global (internet) */
 #define	_GLIDIX_DOM_LINK				1	/* link-local (LAN only) */
@@ -206,9 +281,14 @@ extern "C" {
 #define	_GLIDIX_DOM_MULTICAST				4	/* multicast (used for addresses and NEVER routes) */
 #define	_GLIDIX_DOM_NODEFAULT				5	/* non-default address (never selected for any route) */
 
+#define	_GLIDIX_SPAWN_OPEN				1
+#define	_GLIDIX_SPAWN_CLOSE				2
+#define	_GLIDIX_SPAWN_DUP2				3
+
 struct __siginfo;
 
 int		_glidix_exec(const char *path, const char *pars, size_t parsz);
+int		_glidix_spawn(const char *path, const char *pars, size_t parsz, const void *actions, int numActions, const void *attr);
 int		_glidix_open(const char *path, int flags, mode_t mode);
 uid_t		_glidix_getsuid();
 gid_t		_glidix_getsgid();
@@ -246,11 +326,20 @@ int		_glidix_kopt(int option, int value);
 int		_glidix_sigwait(uint64_t sigset, struct __siginfo *info, uint64_t nanotimeout);
 int		_glidix_sigsuspend(uint64_t mask);
 int		_glidix_mcast(int sockfd, int op, uint32_t scope, uint64_t addr0, uint64_t addr1);
-int		_glidix_fpoll(const uint8_t *bitmapReq, uint8_t *bitmapRes, int flags, uint64_t nanotimeout);
+int		_glidix_fpoll(const uint8_t *bitmapReq, uint8_t *bitmapRes, int flags, uint64_t nanotimeout, int nfds);
 int		_glidix_cpuno();
+ssize_t		_glidix_sendmsg(int sockfd, const void *buffer, size_t len, int flags, const int *fds, int numfds);
+ssize_t		_glidix_recvmsg(int sockfd, void *buffer, size_t len, int flags, int *fds, int *numfds);
+int		_glidix_neightab();
+int		_glidix_futex(void *addr, int op, uint64_t val, uint64_t arg, void *addr2);
+int		_glidix_eqcreate(int flags);
+int		_glidix_eqctl(int eqfd, int op, int fd, int events, uint64_t udata);
+int		_glidix_eqwait(int eqfd, _glidix_eqevent *events, int max, int flags, uint64_t nanotimeout);
 
 // some runtime stuff
 uint64_t	__alloc_pages(size_t len);
+uint64_t	__nanotime();
+int64_t		__realtime_offset();
 
 #ifdef __cplusplus
 }	/* extern "C" */
@@ -50,14 +50,21 @@ extern "C" {
 #define	MAP_UN				(1 << 5)
 #endif
 
+#define	MAP_POPULATE			(1 << 6)
+
 #define	MAP_ANON			MAP_ANONYMOUS
 
 #define	MAP_FAILED			((void*)-1)
 
+#define	MADV_NORMAL			0
+#define	MADV_HUGEPAGE			14
+#define	MADV_NOHUGEPAGE			15
+
 /* implemented by libglidix directly */
 int mprotect(void *addr, size_t len, int prot);
 int munmap(void *addr, size_t len);
 void* mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int madvise(void *addr, size_t len, int advice);
 
 #ifdef __cplusplus
 }	/* extern "C" */
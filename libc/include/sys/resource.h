@@ -0,0 +1,71 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SYS_RESOURCE_H
+#define _SYS_RESOURCE_H
+
+#include <inttypes.h>
+#include <sys/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Resources for getrlimit() and setrlimit(). Only RLIMIT_NOFILE is currently enforced by the kernel;
+ * the others always read as RLIM_INFINITY.
+ */
+#define	RLIMIT_CORE				0
+#define	RLIMIT_CPU				1
+#define	RLIMIT_DATA				2
+#define	RLIMIT_FSIZE				3
+#define	RLIMIT_NOFILE				4
+#define	RLIMIT_STACK				5
+#define	RLIMIT_AS				6
+
+#define	RLIM_INFINITY				((rlim_t)-1)
+#define	RLIM_SAVED_MAX				RLIM_INFINITY
+#define	RLIM_SAVED_CUR				RLIM_INFINITY
+
+typedef uint64_t rlim_t;
+
+struct rlimit
+{
+	rlim_t					rlim_cur;
+	rlim_t					rlim_max;
+};
+
+/* implemented by the runtime */
+int getrlimit(int resource, struct rlimit *rlp);
+int setrlimit(int resource, const struct rlimit *rlp);
+
+#ifdef __cplusplus
+};	/* extern "C" */
+#endif
+
+#endif
@@ -30,21 +30,22 @@
 #define _SYS_SELECT_H
 
 #include <sys/time.h>
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define	FD_CLR(fd, set)				((set)->__fdset &= ~(1 << (fd)))
-#define	FD_SET(fd, set)				((set)->__fdset |=  (1 << (fd)))
-#define	FD_ISSET(fd, set)			(!!((set)->__fdset &   (1 << (fd))))
-#define	FD_ZERO(set)				((set)->__fdset = 0)
+#define	FD_SETSIZE				1024
 
-#define	FD_SETSIZE				64
+#define	FD_CLR(fd, set)				((set)->__fdset[(fd) / 64] &= ~(1UL << ((fd) % 64)))
+#define	FD_SET(fd, set)				((set)->__fdset[(fd) / 64] |=  (1UL << ((fd) % 64)))
+#define	FD_ISSET(fd, set)			(!!((set)->__fdset[(fd) / 64] &   (1UL << ((fd) % 64))))
+#define	FD_ZERO(set)				memset((set)->__fdset, 0, sizeof((set)->__fdset))
 
 typedef struct
 {
-	uint64_t				__fdset;
+	uint64_t				__fdset[FD_SETSIZE / 64];
 } fd_set;
 
 int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
@@ -58,6 +58,14 @@ extern "C" {
 #define	MSG_OOB				(1 << 1)
 #define	MSG_PEEK			(1 << 2)
 #define	MSG_WAITALL			(1 << 3)
+#define	MSG_TRUNC			(1 << 4)
+#define	MSG_CTRUNC			(1 << 5)
+
+/* control message types */
+#define	SCM_RIGHTS			1
+
+/* maximum number of file descriptors passed in a single message */
+#define	SCM_MAX_FD			16
 
 #define	SOL_SOCKET			0
 
@@ -77,6 +85,40 @@ struct sockaddr_storage
 	char				ss_data[256];
 };
 
+struct iovec
+{
+	void*				iov_base;
+	size_t				iov_len;
+};
+
+struct msghdr
+{
+	void*				msg_name;
+	socklen_t			msg_namelen;
+	struct iovec*			msg_iov;
+	int				msg_iovlen;
+	void*				msg_control;
+	socklen_t			msg_controllen;
+	int				msg_flags;
+};
+
+struct cmsghdr
+{
+	socklen_t			cmsg_len;
+	int				cmsg_level;
+	int				cmsg_type;
+};
+
+#define	CMSG_ALIGN(len)			(((len) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+#define	CMSG_SPACE(len)			(CMSG_ALIGN(sizeof(struct cmsghdr)) + CMSG_ALIGN(len))
+#define	CMSG_LEN(len)			(CMSG_ALIGN(sizeof(struct cmsghdr)) + (len))
+#define	CMSG_DATA(cmsg)			((unsigned char*) (cmsg) + CMSG_ALIGN(sizeof(struct cmsghdr)))
+#define	CMSG_FIRSTHDR(mhdr)		((mhdr)->msg_controllen >= sizeof(struct cmsghdr) ? \
+						(struct cmsghdr*) (mhdr)->msg_control : (struct cmsghdr*) 0)
+#define	CMSG_NXTHDR(mhdr, cmsg)		__cmsg_nxthdr((mhdr), (cmsg))
+
+struct cmsghdr* __cmsg_nxthdr(struct msghdr *msg, struct cmsghdr *cmsg);
+
 /* implemented by libglidix directly */
 int socket(int domain, int type, int proto);
 int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
@@ -94,6 +136,10 @@ int listen(int sockfd, int backlog);
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
 
+/* implemented in the C library */
+ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags);
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags);
+
 #ifdef __cplusplus
 };	/* extern "C" */
 #endif
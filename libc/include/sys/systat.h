@@ -39,6 +39,12 @@ struct system_state
 	uint64_t			sst_frames_total;	/* total number of physical memory frames */
 	uint64_t			sst_frames_used;	/* number on frames in application use */
 	uint64_t			sst_frames_cached;	/* number of cached frames */
+	uint64_t			sst_ticks_avoided;	/* timer interrupts skipped by idle CPUs */
+	uint64_t			sst_shootdowns;		/* TLB shootdowns (IPI rounds) since boot */
+	uint64_t			sst_shootdown_rate;	/* TLB shootdowns in the last second */
+	uint64_t			sst_zero_pooled;	/* frames zeroed in advance, waiting to be used */
+	uint64_t			sst_zero_hits;		/* zeroed frame requests served from the pools */
+	uint64_t			sst_zero_misses;	/* zeroed frame requests which had to zero a frame */
 };
 
 #endif
@@ -53,6 +53,7 @@ typedef	uint64_t			gid_t;
 typedef	uint64_t			blksize_t;
 typedef	uint64_t			blkcnt_t;
 typedef int64_t				clock_t;
+typedef int				clockid_t;
 typedef	int64_t				time_t;
 typedef	int64_t				off_t;
 typedef	int64_t				ssize_t;
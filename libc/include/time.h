@@ -40,6 +40,9 @@ extern "C" {
 #define	CLOCKS_PER_SEC			1000000				/* value required by POSIX */
 #define	TIME_MAX			9223372036854775807L
 
+#define	CLOCK_REALTIME			0
+#define	CLOCK_MONOTONIC			1
+
 struct tm
 {
 	int		tm_sec;
@@ -84,6 +87,8 @@ time_t		mktime(struct tm *tm);
 size_t		strftime(char *s, size_t maxsize, const char *format, const struct tm *timeptr);
 double		difftime(time_t time1, time_t time0);
 clock_t		clock();
+int		clock_gettime(clockid_t clk, struct timespec *tp);
+int		clock_getres(clockid_t clk, struct timespec *res);
 
 /* implemented by libglidix directly */
 uint64_t	_glidix_nanotime();
@@ -48,7 +48,7 @@ extern "C" {
 #define	PAGESIZE				0x1000
 #define	PAGE_SIZE				0x1000
 #define	NGROUPS_MAX				64
-#define	OPEN_MAX				256
+#define	OPEN_MAX				1024
 #define	PATH_MAX				256
 
 #define	_PC_LINK_MAX				0
@@ -85,6 +85,7 @@ int		execl(const char *, const char *arg0, ...);
 int		execle(const char *, const char *arg0, ...);
 int		execlp(const char *, const char *arg0, ...);
 pid_t		fork(void);
+pid_t		vfork(void);
 int		truncate(const char *path, off_t length);
 long		fpathconf(int fd, int name);
 long		pathconf(const char *path, int name);
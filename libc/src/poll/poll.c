@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <unistd.h>
+#include <string.h>
 
 int poll(struct pollfd *fds, nfds_t nfds, int timeout)
 {
@@ -52,22 +53,20 @@ int poll(struct pollfd *fds, nfds_t nfds, int timeout)
 		nanotimeout = (uint64_t)timeout * 1000000UL;		// 10^6 nanoseconds in a millisecond
 	};
 	
-	int maxFiles = sysconf(_SC_OPEN_MAX);
-	uint8_t bitmap[maxFiles];
-	memset(bitmap, 0, maxFiles);
-	
+	// the request bitmap only needs to cover the highest descriptor we poll
+	int maxFiles = 0;
 	unsigned int i;
 	int numErrors = 0;
 	for (i=0; i<nfds; i++)
 	{
-		if ((fds[i].fd < 0) || (fds[i].fd >= maxFiles))
+		if (fds[i].fd < 0)
 		{
 			fds[i].revents = POLLNVAL;
 			numErrors++;
 		}
-		else
+		else if (fds[i].fd >= maxFiles)
 		{
-			bitmap[fds[i].fd] |= (uint8_t) fds[i].events;
+			maxFiles = fds[i].fd + 1;
 		};
 	};
 	
@@ -76,7 +75,15 @@ int poll(struct pollfd *fds, nfds_t nfds, int timeout)
 		return numErrors;
 	};
 	
-	int result = _glidix_fpoll(bitmap, bitmap, flags, nanotimeout);
+	uint8_t bitmap[maxFiles+1];
+	memset(bitmap, 0, maxFiles);
+	
+	for (i=0; i<nfds; i++)
+	{
+		bitmap[fds[i].fd] |= (uint8_t) fds[i].events;
+	};
+	
+	int result = _glidix_fpoll(bitmap, bitmap, flags, nanotimeout, maxFiles);
 	if (result == -1)
 	{
 		return -1;
@@ -0,0 +1,95 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <errno.h>
+
+int pthread_barrierattr_init(pthread_barrierattr_t *attr)
+{
+	attr->__pshared = PTHREAD_PROCESS_PRIVATE;
+	return 0;
+};
+
+int pthread_barrierattr_destroy(pthread_barrierattr_t *attr)
+{
+	return 0;
+};
+
+int pthread_barrier_init(pthread_barrier_t *barrier, const pthread_barrierattr_t *attr, unsigned int count)
+{
+	if (count == 0)
+	{
+		return EINVAL;
+	};
+	
+	if ((attr != NULL) && (attr->__pshared != PTHREAD_PROCESS_PRIVATE))
+	{
+		return EINVAL;
+	};
+	
+	pthread_mutex_init(&barrier->__lock, NULL);
+	pthread_cond_init(&barrier->__cond, NULL);
+	barrier->__count = count;
+	barrier->__waiting = 0;
+	barrier->__generation = 0;
+	return 0;
+};
+
+int pthread_barrier_destroy(pthread_barrier_t *barrier)
+{
+	if (barrier->__waiting != 0)
+	{
+		return EBUSY;
+	};
+	
+	return 0;
+};
+
+int pthread_barrier_wait(pthread_barrier_t *barrier)
+{
+	pthread_mutex_lock(&barrier->__lock);
+	
+	if (++barrier->__waiting == barrier->__count)
+	{
+		// we're the last one; release everyone, and start the next cycle
+		barrier->__waiting = 0;
+		barrier->__generation++;
+		pthread_cond_broadcast(&barrier->__cond);
+		pthread_mutex_unlock(&barrier->__lock);
+		return PTHREAD_BARRIER_SERIAL_THREAD;
+	};
+	
+	uint64_t generation = barrier->__generation;
+	while (barrier->__generation == generation)
+	{
+		pthread_cond_wait(&barrier->__cond, &barrier->__lock);
+	};
+	
+	pthread_mutex_unlock(&barrier->__lock);
+	return 0;
+};
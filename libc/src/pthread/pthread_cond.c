@@ -0,0 +1,173 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/glidix.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+int pthread_condattr_init(pthread_condattr_t *attr)
+{
+	attr->__pshared = PTHREAD_PROCESS_PRIVATE;
+	return 0;
+};
+
+int pthread_condattr_destroy(pthread_condattr_t *attr)
+{
+	return 0;
+};
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+	if ((attr != NULL) && (attr->__pshared != PTHREAD_PROCESS_PRIVATE))
+	{
+		return EINVAL;
+	};
+	
+	cond->__seq = 0;
+	cond->__mutex = NULL;
+	return 0;
+};
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+	return 0;
+};
+
+/**
+ * Returns the futex flags to use for the specified mutex (see pthread_mutex.c).
+ */
+static int __mutex_futex_flags(pthread_mutex_t *mutex)
+{
+	if (mutex->__type & __PTHREAD_MUTEX_PSHARED)
+	{
+		return 0;
+	}
+	else
+	{
+		return _GLIDIX_FUTEX_PRIVATE;
+	};
+};
+
+static int __cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t nanotimeout)
+{
+	if (mutex->__owner != pthread_self())
+	{
+		return EPERM;
+	};
+	
+	uint64_t seq = cond->__seq;
+	cond->__mutex = mutex;
+	
+	// release the mutex completely, even if it's recursive
+	int count = mutex->__count;
+	mutex->__count = 0;
+	mutex->__owner = 0;
+	if (__sync_fetch_and_sub(&mutex->__futex, 1) != 1)
+	{
+		mutex->__futex = 0;
+		_glidix_futex((void*) &mutex->__futex, _GLIDIX_FUTEX_WAKE | __mutex_futex_flags(mutex), 1, 0, NULL);
+	};
+	
+	// if the condition was signalled since we read 'seq', this returns immediately
+	int status = 0;
+	if (_glidix_futex((void*) &cond->__seq, _GLIDIX_FUTEX_WAIT | _GLIDIX_FUTEX_PRIVATE, seq, nanotimeout, NULL) != 0)
+	{
+		if (errno == ETIMEDOUT)
+		{
+			status = ETIMEDOUT;
+		};
+	};
+	
+	// a broadcast may have moved us onto the mutex, so other waiters may be sleeping on it too; we must
+	// therefore lock it in the contended state, so that unlocking it wakes up the next one.
+	while (__sync_lock_test_and_set(&mutex->__futex, 2) != 0)
+	{
+		_glidix_futex((void*) &mutex->__futex, _GLIDIX_FUTEX_WAIT | __mutex_futex_flags(mutex), 2, 0, NULL);
+	};
+	
+	mutex->__owner = pthread_self();
+	mutex->__count = count;
+	return status;
+};
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	return __cond_wait(cond, mutex, 0);
+};
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+	if ((abstime->tv_nsec < 0) || (abstime->tv_nsec >= 1000000000L))
+	{
+		return EINVAL;
+	};
+	
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t now = (uint64_t) ts.tv_sec * 1000000000UL + (uint64_t) ts.tv_nsec;
+	uint64_t deadline = (uint64_t) abstime->tv_sec * 1000000000UL + (uint64_t) abstime->tv_nsec;
+	if (deadline <= now)
+	{
+		return ETIMEDOUT;
+	};
+	
+	return __cond_wait(cond, mutex, deadline - now);
+};
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+	__sync_fetch_and_add(&cond->__seq, 1);
+	_glidix_futex((void*) &cond->__seq, _GLIDIX_FUTEX_WAKE | _GLIDIX_FUTEX_PRIVATE, 1, 0, NULL);
+	return 0;
+};
+
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+	__sync_fetch_and_add(&cond->__seq, 1);
+	
+	pthread_mutex_t *mutex = cond->__mutex;
+	if (mutex == NULL)
+	{
+		// nobody has ever waited
+		return 0;
+	};
+	
+	if (mutex->__type & __PTHREAD_MUTEX_PSHARED)
+	{
+		// the mutex futex is keyed differently from ours, so the waiters cannot be moved onto it
+		_glidix_futex((void*) &cond->__seq, _GLIDIX_FUTEX_WAKE | _GLIDIX_FUTEX_PRIVATE, 0x7FFFFFFF, 0, NULL);
+		return 0;
+	};
+	
+	// wake up one waiter, and move the rest onto the mutex: they could not all run at once anyway, since
+	// they must re-acquire it first, and this way each one is woken up when the previous one unlocks it.
+	_glidix_futex((void*) &cond->__seq, _GLIDIX_FUTEX_REQUEUE | _GLIDIX_FUTEX_PRIVATE, 1, 0x7FFFFFFF,
+		(void*) &mutex->__futex);
+	return 0;
+};
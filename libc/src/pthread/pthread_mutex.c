@@ -27,6 +27,7 @@
 */
 
 #include <sys/call.h>
+#include <sys/glidix.h>
 #include <pthread.h>
 #include <errno.h>
 #include <unistd.h>
@@ -38,6 +39,7 @@ int pthread_mutexattr_init(pthread_mutexattr_t *attr)
 	attr->__type = PTHREAD_MUTEX_DEFAULT;
 	attr->__protocol = PTHREAD_PRIO_NONE;
 	attr->__prioceiling = 0;
+	attr->__pshared = PTHREAD_PROCESS_PRIVATE;
 	return 0;
 };
 
@@ -58,12 +60,47 @@ int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type)
 	return 0;
 };
 
+int pthread_mutexattr_getpshared(const pthread_mutexattr_t *attr, int *pshared)
+{
+	*pshared = attr->__pshared;
+	return 0;
+};
+
+int pthread_mutexattr_setpshared(pthread_mutexattr_t *attr, int pshared)
+{
+	if ((pshared != PTHREAD_PROCESS_PRIVATE) && (pshared != PTHREAD_PROCESS_SHARED))
+	{
+		return EINVAL;
+	};
+	
+	attr->__pshared = pshared;
+	return 0;
+};
+
+/**
+ * Returns the futex flags to use for the specified mutex: process-shared mutexes must not be keyed on the
+ * address space.
+ */
+static int __mutex_futex_flags(pthread_mutex_t *mutex)
+{
+	if (mutex->__type & __PTHREAD_MUTEX_PSHARED)
+	{
+		return 0;
+	}
+	else
+	{
+		return _GLIDIX_FUTEX_PRIVATE;
+	};
+};
+
 int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
 {
 	int type = PTHREAD_MUTEX_DEFAULT;
+	int pshared = PTHREAD_PROCESS_PRIVATE;
 	if (attr != NULL)
 	{
 		type = attr->__type;
+		pshared = attr->__pshared;
 	};
 	
 	if ((type != PTHREAD_MUTEX_NORMAL) && (type != PTHREAD_MUTEX_ERRORCHECK) && (type != PTHREAD_MUTEX_RECURSIVE))
@@ -71,8 +108,13 @@ int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
 		return EINVAL;
 	};
 	
-	mutex->__tickets = 0;
-	mutex->__cakes = 0;
+	if (pshared == PTHREAD_PROCESS_SHARED)
+	{
+		type |= __PTHREAD_MUTEX_PSHARED;
+	};
+	
+	mutex->__futex = 0;
+	mutex->__spins = 0;
 	mutex->__type = type;
 	mutex->__owner = 0;
 	mutex->__count = 0;
@@ -85,11 +127,47 @@ int pthread_mutex_destroy(pthread_mutex_t *mutex)
 	return 0;
 };
 
+static void __mutex_wait(pthread_mutex_t *mutex)
+{
+	// spin for a while first, since critical sections are usually short and the owner may be about to release
+	// the mutex; the spin count adapts to how long that usually takes for this mutex.
+	int maxSpins = mutex->__spins * 2 + 10;
+	if (maxSpins > PTHREAD_MUTEX_SPIN_MAX)
+	{
+		maxSpins = PTHREAD_MUTEX_SPIN_MAX;
+	};
+	
+	int spins;
+	int acquired = 0;
+	for (spins=0; spins<maxSpins; spins++)
+	{
+		if ((mutex->__futex == 0) && (__sync_val_compare_and_swap(&mutex->__futex, 0, 1) == 0))
+		{
+			acquired = 1;
+			break;
+		};
+		
+		__asm__ __volatile__ ("pause");
+	};
+	
+	mutex->__spins += (spins - mutex->__spins) / 8;
+	if (acquired)
+	{
+		return;
+	};
+	
+	// mark the mutex as contended and sleep until it's released
+	while (__sync_lock_test_and_set(&mutex->__futex, 2) != 0)
+	{
+		_glidix_futex((void*) &mutex->__futex, _GLIDIX_FUTEX_WAIT | __mutex_futex_flags(mutex), 2, 0, NULL);
+	};
+};
+
 int pthread_mutex_lock(pthread_mutex_t *mutex)
 {
 	if (mutex->__owner == pthread_self())
 	{
-		if (mutex->__type == PTHREAD_MUTEX_RECURSIVE)
+		if ((mutex->__type & ~__PTHREAD_MUTEX_PSHARED) == PTHREAD_MUTEX_RECURSIVE)
 		{
 			mutex->__count++;
 			return 0;
@@ -100,20 +178,9 @@ int pthread_mutex_lock(pthread_mutex_t *mutex)
 		};
 	};
 	
-	uint64_t ticket = __sync_fetch_and_add(&mutex->__tickets, 1);
-	while (1)
+	if (__sync_val_compare_and_swap(&mutex->__futex, 0, 1) != 0)
 	{
-		uint64_t cakes = mutex->__cakes;
-		if (cakes == ticket)
-		{
-			break;
-		};
-		
-		uint64_t errnum = __syscall(__SYS_block_on, &mutex->__cakes, cakes);
-		if (errnum != 0)
-		{
-			return errnum;
-		};
+		__mutex_wait(mutex);
 	};
 	
 	mutex->__owner = pthread_self();
@@ -125,7 +192,7 @@ int pthread_mutex_trylock(pthread_mutex_t *mutex)
 {
 	if (mutex->__owner == pthread_self())
 	{
-		if (mutex->__type == PTHREAD_MUTEX_RECURSIVE)
+		if ((mutex->__type & ~__PTHREAD_MUTEX_PSHARED) == PTHREAD_MUTEX_RECURSIVE)
 		{
 			mutex->__count++;
 			return 0;
@@ -136,18 +203,13 @@ int pthread_mutex_trylock(pthread_mutex_t *mutex)
 		};
 	};
 
-	uint64_t tickets = mutex->__tickets;
-	if (tickets != mutex->__cakes)
-	{
-		return EBUSY;
-	};
-	
-	// succeed only if nobody gets a ticket before us
-	if (__sync_val_compare_and_swap(&mutex->__tickets, tickets, tickets+1) != tickets)
+	if (__sync_val_compare_and_swap(&mutex->__futex, 0, 1) != 0)
 	{
 		return EBUSY;
 	};
 	
+	mutex->__owner = pthread_self();
+	mutex->__count = 1;
 	return 0;
 };
 
@@ -162,10 +224,11 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex)
 	{
 		mutex->__owner = 0;
 		
-		__sync_fetch_and_add(&mutex->__cakes, 1);
-		if (mutex->__cakes != mutex->__tickets)
+		if (__sync_fetch_and_sub(&mutex->__futex, 1) != 1)
 		{
-			return __syscall(__SYS_unblock, &mutex->__cakes);
+			// there may be sleepers; wake one of them up
+			mutex->__futex = 0;
+			_glidix_futex((void*) &mutex->__futex, _GLIDIX_FUTEX_WAKE | __mutex_futex_flags(mutex), 1, 0, NULL);
 		};
 	};
 	
@@ -0,0 +1,169 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <errno.h>
+
+int pthread_rwlockattr_init(pthread_rwlockattr_t *attr)
+{
+	attr->__pshared = PTHREAD_PROCESS_PRIVATE;
+	return 0;
+};
+
+int pthread_rwlockattr_destroy(pthread_rwlockattr_t *attr)
+{
+	return 0;
+};
+
+int pthread_rwlock_init(pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr)
+{
+	if ((attr != NULL) && (attr->__pshared != PTHREAD_PROCESS_PRIVATE))
+	{
+		return EINVAL;
+	};
+	
+	pthread_mutex_init(&rwlock->__lock, NULL);
+	pthread_cond_init(&rwlock->__readable, NULL);
+	pthread_cond_init(&rwlock->__writable, NULL);
+	rwlock->__readers = 0;
+	rwlock->__waitingWriters = 0;
+	rwlock->__writer = 0;
+	return 0;
+};
+
+int pthread_rwlock_destroy(pthread_rwlock_t *rwlock)
+{
+	if ((rwlock->__readers != 0) || (rwlock->__writer != 0))
+	{
+		return EBUSY;
+	};
+	
+	return 0;
+};
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
+{
+	pthread_mutex_lock(&rwlock->__lock);
+	if (rwlock->__writer == pthread_self())
+	{
+		pthread_mutex_unlock(&rwlock->__lock);
+		return EDEADLK;
+	};
+	
+	// writers are preferred: don't start reading while one is waiting, or readers could starve it forever
+	while ((rwlock->__writer != 0) || (rwlock->__waitingWriters != 0))
+	{
+		pthread_cond_wait(&rwlock->__readable, &rwlock->__lock);
+	};
+	
+	rwlock->__readers++;
+	pthread_mutex_unlock(&rwlock->__lock);
+	return 0;
+};
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock)
+{
+	pthread_mutex_lock(&rwlock->__lock);
+	if ((rwlock->__writer != 0) || (rwlock->__waitingWriters != 0))
+	{
+		pthread_mutex_unlock(&rwlock->__lock);
+		return EBUSY;
+	};
+	
+	rwlock->__readers++;
+	pthread_mutex_unlock(&rwlock->__lock);
+	return 0;
+};
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
+{
+	pthread_mutex_lock(&rwlock->__lock);
+	if (rwlock->__writer == pthread_self())
+	{
+		pthread_mutex_unlock(&rwlock->__lock);
+		return EDEADLK;
+	};
+	
+	rwlock->__waitingWriters++;
+	while ((rwlock->__writer != 0) || (rwlock->__readers != 0))
+	{
+		pthread_cond_wait(&rwlock->__writable, &rwlock->__lock);
+	};
+	rwlock->__waitingWriters--;
+	
+	rwlock->__writer = pthread_self();
+	pthread_mutex_unlock(&rwlock->__lock);
+	return 0;
+};
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock)
+{
+	pthread_mutex_lock(&rwlock->__lock);
+	if ((rwlock->__writer != 0) || (rwlock->__readers != 0))
+	{
+		pthread_mutex_unlock(&rwlock->__lock);
+		return EBUSY;
+	};
+	
+	rwlock->__writer = pthread_self();
+	pthread_mutex_unlock(&rwlock->__lock);
+	return 0;
+};
+
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
+{
+	pthread_mutex_lock(&rwlock->__lock);
+	if (rwlock->__writer == pthread_self())
+	{
+		rwlock->__writer = 0;
+	}
+	else if (rwlock->__readers != 0)
+	{
+		rwlock->__readers--;
+	}
+	else
+	{
+		pthread_mutex_unlock(&rwlock->__lock);
+		return EPERM;
+	};
+	
+	if (rwlock->__readers == 0)
+	{
+		if (rwlock->__waitingWriters != 0)
+		{
+			pthread_cond_signal(&rwlock->__writable);
+		}
+		else
+		{
+			pthread_cond_broadcast(&rwlock->__readable);
+		};
+	};
+	
+	pthread_mutex_unlock(&rwlock->__lock);
+	return 0;
+};
@@ -0,0 +1,71 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <errno.h>
+
+int pthread_spin_init(pthread_spinlock_t *lock, int pshared)
+{
+	*lock = 0;
+	return 0;
+};
+
+int pthread_spin_destroy(pthread_spinlock_t *lock)
+{
+	return 0;
+};
+
+int pthread_spin_lock(pthread_spinlock_t *lock)
+{
+	while (__sync_lock_test_and_set(lock, 1) != 0)
+	{
+		// wait until it looks free before trying again, so we don't keep bouncing the cache line
+		while (*lock != 0)
+		{
+			__asm__ __volatile__ ("pause");
+		};
+	};
+	
+	return 0;
+};
+
+int pthread_spin_trylock(pthread_spinlock_t *lock)
+{
+	if (__sync_lock_test_and_set(lock, 1) != 0)
+	{
+		return EBUSY;
+	};
+	
+	return 0;
+};
+
+int pthread_spin_unlock(pthread_spinlock_t *lock)
+{
+	__sync_lock_release(lock);
+	return 0;
+};
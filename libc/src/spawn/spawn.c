@@ -0,0 +1,334 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <spawn.h>
+#include <sys/glidix.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define	__SPAWN_ALL_FLAGS	(POSIX_SPAWN_RESETIDS | POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF \
+				| POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSID | POSIX_SPAWN_TCSETPGROUP)
+
+/* unistd/exec.c */
+int __find_command(char *path, char *cmd);
+
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions,
+		const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+	posix_spawnattr_t attr;
+	const posix_spawnattr_t *kattr = NULL;
+	if (attrp != NULL)
+	{
+		attr = *attrp;
+		if (attr.__flags & POSIX_SPAWN_SETSIGMASK)
+		{
+			// a new image always starts with no signals blocked (as with exec), so an
+			// empty mask is the only one we can honour
+			if (attr.__sigmask != 0)
+			{
+				return EINVAL;
+			};
+			
+			attr.__flags &= ~POSIX_SPAWN_SETSIGMASK;
+		};
+		
+		kattr = &attr;
+	};
+	
+	const struct __spawn_action *acts = NULL;
+	int nacts = 0;
+	if (file_actions != NULL)
+	{
+		acts = file_actions->__actions;
+		nacts = file_actions->__count;
+	};
+	
+	size_t argcount = 0;
+	size_t argsize = 0;
+	char *const *scan = argv;
+	while (*scan != NULL)
+	{
+		argcount++;
+		argsize += strlen(*scan);
+		scan++;
+	};
+
+	size_t envcount = 0;
+	size_t envsize = 0;
+	scan = envp;
+	while (*scan != NULL)
+	{
+		envcount++;
+		envsize += strlen(*scan);
+		scan++;
+	};
+
+	size_t execparsz = argcount + argsize + envcount + envsize + 4;
+	char *execpars = (char*) malloc(execparsz);
+	if (execpars == NULL)
+	{
+		return ENOMEM;
+	};
+	
+	memset(execpars, 0, execparsz);
+
+	size_t i;
+	size_t offset = 0;
+	for (i=0; i<argcount; i++)
+	{
+		strcpy(&execpars[offset], argv[i]);
+		offset += strlen(argv[i]) + 1;
+	};
+	offset++;
+
+	for (i=0; i<envcount; i++)
+	{
+		strcpy(&execpars[offset], envp[i]);
+		offset += strlen(envp[i]) + 1;
+	};
+	
+	// posix_spawn() reports errors through its return value and leaves errno alone
+	int saved = errno;
+	pid_t child = _glidix_spawn(path, execpars, execparsz, acts, nacts, kattr);
+	free(execpars);
+	
+	if (child == -1)
+	{
+		int error = errno;
+		errno = saved;
+		return error;
+	};
+	
+	if (pid != NULL) *pid = child;
+	return 0;
+};
+
+int posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions,
+		const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+	if (strchr(file, '/') != NULL)
+	{
+		return posix_spawn(pid, file, file_actions, attrp, argv, envp);
+	};
+	
+	char path[256];
+	char *filedup = strdup(file);
+	int ok = __find_command(path, filedup);
+	free(filedup);
+	
+	if (ok == -1)
+	{
+		return ENOENT;
+	};
+	
+	return posix_spawn(pid, path, file_actions, attrp, argv, envp);
+};
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions)
+{
+	file_actions->__count = 0;
+	file_actions->__alloc = 0;
+	file_actions->__actions = NULL;
+	return 0;
+};
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions)
+{
+	int i;
+	for (i=0; i<file_actions->__count; i++)
+	{
+		free(file_actions->__actions[i].__path);
+	};
+	
+	free(file_actions->__actions);
+	file_actions->__count = 0;
+	file_actions->__alloc = 0;
+	file_actions->__actions = NULL;
+	return 0;
+};
+
+static struct __spawn_action* __spawn_push(posix_spawn_file_actions_t *file_actions, int type, int fd)
+{
+	if (file_actions->__count == file_actions->__alloc)
+	{
+		int newAlloc = file_actions->__alloc * 2;
+		if (newAlloc == 0) newAlloc = 4;
+		
+		struct __spawn_action *newActions = (struct __spawn_action*) realloc(file_actions->__actions,
+								sizeof(struct __spawn_action) * newAlloc);
+		if (newActions == NULL)
+		{
+			return NULL;
+		};
+		
+		file_actions->__actions = newActions;
+		file_actions->__alloc = newAlloc;
+	};
+	
+	struct __spawn_action *act = &file_actions->__actions[file_actions->__count++];
+	memset(act, 0, sizeof(struct __spawn_action));
+	act->__type = type;
+	act->__fd = fd;
+	return act;
+};
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions, int fildes,
+		const char *path, int oflag, mode_t mode)
+{
+	if (fildes < 0)
+	{
+		return EBADF;
+	};
+	
+	char *pathdup = strdup(path);
+	if (pathdup == NULL)
+	{
+		return ENOMEM;
+	};
+	
+	struct __spawn_action *act = __spawn_push(file_actions, _GLIDIX_SPAWN_OPEN, fildes);
+	if (act == NULL)
+	{
+		free(pathdup);
+		return ENOMEM;
+	};
+	
+	act->__oflag = oflag;
+	act->__mode = mode;
+	act->__path = pathdup;
+	return 0;
+};
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions, int fildes)
+{
+	if (fildes < 0)
+	{
+		return EBADF;
+	};
+	
+	if (__spawn_push(file_actions, _GLIDIX_SPAWN_CLOSE, fildes) == NULL)
+	{
+		return ENOMEM;
+	};
+	
+	return 0;
+};
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions, int fildes, int newfildes)
+{
+	if ((fildes < 0) || (newfildes < 0))
+	{
+		return EBADF;
+	};
+	
+	struct __spawn_action *act = __spawn_push(file_actions, _GLIDIX_SPAWN_DUP2, fildes);
+	if (act == NULL)
+	{
+		return ENOMEM;
+	};
+	
+	act->__newfd = newfildes;
+	return 0;
+};
+
+int posix_spawnattr_init(posix_spawnattr_t *attr)
+{
+	memset(attr, 0, sizeof(posix_spawnattr_t));
+	return 0;
+};
+
+int posix_spawnattr_destroy(posix_spawnattr_t *attr)
+{
+	return 0;
+};
+
+int posix_spawnattr_getflags(const posix_spawnattr_t *attr, short *flags)
+{
+	*flags = (short) attr->__flags;
+	return 0;
+};
+
+int posix_spawnattr_setflags(posix_spawnattr_t *attr, short flags)
+{
+	if ((flags & __SPAWN_ALL_FLAGS) != flags)
+	{
+		return EINVAL;
+	};
+	
+	attr->__flags = flags;
+	return 0;
+};
+
+int posix_spawnattr_getpgroup(const posix_spawnattr_t *attr, pid_t *pgroup)
+{
+	*pgroup = attr->__pgroup;
+	return 0;
+};
+
+int posix_spawnattr_setpgroup(posix_spawnattr_t *attr, pid_t pgroup)
+{
+	attr->__pgroup = pgroup;
+	return 0;
+};
+
+int posix_spawnattr_getsigdefault(const posix_spawnattr_t *attr, sigset_t *sigdefault)
+{
+	*sigdefault = attr->__sigdefault;
+	return 0;
+};
+
+int posix_spawnattr_setsigdefault(posix_spawnattr_t *attr, const sigset_t *sigdefault)
+{
+	attr->__sigdefault = *sigdefault;
+	return 0;
+};
+
+int posix_spawnattr_getsigmask(const posix_spawnattr_t *attr, sigset_t *sigmask)
+{
+	*sigmask = attr->__sigmask;
+	return 0;
+};
+
+int posix_spawnattr_setsigmask(posix_spawnattr_t *attr, const sigset_t *sigmask)
+{
+	attr->__sigmask = *sigmask;
+	return 0;
+};
+
+int posix_spawnattr_tcgetpgrp_np(const posix_spawnattr_t *attr, int *tcfd)
+{
+	*tcfd = attr->__tcfd;
+	return 0;
+};
+
+int posix_spawnattr_tcsetpgrp_np(posix_spawnattr_t *attr, int tcfd)
+{
+	attr->__tcfd = tcfd;
+	return 0;
+};
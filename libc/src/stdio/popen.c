@@ -33,6 +33,9 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <spawn.h>
+
+extern char **environ;
 
 enum
 {
@@ -66,31 +69,33 @@ FILE *popen(const char *cmd, const char *mode)
 		return NULL;
 	};
 	
-	pid_t pid = fork();
-	if (pid == -1)
+	posix_spawn_file_actions_t fa;
+	posix_spawn_file_actions_init(&fa);
+	if (m == __MODE_READ)
 	{
-		return NULL;
+		// they're reading from our stdout/stderr
+		posix_spawn_file_actions_adddup2(&fa, pipefd[1], 1);
+		posix_spawn_file_actions_adddup2(&fa, pipefd[1], 2);
+	}
+	else
+	{
+		// they're writing to our stdin
+		posix_spawn_file_actions_adddup2(&fa, pipefd[0], 0);
 	};
+	posix_spawn_file_actions_addclose(&fa, pipefd[0]);
+	posix_spawn_file_actions_addclose(&fa, pipefd[1]);
+	
+	pid_t pid;
+	char *argv[] = {"sh", "-c", (char*) cmd, NULL};
+	int error = posix_spawn(&pid, "/bin/sh", &fa, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
 	
-	if (pid == 0)
+	if (error != 0)
 	{
-		if (m == __MODE_READ)
-		{
-			// they're reading from our stdout/stderr
-			close(1);
-			close(2);
-			dup2(pipefd[1], 1);
-			dup2(pipefd[2], 2);
-		}
-		else
-		{
-			// they're writing to out stdin
-			close(0);
-			dup2(pipefd[0], 0);
-		};
-		
-		execl("/bin/sh", "sh", "-c", cmd, NULL);
-		_exit(127);
+		close(pipefd[0]);
+		close(pipefd[1]);
+		errno = error;
+		return NULL;
 	}
 	else
 	{
@@ -104,11 +109,13 @@ FILE *popen(const char *cmd, const char *mode)
 		fp->_flush = __fd_flush;
 		if (m == __MODE_READ)
 		{
+			close(pipefd[1]);
 			fp->_fd = pipefd[0];
 			fp->_flags = __FILE_READ;
 		}
 		else
 		{
+			close(pipefd[0]);
 			fp->_fd = pipefd[1];
 			fp->_flags = __FILE_WRITE;
 		};
@@ -31,6 +31,9 @@
 #include <signal.h>
 #include <unistd.h>
 #include <errno.h>
+#include <spawn.h>
+
+extern char **environ;
 
 int system(const char *cmd)
 {
@@ -49,17 +52,30 @@ int system(const char *cmd)
 	sigaction(SIGINT, &sa, &savintr);
 	sigaction(SIGQUIT, &sa, &savequit);
 	
-	if ((pid = fork()) == 0)
-	{
-		sigaction(SIGINT, &savintr, NULL);
-		sigaction(SIGQUIT, &savequit, NULL);
-		execl(shell, "sh", "-c", cmd, NULL);
-		_exit(127);
-	};
+	// the shell gets back the dispositions we had, unless they were "ignore"; a handler
+	// would be reset to the default by exec anyway
+	sigset_t sigdef;
+	sigemptyset(&sigdef);
+	if (savintr.sa_handler != SIG_IGN) sigaddset(&sigdef, SIGINT);
+	if (savequit.sa_handler != SIG_IGN) sigaddset(&sigdef, SIGQUIT);
+	
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigdefault(&attr, &sigdef);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
 	
-	if (pid == -1)
+	char *argv[] = {"sh", "-c", (char*) cmd, NULL};
+	int error = posix_spawn(&pid, shell, NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	
+	if ((error == ENOENT) || (error == EACCES) || (error == ENOEXEC))
+	{
+		stat = 127 << 8; /* as if the shell exited with 127 */
+	}
+	else if (error != 0)
 	{
-		stat = -1; /* errno comes from fork() */
+		errno = error;
+		stat = -1;
 	}
 	else
 	{
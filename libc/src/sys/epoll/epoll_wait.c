@@ -0,0 +1,104 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/epoll.h>
+#include <sys/glidix.h>
+#include <stdlib.h>
+#include <errno.h>
+
+/**
+ * Requests for up to EPOLL_WAIT_STACK events are served from a buffer on the stack; larger ones from the
+ * heap. The kernel never returns more than EPOLL_WAIT_MAX events (EQ_MAX_EVENTS) in one call. The events
+ * must be fetched in a single call, since level-triggered events are queued again once returned, and a
+ * second call would return them twice.
+ */
+#define	EPOLL_WAIT_STACK			64
+#define	EPOLL_WAIT_MAX				1024
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+	int flags;
+	uint64_t nanotimeout;
+	
+	if (maxevents <= 0)
+	{
+		errno = EINVAL;
+		return -1;
+	};
+	
+	if (timeout < 0)
+	{
+		flags = 0;
+		nanotimeout = 0;
+	}
+	else if (timeout == 0)
+	{
+		flags = O_NONBLOCK;
+		nanotimeout = 0;
+	}
+	else
+	{
+		flags = 0;
+		nanotimeout = (uint64_t)timeout * 1000000UL;		// 10^6 nanoseconds in a millisecond
+	};
+	
+	if (maxevents > EPOLL_WAIT_MAX)
+	{
+		maxevents = EPOLL_WAIT_MAX;
+	};
+	
+	_glidix_eqevent stackev[EPOLL_WAIT_STACK];
+	_glidix_eqevent *eqev = stackev;
+	if (maxevents > EPOLL_WAIT_STACK)
+	{
+		eqev = (_glidix_eqevent*) malloc(sizeof(_glidix_eqevent) * maxevents);
+		if (eqev == NULL)
+		{
+			errno = ENOMEM;
+			return -1;
+		};
+	};
+	
+	int count = _glidix_eqwait(epfd, eqev, maxevents, flags, nanotimeout);
+	
+	int i;
+	for (i=0; i<count; i++)
+	{
+		events[i].events = (uint32_t) eqev[i].events;
+		events[i].data.u64 = eqev[i].udata;
+	};
+	
+	if (eqev != stackev)
+	{
+		int errnum = errno;
+		free(eqev);
+		errno = errnum;
+	};
+	
+	return count;
+};
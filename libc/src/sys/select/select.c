@@ -60,9 +60,8 @@ int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struc
 		nanotimeout = (uint64_t)timeout->tv_sec * 1000000000UL + (uint64_t)timeout->tv_usec * 1000UL;
 	};
 	
-	int maxFiles = sysconf(_SC_OPEN_MAX);
-	uint8_t bitmap[maxFiles];
-	memset(bitmap, 0, maxFiles);
+	uint8_t bitmap[nfds+1];
+	memset(bitmap, 0, nfds);
 	
 	int i;
 	for (i=0; i<nfds; i++)
@@ -90,7 +89,7 @@ int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struc
 	if (writefds != NULL) FD_ZERO(writefds);
 	if (exceptfds != NULL) FD_ZERO(exceptfds);
 	
-	int status = _glidix_fpoll(bitmap, bitmap, flags, nanotimeout);
+	int status = _glidix_fpoll(bitmap, bitmap, flags, nanotimeout, nfds);
 	if (status == -1)
 	{
 		return -1;
@@ -0,0 +1,219 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <sys/socket.h>
+#include <sys/glidix.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+struct cmsghdr* __cmsg_nxthdr(struct msghdr *msg, struct cmsghdr *cmsg)
+{
+	char *next = (char*) cmsg + CMSG_ALIGN(cmsg->cmsg_len);
+	char *end = (char*) msg->msg_control + msg->msg_controllen;
+	
+	if ((cmsg->cmsg_len < sizeof(struct cmsghdr)) || (next + sizeof(struct cmsghdr) > end))
+	{
+		return NULL;
+	};
+	
+	return (struct cmsghdr*) next;
+};
+
+static size_t __iov_total(const struct msghdr *msg)
+{
+	size_t total = 0;
+	int i;
+	for (i=0; i<msg->msg_iovlen; i++)
+	{
+		total += msg->msg_iov[i].iov_len;
+	};
+	
+	return total;
+};
+
+ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags)
+{
+	// collect the file descriptors to pass
+	int fds[SCM_MAX_FD];
+	int numfds = 0;
+	
+	struct cmsghdr *cmsg;
+	for (cmsg=CMSG_FIRSTHDR(msg); cmsg!=NULL; cmsg=CMSG_NXTHDR((struct msghdr*)msg, cmsg))
+	{
+		if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+		{
+			int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			if (numfds + count > SCM_MAX_FD)
+			{
+				errno = EINVAL;
+				return -1;
+			};
+			
+			memcpy(&fds[numfds], CMSG_DATA(cmsg), sizeof(int) * count);
+			numfds += count;
+		};
+	};
+	
+	// gather the data into a single buffer
+	size_t total = __iov_total(msg);
+	char *buffer = (char*) malloc(total);
+	if ((buffer == NULL) && (total != 0))
+	{
+		errno = ENOMEM;
+		return -1;
+	};
+	
+	char *put = buffer;
+	int i;
+	for (i=0; i<msg->msg_iovlen; i++)
+	{
+		memcpy(put, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+		put += msg->msg_iov[i].iov_len;
+	};
+	
+	ssize_t result;
+	if (numfds != 0)
+	{
+		result = _glidix_sendmsg(sockfd, buffer, total, flags, fds, numfds);
+	}
+	else if (msg->msg_name != NULL)
+	{
+		result = sendto(sockfd, buffer, total, flags, (struct sockaddr*) msg->msg_name, msg->msg_namelen);
+	}
+	else
+	{
+		result = send(sockfd, buffer, total, flags);
+	};
+	
+	int errnum = errno;
+	free(buffer);
+	errno = errnum;
+	return result;
+};
+
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
+{
+	size_t total = __iov_total(msg);
+	char *buffer = (char*) malloc(total);
+	if ((buffer == NULL) && (total != 0))
+	{
+		errno = ENOMEM;
+		return -1;
+	};
+	
+	// see how many file descriptors the control buffer has room for
+	int fds[SCM_MAX_FD];
+	int numfds = 0;
+	int capacity = 0;
+	if ((msg->msg_control != NULL) && (msg->msg_controllen >= CMSG_LEN(sizeof(int))))
+	{
+		capacity = (msg->msg_controllen - CMSG_LEN(0)) / sizeof(int);
+		if (capacity > SCM_MAX_FD) capacity = SCM_MAX_FD;
+	};
+	
+	// MSG_TRUNC makes message-based sockets return the full size of the message, so that we can tell
+	// whether it was truncated; with a control buffer (even one too small for a descriptor), we also
+	// learn whether any descriptors were discarded. Sockets that cannot pass descriptors do not support
+	// that, in which case we fall back to recvfrom().
+	ssize_t result = -1;
+	int useMsg = (msg->msg_control != NULL);
+	if (useMsg)
+	{
+		numfds = capacity;
+		result = _glidix_recvmsg(sockfd, buffer, total, flags | MSG_TRUNC, fds, &numfds);
+		msg->msg_namelen = 0;
+		
+		if ((result == -1) && (errno == EOPNOTSUPP)) useMsg = 0;
+	};
+	
+	if (!useMsg)
+	{
+		numfds = 0;
+		result = recvfrom(sockfd, buffer, total, flags | MSG_TRUNC, (struct sockaddr*) msg->msg_name, &msg->msg_namelen);
+	};
+	
+	if (result == -1)
+	{
+		int errnum = errno;
+		free(buffer);
+		errno = errnum;
+		return -1;
+	};
+	
+	msg->msg_flags = 0;
+	size_t received = (size_t) result;
+	if (received > total)
+	{
+		received = total;
+		msg->msg_flags |= MSG_TRUNC;
+		
+		// the caller only gets the full size if it asked for it
+		if ((flags & MSG_TRUNC) == 0) result = (ssize_t) total;
+	};
+	
+	// scatter the data into the caller's buffers
+	const char *scan = buffer;
+	size_t left = received;
+	int i;
+	for (i=0; i<msg->msg_iovlen && left!=0; i++)
+	{
+		size_t chunk = msg->msg_iov[i].iov_len;
+		if (chunk > left) chunk = left;
+		
+		memcpy(msg->msg_iov[i].iov_base, scan, chunk);
+		scan += chunk;
+		left -= chunk;
+	};
+	
+	free(buffer);
+	
+	int delivered = numfds;
+	if (delivered > capacity)
+	{
+		delivered = capacity;
+		msg->msg_flags |= MSG_CTRUNC;
+	};
+	
+	if (delivered != 0)
+	{
+		struct cmsghdr *cmsg = (struct cmsghdr*) msg->msg_control;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * delivered);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * delivered);
+		msg->msg_controllen = CMSG_SPACE(sizeof(int) * delivered);
+	}
+	else
+	{
+		msg->msg_controllen = 0;
+	};
+	
+	return result;
+};
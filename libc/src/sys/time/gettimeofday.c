@@ -31,7 +31,10 @@
 
 int gettimeofday(struct timeval *tp, void *tzp)
 {
-	tp->tv_sec = time(NULL);
-	tp->tv_usec = 0;
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	
+	tp->tv_sec = ts.tv_sec;
+	tp->tv_usec = ts.tv_nsec / 1000;
 	return 0;
 };
@@ -26,9 +26,10 @@
 	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <sys/glidix.h>
 #include <time.h>
 
 clock_t clock()
 {
-	return _glidix_nanotime() / 1000;
+	return __nanotime() / 1000;
 };
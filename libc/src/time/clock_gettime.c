@@ -0,0 +1,145 @@
+/*
+	Glidix Runtime
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/glidix.h>
+#include <time.h>
+#include <errno.h>
+
+#define	NANO_PER_SEC			1000000000UL
+
+static uint64_t __rdtsc()
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32) | lo;
+};
+
+uint64_t __nanotime()
+{
+	volatile _glidix_clockpage *page = (volatile _glidix_clockpage*) _GLIDIX_CLOCK_PAGE;
+	
+	while (1)
+	{
+		uint32_t seq = page->seq;
+		if (seq & 1)
+		{
+			// the kernel is updating it
+			continue;
+		};
+		
+		__sync_synchronize();
+		if (page->source != _GLIDIX_CLOCK_TSC)
+		{
+			// we can't read the clock source from userspace
+			return _glidix_nanotime();
+		};
+		
+		uint64_t nanotime = page->nanoBase
+			+ (uint64_t) (((unsigned __int128) (__rdtsc() - page->tscBase) * page->mult) >> 32);
+		__sync_synchronize();
+		
+		if (page->seq == seq)
+		{
+			return nanotime;
+		};
+	};
+};
+
+int64_t __realtime_offset()
+{
+	volatile _glidix_clockpage *page = (volatile _glidix_clockpage*) _GLIDIX_CLOCK_PAGE;
+	
+	while (1)
+	{
+		uint32_t seq = page->seq;
+		__sync_synchronize();
+		int64_t offset = page->realOffset;
+		__sync_synchronize();
+		
+		if (((seq & 1) == 0) && (page->seq == seq))
+		{
+			return offset;
+		};
+	};
+};
+
+int clock_gettime(clockid_t clk, struct timespec *tp)
+{
+	uint64_t nanotime;
+	if (clk == CLOCK_MONOTONIC)
+	{
+		nanotime = __nanotime();
+	}
+	else if (clk == CLOCK_REALTIME)
+	{
+		int64_t offset = __realtime_offset();
+		if (offset == 0)
+		{
+			// the kernel hasn't read the RTC yet
+			nanotime = (uint64_t) time(NULL) * NANO_PER_SEC;
+		}
+		else
+		{
+			nanotime = __nanotime() + offset;
+		};
+	}
+	else
+	{
+		errno = EINVAL;
+		return -1;
+	};
+	
+	tp->tv_sec = nanotime / NANO_PER_SEC;
+	tp->tv_nsec = nanotime % NANO_PER_SEC;
+	return 0;
+};
+
+int clock_getres(clockid_t clk, struct timespec *res)
+{
+	if ((clk != CLOCK_MONOTONIC) && (clk != CLOCK_REALTIME))
+	{
+		errno = EINVAL;
+		return -1;
+	};
+	
+	if (res != NULL)
+	{
+		volatile _glidix_clockpage *page = (volatile _glidix_clockpage*) _GLIDIX_CLOCK_PAGE;
+		res->tv_sec = 0;
+		if (page->source == _GLIDIX_CLOCK_TICKS)
+		{
+			res->tv_nsec = 1000000;
+		}
+		else
+		{
+			res->tv_nsec = 1;
+		};
+	};
+	
+	return 0;
+};
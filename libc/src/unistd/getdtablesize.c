@@ -30,5 +30,5 @@
 
 int getdtablesize()
 {
-	return 32;
+	return (int) sysconf(_SC_OPEN_MAX);
 };
@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <pwd.h>
 #include <errno.h>
+#include <sys/resource.h>
 
 long sysconf(int name)
 {
@@ -45,7 +46,11 @@ long sysconf(int name)
 	case _SC_NGROUPS_MAX:
 		return NGROUPS_MAX;
 	case _SC_OPEN_MAX:
-		return OPEN_MAX;
+		{
+			struct rlimit rl;
+			if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return OPEN_MAX;
+			return (long) rl.rlim_cur;
+		};
 	default:
 		errno = EINVAL;
 		return -1;
@@ -66,6 +66,24 @@ typedef struct
 	volatile uint16_t		special;
 } ETXDesc;
 
+/**
+ * TCP/IP context descriptor; shares the TX ring with data descriptors, and sets up the checksum and
+ * segmentation offloads for the data descriptors that follow it.
+ */
+typedef struct
+{
+	volatile uint8_t		ipcss;			// IP checksum start
+	volatile uint8_t		ipcso;			// IP checksum offset
+	volatile uint16_t		ipcse;			// IP checksum end (inclusive)
+	volatile uint8_t		tucss;			// TCP/UDP checksum start
+	volatile uint8_t		tucso;			// TCP/UDP checksum offset
+	volatile uint16_t		tucse;			// TCP/UDP checksum end (0 = end of packet)
+	volatile uint32_t		paylenCmd;		// PAYLEN (bits 0-19), DTYP (20-23), TUCMD (24-31)
+	volatile uint8_t		sta;
+	volatile uint8_t		hdrlen;
+	volatile uint16_t		mss;
+} ETXContextDesc;
+
 typedef struct
 {
 	volatile uint64_t		phaddr;
@@ -96,6 +114,7 @@ typedef struct EPacket_
 {
 	struct EPacket_*		next;
 	size_t				size;
+	int				flags;			// ETHER_* flags to pass to onEtherFrame()
 	uint8_t				data[];
 } EPacket;
 
@@ -112,6 +131,7 @@ typedef struct EInterface_
 	uint64_t			mmioAddr;
 	DMABuffer			dmaSharedArea;
 	Semaphore			semTXCount;
+	uint8_t				txEOP[NUM_TX_DESC];	// which TX descriptors end a packet
 	int				nextTX;
 	int				nextWaitingTX;
 	int				nextRX;
@@ -179,7 +199,7 @@ static void e1000_qthread(void *context)
 		nif->qfirst = packet->next;
 		semSignal(&nif->semQueue);
 
-		onEtherFrame(nif->netif, packet->data, packet->size+4, ETHER_IGNORE_CRC);
+		onEtherFrame(nif->netif, packet->data, packet->size+4, ETHER_IGNORE_CRC | packet->flags);
 		kfree(packet);
 	};
 };
@@ -221,10 +241,10 @@ static void e1000_send(NetIf *netif, const void *frame, size_t framelen)
 {
 	EInterface *nif = (EInterface*) netif->drvdata;
 	
-	// wait for transmit descriptors to be available
-	semWait(&nif->semTXCount);
-	
+	// wait for a transmit descriptor to be available; we take the lock first so that e1000_send_offload(),
+	// which needs several descriptors at once, cannot be starved
 	semWait(&nif->lock);
+	semWait(&nif->semTXCount);
 	
 	// get buffer index
 	int index = nif->nextTX++;
@@ -247,6 +267,106 @@ static void e1000_send(NetIf *netif, const void *frame, size_t framelen)
 	sha->txdesc[index].sta = 0;
 	sha->txdesc[index].css = 0;
 	sha->txdesc[index].special = 0;
+	nif->txEOP[index] = 1;
+	
+	// write new tail
+	volatile uint32_t * regTail = (volatile uint32_t *) (nif->mmioAddr + 0x3818);
+	*regTail = (uint32_t) nif->nextTX;
+	
+	semSignal(&nif->lock);
+};
+
+static void e1000_send_offload(NetIf *netif, const void *frame, size_t framelen, const NetOffload *off)
+{
+	EInterface *nif = (EInterface*) netif->drvdata;
+	ESharedArea *sha = (ESharedArea*) dmaGetPtr(&nif->dmaSharedArea);
+	ESharedArea *shaPhys = (ESharedArea*) dmaGetPhys(&nif->dmaSharedArea);
+	
+	// one context descriptor, followed by as many data descriptors as needed to hold the frame
+	int numData = (int) ((framelen + sizeof(EFrameBuffer) - 1) / sizeof(EFrameBuffer));
+	int count = numData + 1;
+	
+	semWait(&nif->lock);
+	while (count)
+	{
+		count -= semWaitGen(&nif->semTXCount, count, 0, 0);
+	};
+	
+	int tso = (off->flags & NETIF_OFF_TSO) != 0;
+	int ipv4 = (off->flags & NETIF_OFF_IPV4) != 0;
+	
+	// context descriptor
+	int index = nif->nextTX;
+	nif->nextTX = (nif->nextTX + 1) & (NUM_TX_DESC-1);
+	
+	ETXContextDesc *ctx = (ETXContextDesc*) &sha->txdesc[index];
+	uint8_t tucmd =
+		(1 << 5)					// extended descriptor
+		| (1 << 3);					// report status
+	if (tso) tucmd |= (1 << 2);				// TCP segmentation
+	if (ipv4) tucmd |= (1 << 1);				// IPv4 (otherwise IPv6)
+	if (off->flags & NETIF_OFF_TCP) tucmd |= (1 << 0);	// TCP (otherwise UDP)
+	
+	ctx->ipcss = (uint8_t) off->l3off;
+	ctx->ipcso = (uint8_t) (off->l3off + 10);
+	ctx->ipcse = off->l4off - 1;
+	ctx->tucss = (uint8_t) off->l4off;
+	ctx->tucso = (uint8_t) off->csumoff;
+	ctx->tucse = 0;
+	ctx->paylenCmd = ((uint32_t) tucmd << 24) | (tso ? (uint32_t) (framelen - off->hdrlen) : 0);
+	ctx->sta = 0;
+	ctx->hdrlen = (uint8_t) off->hdrlen;
+	ctx->mss = tso ? off->mss : 0;
+	nif->txEOP[index] = 0;
+	
+	// data descriptors
+	const uint8_t *put = (const uint8_t*) frame;
+	size_t sizeLeft = framelen;
+	int first = 1;
+	while (sizeLeft)
+	{
+		size_t chunk = sizeLeft;
+		if (chunk > sizeof(EFrameBuffer)) chunk = sizeof(EFrameBuffer);
+		
+		index = nif->nextTX;
+		nif->nextTX = (nif->nextTX + 1) & (NUM_TX_DESC-1);
+		
+		memcpy((void*)sha->txbufs[index].data, put, chunk);
+		if (first && tso && ipv4)
+		{
+			// the device fills in the length and header checksum of each segment
+			uint8_t *iphead = (uint8_t*) sha->txbufs[index].data + off->l3off;
+			*((uint16_t*)&iphead[2]) = 0;
+			*((uint16_t*)&iphead[10]) = 0;
+		};
+		
+		put += chunk;
+		sizeLeft -= chunk;
+		
+		sha->txdesc[index].phaddr = (uint64_t) (shaPhys->txbufs[index].data);
+		sha->txdesc[index].len = (uint16_t) chunk;
+		sha->txdesc[index].cso = 0x10;			// DTYP = data
+		sha->txdesc[index].cmd =
+			(1 << 5)				// extended descriptor
+			| (1 << 3)				// report status
+			| (1 << 1);				// insert CRC
+		if (tso) sha->txdesc[index].cmd |= (1 << 2);	// TCP segmentation
+		if (sizeLeft == 0) sha->txdesc[index].cmd |= (1 << 0);	// end of packet
+		sha->txdesc[index].sta = 0;
+		sha->txdesc[index].css = 0;
+		if (first)
+		{
+			// packet options: insert TCP/UDP checksum, and the IP checksum when segmenting IPv4
+			sha->txdesc[index].css = (1 << 1);
+			if (tso && ipv4) sha->txdesc[index].css |= (1 << 0);
+		};
+		sha->txdesc[index].special = 0;
+		nif->txEOP[index] = (sizeLeft == 0);
+		
+		first = 0;
+	};
+	
+	__sync_synchronize();
 	
 	// write new tail
 	volatile uint32_t * regTail = (volatile uint32_t *) (nif->mmioAddr + 0x3818);
@@ -288,13 +408,13 @@ static void e1000_thread(void *context)
 			volatile uint32_t * regTXHead = (volatile uint32_t *) (nif->mmioAddr + 0x3810);
 			while ((sha->txdesc[nif->nextWaitingTX].sta & 1) && ((uint32_t)nif->nextWaitingTX != (*regTXHead)))
 			{
-				// it's done with this descriptor
+				// it's done with this descriptor; only count packets, not each descriptor of one
 				if (sha->txdesc[nif->nextWaitingTX].sta & 2)
 				{
 					// error occured (excessive collisions)
 					__sync_fetch_and_add(&nif->netif->numErrors, 1);
 				}
-				else
+				else if (nif->txEOP[nif->nextWaitingTX])
 				{
 					// successful transmission
 					__sync_fetch_and_add(&nif->netif->numTrans, 1);
@@ -343,6 +463,15 @@ static void e1000_thread(void *context)
 					EPacket *pkt = (EPacket*) kmalloc(sizeof(EPacket) + len + 4);
 					pkt->next = NULL;
 					pkt->size = len;
+					pkt->flags = 0;
+					
+					uint8_t status = sha->rxdesc[index].status;
+					if ((status & (1 << 5)) && ((status & (1 << 2)) == 0))
+					{
+						// TCP/UDP checksum was checked by the device (and we know there were no errors)
+						pkt->flags = ETHER_CSUM_VERIFIED;
+					};
+					
 					memcpy(pkt->data, (const void*)sha->rxbufs[index].data, len);
 					semWait(&nif->semQueue);
 					if (nif->qfirst == NULL)
@@ -398,6 +527,8 @@ MODULE_INIT(const char *opt)
 		memset(&ifconfig, 0, sizeof(NetIfConfig));
 		ifconfig.ethernet.type = IF_ETHERNET;
 		ifconfig.ethernet.send = e1000_send;
+		ifconfig.ethernet.sendOffload = e1000_send_offload;
+		ifconfig.ethernet.caps = NETIF_CAP_TXCSUM | NETIF_CAP_RXCSUM | NETIF_CAP_TSO4;
 
 		uint16_t macbits[3];
 		int i;
@@ -517,6 +648,10 @@ MODULE_INIT(const char *opt)
 		// enable bus mastering before receiving
 		pciSetBusMastering(nif->pcidev, 1);
 		
+		// have the device verify IP and TCP/UDP checksums of incoming packets
+		volatile uint32_t *regRXCSUM = (volatile uint32_t*) (nif->mmioAddr + 0x5000);
+		*regRXCSUM = (1 << 8) | (1 << 9);
+		
 		// TODO: let's not be promiscuous
 		// a value of 0 for BSEX and BSIZE means 2KB buffers, just like we want
 		volatile uint32_t *regRCTL = (volatile uint32_t*) (nif->mmioAddr + 0x0100);
@@ -36,6 +36,7 @@
 #include <fcntl.h>
 #include <pwd.h>
 #include <grp.h>
+#include <spawn.h>
 
 #include "command.h"
 #include "strops.h"
@@ -407,82 +408,111 @@ static int executeGroup(CmdGroup *group)
 				pipe(pipefd);
 			};
 			
-			childrenLeft = 1;
-			member->pid = fork();
-			if (member->pid == 0)
+			// the child is set up by the kernel from these actions, so that we never have to
+			// duplicate the shell's address space
+			posix_spawn_file_actions_t fa;
+			posix_spawn_file_actions_init(&fa);
+			
+			if (member->prev != NULL)
 			{
-				member->pid = getpid();
-				setpgid(0, group->firstMember->pid);
-				
-				int i;
-				for (i=0; i<3; i++)
+				posix_spawn_file_actions_adddup2(&fa, prevInput, 1);
+				posix_spawn_file_actions_addclose(&fa, prevInput);
+			};
+			
+			if (member->next != NULL)
+			{
+				posix_spawn_file_actions_addclose(&fa, pipefd[1]);
+				posix_spawn_file_actions_adddup2(&fa, pipefd[0], 0);
+				posix_spawn_file_actions_addclose(&fa, pipefd[0]);
+			};
+			
+			CmdRedir *redir;
+			for (redir=member->redir; redir!=NULL; redir=redir->next)
+			{
+				if (redir->targetName[0] == '&')
 				{
-					if (isatty(i))
+					int fd = 1;
+					sscanf(redir->targetName, "&%d", &fd);
+					if (fd != redir->fd)
 					{
-						tcsetpgrp(i, group->firstMember->pid);
+						// we do NOT close the target descriptor in this case
+						posix_spawn_file_actions_adddup2(&fa, fd, redir->fd);
 					};
-				};
-				
-				if (member->prev != NULL)
+				}
+				else
 				{
-					close(1);
-					dup2(prevInput, 1);
-					close(prevInput);
+					posix_spawn_file_actions_addopen(&fa, redir->fd, redir->targetName, redir->oflag, 0644);
 				};
-				
-				if (member->next != NULL)
+			};
+			
+			// the first member starts a new process group, and the others join it (unless the
+			// first member failed to start, in which case they start their own); the group
+			// takes over the terminal
+			posix_spawnattr_t attr;
+			posix_spawnattr_init(&attr);
+			short flags = POSIX_SPAWN_SETPGROUP;
+			if ((member != group->firstMember) && (group->firstMember->pid > 0))
+			{
+				posix_spawnattr_setpgroup(&attr, group->firstMember->pid);
+			};
+			
+			int i;
+			for (i=0; i<3; i++)
+			{
+				if (isatty(i))
 				{
-					close(pipefd[1]);
-					close(0);
-					dup2(pipefd[0], 0);
-					close(pipefd[0]);
-				};
-				
-				CmdRedir *redir;
-				for (redir=member->redir; redir!=NULL; redir=redir->next)
-				{	
-					if (redir->targetName[0] == '&')
-					{
-						int fd = 1;
-						sscanf(redir->targetName, "&%d", &fd);
-						if (fd != redir->fd)
-						{
-							close(redir->fd);
-							dup2(fd, redir->fd);
-							
-							// we do NOT close the target descriptor in this case
-						};
-					}
-					else
-					{
-						int fd = open(redir->targetName, redir->oflag, 0644);
-						if (fd != redir->fd)
-						{
-							close(redir->fd);
-							dup2(fd, redir->fd);
-							close(fd);
-						};
-					};
+					flags |= POSIX_SPAWN_TCSETPGROUP;
+					posix_spawnattr_tcsetpgrp_np(&attr, i);
+					break;
 				};
-				
-				execve(execPath, ptr, localEnviron.list);
-				fprintf(stderr, "%s: cannot exec %s: %s\n", *ptr, execPath, strerror(errno));
-				_exit(1);
+			};
+			posix_spawnattr_setflags(&attr, flags);
+			
+			int error = posix_spawn(&member->pid, execPath, &fa, &attr, ptr, localEnviron.list);
+			
+			// like setpgid() and tcsetpgrp() in a forked child, the group and terminal are
+			// best-effort: the group may be gone already (e.g. the first member exited), or we
+			// may not be in the terminal's session; run the command anyway, first without
+			// taking the terminal, then in our own group
+			if ((error != 0) && (flags & POSIX_SPAWN_TCSETPGROUP))
+			{
+				flags &= ~POSIX_SPAWN_TCSETPGROUP;
+				posix_spawnattr_setflags(&attr, flags);
+				error = posix_spawn(&member->pid, execPath, &fa, &attr, ptr, localEnviron.list);
+			};
+			
+			if ((error != 0) && (flags & POSIX_SPAWN_SETPGROUP))
+			{
+				flags &= ~POSIX_SPAWN_SETPGROUP;
+				posix_spawnattr_setflags(&attr, flags);
+				error = posix_spawn(&member->pid, execPath, &fa, &attr, ptr, localEnviron.list);
+			};
+			
+			posix_spawn_file_actions_destroy(&fa);
+			posix_spawnattr_destroy(&attr);
+			
+			if (error != 0)
+			{
+				fprintf(stderr, "%s: cannot exec %s: %s\n", *ptr, execPath, strerror(error));
+				member->pid = -1;
+				member->status = 0x0100;
 			}
 			else
 			{
-				if (member->next != NULL)
-				{
-					// (only then did we create a pipe)
-					close(pipefd[0]);
-				};
-				
-				if (member->prev != NULL)
-				{
-					close(prevInput);
-				};
-				prevInput = pipefd[1];
+				childrenLeft = 1;
+			};
+			
+			if (member->next != NULL)
+			{
+				// (only then did we create a pipe)
+				close(pipefd[0]);
+			};
+			
+			if (member->prev != NULL)
+			{
+				close(prevInput);
 			};
+			prevInput = pipefd[1];
 		};
 	};
 	
@@ -0,0 +1,118 @@
+/*
+	Glidix Shell Utilities
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/wait.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+static long numRounds = 100000;
+
+static uint64_t nanotime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1)
+	{
+		numRounds = atol(argv[1]);
+	};
+	
+	if ((argc > 2) || (numRounds < 1))
+	{
+		fprintf(stderr, "USAGE:\t%s [rounds]\n", argv[0]);
+		fprintf(stderr, "\tMeasure the cost of a context switch between two processes, by passing a\n");
+		fprintf(stderr, "\tbyte back and forth over a pair of pipes. By default, run 100000 rounds.\n");
+		return 1;
+	};
+	
+	int ping[2];
+	int pong[2];
+	if ((pipe(ping) != 0) || (pipe(pong) != 0))
+	{
+		fprintf(stderr, "%s: pipe: %s\n", argv[0], strerror(errno));
+		return 1;
+	};
+	
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		fprintf(stderr, "%s: fork: %s\n", argv[0], strerror(errno));
+		return 1;
+	};
+	
+	char c = 0;
+	if (pid == 0)
+	{
+		close(ping[1]);
+		close(pong[0]);
+		
+		while (read(ping[0], &c, 1) == 1)
+		{
+			write(pong[1], &c, 1);
+		};
+		
+		_exit(0);
+	};
+	
+	close(ping[0]);
+	close(pong[1]);
+	
+	// warm up, so that both processes are running and have touched their pages
+	write(ping[1], &c, 1);
+	read(pong[0], &c, 1);
+	
+	uint64_t start = nanotime();
+	long i;
+	for (i=0; i<numRounds; i++)
+	{
+		if (write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1)
+		{
+			fprintf(stderr, "%s: lost the other process: %s\n", argv[0], strerror(errno));
+			return 1;
+		};
+	};
+	uint64_t end = nanotime();
+	
+	close(ping[1]);
+	waitpid(pid, NULL, 0);
+	
+	// each round trip is two switches
+	uint64_t ns = end - start;
+	printf("%ld round trips in %lu us: %lu ns per round trip, %lu ns per switch\n",
+		numRounds, ns / 1000, ns / numRounds, ns / (2 * numRounds));
+	return 0;
+};
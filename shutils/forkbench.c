@@ -0,0 +1,136 @@
+/*
+	Glidix Shell Utilities
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/wait.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+static long numRounds = 1000;
+static long numMegs = 0;
+
+static uint64_t nanotime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+};
+
+/**
+ * Run /bin/true 'numRounds' times, creating each child with the given function, and return the
+ * average time per command in nanoseconds; or 0 on error.
+ */
+static uint64_t runLoop(const char *progName, const char *how, pid_t (*forkfunc)(void))
+{
+	uint64_t start = nanotime();
+	long i;
+	for (i=0; i<numRounds; i++)
+	{
+		pid_t pid = forkfunc();
+		if (pid == -1)
+		{
+			fprintf(stderr, "%s: %s: %s\n", progName, how, strerror(errno));
+			return 0;
+		};
+		
+		if (pid == 0)
+		{
+			execl("/bin/true", "true", NULL);
+			_exit(127);
+		};
+		
+		int status;
+		if (waitpid(pid, &status, 0) == -1)
+		{
+			fprintf(stderr, "%s: waitpid: %s\n", progName, strerror(errno));
+			return 0;
+		};
+		
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			fprintf(stderr, "%s: /bin/true failed\n", progName);
+			return 0;
+		};
+	};
+	uint64_t end = nanotime();
+	
+	return (end - start) / numRounds;
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1)
+	{
+		numRounds = atol(argv[1]);
+	};
+	
+	if (argc > 2)
+	{
+		numMegs = atol(argv[2]);
+	};
+	
+	if ((argc > 3) || (numRounds < 1) || (numMegs < 0))
+	{
+		fprintf(stderr, "USAGE:\t%s [rounds [megabytes]]\n", argv[0]);
+		fprintf(stderr, "\tMeasure the cost of running /bin/true with fork()+exec() and with vfork()+exec(),\n");
+		fprintf(stderr, "\tafter touching the given number of megabytes of memory (default 0), so that fork()\n");
+		fprintf(stderr, "\thas page tables to copy. By default, run 1000 rounds of each.\n");
+		return 1;
+	};
+	
+	if (numMegs != 0)
+	{
+		size_t size = (size_t) numMegs << 20;
+		char *mem = (char*) malloc(size);
+		if (mem == NULL)
+		{
+			fprintf(stderr, "%s: cannot allocate %ld MB\n", argv[0], numMegs);
+			return 1;
+		};
+		
+		size_t i;
+		for (i=0; i<size; i+=4096)
+		{
+			mem[i] = 1;
+		};
+	};
+	
+	uint64_t forkTime = runLoop(argv[0], "fork", fork);
+	if (forkTime == 0) return 1;
+	
+	uint64_t vforkTime = runLoop(argv[0], "vfork", vfork);
+	if (vforkTime == 0) return 1;
+	
+	printf("fork+exec:  %lu us per command\n", forkTime / 1000);
+	printf("vfork+exec: %lu us per command\n", vforkTime / 1000);
+	return 0;
+};
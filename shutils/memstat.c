@@ -55,6 +55,7 @@ void printFrames(const char *label, size_t frames)
 int main(int argc, char *argv[])
 {
 	struct system_state sst;
+	memset(&sst, 0, sizeof(struct system_state));
 	if (__syscall(__SYS_systat, &sst, sizeof(struct system_state)) != 0)
 	{
 		fprintf(stderr, "%s: failed to get system state: %s\n", argv[0], strerror(errno));
@@ -67,6 +68,12 @@ int main(int argc, char *argv[])
 	printFrames("Cache memory:", sst.sst_frames_cached);
 	printFrames("Available memory:", sst.sst_frames_total - sst.sst_frames_used + sst.sst_frames_cached);
 	printFrames("Unallocated memory:", sst.sst_frames_total - sst.sst_frames_used);
+	printFrames("Pre-zeroed memory:", sst.sst_zero_pooled);
+	
+	uint64_t requests = sst.sst_zero_hits + sst.sst_zero_misses;
+	uint64_t percent = 0;
+	if (requests != 0) percent = sst.sst_zero_hits * 100 / requests;
+	printf("\nZeroed frame pool: %lu hits, %lu misses (%lu%% hit rate)\n", sst.sst_zero_hits, sst.sst_zero_misses, percent);
 	
 	return 0;
 };
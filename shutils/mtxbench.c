@@ -0,0 +1,226 @@
+/*
+	Glidix Shell Utilities
+
+	Copyright (c) 2014-2017, Madd Games.
+	All rights reserved.
+	
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+	
+	* Redistributions of source code must retain the above copyright notice, this
+	  list of conditions and the following disclaimer.
+	
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+	FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+	DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+	SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+	CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+	OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+	OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define	MAX_THREADS			64
+
+typedef struct
+{
+	const char*			name;
+	void*				(*func)(void*);
+} Benchmark;
+
+static int numThreads = 4;
+static long numIters = 100000;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_spinlock_t spinlock;
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_barrier_t startBarrier;
+
+static pthread_mutex_t pingLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pingCond = PTHREAD_COND_INITIALIZER;
+static long pingTurn;
+
+static volatile long counter;
+
+static void* benchMutex(void *context)
+{
+	pthread_barrier_wait(&startBarrier);
+	
+	long i;
+	for (i=0; i<numIters; i++)
+	{
+		pthread_mutex_lock(&mutex);
+		counter++;
+		pthread_mutex_unlock(&mutex);
+	};
+	
+	return NULL;
+};
+
+static void* benchSpin(void *context)
+{
+	pthread_barrier_wait(&startBarrier);
+	
+	long i;
+	for (i=0; i<numIters; i++)
+	{
+		pthread_spin_lock(&spinlock);
+		counter++;
+		pthread_spin_unlock(&spinlock);
+	};
+	
+	return NULL;
+};
+
+static void* benchRwlock(void *context)
+{
+	pthread_barrier_wait(&startBarrier);
+	
+	// mostly reads, with a write every 16 iterations
+	long i;
+	for (i=0; i<numIters; i++)
+	{
+		if ((i % 16) == 0)
+		{
+			pthread_rwlock_wrlock(&rwlock);
+			counter++;
+			pthread_rwlock_unlock(&rwlock);
+		}
+		else
+		{
+			pthread_rwlock_rdlock(&rwlock);
+			long value = counter;
+			(void)value;
+			pthread_rwlock_unlock(&rwlock);
+		};
+	};
+	
+	return NULL;
+};
+
+static void* benchCond(void *context)
+{
+	long index = (long) context;
+	pthread_barrier_wait(&startBarrier);
+	
+	// pass a token around all the threads in turn
+	long i;
+	for (i=0; i<numIters; i++)
+	{
+		pthread_mutex_lock(&pingLock);
+		while ((pingTurn % numThreads) != index)
+		{
+			pthread_cond_wait(&pingCond, &pingLock);
+		};
+		
+		pingTurn++;
+		counter++;
+		pthread_cond_broadcast(&pingCond);
+		pthread_mutex_unlock(&pingLock);
+	};
+	
+	return NULL;
+};
+
+static Benchmark benchmarks[] = {
+	{"mutex", benchMutex},
+	{"spinlock", benchSpin},
+	{"rwlock", benchRwlock},
+	{"cond", benchCond},
+	{NULL, NULL}
+};
+
+static void runBenchmark(Benchmark *bench)
+{
+	pthread_t threads[MAX_THREADS];
+	long iters = numIters;
+	if (strcmp(bench->name, "cond") == 0)
+	{
+		// each handoff involves a sleep and a wakeup, so keep the run time sane
+		iters = numIters / 100;
+		if (iters == 0) iters = 1;
+	};
+	
+	long savedIters = numIters;
+	numIters = iters;
+	counter = 0;
+	pingTurn = 0;
+	pthread_barrier_init(&startBarrier, NULL, numThreads);
+	
+	clock_t start = clock();
+	long i;
+	for (i=0; i<numThreads; i++)
+	{
+		pthread_create(&threads[i], NULL, bench->func, (void*) i);
+	};
+	
+	for (i=0; i<numThreads; i++)
+	{
+		pthread_join(threads[i], NULL);
+	};
+	clock_t end = clock();
+	
+	pthread_barrier_destroy(&startBarrier);
+	numIters = savedIters;
+	
+	long ops = iters * numThreads;
+	long expected = ops;
+	if (bench->func == benchRwlock)
+	{
+		expected = ((iters + 15) / 16) * numThreads;
+	};
+	
+	unsigned long us = (end - start) * 1000000 / CLOCKS_PER_SEC;
+	printf("%-10s %8ld ops %8lu us %8lu ns/op %s\n", bench->name, ops, us,
+		us * 1000 / (ops ? ops : 1), counter == expected ? "" : "(COUNTER MISMATCH!)");
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1)
+	{
+		numThreads = atoi(argv[1]);
+	};
+	
+	if (argc > 2)
+	{
+		numIters = atol(argv[2]);
+	};
+	
+	if ((argc > 4) || (numThreads < 1) || (numThreads > MAX_THREADS) || (numIters < 1))
+	{
+		fprintf(stderr, "USAGE:\t%s [threads [iterations [benchmark]]]\n", argv[0]);
+		fprintf(stderr, "\tMeasure the cost of contended pthread locks. By default, run all benchmarks\n");
+		fprintf(stderr, "\twith 4 threads and 100000 iterations per thread.\n");
+		return 1;
+	};
+	
+	pthread_spin_init(&spinlock, PTHREAD_PROCESS_PRIVATE);
+	
+	printf("%d threads, %ld iterations each\n", numThreads, numIters);
+	
+	Benchmark *bench;
+	for (bench=benchmarks; bench->name!=NULL; bench++)
+	{
+		if ((argc == 4) && (strcmp(argv[3], bench->name) != 0))
+		{
+			continue;
+		};
+		
+		runBenchmark(bench);
+	};
+	
+	return 0;
+};
@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 typedef struct
 {
@@ -56,6 +57,8 @@ char *progName;
 void usage()
 {
 	fprintf(stderr, "USAGE:\t%s <ifname>\n", progName);
+	fprintf(stderr, "\t%s <ifname> addr|addr6 <address>/<prefix>...\n", progName);
+	fprintf(stderr, "\t%s <ifname> neigh\n", progName);
 	fprintf(stderr, "\tConfigure network interfaces.\n");
 	exit(1);
 };
@@ -135,6 +138,15 @@ void printIntfInfo(const char *ifname)
 			netstat.ifconfig.ethernet.mac[2], netstat.ifconfig.ethernet.mac[3], netstat.ifconfig.ethernet.mac[4],
 			netstat.ifconfig.ethernet.mac[5]
 		);
+		
+		int caps = netstat.ifconfig.ethernet.caps;
+		printf("\t\tOffloads:%s%s%s%s%s\n",
+			(caps & NETIF_CAP_TXCSUM) ? " tx-checksum" : "",
+			(caps & NETIF_CAP_RXCSUM) ? " rx-checksum" : "",
+			(caps & NETIF_CAP_TSO4) ? " tso4" : "",
+			(caps & NETIF_CAP_TSO6) ? " tso6" : "",
+			(caps == 0) ? " none" : ""
+		);
 	};
 	
 	printf("\tAddresses:\n");
@@ -290,6 +302,60 @@ void doAddrConf(int family, const char *ifname, char **addrnames, int count)
 	};
 };
 
+const char *neighstate(int state)
+{
+	switch (state)
+	{
+	case _GLIDIX_NEIGH_INCOMPLETE:
+		return "INCOMPLETE";
+	case _GLIDIX_NEIGH_REACHABLE:
+		return "REACHABLE";
+	case _GLIDIX_NEIGH_STALE:
+		return "STALE";
+	case _GLIDIX_NEIGH_PROBE:
+		return "PROBE";
+	case _GLIDIX_NEIGH_FAILED:
+		return "FAILED";
+	default:
+		return "?";
+	};
+};
+
+void printNeighbors(const char *ifname)
+{
+	int fd = _glidix_neightab();
+	if (fd == -1)
+	{
+		fprintf(stderr, "%s: cannot read neighbor table: %s\n", progName, strerror(errno));
+		exit(1);
+	};
+	
+	_glidix_neigh neigh;
+	while (read(fd, &neigh, sizeof(_glidix_neigh)) == sizeof(_glidix_neigh))
+	{
+		if (strcmp(neigh.ifname, ifname) != 0)
+		{
+			continue;
+		};
+		
+		char ipstr[INET6_ADDRSTRLEN];
+		inet_ntop(neigh.family, neigh.ip, ipstr, INET6_ADDRSTRLEN);
+		
+		if (neigh.state == _GLIDIX_NEIGH_INCOMPLETE)
+		{
+			printf("%-40s (incomplete)      %-10s %hu queued\n", ipstr, neighstate(neigh.state), neigh.queued);
+		}
+		else
+		{
+			printf("%-40s %02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx %-10s %lus\n", ipstr,
+				neigh.mac[0], neigh.mac[1], neigh.mac[2], neigh.mac[3], neigh.mac[4], neigh.mac[5],
+				neighstate(neigh.state), (unsigned long) (neigh.age / 1000000000UL));
+		};
+	};
+	
+	close(fd);
+};
+
 int main(int argc, char *argv[])
 {
 	progName = argv[0];
@@ -329,6 +395,10 @@ int main(int argc, char *argv[])
 	{
 		doAddrConf(AF_INET6, argv[1], &argv[3], argc-3);
 	}
+	else if (strcmp(argv[2], "neigh") == 0)
+	{
+		printNeighbors(argv[1]);
+	}
 	else
 	{
 		usage();
@@ -37,9 +37,11 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <errno.h>
+#include <spawn.h>
 
 #define	NUM_LEVELS				3
 
+extern char **environ;
 char *progName;
 
 int startService(const char *name)
@@ -130,14 +132,15 @@ int serviceState(const char *val)
 				{
 					if (strcmp(&ent->d_name[strlen(ent->d_name)-strlen(op)], op) == 0)
 					{
-						pid_t pid = fork();
-						if (pid == 0)
+						char fullpath[PATH_MAX];
+						sprintf(fullpath, "/etc/services/%d/%s", state, ent->d_name);
+						char *args[] = {fullpath, NULL};
+						
+						pid_t pid;
+						int error = posix_spawn(&pid, fullpath, NULL, NULL, args, environ);
+						if (error != 0)
 						{
-							char fullpath[PATH_MAX];
-							sprintf(fullpath, "/etc/services/%d/%s", state, ent->d_name);
-							execl(fullpath, fullpath, NULL);
-							perror("execl");
-							_exit(1);
+							fprintf(stderr, "%s: cannot run %s: %s\n", progName, fullpath, strerror(error));
 						}
 						else
 						{
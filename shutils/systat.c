@@ -58,5 +58,6 @@ int main(int argc, char *argv[])
 	};
 	
 	printf("Boot ID:       %s\n", idToString(sst.sst_bootid));
+	printf("Shootdowns:    %lu (%lu/s)\n", sst.sst_shootdowns, sst.sst_shootdown_rate);
 	return 0;
 };
@@ -33,9 +33,132 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
 
-int main()
+#define	BENCH_PATH			"/run/unixbench.sock"
+#define	BENCH_MSG_SIZE			64
+
+/**
+ * Measure the round-trip latency of a Unix socket of the given type: a child process connects and echoes
+ * every message back, and we time 'count' round trips.
+ */
+static int bench(int type, int count)
+{
+	unlink(BENCH_PATH);
+	
+	int sockfd = socket(AF_UNIX, type, 0);
+	if (sockfd == -1)
+	{
+		perror("socket");
+		return 1;
+	};
+	
+	struct sockaddr_un addr;
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, BENCH_PATH);
+	
+	if (bind(sockfd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un)) != 0)
+	{
+		perror("bind");
+		return 1;
+	};
+	
+	if (listen(sockfd, 5) != 0)
+	{
+		perror("listen");
+		return 1;
+	};
+	
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		perror("fork");
+		return 1;
+	}
+	else if (pid == 0)
+	{
+		close(sockfd);
+		int clientfd = socket(AF_UNIX, type, 0);
+		if (connect(clientfd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un)) != 0)
+		{
+			perror("connect");
+			_exit(1);
+		};
+		
+		char buffer[BENCH_MSG_SIZE];
+		ssize_t sz;
+		while ((sz = read(clientfd, buffer, BENCH_MSG_SIZE)) > 0)
+		{
+			write(clientfd, buffer, sz);
+		};
+		
+		_exit(0);
+	};
+	
+	int peerfd = accept(sockfd, NULL, NULL);
+	if (peerfd == -1)
+	{
+		perror("accept");
+		return 1;
+	};
+	
+	char msg[BENCH_MSG_SIZE];
+	memset(msg, 'x', BENCH_MSG_SIZE);
+	
+	uint64_t start = _glidix_nanotime();
+	int i;
+	for (i=0; i<count; i++)
+	{
+		write(peerfd, msg, BENCH_MSG_SIZE);
+		
+		// a stream socket may return the reply in pieces
+		size_t got = 0;
+		while (got < BENCH_MSG_SIZE)
+		{
+			ssize_t sz = read(peerfd, msg + got, BENCH_MSG_SIZE - got);
+			if (sz <= 0)
+			{
+				fprintf(stderr, "unixtest: echo child went away\n");
+				return 1;
+			};
+			
+			got += sz;
+		};
+	};
+	uint64_t end = _glidix_nanotime();
+	
+	close(peerfd);
+	close(sockfd);
+	waitpid(pid, NULL, 0);
+	unlink(BENCH_PATH);
+	
+	printf("%s: %d round trips of %d bytes, %lu ns average\n", type == SOCK_STREAM ? "SOCK_STREAM" : "SOCK_SEQPACKET",
+		count, BENCH_MSG_SIZE, (end - start) / count);
+	return 0;
+};
+
+int main(int argc, char *argv[])
 {
+	if ((argc >= 2) && (strcmp(argv[1], "bench") == 0))
+	{
+		int count = 10000;
+		if (argc >= 3)
+		{
+			count = atoi(argv[2]);
+			if (count < 1) count = 1;
+		};
+		
+		if (bench(SOCK_SEQPACKET, count) != 0) return 1;
+		return bench(SOCK_STREAM, count);
+	};
+	
+	if (argc != 1)
+	{
+		fprintf(stderr, "USAGE:\t%s\n\t%s bench [count]\n", argv[0], argv[0]);
+		return 1;
+	};
+	
 	printf("Creating socket...\n");
 	int sockfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
 	if (sockfd == -1)